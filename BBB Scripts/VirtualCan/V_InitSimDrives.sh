@@ -0,0 +1,13 @@
+#!/bin/bash
+
+#Simulated CiA 402 drives (nodes 1-4) on Virtual CAN interface, instead
+#of canopend slaves from V_InitSlave.sh. Run V_InitMaster.sh afterwards.
+#Optional arguments are passed to driveSim, for example: -l 300 -j 100
+
+sudo modprobe vcan
+sudo ip link add dev vcan0 type vcan
+sudo ip link set up vcan0
+
+cd /home/debian/CANopenSocket/canopend
+gcc driveSim.c -o driveSim -Wall -lm
+./driveSim vcan0 -n 1-4 "$@" &
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+#End-to-end latency benchmark on Virtual CAN interface: canopend as master
+#and driveSim as node 1. Result is written to latency_<commit>.json, so
+#results of different commits may be compared.
+#Optional arguments are passed to latencyBench, for example: -p sdo,pdo -i 5000
+
+sudo modprobe vcan
+sudo ip link add dev vcan0 type vcan
+sudo ip link set up vcan0
+
+cd /home/debian/CANopenSocket/canopend
+gcc driveSim.c -o driveSim -Wall -lm
+gcc latencyBench.c -o latencyBench -Wall -lm
+LABEL=$(git describe --always --dirty 2>/dev/null || echo unknown)
+
+echo - > od100_storage
+echo - > od100_storage_auto
+app/canopend vcan0 -i 100 -s od100_storage -a od100_storage_auto -c "" -C "" -n 1 &
+CANOPEND_PID=$!
+sleep 1
+
+./latencyBench vcan0 -s ./driveSim -L "$LABEL" -o latency_$LABEL.csv "$@" > latency_$LABEL.json
+cat latency_$LABEL.json
+
+kill $CANOPEND_PID
@@ -0,0 +1,22 @@
+#!/bin/bash
+
+#Simulation in virtual time on Virtual CAN interface: canopend as master and
+#driveSim (nodes 1-4) as harness, which steps both by 1 ms as fast as possible.
+#Optional arguments are passed to driveSim, for example: -d 600 -s 1
+
+sudo modprobe vcan
+sudo ip link add dev vcan0 type vcan
+sudo ip link set up vcan0
+
+cd /home/debian/CANopenSocket/canopend
+gcc driveSim.c -o driveSim -Wall -lm
+
+echo - > od100_storage
+echo - > od100_storage_auto
+app/canopend vcan0 -i 100 -s od100_storage -a od100_storage_auto -c "" -C "" -n 1-4 -V "" &
+CANOPEND_PID=$!
+sleep 1
+
+./driveSim vcan0 -n 1-4 -V /tmp/CO_sim_socket -d 60 "$@"
+
+kill $CANOPEND_PID
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+cd /home/debian/CANopenSocket/canopencomm
+
+# Heartbeat of the drives every 50 ms
+./canopencomm [1] 1 write 0x1017 0 u16 50
+./canopencomm [1] 2 write 0x1017 0 u16 50
+./canopencomm [1] 3 write 0x1017 0 u16 50
+./canopencomm [1] 4 write 0x1017 0 u16 50
+
+# Master consumes them with 150 ms timeout (node ID << 16 | time in ms)
+./canopencomm [1] 100 write 0x1016 1 u32 0x00010096
+./canopencomm [1] 100 write 0x1016 2 u32 0x00020096
+./canopencomm [1] 100 write 0x1016 3 u32 0x00030096
+./canopencomm [1] 100 write 0x1016 4 u32 0x00040096
+
+# Quick stop all drives on a fault (0 = report only)
+./canopencomm [1] 100 write 0x2113 1 u32 1
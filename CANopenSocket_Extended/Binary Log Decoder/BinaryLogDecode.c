@@ -29,13 +29,11 @@ int main(int argc, char *argv[]) {
     uint16_t motor2Tor=1;
     uint16_t motor3Tor=1;
     uint16_t motor4Tor=1;
-    long long timesec=1;
-    long timeusec=1;
+    uint64_t time_ns=1;     //CLOCK_MONOTONIC of canopend RT cycle
 
-    fprintf(fp_write,"Lhip pos,Lhip torque,Lknee pos,Lknee torque,Rhip pos,Rhip torque,Rknee pos,Rknee torque,\n");
+    fprintf(fp_write,"time ns,Lhip pos,Lhip torque,Lknee pos,Lknee torque,Rhip pos,Rhip torque,Rknee pos,Rknee torque,\n");
     while(1){
-        fread(&timesec, sizeof(timesec), 1, fp);
-        fread(&timeusec, sizeof(timeusec), 1, fp);
+        fread(&time_ns, sizeof(time_ns), 1, fp);
         fread(&motor1pos, sizeof(sizeInt), 1, fp);
         fread(&motor1Tor, sizeof(sizeInt), 1, fp);
         fread(&motor2pos, sizeof(sizeInt), 1, fp);
@@ -46,8 +44,8 @@ int main(int argc, char *argv[]) {
         fread(&motor4Tor, sizeof(sizeInt), 1, fp);
 
         if(!feof(fp)){
-            fprintf(fp_write,"%lld,%ld,%d,%d,%d,%d,%d,%d,%d,%d\n",
-                   timesec,timeusec,
+            fprintf(fp_write,"%llu,%d,%d,%d,%d,%d,%d,%d,%d\n",
+                   (unsigned long long)time_ns,
                    motor1pos,motor1Tor,
                    motor2pos,motor2Tor,
                    motor3pos,motor3Tor,
@@ -0,0 +1,381 @@
+/*
+ * Batched SocketCAN receive and transmit.
+ *
+ * @file        CO_CANbatch.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* recvmmsg, sendmmsg */
+#endif
+
+#include "CO_CANbatch.h"
+#include "CO_clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+
+/* Clear statistics. */
+static void clearStats(CO_CANbatch_t *batch) {
+    batch->rxFrames = 0;
+    batch->rxBatches = 0;
+    batch->rxMaxBatch = 0;
+    batch->rxErrorFrames = 0;
+    batch->rxLatencyMin_us = UINT32_MAX;
+    batch->rxLatencyMax_us = 0;
+    batch->rxLatencySum_us = 0;
+    batch->rxLatencyCount = 0;
+    batch->txFrames = 0;
+    batch->txBatches = 0;
+    batch->txOverflow = 0;
+    memset(batch->rxTime_ns, 0, sizeof(batch->rxTime_ns));
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_CANbatch_init(CO_CANbatch_t *batch, CO_CANmodule_t *CANmodule) {
+    int flags;
+
+    if(batch == NULL || CANmodule == NULL || CANmodule->fd < 0) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    batch->CANmodule = CANmodule;
+    batch->pFunctRx = NULL;
+    batch->functRxObject = NULL;
+    batch->pFunctFallback = NULL;
+    batch->functFallbackObject = NULL;
+    batch->txCount = 0;
+    clearStats(batch);
+
+    /* Hardware timestamps are used if interface supports them. Software
+     * timestamps are always generated. */
+    flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+          | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    batch->timestamping =
+        setsockopt(CANmodule->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+void CO_CANbatch_initCallback(
+        CO_CANbatch_t          *batch,
+        void                   *object,
+        void                  (*pFunct)(void *object, const CO_CANrxMsg_t *msg,
+                                        const struct timespec *timestamp))
+{
+    if(batch != NULL) {
+        batch->functRxObject = object;
+        batch->pFunctRx = pFunct;
+    }
+}
+
+
+/******************************************************************************/
+void CO_CANbatch_setFallback(
+        CO_CANbatch_t          *batch,
+        void                   *object,
+        void                  (*pFunct)(void *object, const CO_CANrxMsg_t *msg))
+{
+    if(batch != NULL) {
+        batch->functFallbackObject = object;
+        batch->pFunctFallback = pFunct;
+    }
+}
+
+
+/* Get kernel timestamp from control messages. Returns false if none. */
+static bool_t getTimestamp(struct msghdr *msg, struct timespec *ts) {
+    struct cmsghdr *cmsg;
+
+    for(cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping *stamp = (struct scm_timestamping *)CMSG_DATA(cmsg);
+
+            /* ts[2] is raw hardware timestamp, ts[0] is software timestamp. */
+            if(stamp->ts[2].tv_sec != 0 || stamp->ts[2].tv_nsec != 0) {
+                *ts = stamp->ts[2];
+            }
+            else {
+                *ts = stamp->ts[0];
+            }
+            return ts->tv_sec != 0 || ts->tv_nsec != 0;
+        }
+    }
+
+    return false;
+}
+
+
+/* Pass frame to matching receive buffer, as CO_CANrxWait() does, and store
+ * its receive time, if batch is given. Returns false, if no buffer matches. */
+static bool_t dispatch(CO_CANbatch_t *batch, CO_CANmodule_t *CANmodule,
+                       const CO_CANrxMsg_t *rcvMsg, uint64_t rxTime_ns)
+{
+    CO_CANrx_t *buffer = &CANmodule->rxArray[0];
+    uint16_t index;
+
+    for(index = 0; index < CANmodule->rxSize; index++) {
+        if(((rcvMsg->ident ^ buffer->ident) & buffer->mask) == 0U) {
+            if(buffer->pFunct != NULL) {
+                buffer->pFunct(buffer->object, rcvMsg);
+            }
+            if(batch != NULL && index < CO_CAN_BATCH_RX_BUFFERS) {
+                __atomic_store_n(&batch->rxTime_ns[index], rxTime_ns, __ATOMIC_RELAXED);
+            }
+            return true;
+        }
+        buffer++;
+    }
+    return false;
+}
+
+
+/******************************************************************************/
+bool_t CO_CANbatch_dispatch(CO_CANmodule_t *CANmodule, const CO_CANrxMsg_t *msg) {
+    if(CANmodule == NULL || msg == NULL || !CANmodule->CANnormal) {
+        return false;
+    }
+    return dispatch(NULL, CANmodule, msg, 0);
+}
+
+
+/******************************************************************************/
+int CO_CANbatch_rx(CO_CANbatch_t *batch) {
+    struct can_frame frames[CO_CAN_BATCH_SIZE];
+    struct iovec iov[CO_CAN_BATCH_SIZE];
+    struct mmsghdr msgs[CO_CAN_BATCH_SIZE];
+    char control[CO_CAN_BATCH_SIZE][CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct timespec now;
+    CO_CANmodule_t *CANmodule;
+    int n, i;
+
+    if(batch == NULL || batch->CANmodule == NULL) {
+        return -1;
+    }
+    CANmodule = batch->CANmodule;
+
+    memset(msgs, 0, sizeof(msgs));
+    for(i=0; i<CO_CAN_BATCH_SIZE; i++) {
+        iov[i].iov_base = &frames[i];
+        iov[i].iov_len = sizeof(struct can_frame);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    /* Socket is readable, so at least one frame is there. Do not block. */
+    n = recvmmsg(CANmodule->fd, msgs, CO_CAN_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if(n < 0) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        CO_error(0x13100000L + errno);
+        return -1;
+    }
+    if(n == 0) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    batch->rxBatches++;
+    if((uint32_t)n > batch->rxMaxBatch) {
+        batch->rxMaxBatch = n;
+    }
+
+    for(i=0; i<n; i++) {
+        /* CO_CANrxMsg_t has the same layout as struct can_frame. */
+        const CO_CANrxMsg_t *rcvMsg = (const CO_CANrxMsg_t *)&frames[i];
+        struct timespec ts;
+        bool_t tsValid;
+        uint64_t rxTime_ns;
+
+        if(msgs[i].msg_len != sizeof(struct can_frame)) {
+            CO_error(0x13200000L | msgs[i].msg_len);
+            continue;
+        }
+        if(frames[i].can_id & CAN_ERR_FLAG) {
+            batch->rxErrorFrames++;
+            continue;
+        }
+
+        batch->rxFrames++;
+
+        /* Without kernel timestamp the time of recvmmsg() return is used */
+        tsValid = batch->timestamping && getTimestamp(&msgs[i].msg_hdr, &ts);
+        rxTime_ns = CO_clock_fromRealtime(tsValid ? &ts : &now);
+
+        if(CANmodule->CANnormal && !dispatch(batch, CANmodule, rcvMsg, rxTime_ns)
+           && batch->pFunctFallback != NULL) {
+            batch->pFunctFallback(batch->functFallbackObject, rcvMsg);
+        }
+
+        if(tsValid) {
+            int64_t lat_us = (int64_t)(now.tv_sec - ts.tv_sec) * 1000000
+                           + (now.tv_nsec - ts.tv_nsec) / 1000;
+
+            /* Hardware clock may not be related to CLOCK_REALTIME. */
+            if(lat_us >= 0 && lat_us < 1000000) {
+                if((uint32_t)lat_us < batch->rxLatencyMin_us) {
+                    batch->rxLatencyMin_us = (uint32_t)lat_us;
+                }
+                if((uint32_t)lat_us > batch->rxLatencyMax_us) {
+                    batch->rxLatencyMax_us = (uint32_t)lat_us;
+                }
+                batch->rxLatencySum_us += (uint64_t)lat_us;
+                batch->rxLatencyCount++;
+            }
+        }
+
+        if(batch->pFunctRx != NULL) {
+            batch->pFunctRx(batch->functRxObject, rcvMsg, tsValid ? &ts : NULL);
+        }
+    }
+
+    return n;
+}
+
+
+/******************************************************************************/
+uint64_t CO_CANbatch_rxTime(const CO_CANbatch_t *batch, const void *object) {
+    const CO_CANmodule_t *CANmodule;
+    uint16_t index;
+
+    if(batch == NULL || batch->CANmodule == NULL || object == NULL) {
+        return 0;
+    }
+    CANmodule = batch->CANmodule;
+    for(index = 0; index < CANmodule->rxSize && index < CO_CAN_BATCH_RX_BUFFERS; index++) {
+        if(CANmodule->rxArray[index].object == object) {
+            return __atomic_load_n(&batch->rxTime_ns[index], __ATOMIC_RELAXED);
+        }
+    }
+    return 0;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_CANbatch_txQueue(CO_CANbatch_t *batch, const CO_CANtx_t *buffer) {
+    struct can_frame *frame;
+
+    if(batch == NULL || buffer == NULL) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+    if(batch->txCount >= CO_CAN_BATCH_SIZE) {
+        batch->txOverflow++;
+        return CO_ERROR_TX_OVERFLOW;
+    }
+
+    frame = &batch->txQueue[batch->txCount++];
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id = buffer->ident;
+    frame->can_dlc = buffer->DLC;
+    memcpy(frame->data, buffer->data, sizeof(frame->data));
+
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_CANbatch_txQueueTPDO(CO_CANbatch_t *batch, CO_TPDO_t *TPDO) {
+    uint8_t *pPDOdataByte;
+    uint8_t **ppODdataByte;
+    int i;
+
+    if(batch == NULL || TPDO == NULL) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+    if(!TPDO->valid || *TPDO->operatingState != CO_NMT_OPERATIONAL) {
+        return CO_ERROR_WRONG_NMT_STATE;
+    }
+
+    /* Copy mapped data from Object Dictionary, as CO_TPDOsend() */
+    pPDOdataByte = &TPDO->CANtxBuff->data[0];
+    ppODdataByte = &TPDO->mapPointer[0];
+    for(i=TPDO->dataLength; i>0; i--) {
+        *(pPDOdataByte++) = **(ppODdataByte++);
+    }
+
+    TPDO->sendRequest = 0;
+
+    return CO_CANbatch_txQueue(batch, TPDO->CANtxBuff);
+}
+
+
+/******************************************************************************/
+int CO_CANbatch_txFlush(CO_CANbatch_t *batch) {
+    struct iovec iov[CO_CAN_BATCH_SIZE];
+    struct mmsghdr msgs[CO_CAN_BATCH_SIZE];
+    int count, n, i;
+
+    if(batch == NULL || batch->CANmodule == NULL) {
+        return -1;
+    }
+
+    count = batch->txCount;
+    batch->txCount = 0;
+    if(count == 0) {
+        return 0;
+    }
+
+    /* Do not send, if CAN is not in normal mode, the same as CO_CANsend(). */
+    if(!batch->CANmodule->CANnormal) {
+        batch->txOverflow += count;
+        return 0;
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    for(i=0; i<count; i++) {
+        iov[i].iov_base = &batch->txQueue[i];
+        iov[i].iov_len = sizeof(struct can_frame);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    n = sendmmsg(batch->CANmodule->fd, msgs, count, 0);
+    batch->txBatches++;
+    if(n < 0) {
+        batch->txOverflow += count;
+        CO_error(0x13300000L + errno);
+        return -1;
+    }
+
+    batch->txFrames += n;
+    if(n < count) {
+        /* Socket buffer full, remaining frames are lost. */
+        batch->txOverflow += count - n;
+        CO_error(0x13400000L | (count - n));
+    }
+
+    return n;
+}
+
+
+/******************************************************************************/
+void CO_CANbatch_printStats(const CO_CANbatch_t *batch, const char *name) {
+    if(batch == NULL || batch->CANmodule == NULL) {
+        return;
+    }
+
+    printf("%s - rx %u frames in %u batches (max %u), %u error frames",
+           name, batch->rxFrames, batch->rxBatches, batch->rxMaxBatch, batch->rxErrorFrames);
+    if(batch->rxLatencyCount > 0) {
+        printf(", latency min/avg/max %u/%u/%u us",
+               batch->rxLatencyMin_us,
+               (uint32_t)(batch->rxLatencySum_us / batch->rxLatencyCount),
+               batch->rxLatencyMax_us);
+    }
+    printf("; tx %u frames in %u batches, %u lost\n",
+           batch->txFrames, batch->txBatches, batch->txOverflow);
+}
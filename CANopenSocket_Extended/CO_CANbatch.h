@@ -0,0 +1,205 @@
+/*
+ * Batched SocketCAN receive and transmit.
+ *
+ * @file        CO_CANbatch.h
+ *
+ * CO_CANrxWait() from CANopenNode reads one frame per wakeup with read().
+ * With four drives sending TPDOs on each SYNC, a burst of frames costs one
+ * epoll wakeup and one system call per frame. This module drains the CAN
+ * socket with recvmmsg() up to CO_CAN_BATCH_SIZE frames at once and
+ * dispatches them to the receive buffers of the CANmodule, the same way as
+ * CO_CANrxWait() does.
+ *
+ * Kernel receive timestamps (SO_TIMESTAMPING) are taken for each frame.
+ * Hardware timestamp is used, if CAN interface provides it, software
+ * timestamp otherwise. Latency from kernel timestamp to dispatch is
+ * accumulated in statistics. Each frame, which matches a receive buffer,
+ * stores its timestamp, converted to the CO_clock timebase, for that buffer,
+ * see CO_CANbatch_rxTime().
+ *
+ * Frames for transmission may be queued and sent with single sendmmsg() call,
+ * for example setpoint TPDOs to all drives followed by SYNC. Transmit
+ * functions must be called from the same thread, which processes the
+ * CANopen timer (rt_thread).
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_CAN_BATCH_H
+#define CO_CAN_BATCH_H
+
+#include "CANopen.h"
+#include <time.h>
+
+
+/* Maximum number of frames received or transmitted with one system call. */
+#ifndef CO_CAN_BATCH_SIZE
+#define CO_CAN_BATCH_SIZE           16
+#endif
+
+/* Receive buffers of CANmodule with stored receive time. */
+#ifndef CO_CAN_BATCH_RX_BUFFERS
+#define CO_CAN_BATCH_RX_BUFFERS     64
+#endif
+
+
+/**
+ * Batched I/O object for one CANmodule.
+ */
+typedef struct {
+    CO_CANmodule_t     *CANmodule;      /**< From CO_CANbatch_init(). */
+    bool_t              timestamping;   /**< True, if SO_TIMESTAMPING is enabled. */
+    /** Optional callback for each received frame, see CO_CANbatch_initCallback(). */
+    void              (*pFunctRx)(void *object, const CO_CANrxMsg_t *msg,
+                                  const struct timespec *timestamp);
+    void               *functRxObject;
+    /** Frames, which don't match receive buffers of CANmodule, are passed to
+     * this callback, see CO_CANbatch_setFallback(). */
+    void              (*pFunctFallback)(void *object, const CO_CANrxMsg_t *msg);
+    void               *functFallbackObject;
+    /* Receive statistics */
+    uint32_t            rxFrames;       /**< Number of received frames. */
+    uint32_t            rxBatches;      /**< Number of recvmmsg() calls, which returned frames. */
+    uint32_t            rxMaxBatch;     /**< Largest number of frames from one recvmmsg(). */
+    uint32_t            rxErrorFrames;  /**< Number of CAN error frames (not dispatched). */
+    uint32_t            rxLatencyMin_us;/**< Minimum kernel timestamp to dispatch latency. */
+    uint32_t            rxLatencyMax_us;/**< Maximum kernel timestamp to dispatch latency. */
+    uint64_t            rxLatencySum_us;/**< Sum of latencies, for average. */
+    uint32_t            rxLatencyCount; /**< Number of frames with timestamp. */
+    /** Receive time (CO_clock_ns() timebase) of the last frame of each
+     * receive buffer of CANmodule, 0 if none yet. */
+    uint64_t            rxTime_ns[CO_CAN_BATCH_RX_BUFFERS];
+    /* Transmit queue and statistics */
+    struct can_frame    txQueue[CO_CAN_BATCH_SIZE];
+    uint8_t             txCount;        /**< Number of frames in txQueue. */
+    uint32_t            txFrames;       /**< Number of transmitted frames. */
+    uint32_t            txBatches;      /**< Number of sendmmsg() calls. */
+    uint32_t            txOverflow;     /**< Frames, which were not sent. */
+} CO_CANbatch_t;
+
+
+/**
+ * Initialize batched I/O for CANmodule. Call after each CO_init(), because
+ * CANmodule is created again on communication reset. Statistics are cleared.
+ *
+ * @param batch This object.
+ * @param CANmodule CAN module, its socket must be already open.
+ *
+ * @return CO_ERROR_NO on success. If timestamping can not be enabled, frames
+ * are still received in batches and CO_ERROR_NO is returned.
+ */
+CO_ReturnError_t CO_CANbatch_init(CO_CANbatch_t *batch, CO_CANmodule_t *CANmodule);
+
+
+/**
+ * Initialize callback, which is called for each received frame after it is
+ * dispatched to the CANopen objects. Called from the receiving thread.
+ *
+ * @param batch This object.
+ * @param object Passed to pFunct, may be NULL.
+ * @param pFunct Function, timestamp is NULL if frame has no timestamp.
+ */
+void CO_CANbatch_initCallback(
+        CO_CANbatch_t          *batch,
+        void                   *object,
+        void                  (*pFunct)(void *object, const CO_CANrxMsg_t *msg,
+                                        const struct timespec *timestamp));
+
+
+/**
+ * Set callback for frames, which don't match receive buffers of this
+ * CANmodule. Used for CAN interfaces, which are bridged to the CANopen
+ * interface (see CO_CANbus.h). Called from the receiving thread, so the
+ * callback must not dispatch to a CANmodule of another thread.
+ *
+ * @param batch This object.
+ * @param object Passed to pFunct, may be NULL.
+ * @param pFunct Function or NULL to drop unmatched frames.
+ */
+void CO_CANbatch_setFallback(
+        CO_CANbatch_t          *batch,
+        void                   *object,
+        void                  (*pFunct)(void *object, const CO_CANrxMsg_t *msg));
+
+
+/**
+ * Pass frame to the matching receive buffer of CANmodule, as CO_CANrxWait()
+ * does. Call from the thread, which receives on the CANmodule.
+ *
+ * @param CANmodule CAN module in normal mode.
+ * @param msg Received frame.
+ *
+ * @return True, if a receive buffer matched.
+ */
+bool_t CO_CANbatch_dispatch(CO_CANmodule_t *CANmodule, const CO_CANrxMsg_t *msg);
+
+
+/**
+ * Receive all pending frames and dispatch them. Replacement for
+ * CO_CANrxWait(), call when socket of the CANmodule is readable.
+ *
+ * @param batch This object.
+ *
+ * @return Number of received frames or -1 on error.
+ */
+int CO_CANbatch_rx(CO_CANbatch_t *batch);
+
+
+/**
+ * Receive time of the last frame, dispatched to the receive buffer with
+ * object, for example CO->RPDO[i]. May be called from any thread.
+ *
+ * @param batch This object.
+ * @param object Object of the receive buffer (CO_CANrxBufferInit()).
+ *
+ * @return Time in CO_clock_ns() timebase or 0, if no frame was received.
+ */
+uint64_t CO_CANbatch_rxTime(const CO_CANbatch_t *batch, const void *object);
+
+
+/**
+ * Queue CAN frame from CANmodule's transmit buffer. Frame is copied, so
+ * buffer may be modified after the call.
+ *
+ * @param batch This object.
+ * @param buffer Transmit buffer from CO_CANtxBufferInit().
+ *
+ * @return CO_ERROR_NO or CO_ERROR_TX_OVERFLOW, if queue is full.
+ */
+CO_ReturnError_t CO_CANbatch_txQueue(CO_CANbatch_t *batch, const CO_CANtx_t *buffer);
+
+
+/**
+ * Queue TPDO with actual values from the Object Dictionary. The same as
+ * CO_TPDOsend(), but frame is only queued. TPDO is queued only if it is
+ * valid and node is operational.
+ *
+ * @param batch This object.
+ * @param TPDO TPDO object.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_CANbatch_txQueueTPDO(CO_CANbatch_t *batch, CO_TPDO_t *TPDO);
+
+
+/**
+ * Send all queued frames with one sendmmsg() call.
+ *
+ * @param batch This object.
+ *
+ * @return Number of sent frames or -1 on error. Unsent frames are dropped.
+ */
+int CO_CANbatch_txFlush(CO_CANbatch_t *batch);
+
+
+/**
+ * Print statistics to stdout.
+ *
+ * @param batch This object.
+ * @param name Printed in front of the statistics.
+ */
+void CO_CANbatch_printStats(const CO_CANbatch_t *batch, const char *name);
+
+
+#endif
@@ -0,0 +1,572 @@
+/*
+ * Additional CAN interfaces for canopend.
+ *
+ * @file        CO_CANbus.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* recvmmsg, sendmmsg, pthread_setname_np */
+#endif
+
+#include "CO_CANbus.h"
+#include "CO_CANbatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can/raw.h>
+
+
+#define BUS_EPOLL_TIMEOUT_MS        100     /* for checking end of program */
+
+/* Frames for CO->CANmodule[0], queued by bus_thread for rt_thread. Power of 2. */
+#ifndef CO_CAN_BUS_QUEUE_SIZE
+#define CO_CAN_BUS_QUEUE_SIZE       64
+#endif
+
+
+/* Additional CAN interface */
+typedef struct {
+    char               *name;           /* Interface name */
+    int32_t             CANbaseAddress; /* Interface index */
+    bool_t              node[128];      /* Nodes on this interface */
+    uint8_t             nodeCount;
+    CO_CANmodule_t      CANmodule;
+    CO_CANrx_t          CANrx[CO_NO_RPDO];
+    CO_CANtx_t          CANtx[CO_NO_TPDO];
+    CO_CANbatch_t       batch;
+    uint8_t             RPDOcount;      /* PDOs bound to this interface */
+    uint8_t             TPDOcount;
+    int                 fdBridge;       /* Socket on CANopen interface */
+    int                 fdEpoll;
+    pthread_t           thread;
+    bool_t              threadRunning;
+    uint32_t            bridged;        /* Frames forwarded from CANopen interface */
+    /* Single producer (bus_thread), single consumer (rt_thread) queue */
+    CO_CANrxMsg_t       queue[CO_CAN_BUS_QUEUE_SIZE];
+    uint32_t            queueHead;      /* Written by bus_thread only */
+    uint32_t            queueTail;      /* Written by rt_thread only */
+    uint32_t            queueOverflow;  /* Frames dropped, queue was full */
+} CO_CANbus_t;
+
+
+static CO_CANbus_t          buses[CO_CAN_BUS_MAX];
+static uint8_t              busCount = 0;
+static bool_t               busModulesInitialized = false;
+static volatile bool_t      busEnd = false;
+static int                  fdQueue = -1;   /* eventfd, signals queued frames to rt_thread */
+static CO_CANmodule_t      *queueModule;    /* Receives queued frames, CO->CANmodule[0] */
+
+
+static CO_CANbus_t *findBus(uint8_t nodeId) {
+    int b;
+
+    for(b=0; b<busCount; b++) {
+        if(nodeId < 128 && buses[b].node[nodeId]) {
+            return &buses[b];
+        }
+    }
+    return NULL;
+}
+
+
+/******************************************************************************/
+int CO_CANbus_add(char *arg) {
+    CO_CANbus_t *bus;
+    char *list, *tok, *save;
+
+    list = strchr(arg, ':');
+    if(busCount >= CO_CAN_BUS_MAX || busModulesInitialized || list == NULL) {
+        return -1;
+    }
+    *list++ = 0;
+
+    bus = &buses[busCount];
+    memset(bus, 0, sizeof(*bus));
+    bus->name = arg;
+    bus->CANbaseAddress = if_nametoindex(arg);
+    bus->fdBridge = -1;
+    bus->fdEpoll = -1;
+    if(bus->CANbaseAddress == 0) {
+        return -1;
+    }
+
+    for(tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long first, last, id;
+
+        first = strtol(tok, &end, 0);
+        last = (*end == '-') ? strtol(end + 1, &end, 0) : first;
+        if(*end != 0 || first < 1 || last > 127 || first > last) {
+            return -1;
+        }
+        for(id = first; id <= last; id++) {
+            /* Node may be on one interface only */
+            if(findBus((uint8_t)id) != NULL) {
+                return -1;
+            }
+            if(!bus->node[id]) {
+                bus->node[id] = true;
+                bus->nodeCount++;
+            }
+        }
+    }
+    if(bus->nodeCount == 0) {
+        return -1;
+    }
+
+    busCount++;
+    return 0;
+}
+
+
+/******************************************************************************/
+int32_t CO_CANbus_nodeInterface(uint8_t nodeId, int32_t CANbaseAddress) {
+    CO_CANbus_t *bus = findBus(nodeId);
+
+    return (bus != NULL) ? bus->CANbaseAddress : CANbaseAddress;
+}
+
+
+/* Fallback of the bus batch, called from bus_thread for frames, which are
+ * not PDOs of the bus. Queued, rt_thread dispatches them to CO->CANmodule[0]. */
+static void queueFrame(void *object, const CO_CANrxMsg_t *msg) {
+    CO_CANbus_t *bus = (CO_CANbus_t *)object;
+    uint32_t head = bus->queueHead;
+
+    if(head - __atomic_load_n(&bus->queueTail, __ATOMIC_ACQUIRE) >= CO_CAN_BUS_QUEUE_SIZE) {
+        bus->queueOverflow++;
+        return;
+    }
+    bus->queue[head % CO_CAN_BUS_QUEUE_SIZE] = *msg;
+    __atomic_store_n(&bus->queueHead, head + 1, __ATOMIC_RELEASE);
+}
+
+
+/* First time initialization of CANmodules. */
+static CO_ReturnError_t busModulesInit(void) {
+    int b;
+
+    for(b=0; b<busCount; b++) {
+        CO_CANbus_t *bus = &buses[b];
+        struct can_filter acceptAll = {0, 0};
+        CO_ReturnError_t err;
+
+        err = CO_CANmodule_init(&bus->CANmodule, bus->CANbaseAddress, bus->CANrx, CO_NO_RPDO,
+                                bus->CANtx, CO_NO_TPDO, OD_CANBitRate);
+        if(err != CO_ERROR_NO) {
+            return err;
+        }
+
+        /* Heartbeats, emergencies and SDO responses must also be received
+         * and queued for CO->CANmodule[0], so no kernel filters. */
+        bus->CANmodule.useCANrxFilters = false;
+        if(setsockopt(bus->CANmodule.fd, SOL_CAN_RAW, CAN_RAW_FILTER, &acceptAll, sizeof(acceptAll)) != 0) {
+            return CO_ERROR_SYSCALL;
+        }
+
+        CO_CANbatch_init(&bus->batch, &bus->CANmodule);
+        CO_CANbatch_setFallback(&bus->batch, bus, queueFrame);
+    }
+
+    busModulesInitialized = true;
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_CANbus_bind(void) {
+    CO_ReturnError_t err = CO_ERROR_NO;
+    int b, i;
+
+    if(busCount == 0) {
+        return CO_ERROR_NO;
+    }
+    if(!busModulesInitialized && (err = busModulesInit()) != CO_ERROR_NO) {
+        return err;
+    }
+
+    for(b=0; b<busCount; b++) {
+        buses[b].RPDOcount = 0;
+        buses[b].TPDOcount = 0;
+    }
+    queueModule = CO->CANmodule[0];
+
+    /* Arguments are the same as in CO_init(), except CANmodule. Receive
+     * buffer on CO->CANmodule[0] stays, but node does not send there. */
+    for(i=0; i<CO_NO_RPDO && err == CO_ERROR_NO; i++) {
+        uint32_t COB_ID = OD_RPDOCommunicationParameter[i].COB_IDUsedByRPDO;
+        CO_CANbus_t *bus = findBus(COB_ID & 0x7F);
+
+        if((COB_ID & 0x80000000L) == 0 && bus != NULL) {
+            err = CO_RPDO_init(CO->RPDO[i], CO->em, CO->SDO[0], CO->SYNC,
+                    &CO->NMT->operatingState, CO->NMT->nodeId,
+                    ((i<4) ? (CO_CAN_ID_RPDO_1+i*0x100) : 0), 0,
+                    (CO_RPDOCommPar_t*) &OD_RPDOCommunicationParameter[i],
+                    (CO_RPDOMapPar_t*) &OD_RPDOMappingParameter[i],
+                    OD_H1400_RXPDO_1_PARAM+i, OD_H1600_RXPDO_1_MAPPING+i,
+                    &bus->CANmodule, bus->RPDOcount++);
+        }
+    }
+
+    for(i=0; i<CO_NO_TPDO && err == CO_ERROR_NO; i++) {
+        uint32_t COB_ID = OD_TPDOCommunicationParameter[i].COB_IDUsedByTPDO;
+        CO_CANbus_t *bus = findBus(COB_ID & 0x7F);
+
+        if((COB_ID & 0x80000000L) == 0 && bus != NULL) {
+            err = CO_TPDO_init(CO->TPDO[i], CO->em, CO->SDO[0],
+                    &CO->NMT->operatingState, CO->NMT->nodeId,
+                    ((i<4) ? (CO_CAN_ID_TPDO_1+i*0x100) : 0), 0,
+                    (CO_TPDOCommPar_t*) &OD_TPDOCommunicationParameter[i],
+                    (CO_TPDOMapPar_t*) &OD_TPDOMappingParameter[i],
+                    OD_H1800_TXPDO_1_PARAM+i, OD_H1A00_TXPDO_1_MAPPING+i,
+                    &bus->CANmodule, bus->TPDOcount++);
+        }
+    }
+
+    return err;
+}
+
+
+/* Forward frames from CANopen interface to the bus. */
+static void bridgeForward(CO_CANbus_t *bus) {
+    struct can_frame frames[CO_CAN_BATCH_SIZE];
+    struct iovec iov[CO_CAN_BATCH_SIZE];
+    struct mmsghdr msgs[CO_CAN_BATCH_SIZE];
+    int n, i;
+
+    memset(msgs, 0, sizeof(msgs));
+    for(i=0; i<CO_CAN_BATCH_SIZE; i++) {
+        iov[i].iov_base = &frames[i];
+        iov[i].iov_len = sizeof(struct can_frame);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    n = recvmmsg(bus->fdBridge, msgs, CO_CAN_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if(n <= 0 || !bus->CANmodule.CANnormal) {
+        return;
+    }
+
+    /* The same buffers are sent, msg_len is ignored by sendmmsg. */
+    if(sendmmsg(bus->CANmodule.fd, msgs, n, 0) != n) {
+        CO_error(0x13500000L + errno);
+    }
+    else {
+        bus->bridged += n;
+    }
+}
+
+
+/* RT thread of additional interface */
+static void *bus_thread(void *arg) {
+    CO_CANbus_t *bus = (CO_CANbus_t *)arg;
+
+    while(!busEnd) {
+        struct epoll_event ev[2];
+        int ready, i;
+
+        ready = epoll_wait(bus->fdEpoll, ev, 2, BUS_EPOLL_TIMEOUT_MS);
+        if(ready < 0 && errno != EINTR) {
+            CO_error(0x13600000L + errno);
+        }
+
+        for(i=0; i<ready; i++) {
+            if(ev[i].data.fd == bus->CANmodule.fd) {
+                uint32_t head = bus->queueHead;
+
+                CO_CANbatch_rx(&bus->batch);
+                /* One wakeup of rt_thread for all queued frames of the batch */
+                if(bus->queueHead != head) {
+                    uint64_t one = 1;
+
+                    if(write(fdQueue, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+                        CO_error(0x13900000L + errno);
+                    }
+                }
+            }
+            else if(ev[i].data.fd == bus->fdBridge) {
+                bridgeForward(bus);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Open socket on CANopen interface, which receives frames for the bus. */
+static int bridgeOpen(CO_CANbus_t *bus, int32_t CANbaseAddress, bool_t bridgeSync) {
+    struct can_filter filters[3 + 128];
+    struct sockaddr_can addr;
+    int fd, n = 0, id;
+
+    fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if(fd < 0) {
+        return -1;
+    }
+
+    /* NMT, SYNC, TIME and SDO requests to the nodes of the bus */
+    filters[n].can_id = 0x000; filters[n++].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    if(bridgeSync) {
+        filters[n].can_id = 0x080; filters[n++].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+    filters[n].can_id = 0x100; filters[n++].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    for(id=1; id<128; id++) {
+        if(bus->node[id]) {
+            filters[n].can_id = 0x600 + id;
+            filters[n++].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = CANbaseAddress;
+    if(setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters, sizeof(struct can_filter) * n) != 0
+       || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_CANbus_init(int32_t CANbaseAddress, int rtPriority, int epoll_fd, bool_t bridgeSync) {
+    struct epoll_event evQueue;
+    int b;
+
+    if(busCount == 0) {
+        return CO_ERROR_NO;
+    }
+    if(!busModulesInitialized) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    fdQueue = eventfd(0, EFD_NONBLOCK);
+    if(fdQueue < 0) {
+        return CO_ERROR_SYSCALL;
+    }
+    evQueue.events = EPOLLIN;
+    evQueue.data.fd = fdQueue;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fdQueue, &evQueue) != 0) {
+        return CO_ERROR_SYSCALL;
+    }
+
+    for(b=0; b<busCount; b++) {
+        CO_CANbus_t *bus = &buses[b];
+        struct epoll_event ev;
+        pthread_attr_t attr;
+        char threadName[16];
+
+        if(bus->CANbaseAddress == CANbaseAddress) {
+            return CO_ERROR_ILLEGAL_ARGUMENT;
+        }
+
+        bus->fdBridge = bridgeOpen(bus, CANbaseAddress, bridgeSync);
+        bus->fdEpoll = epoll_create(2);
+        if(bus->fdBridge < 0 || bus->fdEpoll < 0) {
+            return CO_ERROR_SYSCALL;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.fd = bus->CANmodule.fd;
+        if(epoll_ctl(bus->fdEpoll, EPOLL_CTL_ADD, ev.data.fd, &ev) != 0) {
+            return CO_ERROR_SYSCALL;
+        }
+        ev.data.fd = bus->fdBridge;
+        if(epoll_ctl(bus->fdEpoll, EPOLL_CTL_ADD, ev.data.fd, &ev) != 0) {
+            return CO_ERROR_SYSCALL;
+        }
+
+        /* Thread has the same priority as rt_thread */
+        pthread_attr_init(&attr);
+        if(rtPriority > 0) {
+            struct sched_param param;
+
+            param.sched_priority = rtPriority;
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            pthread_attr_setschedparam(&attr, &param);
+        }
+        if(pthread_create(&bus->thread, &attr, bus_thread, bus) != 0) {
+            pthread_attr_destroy(&attr);
+            return CO_ERROR_SYSCALL;
+        }
+        pthread_attr_destroy(&attr);
+        bus->threadRunning = true;
+
+        snprintf(threadName, sizeof(threadName), "canopend-%s", bus->name);
+        pthread_setname_np(bus->thread, threadName);
+    }
+
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+bool_t CO_CANbus_processRx(int fd) {
+    uint64_t count;
+    int b;
+
+    if(fd < 0 || fd != fdQueue) {
+        return false;
+    }
+    if(read(fd, &count, sizeof(count)) != sizeof(count) && errno != EAGAIN) {
+        CO_error(0x13A00000L + errno);
+    }
+
+    for(b=0; b<busCount; b++) {
+        CO_CANbus_t *bus = &buses[b];
+        uint32_t tail = bus->queueTail;
+        uint32_t head = __atomic_load_n(&bus->queueHead, __ATOMIC_ACQUIRE);
+
+        for(; tail != head; tail++) {
+            CO_CANbatch_dispatch(queueModule, &bus->queue[tail % CO_CAN_BUS_QUEUE_SIZE]);
+        }
+        __atomic_store_n(&bus->queueTail, tail, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+
+/******************************************************************************/
+CO_CANbatch_t *CO_CANbus_batch(const CO_CANmodule_t *CANmodule) {
+    int b;
+
+    for(b=0; b<busCount && busModulesInitialized; b++) {
+        if(&buses[b].CANmodule == CANmodule) {
+            return &buses[b].batch;
+        }
+    }
+    return NULL;
+}
+
+
+/******************************************************************************/
+void CO_CANbus_txQueue(const CO_CANtx_t *buffer) {
+    int b;
+
+    for(b=0; b<busCount && busModulesInitialized; b++) {
+        CO_CANbatch_txQueue(&buses[b].batch, buffer);
+    }
+}
+
+
+/******************************************************************************/
+void CO_CANbus_txFlush(void) {
+    int b;
+
+    for(b=0; b<busCount && busModulesInitialized; b++) {
+        CO_CANbatch_txFlush(&buses[b].batch);
+    }
+}
+
+
+/******************************************************************************/
+void CO_CANbus_setNormalMode(bool_t normal) {
+    int b;
+
+    if(!busModulesInitialized) {
+        return;
+    }
+    for(b=0; b<busCount; b++) {
+        if(normal) {
+            CO_CANsetNormalMode(&buses[b].CANmodule);
+        }
+        else {
+            buses[b].CANmodule.CANnormal = false;
+        }
+    }
+}
+
+
+/******************************************************************************/
+void CO_CANbus_initCallback(
+        void                   *object,
+        void                  (*pFunct)(void *object, const CO_CANrxMsg_t *msg,
+                                        const struct timespec *timestamp))
+{
+    int b;
+
+    if(!busModulesInitialized) {
+        return;
+    }
+    for(b=0; b<busCount; b++) {
+        CO_CANbatch_initCallback(&buses[b].batch, object, pFunct);
+    }
+}
+
+
+/******************************************************************************/
+uint64_t CO_CANbus_rxTime(const void *object) {
+    int b;
+
+    for(b=0; b<busCount && busModulesInitialized; b++) {
+        uint64_t t = CO_CANbatch_rxTime(&buses[b].batch, object);
+
+        if(t != 0) {
+            return t;
+        }
+    }
+    return 0;
+}
+
+
+/******************************************************************************/
+void CO_CANbus_delete(void) {
+    int b;
+
+    busEnd = true;
+    for(b=0; b<busCount; b++) {
+        CO_CANbus_t *bus = &buses[b];
+
+        if(bus->threadRunning) {
+            pthread_join(bus->thread, NULL);
+            bus->threadRunning = false;
+        }
+        if(bus->fdBridge >= 0) {
+            close(bus->fdBridge);
+            bus->fdBridge = -1;
+        }
+        if(bus->fdEpoll >= 0) {
+            close(bus->fdEpoll);
+            bus->fdEpoll = -1;
+        }
+        if(busModulesInitialized) {
+            CO_CANmodule_disable(&bus->CANmodule);
+        }
+    }
+    if(fdQueue >= 0) {
+        close(fdQueue);
+        fdQueue = -1;
+    }
+    busModulesInitialized = false;
+}
+
+
+/******************************************************************************/
+void CO_CANbus_printStats(void) {
+    int b;
+
+    for(b=0; b<busCount && busModulesInitialized; b++) {
+        CO_CANbus_t *bus = &buses[b];
+
+        printf("%s - %u RPDOs, %u TPDOs, %u frames bridged, %u frames lost (queue full)\n",
+               bus->name, bus->RPDOcount, bus->TPDOcount, bus->bridged, bus->queueOverflow);
+        CO_CANbatch_printStats(&bus->batch, bus->name);
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ * Additional CAN interfaces for canopend.
+ *
+ * @file        CO_CANbus.h
+ *
+ * CO_init() runs CANopen on one CAN interface. With all joints on one bus,
+ * bus load limits the SYNC rate. This module adds more CAN interfaces (for
+ * example can1 from 'BBB Scripts/Tests/CAN1_enable.sh') and moves remote
+ * nodes to them, for example left leg on can0 and right leg on can1.
+ *
+ * Each additional interface has:
+ *  - Own CANmodule with RPDOs and TPDOs of its nodes. A PDO belongs to the
+ *    node in the lower 7 bits of its COB-ID, as configured in CO_OD.c.
+ *    Received PDOs are written to the same Object Dictionary, so clients
+ *    see one merged Object Dictionary, regardless of the bus.
+ *  - Own RT thread, which receives frames in batches (CO_CANbatch.h).
+ *    Frames, which are not PDOs (heartbeat, emergency, SDO responses), are
+ *    queued for the RT thread of CO->CANmodule[0], which dispatches them
+ *    as if they were received there (CO_CANbus_processRx()). So the
+ *    heartbeat consumer, emergency and SDO client run in one thread only.
+ *  - Bridge from the CANopen interface: NMT, SYNC, TIME and SDO requests to
+ *    the nodes of this bus are forwarded, so NMT commands and canopencomm
+ *    work without changes. Bridge relies on local loopback of SocketCAN
+ *    (enabled by default). With own SYNC producer (CO_SYNCproducer.h) SYNC
+ *    is not bridged, producer sends it on all interfaces at the same time.
+ *
+ * TPDOs are still processed by the CANopen timer in rt_thread, but sent
+ * on the interface of their node.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_CAN_BUS_H
+#define CO_CAN_BUS_H
+
+#include "CANopen.h"
+#include "CO_CANbatch.h"
+#include <time.h>
+
+
+/* Maximum number of additional CAN interfaces. */
+#ifndef CO_CAN_BUS_MAX
+#define CO_CAN_BUS_MAX              3
+#endif
+
+
+/**
+ * Add CAN interface with its nodes, for example "can1:3-4". Call before
+ * CO_CANbus_init().
+ *
+ * @param arg Interface name and list of node IDs, separated by ':'. String
+ * must stay valid.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int CO_CANbus_add(char *arg);
+
+
+/**
+ * Get CAN interface of the node.
+ *
+ * @param nodeId Node-ID.
+ * @param CANbaseAddress Interface of CO_init(), returned for nodes not on
+ * additional interfaces.
+ *
+ * @return CAN interface index.
+ */
+int32_t CO_CANbus_nodeInterface(uint8_t nodeId, int32_t CANbaseAddress);
+
+
+/**
+ * Initialize CANmodules, bridges and RT threads of additional interfaces.
+ * Call once after first CO_init() and CO_CANbus_bind().
+ *
+ * @param CANbaseAddress Interface of CO_init().
+ * @param rtPriority SCHED_FIFO priority of RT threads or -1.
+ * @param epoll_fd epoll of the thread, which receives on CO->CANmodule[0].
+ * Queued frames are signalled there, see CO_CANbus_processRx().
+ * @param bridgeSync False, if SYNC is sent by CO_CANbus_txQueue().
+ *
+ * @return CO_ERROR_NO on success, also if there are no additional interfaces.
+ */
+CO_ReturnError_t CO_CANbus_init(int32_t CANbaseAddress, int rtPriority, int epoll_fd, bool_t bridgeSync);
+
+
+/**
+ * Dispatch frames, which RT threads of additional interfaces queued for
+ * CO->CANmodule[0]. Call from the thread, which receives on CO->CANmodule[0],
+ * when fd from its epoll is readable.
+ *
+ * @param fd Readable file descriptor.
+ *
+ * @return True, if fd was the queue of additional interfaces.
+ */
+bool_t CO_CANbus_processRx(int fd);
+
+
+/**
+ * Get batch of the additional interface with CANmodule, for example
+ * TPDO->CANdevTx. Transmit with it only from rt_thread.
+ *
+ * @return Batch or NULL, if CANmodule is not an additional interface.
+ */
+CO_CANbatch_t *CO_CANbus_batch(const CO_CANmodule_t *CANmodule);
+
+
+/**
+ * Queue frame for transmission on all additional interfaces, for example
+ * SYNC. Call from rt_thread.
+ *
+ * @param buffer Transmit buffer from CO_CANtxBufferInit().
+ */
+void CO_CANbus_txQueue(const CO_CANtx_t *buffer);
+
+
+/**
+ * Send queued frames on all additional interfaces, see CO_CANbatch_txFlush().
+ * Call from rt_thread.
+ */
+void CO_CANbus_txFlush(void);
+
+
+/**
+ * Move PDOs of the nodes to their interfaces. Call after each CO_init(),
+ * which binds all PDOs to CO->CANmodule[0] again. First call also
+ * initializes CANmodules of additional interfaces.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_CANbus_bind(void);
+
+
+/**
+ * Set normal or configuration mode of additional interfaces, together with
+ * CO->CANmodule[0].
+ *
+ * @param normal True for normal mode.
+ */
+void CO_CANbus_setNormalMode(bool_t normal);
+
+
+/**
+ * Set receive callback of additional interfaces, see
+ * CO_CANbatch_initCallback(). Called from their RT threads for each frame.
+ * Call after CO_CANbus_bind().
+ */
+void CO_CANbus_initCallback(
+        void                   *object,
+        void                  (*pFunct)(void *object, const CO_CANrxMsg_t *msg,
+                                        const struct timespec *timestamp));
+
+
+/**
+ * Receive time of the last frame for object (RPDO moved to an additional
+ * interface), see CO_CANbatch_rxTime().
+ *
+ * @return Time in CO_clock_ns() timebase or 0, if object is not on an
+ * additional interface or nothing was received.
+ */
+uint64_t CO_CANbus_rxTime(const void *object);
+
+
+/**
+ * Stop RT threads and close additional interfaces.
+ */
+void CO_CANbus_delete(void);
+
+
+/**
+ * Print statistics of additional interfaces to stdout.
+ */
+void CO_CANbus_printStats(void);
+
+
+#endif
@@ -169,12 +169,14 @@ struct sCO_OD_RAM CO_OD_RAM = {
 /*2103*/ 0x00,
 /*2104*/ 0x00,
 /*2106*/ 0x0000L,
-/*2107*/ {0x3e8, 0x00, 0x00, 0x00, 0x00},
+/*2107*/ {0x3e8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
 /*2108*/ {0x00},
 /*2109*/ {0x00},
 /*2110*/ {0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
 /*2111*/ {0x0001L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
 /*2112*/ {0x0001L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
+/*2113*/ {0x0001L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
+/*2114*/ {0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
 /*2120*/ {0x5L, 0x1234567890abcdefL, 0x234567890abcdef1L, 12.345, 456.789, 0},
 /*2130*/ {0x3L, {'-'}, 0x00000000L, 0x0000L},
 /*2301*/ {{0x8L, 0x03e8L, 0x0L, {'T', 'r', 'a', 'c', 'e', '1'}, {'r', 'e', 'd'}, 0x0000L, 0x0L, 0x0L, 0x0000L},
@@ -1705,7 +1707,7 @@ struct sCO_OD_EEPROM CO_OD_EEPROM = {
 /*******************************************************************************
    OBJECT DICTIONARY
 *******************************************************************************/
-const CO_OD_entry_t CO_OD[175] = {
+const CO_OD_entry_t CO_OD[177] = {
 
 {0x1000, 0x00, 0x86, 4, (void*)&CO_OD_RAM.deviceType},
 {0x1001, 0x00, 0x26, 1, (void*)&CO_OD_RAM.errorRegister},
@@ -1799,12 +1801,14 @@ const CO_OD_entry_t CO_OD[175] = {
 {0x2103, 0x00, 0x8e, 2, (void*)&CO_OD_RAM.SYNCCounter},
 {0x2104, 0x00, 0x86, 2, (void*)&CO_OD_RAM.SYNCTime},
 {0x2106, 0x00, 0x86, 4, (void*)&CO_OD_RAM.powerOnCounter},
-{0x2107, 0x05, 0x8e, 2, (void*)&CO_OD_RAM.performance[0]},
+{0x2107, 0x09, 0x8e, 2, (void*)&CO_OD_RAM.performance[0]},
 {0x2108, 0x01, 0x8e, 2, (void*)&CO_OD_RAM.temperature[0]},
 {0x2109, 0x01, 0x8e, 2, (void*)&CO_OD_RAM.voltage[0]},
 {0x2110, 0x20, 0x8e, 4, (void*)&CO_OD_RAM.variableInt32[0]},
 {0x2111, 0x10, 0x8e, 4, (void*)&CO_OD_RAM.variableROM_Int32[0]},
 {0x2112, 0x10, 0x8e, 4, (void*)&CO_OD_RAM.variableNV_Int32[0]},
+{0x2113, 0x06, 0x8e, 4, (void*)&CO_OD_RAM.faultMonitor[0]},
+{0x2114, 0x05, 0x86, 4, (void*)&CO_OD_RAM.lockStats[0]},
 {0x2120, 0x05, 0x00, 0, (void*)&OD_record2120},
 {0x2130, 0x03, 0x00, 0, (void*)&OD_record2130},
 {0x2301, 0x08, 0x00, 0, (void*)&OD_record2301},
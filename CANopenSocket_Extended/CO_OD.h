@@ -110,7 +110,7 @@
 /*******************************************************************************
    OBJECT DICTIONARY
 *******************************************************************************/
-   #define CO_OD_NoOfElements             175
+   #define CO_OD_NoOfElements             177
 
 
 /*******************************************************************************
@@ -1095,6 +1095,10 @@
         #define OD_2107_3_performance_timerCycleMaxTime             3
         #define OD_2107_4_performance_mainCycleTime                 4
         #define OD_2107_5_performance_mainCycleMaxTime              5
+        #define OD_2107_6_performance_storageSaveTime               6
+        #define OD_2107_7_performance_storageSaveMaxTime            7
+        #define OD_2107_8_performance_syncJitter                    8
+        #define OD_2107_9_performance_syncJitterMax                 9
 
 /*2108 */
         #define OD_2108_temperature                                 0x2108
@@ -1187,6 +1191,27 @@
         #define OD_2112_15_variableNV_Int32_int32                   15
         #define OD_2112_16_variableNV_Int32_int32                   16
 
+/*2113 */
+        #define OD_2113_faultMonitor                                0x2113
+
+        #define OD_2113_0_faultMonitor_maxSubIndex                  0
+        #define OD_2113_1_faultMonitor_reaction                     1
+        #define OD_2113_2_faultMonitor_latched                      2
+        #define OD_2113_3_faultMonitor_count                        3
+        #define OD_2113_4_faultMonitor_node                         4
+        #define OD_2113_5_faultMonitor_type                         5
+        #define OD_2113_6_faultMonitor_code                         6
+
+/*2114 */
+        #define OD_2114_lockStats                                   0x2114
+
+        #define OD_2114_0_lockStats_maxSubIndex                     0
+        #define OD_2114_1_lockStats_locks                           1
+        #define OD_2114_2_lockStats_contended                       2
+        #define OD_2114_3_lockStats_waitMax                         3
+        #define OD_2114_4_lockStats_holdMax                         4
+        #define OD_2114_5_lockStats_rtWaitMax                       5
+
 /*2120 */
         #define OD_2120_testVar                                     0x2120
 
@@ -2135,12 +2160,14 @@ struct sCO_OD_RAM{
 /*2103      */ UNSIGNED16      SYNCCounter;
 /*2104      */ UNSIGNED16      SYNCTime;
 /*2106      */ UNSIGNED32      powerOnCounter;
-/*2107      */ UNSIGNED16      performance[5];
+/*2107      */ UNSIGNED16      performance[9];
 /*2108      */ INTEGER16       temperature[1];
 /*2109      */ INTEGER16       voltage[1];
 /*2110      */ INTEGER32       variableInt32[32];
 /*2111      */ INTEGER32       variableROM_Int32[16];
 /*2112      */ INTEGER32       variableNV_Int32[16];
+/*2113      */ UNSIGNED32      faultMonitor[6];
+/*2114      */ UNSIGNED32      lockStats[5];
 /*2120      */ OD_testVar_t    testVar;
 /*2130      */ OD_time_t       time;
 /*2301      */ OD_traceConfig_t traceConfig[32];
@@ -2293,14 +2320,18 @@ extern struct sCO_OD_EEPROM CO_OD_EEPROM;
 /*2106, Data Type: UNSIGNED32 */
         #define OD_powerOnCounter                                   CO_OD_RAM.powerOnCounter
 
-/*2107, Data Type: UNSIGNED16, Array[5] */
+/*2107, Data Type: UNSIGNED16, Array[9] */
         #define OD_performance                                      CO_OD_RAM.performance
-        #define ODL_performance_arrayLength                         5
+        #define ODL_performance_arrayLength                         9
         #define ODA_performance_cyclesPerSecond                     0
         #define ODA_performance_timerCycleTime                      1
         #define ODA_performance_timerCycleMaxTime                   2
         #define ODA_performance_mainCycleTime                       3
         #define ODA_performance_mainCycleMaxTime                    4
+        #define ODA_performance_storageSaveTime                     5
+        #define ODA_performance_storageSaveMaxTime                  6
+        #define ODA_performance_syncJitter                          7
+        #define ODA_performance_syncJitterMax                       8
 
 /*2108, Data Type: INTEGER16, Array[1] */
         #define OD_temperature                                      CO_OD_RAM.temperature
@@ -2327,6 +2358,25 @@ extern struct sCO_OD_EEPROM CO_OD_EEPROM;
         #define ODL_variableNV_Int32_arrayLength                    16
         #define ODA_variableNV_Int32_int32                          0
 
+/*2113, Data Type: UNSIGNED32, Array[6] */
+        #define OD_faultMonitor                                     CO_OD_RAM.faultMonitor
+        #define ODL_faultMonitor_arrayLength                        6
+        #define ODA_faultMonitor_reaction                           0
+        #define ODA_faultMonitor_latched                            1
+        #define ODA_faultMonitor_count                              2
+        #define ODA_faultMonitor_node                               3
+        #define ODA_faultMonitor_type                               4
+        #define ODA_faultMonitor_code                               5
+
+/*2114, Data Type: UNSIGNED32, Array[5] */
+        #define OD_lockStats                                        CO_OD_RAM.lockStats
+        #define ODL_lockStats_arrayLength                           5
+        #define ODA_lockStats_locks                                 0
+        #define ODA_lockStats_contended                             1
+        #define ODA_lockStats_waitMax                               2
+        #define ODA_lockStats_holdMax                               3
+        #define ODA_lockStats_rtWaitMax                             4
+
 /*2120, Data Type: testVar_t */
         #define OD_testVar                                          CO_OD_RAM.testVar
 
@@ -0,0 +1,270 @@
+/*
+ * Non-blocking automatic storage of Object Dictionary.
+ *
+ * @file        CO_OD_storageAsync.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* pthread_setname_np */
+#endif
+
+#include "CO_OD_storageAsync.h"
+#include "CO_lockStats.h"
+#include "crc16-ccitt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <time.h>
+
+
+/* 64-bit FNV-1a, collisions are practically impossible for OD images. */
+static uint64_t hashImage(const uint8_t *data, uint32_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t i;
+
+    for(i=0; i<size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+/* Write image with CRC to temporary file, sync it and replace storage file. */
+static int writeFile(CO_OD_storageAsync_t *stor, const uint8_t *data) {
+    uint16_t CRC = crc16_ccitt((const unsigned char *)data, stor->odSize, 0);
+    char *dirCopy;
+    FILE *fp;
+    int fd, ret = 0;
+
+    fp = fopen(stor->tmpFilename, "w");
+    if(fp == NULL) {
+        return -1;
+    }
+    if(fwrite(data, 1, stor->odSize, fp) != stor->odSize || fwrite(&CRC, 1, 2, fp) != 2
+       || fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+    {
+        ret = -1;
+    }
+    if(fclose(fp) != 0 || ret != 0) {
+        unlink(stor->tmpFilename);
+        return -1;
+    }
+
+    if(rename(stor->tmpFilename, stor->filename) != 0) {
+        unlink(stor->tmpFilename);
+        return -1;
+    }
+
+    /* Make the rename persistent */
+    dirCopy = strdup(stor->filename);
+    if(dirCopy != NULL) {
+        fd = open(dirname(dirCopy), O_RDONLY);
+        if(fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+        free(dirCopy);
+    }
+
+    return 0;
+}
+
+
+/* Background thread, writes writeBuf when signalled. */
+static void *storage_thread(void *arg) {
+    CO_OD_storageAsync_t *stor = (CO_OD_storageAsync_t *)arg;
+
+    pthread_mutex_lock(&stor->mtx);
+    for(;;) {
+        struct timespec start, stop;
+        uint32_t time_ms;
+        int ret;
+
+        while(!stor->writePending && !stor->end) {
+            pthread_cond_wait(&stor->cond, &stor->mtx);
+        }
+        if(!stor->writePending) {
+            break;
+        }
+        pthread_mutex_unlock(&stor->mtx);
+
+        /* writeBuf is owned by this thread until writePending is cleared */
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ret = writeFile(stor, stor->writeBuf);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+
+        time_ms = (stop.tv_sec - start.tv_sec) * 1000 + (stop.tv_nsec - start.tv_nsec) / 1000000;
+        if(time_ms > 0xFFFF) {
+            time_ms = 0xFFFF;
+        }
+
+        pthread_mutex_lock(&stor->mtx);
+        if(ret == 0) {
+            stor->saves++;
+        }
+        else {
+            stor->errors++;
+            stor->hashQueued = 0;   /* try again next time */
+        }
+        if(stor->saveTime != NULL) {
+            *stor->saveTime = (uint16_t)time_ms;
+            if(time_ms > *stor->saveMaxTime) {
+                *stor->saveMaxTime = (uint16_t)time_ms;
+            }
+        }
+        stor->writePending = false;
+        pthread_cond_broadcast(&stor->cond);
+    }
+    pthread_mutex_unlock(&stor->mtx);
+
+    return NULL;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_OD_storageAsync_init(
+        CO_OD_storageAsync_t   *stor,
+        uint8_t                *odAddress,
+        uint32_t                odSize,
+        char                   *filename,
+        uint16_t               *saveTime)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+
+    if(stor == NULL || odAddress == NULL || odSize == 0 || filename == NULL) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    memset(stor, 0, sizeof(*stor));
+    stor->odAddress = odAddress;
+    stor->odSize = odSize;
+    stor->filename = filename;
+    stor->saveTime = saveTime;
+    stor->saveMaxTime = (saveTime != NULL) ? &saveTime[1] : NULL;
+    stor->snapshot = malloc(odSize);
+    stor->writeBuf = malloc(odSize);
+    stor->tmpFilename = malloc(strlen(filename) + 5);
+    if(stor->snapshot == NULL || stor->writeBuf == NULL || stor->tmpFilename == NULL) {
+        free(stor->snapshot);
+        free(stor->writeBuf);
+        free(stor->tmpFilename);
+        return CO_ERROR_OUT_OF_MEMORY;
+    }
+    strcpy(stor->tmpFilename, filename);
+    strcat(stor->tmpFilename, ".tmp");
+
+    /* Image was just loaded from the file, don't save it again. */
+    CO_LOCK_OD();
+    stor->hashQueued = hashImage(odAddress, odSize);
+    CO_UNLOCK_OD();
+
+    pthread_mutex_init(&stor->mtx, NULL);
+    pthread_cond_init(&stor->cond, NULL);
+
+    /* File access is not realtime, also if created from realtime thread. */
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    param.sched_priority = 0;
+    pthread_attr_setschedparam(&attr, &param);
+    if(pthread_create(&stor->thread, &attr, storage_thread, stor) != 0) {
+        pthread_attr_destroy(&attr);
+        free(stor->snapshot);
+        free(stor->writeBuf);
+        free(stor->tmpFilename);
+        return CO_ERROR_SYSCALL;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_setname_np(stor->thread, "canopend-stor");
+
+    return CO_ERROR_NO;
+}
+
+
+/* Snapshot and queue, if changed. Returns false if thread is busy. */
+static bool_t snapshotAndQueue(CO_OD_storageAsync_t *stor) {
+    uint64_t hash;
+    bool_t queued = true;
+
+    CO_LOCK_OD();
+    memcpy(stor->snapshot, stor->odAddress, stor->odSize);
+    CO_UNLOCK_OD();
+
+    hash = hashImage(stor->snapshot, stor->odSize);
+
+    pthread_mutex_lock(&stor->mtx);
+    if(hash == stor->hashQueued) {
+        stor->skipped++;
+    }
+    else if(stor->writePending) {
+        queued = false;
+    }
+    else {
+        uint8_t *buf = stor->writeBuf;
+
+        stor->writeBuf = stor->snapshot;
+        stor->snapshot = buf;
+        stor->hashQueued = hash;
+        stor->writePending = true;
+        pthread_cond_signal(&stor->cond);
+    }
+    pthread_mutex_unlock(&stor->mtx);
+
+    return queued;
+}
+
+
+/******************************************************************************/
+void CO_OD_storageAsync_process(CO_OD_storageAsync_t *stor, uint16_t timer1ms, uint16_t delay) {
+    if(stor == NULL || stor->snapshot == NULL) {
+        return;
+    }
+
+    if(stor->retry || (uint16_t)(timer1ms - stor->tmrPrev) >= delay) {
+        stor->tmrPrev = timer1ms;
+        stor->retry = !snapshotAndQueue(stor);
+    }
+}
+
+
+/******************************************************************************/
+void CO_OD_storageAsync_close(CO_OD_storageAsync_t *stor) {
+    if(stor == NULL || stor->snapshot == NULL) {
+        return;
+    }
+
+    /* Wait for previous write, then queue the final image. */
+    pthread_mutex_lock(&stor->mtx);
+    while(stor->writePending) {
+        pthread_cond_wait(&stor->cond, &stor->mtx);
+    }
+    pthread_mutex_unlock(&stor->mtx);
+    snapshotAndQueue(stor);
+
+    pthread_mutex_lock(&stor->mtx);
+    stor->end = true;
+    pthread_cond_broadcast(&stor->cond);
+    pthread_mutex_unlock(&stor->mtx);
+    pthread_join(stor->thread, NULL);
+
+    printf("OD storage '%s' - %u saves, %u unchanged, %u errors, max %u ms\n",
+           stor->filename, stor->saves, stor->skipped, stor->errors,
+           (stor->saveMaxTime != NULL) ? *stor->saveMaxTime : 0);
+
+    pthread_mutex_destroy(&stor->mtx);
+    pthread_cond_destroy(&stor->cond);
+    free(stor->snapshot);
+    free(stor->writeBuf);
+    free(stor->tmpFilename);
+    stor->snapshot = NULL;
+    stor->writeBuf = NULL;
+}
@@ -0,0 +1,99 @@
+/*
+ * Non-blocking automatic storage of Object Dictionary.
+ *
+ * @file        CO_OD_storageAsync.h
+ *
+ * CO_OD_storage_autoSave() compares and writes the CO_OD_EEPROM image to
+ * the file directly from the mainline. On SD card this may block for tens
+ * of milliseconds and delays SDO and command interface processing.
+ *
+ * Here mainline only copies the image into a shadow buffer (under
+ * CO_LOCK_OD) and hashes it. Unchanged images are not saved. Changed image
+ * is passed to a background thread, which writes it to a temporary file,
+ * syncs it and renames it over the storage file, so the file is always
+ * complete. Two buffers are used: mainline fills one, while thread writes
+ * the other. File format is the same as of CO_OD_storage (data followed by
+ * CRC16-CCITT), so file is loaded by CO_OD_storage_init().
+ *
+ * Duration of the last and the longest save is reported in milliseconds in
+ * OD_performance (storageSaveTime, storageSaveMaxTime).
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_OD_STORAGE_ASYNC_H
+#define CO_OD_STORAGE_ASYNC_H
+
+#include "CANopen.h"
+#include <pthread.h>
+
+
+/**
+ * Asynchronous storage object.
+ */
+typedef struct {
+    uint8_t            *odAddress;      /**< Image in the Object Dictionary. */
+    uint32_t            odSize;         /**< Size of the image. */
+    char               *filename;       /**< Storage file. */
+    char               *tmpFilename;    /**< filename + ".tmp". */
+    uint8_t            *snapshot;       /**< Filled by mainline. */
+    uint8_t            *writeBuf;       /**< Written by thread. */
+    uint64_t            hashQueued;     /**< Hash of the last image passed to the thread. */
+    bool_t              writePending;   /**< writeBuf is waiting or being written. */
+    bool_t              retry;          /**< Thread was busy, try on next call. */
+    bool_t              end;
+    uint16_t            tmrPrev;
+    uint16_t           *saveTime;       /**< OD_performance, last save time in ms. */
+    uint16_t           *saveMaxTime;    /**< OD_performance, max save time in ms. */
+    uint32_t            saves;          /**< Number of written files. */
+    uint32_t            skipped;        /**< Number of unchanged images. */
+    uint32_t            errors;         /**< Number of failed writes. */
+    pthread_mutex_t     mtx;
+    pthread_cond_t      cond;
+    pthread_t           thread;
+} CO_OD_storageAsync_t;
+
+
+/**
+ * Initialize object and start background thread. Call after
+ * CO_OD_storage_init() loaded the image from the file.
+ *
+ * @param stor This object.
+ * @param odAddress Image in the Object Dictionary, for example &CO_OD_EEPROM.
+ * @param odSize Size of the image.
+ * @param filename Storage file. String must stay valid.
+ * @param saveTime Pointer to two uint16_t variables for last and max save
+ * time in ms (&OD_performance[ODA_performance_storageSaveTime]). May be NULL.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_OD_storageAsync_init(
+        CO_OD_storageAsync_t   *stor,
+        uint8_t                *odAddress,
+        uint32_t                odSize,
+        char                   *filename,
+        uint16_t               *saveTime);
+
+
+/**
+ * Snapshot the image and pass it to the thread, if changed. Call from
+ * mainline, replacement for CO_OD_storage_autoSave(). Does not block on
+ * file access.
+ *
+ * @param stor This object.
+ * @param timer1ms Variable, which increments each millisecond.
+ * @param delay Interval between snapshots in milliseconds.
+ */
+void CO_OD_storageAsync_process(CO_OD_storageAsync_t *stor, uint16_t timer1ms, uint16_t delay);
+
+
+/**
+ * Save the last image, if changed, wait for the thread and release object.
+ *
+ * @param stor This object.
+ */
+void CO_OD_storageAsync_close(CO_OD_storageAsync_t *stor);
+
+
+#endif
@@ -0,0 +1,407 @@
+/*
+ * Typed Object Dictionary access for C++ clients of canopend.
+ *
+ * @file        CO_ODclient.hpp
+ *
+ * Clients of the command interfaces write requests like
+ * "read 0x6063 0 i32" by hand and parse the text of the response, and a
+ * wrong type suffix is found only at runtime. Here each Object Dictionary
+ * entry is a compile-time descriptor (CO::ODentry) with index, subindex,
+ * C++ type and optional scale to engineering units. Reads and writes are
+ * templates on the descriptor, so value type is checked by the compiler.
+ * Requests are encoded directly into the binary mode of the parallel
+ * command interface (CO_commandPool.h, canopend ... -C ""), no text is
+ * formatted or parsed.
+ *
+ * Descriptors of objects, which are also in the master Object Dictionary,
+ * take their type from CO_OD.h with CO_OD_ENTRY(), so they follow the OD
+ * when it is regenerated. The X2 master has CiA 402 objects of the drives
+ * with one subindex per motor, so drive objects use the type of the motor1
+ * subindex. Other drive objects are declared with explicit type.
+ *
+ * Example:
+ *   CO::ODclient od;
+ *   int32_t pos;
+ *   od.open();
+ *   od.write<CO::drive::modesOfOperation>(1, 1);
+ *   od.read<CO::drive::positionActual>(2, pos);
+ *
+ *   // Pipelined, one round trip for all four drives
+ *   int16_t torque[4];
+ *   for(int n=0; n<4; n++)
+ *       od.queueRead<CO::drive::torqueActual>(n + 1, &torque[n]);
+ *   if(od.transfer() == 0)
+ *       printf("%.1f %%\n", CO::drive::torqueActual::toUnits(torque[0]));
+ *
+ * Only expedited transfers (integer types of 1, 2 and 4 bytes) are
+ * supported, same as by the parallel command interface. Object of this
+ * class is not thread safe.
+ *
+ * In canopend itself include this header after CANopen.h.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_OD_CLIENT_HPP
+#define CO_OD_CLIENT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <ratio>
+#include <type_traits>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "CO_commandPool.h"
+
+/* Basic types for CO_OD.h, which are otherwise defined by CO_driver.h */
+#ifndef CO_DRIVER_H
+typedef bool            bool_t;
+typedef float           float32_t;
+typedef double          float64_t;
+typedef char            char_t;
+typedef unsigned char   oChar_t;
+typedef unsigned char   domain_t;
+#endif
+#include "CO_OD.h"
+
+
+/* Default socket of the parallel command interface. */
+#ifndef CO_ODCLIENT_SOCKET
+#define CO_ODCLIENT_SOCKET          "/tmp/CO_command_socket_parallel"
+#endif
+
+/* Maximum number of requests in one transfer(). */
+#ifndef CO_ODCLIENT_MAX_PENDING
+#define CO_ODCLIENT_MAX_PENDING     64
+#endif
+
+/* Result, if connection to canopend failed (client side, in addition to
+ * CO_CMDPOOL_ERR_*) */
+#define CO_ODCLIENT_ERR_CONNECTION  110
+
+
+/**
+ * Descriptor of an Object Dictionary entry with type of CO_OD.h variable.
+ *
+ * @param index Index, for example OD_6041_statusWords.
+ * @param subIndex Subindex.
+ * @param odVariable Variable in CO_OD.h, only its type is used, for example
+ * CO_OD_RAM.statusWords.motor1.
+ */
+#define CO_OD_ENTRY(index, subIndex, odVariable) \
+    CO::ODentry<index, subIndex, typename std::remove_reference<decltype(odVariable)>::type>
+
+
+namespace CO {
+
+/**
+ * Compile-time descriptor of an Object Dictionary entry.
+ *
+ * @tparam Index Object Dictionary index.
+ * @tparam Sub Subindex.
+ * @tparam T Integer type of the value, 1, 2 or 4 bytes.
+ * @tparam Scale Engineering units per raw value, std::ratio.
+ */
+template<uint16_t Index, uint8_t Sub, typename T, typename Scale = std::ratio<1> >
+struct ODentry {
+    static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value
+                  && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4),
+                  "Only integer types of 1, 2 or 4 bytes (expedited SDO)");
+
+    typedef T           type;
+    typedef Scale       scale;
+
+    static constexpr uint16_t index = Index;
+    static constexpr uint8_t subIndex = Sub;
+    static constexpr uint8_t size = sizeof(T);
+
+    /** Raw value to engineering units. */
+    static constexpr double toUnits(T raw) {
+        return (double)raw * Scale::num / Scale::den;
+    }
+
+    /** Engineering units to raw value, rounded. */
+    static T fromUnits(double units) {
+        return (T)std::lround(units * Scale::den / Scale::num);
+    }
+};
+
+
+/**
+ * CiA 402 objects of the Copley drives.
+ */
+namespace drive {
+    /* Types from the master Object Dictionary */
+    typedef CO_OD_ENTRY(OD_6040_controlWords, 0, CO_OD_RAM.controlWords.motor1)                   controlword;
+    typedef CO_OD_ENTRY(OD_6041_statusWords, 0, CO_OD_RAM.statusWords.motor1)                     statusword;
+    typedef CO_OD_ENTRY(OD_6064_actualMotorPositions, 0, CO_OD_RAM.actualMotorPositions.motor1)   positionActual;
+    typedef CO_OD_ENTRY(OD_606c_actualMotorVelocities, 0, CO_OD_RAM.actualMotorVelocities.motor1) velocityActual;
+    typedef CO_OD_ENTRY(OD_607a_targetMotorPositions, 0, CO_OD_RAM.targetMotorPositions.motor1)   targetPosition;
+    typedef CO_OD_ENTRY(OD_60ff_targetMotorVelocities, 0, CO_OD_RAM.targetMotorVelocities.motor1) targetVelocity;
+
+    /* Not in the master Object Dictionary */
+    typedef ODentry<0x6060, 0, int8_t>                      modesOfOperation;
+    typedef ODentry<0x6061, 0, int8_t>                      modesOfOperationDisplay;
+    typedef ODentry<0x6063, 0, int32_t>                     positionActualInternal;
+    typedef ODentry<0x6077, 0, int16_t, std::ratio<1, 10> > torqueActual;   /* % of rated torque */
+    typedef ODentry<0x6081, 0, uint32_t>                    profileVelocity;
+    typedef ODentry<0x6083, 0, uint32_t>                    profileAcceleration;
+    typedef ODentry<0x6084, 0, uint32_t>                    profileDeceleration;
+    typedef ODentry<0x1002, 0, uint32_t>                    manufacturerStatus;
+}
+
+
+/**
+ * Client of the parallel command interface in binary mode.
+ *
+ * Results are 0 on success, SDO abort code, CO_CMDPOOL_ERR_* or
+ * CO_ODCLIENT_ERR_CONNECTION.
+ */
+class ODclient {
+public:
+    /** Priority of SDO requests, same as CO_SDO_POOL_PRIO_*. */
+    enum Priority {
+        PRIO_HIGH = 0,
+        PRIO_NORMAL = 1,
+        PRIO_LOW = 2
+    };
+
+    ODclient() : fd(-1), sequence(0), queued(0), pending(), rxLen(0) {}
+    ~ODclient() { close(); }
+
+    ODclient(const ODclient &) = delete;
+    ODclient &operator=(const ODclient &) = delete;
+
+    /**
+     * Connect to canopend and select binary mode.
+     *
+     * @return 0 on success, -1 on error (errno is set).
+     */
+    int open(const char *path = CO_ODCLIENT_SOCKET) {
+        struct sockaddr_un addr;
+        uint8_t magic = CO_CMDPOOL_BIN_MAGIC;
+
+        close();
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+            || send(fd, &magic, 1, MSG_NOSIGNAL) != 1) {
+            int err = errno;
+            close();
+            errno = err;
+            return -1;
+        }
+        return 0;
+    }
+
+    void close() {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        queued = 0;
+        rxLen = 0;
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    /** Read entry E of node, blocking. */
+    template<class E>
+    uint32_t read(uint8_t node, typename E::type &value) {
+        uint32_t result;
+        if (!queueRead<E>(node, &value, &result))
+            return CO_CMDPOOL_ERR_NOT_PROCESSED;
+        uint32_t err = transfer();
+        return err != 0 ? err : result;
+    }
+
+    /** Write entry E of node, blocking. */
+    template<class E>
+    uint32_t write(uint8_t node, typename E::type value) {
+        if (!queueWrite<E>(node, value))
+            return CO_CMDPOOL_ERR_NOT_PROCESSED;
+        return transfer();
+    }
+
+    /** Read entry E of node in the next transfer(). False, if queue is full. */
+    template<class E>
+    bool queueRead(uint8_t node, typename E::type *value, uint32_t *result = nullptr) {
+        return queueReadAt(node, E::index, E::subIndex, value, result);
+    }
+
+    /** Write entry E of node in the next transfer(). False, if queue is full. */
+    template<class E>
+    bool queueWrite(uint8_t node, typename E::type value, uint32_t *result = nullptr) {
+        return queueWriteAt(node, E::index, E::subIndex, value, result);
+    }
+
+    /** Same as queueRead() with index known at runtime only. */
+    template<typename T>
+    bool queueReadAt(uint8_t node, uint16_t index, uint8_t sub, T *value, uint32_t *result = nullptr) {
+        ODentry<0, 0, T> check;
+        (void)check;
+        return queue(CO_CMDPOOL_BIN_READ, node, index, sub, sizeof(T), 0, value, &storeRaw<T>, result);
+    }
+
+    /** Same as queueWrite() with index known at runtime only. */
+    template<typename T>
+    bool queueWriteAt(uint8_t node, uint16_t index, uint8_t sub, T value, uint32_t *result = nullptr) {
+        ODentry<0, 0, T> check;
+        (void)check;
+        return queue(CO_CMDPOOL_BIN_WRITE, node, index, sub, sizeof(T), (uint32_t)value, nullptr, nullptr, result);
+    }
+
+    /** Priority of the SDO requests of this connection. */
+    uint32_t setPriority(Priority priority) {
+        if (!queue(CO_CMDPOOL_BIN_PRIORITY, 0, 0, 0, 1, priority, nullptr, nullptr, nullptr))
+            return CO_CMDPOOL_ERR_NOT_PROCESSED;
+        return transfer();
+    }
+
+    /**
+     * Send all queued requests at once and wait for all responses. Values
+     * and results are stored as responses arrive.
+     *
+     * @return 0, if all succeeded, else result of the first failed request.
+     */
+    uint32_t transfer() {
+        uint32_t first = 0;
+        size_t n = queued;
+        size_t done = 0;
+
+        queued = 0;
+        if (n == 0)
+            return 0;
+        if (!sendAll(txBuf, n * sizeof(txBuf[0])))
+            return failAll(n);
+
+        while (done < n) {
+            ssize_t r = recv(fd, rxBuf + rxLen, sizeof(rxBuf) - rxLen, 0);
+            if (r <= 0) {
+                if (r < 0 && errno == EINTR)
+                    continue;
+                return failAll(n);
+            }
+            rxLen += r;
+
+            size_t pos = 0;
+            while (rxLen - pos >= sizeof(CO_cmdPoolBinResp_t)) {
+                CO_cmdPoolBinResp_t resp;
+                memcpy(&resp, rxBuf + pos, sizeof(resp));
+                pos += sizeof(resp);
+
+                Pending &p = pending[resp.sequence % CO_ODCLIENT_MAX_PENDING];
+                if (!p.active || p.sequence != resp.sequence)
+                    continue;
+                complete(p, resp.result, resp.data, resp.size);
+                if (resp.result != 0 && first == 0)
+                    first = resp.result;
+                done++;
+            }
+            rxLen -= pos;
+            memmove(rxBuf, rxBuf + pos, rxLen);
+        }
+        return first;
+    }
+
+private:
+    typedef void (*StoreFn)(void *dst, uint32_t raw);
+
+    struct Pending {
+        bool        active;
+        uint32_t    sequence;
+        void       *dst;
+        StoreFn     store;
+        uint32_t   *result;
+    };
+
+    /* Converts little endian data of the response to T, no type switch at
+     * runtime. */
+    template<typename T>
+    static void storeRaw(void *dst, uint32_t raw) {
+        *static_cast<T *>(dst) = static_cast<T>(raw);
+    }
+
+    bool queue(uint8_t op, uint8_t node, uint16_t index, uint8_t sub, uint8_t size,
+               uint32_t value, void *dst, StoreFn store, uint32_t *result) {
+        if (queued >= CO_ODCLIENT_MAX_PENDING)
+            return false;
+
+        CO_cmdPoolBinReq_t &req = txBuf[queued++];
+        uint32_t seq = ++sequence;
+        req.sequence = seq;
+        req.op = op;
+        req.nodeId = node;
+        req.index = index;
+        req.subIndex = sub;
+        req.size = size;
+        req.reserved[0] = req.reserved[1] = 0;
+        req.data[0] = (uint8_t)value;
+        req.data[1] = (uint8_t)(value >> 8);
+        req.data[2] = (uint8_t)(value >> 16);
+        req.data[3] = (uint8_t)(value >> 24);
+
+        Pending &p = pending[seq % CO_ODCLIENT_MAX_PENDING];
+        p.active = true;
+        p.sequence = seq;
+        p.dst = dst;
+        p.store = store;
+        p.result = result;
+        return true;
+    }
+
+    void complete(Pending &p, uint32_t result, const uint8_t *data, uint8_t size) {
+        if (result == 0 && p.store != nullptr) {
+            uint32_t raw = 0;
+            for (int i = size - 1; i >= 0; i--)
+                raw = (raw << 8) | data[i];
+            p.store(p.dst, raw);
+        }
+        if (p.result != nullptr)
+            *p.result = result;
+        p.active = false;
+    }
+
+    uint32_t failAll(size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            Pending &p = pending[txBuf[i].sequence % CO_ODCLIENT_MAX_PENDING];
+            if (p.active)
+                complete(p, CO_ODCLIENT_ERR_CONNECTION, nullptr, 0);
+        }
+        close();
+        return CO_ODCLIENT_ERR_CONNECTION;
+    }
+
+    bool sendAll(const void *buf, size_t len) {
+        const uint8_t *p = static_cast<const uint8_t *>(buf);
+        while (len > 0 && fd >= 0) {
+            ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            len -= n;
+        }
+        return fd >= 0;
+    }
+
+    int fd;
+    uint32_t sequence;
+    size_t queued;
+    CO_cmdPoolBinReq_t txBuf[CO_ODCLIENT_MAX_PENDING];
+    Pending pending[CO_ODCLIENT_MAX_PENDING];
+    uint8_t rxBuf[CO_ODCLIENT_MAX_PENDING * sizeof(CO_cmdPoolBinResp_t)];
+    size_t rxLen;
+};
+
+}
+
+#endif
@@ -0,0 +1,735 @@
+/*
+ * Asynchronous Object Dictionary access and event loop for C++ clients of
+ * canopend.
+ *
+ * @file        CO_ODclientAsync.hpp
+ *
+ * CO::ODclient (CO_ODclient.hpp) blocks in transfer() until all responses
+ * are received, so a program can wait only for one thing at a time: a
+ * button, a motion or a telemetry read. Here one CO::EventLoop (epoll and
+ * timers in a single thread) serves any number of CO::AsyncODclient
+ * connections and timers, and nothing blocks:
+ *
+ *  - read<E>() and write<E>() send the request and return a CO::Request at
+ *    once. Request is a future: check it with ready(), or attach a
+ *    callback with then(). Requests issued in the same loop iteration go
+ *    to canopend in one write, like ODclient::transfer().
+ *  - With C++20, Request is awaitable in coroutines, co_await returns a
+ *    CO::Reply with result and value. CO::Task<T> is a coroutine, which
+ *    may itself be awaited, so steps like "move joints", "wait for button"
+ *    are written as plain functions. CO::spawn() starts a Task, which runs
+ *    alongside the others. loop.sleep(ms) suspends a coroutine, timers are
+ *    in the same epoll_wait() as the sockets, so there are no busy loops.
+ *
+ * Example:
+ *   CO::EventLoop loop;
+ *   CO::AsyncODclient od(loop);
+ *   od.open();
+ *
+ *   CO::Task<> telemetry(CO::AsyncODclient &od, CO::EventLoop &loop) {
+ *       for(;;) {
+ *           auto lhip = od.read<CO::drive::positionActual>(1);
+ *           auto lknee = od.read<CO::drive::positionActual>(2);
+ *           CO::Reply<int32_t> p1 = co_await lhip, p2 = co_await lknee;
+ *           if(p1 && p2)
+ *               printf("%d %d\n", p1.value, p2.value);
+ *           co_await loop.sleep(100);
+ *       }
+ *   }
+ *
+ *   CO::spawn(telemetry(od, loop));
+ *   loop.run();
+ *
+ * With canopend -V (virtual time, see CO_clock.h) timers may follow the
+ * simulation: loop.setClock(simClock) with a CO::SimClock. epoll_wait() then
+ * polls every few ms of real time, so timers expire with that resolution.
+ *
+ * Everything runs in the thread of loop.run(), objects here are not thread
+ * safe. Callbacks and coroutines must not block. gcc 12 miscompiles
+ * co_await in a while condition, assign the result to a variable first.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_OD_CLIENT_ASYNC_HPP
+#define CO_OD_CLIENT_ASYNC_HPP
+
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include "CO_ODclient.hpp"
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#define CO_ODCLIENT_COROUTINES      1
+#endif
+
+
+/* Maximum number of events handled by one epoll_wait(). */
+#ifndef CO_EVENTLOOP_MAX_EVENTS
+#define CO_EVENTLOOP_MAX_EVENTS     16
+#endif
+
+/* Longest epoll_wait() in real ms, when the clock is set by setClock(). */
+#ifndef CO_EVENTLOOP_POLL_MS
+#define CO_EVENTLOOP_POLL_MS        1
+#endif
+
+/* Default simulation socket of canopend -V. */
+#ifndef CO_SIM_SOCKET
+#define CO_SIM_SOCKET               "/tmp/CO_sim_socket"
+#endif
+
+
+namespace CO {
+
+/**
+ * Single threaded event loop with file descriptors and timers.
+ */
+class EventLoop {
+public:
+    /** Handle of a timer, for cancel(). */
+    typedef std::pair<uint64_t, uint64_t> Timer;
+
+    EventLoop() : epfd(epoll_create1(EPOLL_CLOEXEC)), timerId(0), stopped(false) {}
+    ~EventLoop() {
+        if (epfd >= 0)
+            ::close(epfd);
+    }
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /** CLOCK_MONOTONIC in milliseconds. */
+    static uint64_t monotonic() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    /** Time of timers in milliseconds, monotonic() or the clock set. */
+    uint64_t now() const {
+        return clock ? clock() : monotonic();
+    }
+
+    /**
+     * Use clock in milliseconds for timers instead of monotonic(), for
+     * example a SimClock. Set it before timers are added. Empty function
+     * restores monotonic().
+     */
+    void setClock(std::function<uint64_t()> ms) {
+        clock = std::move(ms);
+    }
+
+    /**
+     * Call fn with epoll events, when fd is ready. Calling it again for the
+     * same fd changes events and fn.
+     *
+     * @return 0 on success, -1 on error (errno is set).
+     */
+    int watch(int fd, uint32_t events, std::function<void(uint32_t)> fn) {
+        struct epoll_event ev;
+        bool known = fds.count(fd) > 0;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) != 0)
+            return -1;
+        fds[fd] = std::move(fn);
+        return 0;
+    }
+
+    void unwatch(int fd) {
+        if (fds.erase(fd) > 0)
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    }
+
+    /** Call fn once, after ms milliseconds. */
+    Timer after(uint64_t ms, std::function<void()> fn) {
+        Timer t(now() + ms, ++timerId);
+        timers[t] = std::move(fn);
+        return t;
+    }
+
+    /** Call fn from the loop, after the current callback returns. */
+    Timer post(std::function<void()> fn) {
+        return after(0, std::move(fn));
+    }
+
+    /** Cancel timer, which did not expire yet. */
+    void cancel(const Timer &t) {
+        timers.erase(t);
+    }
+
+    /**
+     * Process events until stop() is called or there is nothing to wait for
+     * (no file descriptors and no timers).
+     *
+     * @return 0 after stop() or when idle, -1 on epoll error.
+     */
+    int run() {
+        stopped = false;
+        while (!stopped) {
+            struct epoll_event ev[CO_EVENTLOOP_MAX_EVENTS];
+            int timeout = -1;
+            int n, i;
+
+            if (fds.empty() && timers.empty())
+                return 0;
+            if (!timers.empty()) {
+                uint64_t t = now();
+                uint64_t first = timers.begin()->first.first;
+                timeout = first > t ? (int)(first - t) : 0;
+            }
+            /* Other clock does not advance with the real time */
+            if (clock && (timeout < 0 || timeout > CO_EVENTLOOP_POLL_MS))
+                timeout = CO_EVENTLOOP_POLL_MS;
+
+            n = epoll_wait(epfd, ev, CO_EVENTLOOP_MAX_EVENTS, timeout);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            for (i = 0; i < n && !stopped; i++) {
+                auto it = fds.find(ev[i].data.fd);
+                if (it != fds.end()) {
+                    /* fn may unwatch its own fd */
+                    std::function<void(uint32_t)> fn = it->second;
+                    fn(ev[i].events);
+                }
+            }
+            runTimers();
+        }
+        return 0;
+    }
+
+    /** Return from run() after the current callback. */
+    void stop() {
+        stopped = true;
+    }
+
+#ifdef CO_ODCLIENT_COROUTINES
+    /** Awaitable, which resumes the coroutine after ms milliseconds. */
+    struct Sleep {
+        EventLoop &loop;
+        uint64_t ms;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            loop.after(ms, [h]() { h.resume(); });
+        }
+        void await_resume() const noexcept {}
+    };
+
+    /** co_await loop.sleep(ms) */
+    Sleep sleep(uint64_t ms) {
+        return Sleep{*this, ms};
+    }
+#endif
+
+private:
+    /* Timers may add or cancel timers, so take one at a time. */
+    void runTimers() {
+        uint64_t t = now();
+
+        while (!stopped && !timers.empty() && timers.begin()->first.first <= t) {
+            std::function<void()> fn = std::move(timers.begin()->second);
+            timers.erase(timers.begin());
+            fn();
+        }
+    }
+
+    int epfd;
+    std::map<int, std::function<void(uint32_t)> > fds;
+    std::map<Timer, std::function<void()> > timers;
+    uint64_t timerId;
+    bool stopped;
+    std::function<uint64_t()> clock;
+};
+
+
+/**
+ * Virtual time of canopend -V in milliseconds, read on its simulation
+ * socket. Copies share the connection. Pass to EventLoop::setClock().
+ */
+class SimClock {
+public:
+    SimClock() : conn(std::make_shared<Conn>()) {}
+
+    /** @return 0 on success, -1 on error (errno is set). */
+    int open(const char *path = CO_SIM_SOCKET) {
+        struct sockaddr_un addr;
+
+        close();
+        conn->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (conn->fd < 0)
+            return -1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        if (connect(conn->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            close();
+            return -1;
+        }
+        return 0;
+    }
+
+    void close() {
+        if (conn->fd >= 0) {
+            ::close(conn->fd);
+            conn->fd = -1;
+        }
+    }
+
+    /** Virtual time in ms, last known time if canopend does not respond. */
+    uint64_t operator()() const {
+        char buf[32];
+        size_t n = 0;
+
+        if (conn->fd < 0 || ::write(conn->fd, "time\n", 5) != 5)
+            return conn->last;
+        while (n < sizeof(buf) - 1) {
+            if (::read(conn->fd, &buf[n], 1) != 1)
+                return conn->last;
+            if (buf[n] == '\n')
+                break;
+            n++;
+        }
+        buf[n] = 0;
+        conn->last = strtoull(buf, NULL, 10) / 1000000;
+        return conn->last;
+    }
+
+private:
+    struct Conn {
+        int fd = -1;
+        uint64_t last = 0;
+        ~Conn() {
+            if (fd >= 0)
+                ::close(fd);
+        }
+    };
+    std::shared_ptr<Conn> conn;
+};
+
+
+/**
+ * Result of a request: 0 on success, SDO abort code, CO_CMDPOOL_ERR_* or
+ * CO_ODCLIENT_ERR_CONNECTION. Value is valid on success.
+ */
+template<typename T>
+struct Reply {
+    uint32_t result;
+    T value;
+
+    explicit operator bool() const { return result == 0; }
+};
+
+
+/**
+ * Future of one request. Copies refer to the same request. Only one
+ * callback (or awaiting coroutine) is kept, then() replaces the previous.
+ */
+template<typename T>
+class Request {
+public:
+    typedef std::function<void(const Reply<T> &)> Callback;
+
+    bool ready() const { return state->done; }
+
+    /** Reply, valid if ready(). */
+    const Reply<T> &get() const { return state->reply; }
+
+    /** Call cb with the reply, now if ready(), otherwise when it arrives. */
+    void then(Callback cb) {
+        if (state->done)
+            cb(state->reply);
+        else
+            state->callback = std::move(cb);
+    }
+
+#ifdef CO_ODCLIENT_COROUTINES
+    bool await_ready() const noexcept { return state->done; }
+    void await_suspend(std::coroutine_handle<> h) {
+        state->callback = [h](const Reply<T> &) { h.resume(); };
+    }
+    Reply<T> await_resume() const { return state->reply; }
+#endif
+
+private:
+    friend class AsyncODclient;
+
+    struct State {
+        bool done;
+        Reply<T> reply;
+        Callback callback;
+    };
+
+    Request() : state(std::make_shared<State>()) {
+        state->done = false;
+        state->reply.result = 0;
+        state->reply.value = T();
+    }
+
+    void complete(uint32_t result, T value) {
+        Callback cb;
+
+        state->done = true;
+        state->reply.result = result;
+        if (result == 0)
+            state->reply.value = value;
+        cb.swap(state->callback);
+        if (cb)
+            cb(state->reply);
+    }
+
+    std::shared_ptr<State> state;
+};
+
+
+/**
+ * Non-blocking client of the parallel command interface in binary mode.
+ */
+class AsyncODclient {
+public:
+    explicit AsyncODclient(EventLoop &loop) : loop(loop), fd(-1), connection(0), sequence(0), flushPosted(false) {}
+
+    /* Requests still pending are dropped without callback. Destroy before
+     * the loop. */
+    ~AsyncODclient() {
+        if (flushPosted)
+            loop.cancel(flushTimer);
+        pending.clear();
+        close();
+    }
+
+    AsyncODclient(const AsyncODclient &) = delete;
+    AsyncODclient &operator=(const AsyncODclient &) = delete;
+
+    /**
+     * Connect to canopend and select binary mode. Connecting blocks shortly,
+     * the socket is non-blocking afterwards.
+     *
+     * @return 0 on success, -1 on error (errno is set).
+     */
+    int open(const char *path = CO_ODCLIENT_SOCKET) {
+        struct sockaddr_un addr;
+        uint8_t magic = CO_CMDPOOL_BIN_MAGIC;
+
+        close();
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+            || send(fd, &magic, 1, MSG_NOSIGNAL) != 1
+            || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0
+            || loop.watch(fd, EPOLLIN, [this](uint32_t events) { onEvents(events); }) != 0) {
+            int err = errno;
+            ::close(fd);
+            fd = -1;
+            errno = err;
+            return -1;
+        }
+        connection++;
+        return 0;
+    }
+
+    /** Close connection, pending requests complete with CO_ODCLIENT_ERR_CONNECTION. */
+    void close() {
+        std::unordered_map<uint32_t, std::function<void(uint32_t, uint32_t)> > failed;
+
+        if (fd >= 0) {
+            loop.unwatch(fd);
+            ::close(fd);
+        }
+        fd = -1;
+        txBuf.clear();
+        rxBuf.clear();
+        failed.swap(pending);
+        for (auto &p : failed)
+            p.second(CO_ODCLIENT_ERR_CONNECTION, 0);
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    /** Number of requests waiting for response. */
+    size_t inFlight() const { return pending.size(); }
+
+    /** Read entry E of node. */
+    template<class E>
+    Request<typename E::type> read(uint8_t node) {
+        return readAt<typename E::type>(node, E::index, E::subIndex);
+    }
+
+    /** Write entry E of node, reply value is the written value. */
+    template<class E>
+    Request<typename E::type> write(uint8_t node, typename E::type value) {
+        return writeAt<typename E::type>(node, E::index, E::subIndex, value);
+    }
+
+    /** Same as read() with index known at runtime only. */
+    template<typename T>
+    Request<T> readAt(uint8_t node, uint16_t index, uint8_t sub) {
+        ODentry<0, 0, T> check;
+        Request<T> req;
+        (void)check;
+        request(CO_CMDPOOL_BIN_READ, node, index, sub, sizeof(T), 0,
+             [req](uint32_t result, uint32_t raw) mutable { req.complete(result, static_cast<T>(raw)); });
+        return req;
+    }
+
+    /** Same as write() with index known at runtime only. */
+    template<typename T>
+    Request<T> writeAt(uint8_t node, uint16_t index, uint8_t sub, T value) {
+        ODentry<0, 0, T> check;
+        Request<T> req;
+        (void)check;
+        request(CO_CMDPOOL_BIN_WRITE, node, index, sub, sizeof(T), (uint32_t)value,
+             [req, value](uint32_t result, uint32_t) mutable { req.complete(result, value); });
+        return req;
+    }
+
+    /** Priority of the SDO requests of this connection, ODclient::PRIO_*. */
+    Request<uint8_t> setPriority(ODclient::Priority priority) {
+        Request<uint8_t> req;
+        request(CO_CMDPOOL_BIN_PRIORITY, 0, 0, 0, 1, priority,
+             [req, priority](uint32_t result, uint32_t) mutable { req.complete(result, (uint8_t)priority); });
+        return req;
+    }
+
+private:
+    typedef std::function<void(uint32_t result, uint32_t raw)> Done;
+
+    void request(uint8_t op, uint8_t node, uint16_t index, uint8_t sub, uint8_t size,
+              uint32_t value, Done done) {
+        CO_cmdPoolBinReq_t req;
+
+        if (fd < 0) {
+            done(CO_ODCLIENT_ERR_CONNECTION, 0);
+            return;
+        }
+        req.sequence = ++sequence;
+        req.op = op;
+        req.nodeId = node;
+        req.index = index;
+        req.subIndex = sub;
+        req.size = size;
+        req.reserved[0] = req.reserved[1] = 0;
+        req.data[0] = (uint8_t)value;
+        req.data[1] = (uint8_t)(value >> 8);
+        req.data[2] = (uint8_t)(value >> 16);
+        req.data[3] = (uint8_t)(value >> 24);
+        pending[req.sequence] = std::move(done);
+
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(&req);
+        txBuf.insert(txBuf.end(), p, p + sizeof(req));
+
+        /* Send all requests of this loop iteration together */
+        if (!flushPosted) {
+            flushPosted = true;
+            flushTimer = loop.post([this]() { flushPosted = false; flush(); });
+        }
+    }
+
+    void flush() {
+        size_t sent = 0;
+
+        while (fd >= 0 && sent < txBuf.size()) {
+            ssize_t n = ::send(fd, txBuf.data() + sent, txBuf.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0) {
+                close();
+                return;
+            }
+            sent += n;
+        }
+        if (fd < 0)
+            return;
+        txBuf.erase(txBuf.begin(), txBuf.begin() + sent);
+        loop.watch(fd, txBuf.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT,
+                   [this](uint32_t events) { onEvents(events); });
+    }
+
+    void onEvents(uint32_t events) {
+        if (events & EPOLLOUT)
+            flush();
+        if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && fd >= 0)
+            receive();
+    }
+
+    void receive() {
+        uint8_t buf[CO_ODCLIENT_MAX_PENDING * sizeof(CO_cmdPoolBinResp_t)];
+        std::vector<uint8_t> data;
+        uint32_t conn = connection;
+        size_t pos = 0;
+
+        for (;;) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0) {
+                close();
+                return;
+            }
+            rxBuf.insert(rxBuf.end(), buf, buf + n);
+        }
+
+        /* Callbacks may send, close and reopen, or resume coroutines, which
+         * do that */
+        data.swap(rxBuf);
+        while (connection == conn && fd >= 0 && data.size() - pos >= sizeof(CO_cmdPoolBinResp_t)) {
+            CO_cmdPoolBinResp_t resp;
+            uint32_t raw = 0;
+            int i;
+
+            memcpy(&resp, data.data() + pos, sizeof(resp));
+            pos += sizeof(resp);
+
+            auto it = pending.find(resp.sequence);
+            if (it == pending.end())
+                continue;
+            Done done = std::move(it->second);
+            pending.erase(it);
+            for (i = resp.size - 1; i >= 0 && i < 4; i--)
+                raw = (raw << 8) | resp.data[i];
+            done(resp.result, raw);
+        }
+        if (connection == conn && fd >= 0)
+            rxBuf.assign(data.begin() + pos, data.end());
+    }
+
+    EventLoop &loop;
+    int fd;
+    uint32_t connection;        /* Incremented by each open() */
+    uint32_t sequence;
+    bool flushPosted;
+    EventLoop::Timer flushTimer;
+    std::unordered_map<uint32_t, Done> pending;
+    std::vector<uint8_t> txBuf;
+    std::vector<uint8_t> rxBuf;
+};
+
+
+#ifdef CO_ODCLIENT_COROUTINES
+
+template<typename T = void> class Task;
+inline void spawn(Task<void> task);
+
+namespace detail {
+    struct TaskPromiseBase {
+        std::coroutine_handle<> continuation;
+        bool detached = false;
+
+        /* Tasks start, when awaited or spawned */
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            template<class P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                TaskPromiseBase &p = h.promise();
+                if (p.continuation)
+                    return p.continuation;
+                if (p.detached)
+                    h.destroy();
+                return std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        /* No exceptions in this code base */
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    template<typename T>
+    struct TaskPromise : TaskPromiseBase {
+        T value{};
+
+        Task<T> get_return_object();
+        void return_value(T v) { value = std::move(v); }
+        T result() { return std::move(value); }
+    };
+
+    template<>
+    struct TaskPromise<void> : TaskPromiseBase {
+        Task<void> get_return_object();
+        void return_void() {}
+        void result() {}
+    };
+}
+
+/**
+ * Coroutine, which returns T. It starts, when it is awaited (and the
+ * awaiting coroutine continues after co_return) or passed to spawn().
+ */
+template<typename T>
+class Task {
+public:
+    typedef detail::TaskPromise<T> promise_type;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task &&t) noexcept : handle(std::exchange(t.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept {
+        handle.promise().continuation = h;
+        return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+
+private:
+    friend void spawn(Task<void> task);
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+}
+
+/**
+ * Start task, which runs until its first co_await and then continues from
+ * the event loop. It frees itself, when it finishes.
+ */
+inline void spawn(Task<void> task) {
+    std::coroutine_handle<detail::TaskPromise<void> > h = std::exchange(task.handle, nullptr);
+    h.promise().detached = true;
+    h.resume();
+}
+
+#endif /* CO_ODCLIENT_COROUTINES */
+
+}
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Lock-free snapshot of PDO mapped Object Dictionary variables.
+ *
+ * @file        CO_ODsnapshot.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_ODsnapshot.h"
+#include "CO_lockStats.h"
+#include "CO_CANbus.h"
+#include "CO_clock.h"
+#include <stdio.h>
+#include <string.h>
+
+
+#define NO_PDO              (CO_NO_RPDO + CO_NO_TPDO)
+#define BUF_SIZE            (NO_PDO * 8)    /* Each mapped byte at most once */
+
+/* Consecutive bytes of the Object Dictionary, copied to buf[offset]. */
+typedef struct {
+    const uint8_t      *od;
+    uint16_t            offset;
+    uint16_t            len;
+} range_t;
+
+/* Written by the RT thread only */
+static uint8_t             *mapPtr[NO_PDO][8]; /* Mapping of the last rebuild */
+static range_t              ranges[BUF_SIZE];
+static uint16_t             rangeCount = 0;
+static uint8_t              buf[BUF_SIZE];
+static uint8_t              bytePdo[BUF_SIZE];  /* PDO of each byte in buf, RPDO first */
+static uint64_t             pdoTime_ns[NO_PDO];
+static uint64_t             cycleTime_ns = 0;
+static const CO_CANbatch_t *rxBatch = NULL;
+static uint32_t             seq = 0;        /* Odd while updating */
+static uint32_t             updates = 0;
+static uint32_t             skipped = 0;    /* OD was locked by other thread */
+static uint32_t             rebuilds = 0;
+
+/* Written by readers */
+static uint32_t             retries = 0;
+static uint32_t             failures = 0;
+
+
+/* Mapping of PDO i, NULL pointers for invalid PDOs and unused bytes. */
+static void getMapping(int i, uint8_t *ptr[8]) {
+    uint8_t len = 0;
+    uint8_t * const *mp = NULL;
+    int j;
+
+    if(i < CO_NO_RPDO) {
+        if(CO->RPDO[i]->valid) {
+            len = CO->RPDO[i]->dataLength;
+            mp = CO->RPDO[i]->mapPointer;
+        }
+    }
+    else if(CO->TPDO[i - CO_NO_RPDO]->valid) {
+        len = CO->TPDO[i - CO_NO_RPDO]->dataLength;
+        mp = CO->TPDO[i - CO_NO_RPDO]->mapPointer;
+    }
+    for(j=0; j<8; j++) {
+        ptr[j] = (j < len) ? mp[j] : NULL;
+    }
+}
+
+
+/* Update mapPtr, return true if PDO mapping changed. */
+static bool_t mappingChanged(void) {
+    bool_t changed = false;
+    int i;
+
+    for(i=0; i<NO_PDO; i++) {
+        uint8_t *ptr[8];
+
+        getMapping(i, ptr);
+        if(memcmp(ptr, mapPtr[i], sizeof(ptr)) != 0) {
+            memcpy(mapPtr[i], ptr, sizeof(ptr));
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+/* Sort mapped bytes and join consecutive ones into ranges. */
+static void rebuildRanges(void) {
+    uint8_t *bytes[BUF_SIZE];
+    uint8_t pdos[BUF_SIZE];
+    int n = 0, i, j;
+
+    for(i=0; i<NO_PDO; i++) {
+        for(j=0; j<8; j++) {
+            uint8_t *p = mapPtr[i][j];
+            int k;
+
+            if(p == NULL) {
+                continue;
+            }
+            /* Insertion sort, without duplicates */
+            for(k=n; k>0 && bytes[k-1] > p; k--);
+            if(k > 0 && bytes[k-1] == p) {
+                continue;
+            }
+            memmove(&bytes[k+1], &bytes[k], (n - k) * sizeof(bytes[0]));
+            memmove(&pdos[k+1], &pdos[k], (n - k) * sizeof(pdos[0]));
+            bytes[k] = p;
+            pdos[k] = i;
+            n++;
+        }
+    }
+
+    rangeCount = 0;
+    for(i=0; i<n; i++) {
+        range_t *r = &ranges[rangeCount];
+
+        bytePdo[i] = pdos[i];
+        if(rangeCount > 0 && bytes[i] == r[-1].od + r[-1].len) {
+            r[-1].len++;
+        }
+        else {
+            r->od = bytes[i];
+            r->offset = i;
+            r->len = 1;
+            rangeCount++;
+        }
+    }
+    rebuilds++;
+}
+
+
+/* Receive time of RPDO i, 0 if no frame yet. */
+static uint64_t rpdoTime(int i) {
+    uint64_t t = CO_CANbatch_rxTime(rxBatch, CO->RPDO[i]);
+
+    return (t != 0) ? t : CO_CANbus_rxTime(CO->RPDO[i]);
+}
+
+
+/******************************************************************************/
+void CO_ODsnapshot_bind(const CO_CANbatch_t *batch) {
+    rxBatch = batch;
+}
+
+
+/******************************************************************************/
+void CO_ODsnapshot_update(void) {
+    uint64_t now = CO_clock_tickNs();
+    int i;
+
+    /* Never wait for other threads, snapshot is one cycle older then. */
+    if(CO_lockStats_trylock(&CO_lockStats_OD) != 0) {
+        skipped++;
+        return;
+    }
+
+    __atomic_store_n(&seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if(mappingChanged()) {
+        rebuildRanges();
+    }
+    for(i=0; i<rangeCount; i++) {
+        memcpy(&buf[ranges[i].offset], ranges[i].od, ranges[i].len);
+    }
+    for(i=0; i<NO_PDO; i++) {
+        pdoTime_ns[i] = (i < CO_NO_RPDO) ? rpdoTime(i) : now;
+    }
+    cycleTime_ns = now;
+
+    __atomic_store_n(&seq, seq + 1, __ATOMIC_RELEASE);
+    CO_lockStats_unlock(&CO_lockStats_OD);
+    updates++;
+}
+
+
+/* Find variable in the ranges, copy it and its time, if time_ns is not
+ * NULL. Result is valid only, if seq did not change meanwhile. */
+static bool_t copyVar(void *dst, const uint8_t *p, size_t len, uint64_t *time_ns) {
+    uint16_t n = __atomic_load_n(&rangeCount, __ATOMIC_RELAXED);
+    int i;
+
+    for(i=0; i<n && i<BUF_SIZE; i++) {
+        range_t r = ranges[i];
+
+        if(p >= r.od && p + len <= r.od + r.len && r.offset + r.len <= BUF_SIZE) {
+            memcpy(dst, &buf[r.offset + (p - r.od)], len);
+            if(time_ns != NULL) {
+                *time_ns = pdoTime_ns[bytePdo[r.offset + (p - r.od)] % NO_PDO];
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/******************************************************************************/
+bool_t CO_ODsnapshot_read(void *dst, const void *odAddress, size_t len) {
+    return CO_ODsnapshot_readStamped(dst, odAddress, len, NULL);
+}
+
+
+/******************************************************************************/
+bool_t CO_ODsnapshot_readStamped(void *dst, const void *odAddress, size_t len, uint64_t *time_ns) {
+    int retry;
+
+    for(retry=0; retry<CO_OD_SNAPSHOT_RETRIES; retry++) {
+        uint32_t s = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+        bool_t found;
+
+        if(s == 0) {
+            return false;
+        }
+        if((s & 1) == 0) {
+            found = copyVar(dst, odAddress, len, time_ns);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&seq, __ATOMIC_RELAXED) == s) {
+                return found;
+            }
+        }
+        __atomic_fetch_add(&retries, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+
+/******************************************************************************/
+uint64_t CO_ODsnapshot_time(void) {
+    int retry;
+
+    for(retry=0; retry<CO_OD_SNAPSHOT_RETRIES; retry++) {
+        uint32_t s = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+        uint64_t t = cycleTime_ns;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if((s & 1) == 0 && __atomic_load_n(&seq, __ATOMIC_RELAXED) == s) {
+            return t;
+        }
+    }
+    return CO_clock_tickNs();
+}
+
+
+/******************************************************************************/
+uint32_t CO_ODsnapshot_cycle(void) {
+    return __atomic_load_n(&seq, __ATOMIC_ACQUIRE) / 2;
+}
+
+
+/******************************************************************************/
+void CO_ODsnapshot_printStats(const char *name) {
+    printf("%s - %u updates, %u skipped (OD locked), %u mapping changes, %u PDO mapped bytes in %u ranges, %u reader retries, %u failed reads\n",
+           name, updates, skipped, rebuilds, rangeCount > 0 ? ranges[rangeCount-1].offset + ranges[rangeCount-1].len : 0,
+           rangeCount, retries, failures);
+}
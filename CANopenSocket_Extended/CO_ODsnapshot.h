@@ -0,0 +1,107 @@
+/*
+ * Lock-free snapshot of PDO mapped Object Dictionary variables.
+ *
+ * @file        CO_ODsnapshot.h
+ *
+ * Positions, statuswords and other PDO mapped variables are read often by
+ * loggers and clients, which would otherwise take CO_LOCK_OD() each time and
+ * delay the RT thread. Here the RT thread copies all variables mapped to
+ * valid RPDOs and TPDOs into a buffer after each PDO processing, protected
+ * by a sequence counter (seqlock). Readers never lock: they copy from the
+ * buffer and retry, if the sequence counter changed meanwhile. All values
+ * in one snapshot are from the same RT cycle.
+ *
+ * Mapped ranges are found from the mapPointer of the PDO objects and are
+ * rebuilt, when PDO mapping changes. Variables, which are not mapped, are
+ * not in the snapshot.
+ *
+ * Each snapshot carries the time of its RT cycle and, for each RPDO, the
+ * kernel receive time of its last frame, both in CO_clock_ns() timebase.
+ * CO_ODsnapshot_readStamped() returns the value with the receive time of
+ * the RPDO, which carries it, or with the cycle time for TPDO variables.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_OD_SNAPSHOT_H
+#define CO_OD_SNAPSHOT_H
+
+#include "CANopen.h"
+#include "CO_CANbatch.h"
+
+
+/* Number of retries of a reader, before it gives up. */
+#ifndef CO_OD_SNAPSHOT_RETRIES
+#define CO_OD_SNAPSHOT_RETRIES      100
+#endif
+
+
+/**
+ * Copy PDO mapped variables to the snapshot. Call from the RT thread after
+ * each CANrx_taskTmr_process(), which processed the timer. If OD is locked
+ * by other thread, RT thread does not wait and snapshot is updated in the
+ * next cycle.
+ */
+void CO_ODsnapshot_update(void);
+
+
+/**
+ * Set batched receive of the CANopen interface, which has receive times of
+ * the RPDOs. RPDOs on additional interfaces are found with
+ * CO_CANbus_rxTime(). Call after each CO_CANbatch_init().
+ *
+ * @param batch Batch of CO->CANmodule[0] or NULL.
+ */
+void CO_ODsnapshot_bind(const CO_CANbatch_t *batch);
+
+
+/**
+ * Read variable from the snapshot without locking. May be called from any
+ * thread.
+ *
+ * @param dst Destination.
+ * @param odAddress Address of the variable in the Object Dictionary, for
+ * example &OD_actualMotorPositions.motor1.
+ * @param len Size of the variable.
+ *
+ * @return True on success. False, if variable is not PDO mapped, snapshot
+ * is not ready or RT thread updated it too often.
+ */
+bool_t CO_ODsnapshot_read(void *dst, const void *odAddress, size_t len);
+
+
+/**
+ * The same as CO_ODsnapshot_read(), with the time of the value.
+ *
+ * @param time_ns Receive time of the RPDO with the variable (0 if none was
+ * received yet) or time of the RT cycle for TPDO variables. May be NULL.
+ */
+bool_t CO_ODsnapshot_readStamped(void *dst, const void *odAddress, size_t len, uint64_t *time_ns);
+
+
+/**
+ * Time of the RT cycle of the last complete snapshot in CO_clock_ns()
+ * timebase. With CO_ODsnapshot_cycle() it belongs to the values read in
+ * between.
+ */
+uint64_t CO_ODsnapshot_time(void);
+
+
+/**
+ * Number of the last complete snapshot, incremented by each update. To read
+ * several variables from the same RT cycle, read them again if the number
+ * changed meanwhile.
+ */
+uint32_t CO_ODsnapshot_cycle(void);
+
+
+/**
+ * Print statistics (updates, skipped updates, reader retries) to stdout.
+ *
+ * @param name Prefix of the line.
+ */
+void CO_ODsnapshot_printStats(const char *name);
+
+
+#endif
@@ -0,0 +1,348 @@
+/*
+ * Pool of CANopen SDO clients, one per remote node.
+ *
+ * @file        CO_SDOclientPool.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_SDOclientPool.h"
+#include "CO_CANbatch.h"
+#include "CO_Linux_tasks.h"
+#include <string.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+
+/* Queue of requests and SDO client for one node */
+typedef struct {
+    uint8_t             nodeId;
+    CO_SDOclientPar_t   par;
+    CO_SDOclient_t      client;
+    bool_t              busy;       /* queue[head] is being transferred */
+    uint8_t             head;
+    uint8_t             count;
+    CO_SDOpool_req_t    queue[CO_SDO_POOL_QUEUE_SIZE];
+} CO_SDOpool_node_t;
+
+
+/* CANmodule of the pool on one CAN interface */
+typedef struct {
+    int32_t             CANbaseAddress;
+    uint8_t             count;      /* number of nodes on this interface */
+    bool_t              enabled;    /* CANmodule is initialized */
+    CO_CANmodule_t      CANmodule;
+    CO_CANbatch_t       CANbatch;
+    CO_CANrx_t          CANrx[CO_SDO_POOL_SIZE];
+    CO_CANtx_t          CANtx[CO_SDO_POOL_SIZE];
+} CO_SDOpool_bus_t;
+
+
+static CO_SDOpool_bus_t     poolBuses[CO_SDO_POOL_BUSES];
+static uint8_t              poolBusCount = 0;
+static CO_SDOpool_node_t    poolNodes[CO_SDO_POOL_SIZE];
+static CO_SDOpool_node_t   *poolIndex[128];     /* node-ID to node lookup */
+static uint8_t              poolCount = 0;
+static bool_t               poolInitialized = false;
+static uint16_t             poolTmrPrev = 0;
+static pthread_mutex_t      poolMtx = PTHREAD_MUTEX_INITIALIZER;
+
+
+static CO_SDOpool_node_t *findNode(uint8_t nodeId) {
+    return (nodeId < 128) ? poolIndex[nodeId] : NULL;
+}
+
+
+/* Release CANmodules after failed initialization or on delete. */
+static void poolBusesDisable(void) {
+    int b;
+
+    for(b=0; b<poolBusCount; b++) {
+        if(poolBuses[b].enabled) {
+            CO_CANmodule_disable(&poolBuses[b].CANmodule);
+        }
+        poolBuses[b].enabled = false;
+    }
+    poolBusCount = 0;
+    memset(poolIndex, 0, sizeof(poolIndex));
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_SDOpool_init(
+        const int32_t           CANbaseAddress[],
+        const uint8_t           nodeIds[],
+        uint8_t                 count,
+        int                     fdEpoll)
+{
+    CO_ReturnError_t err;
+    uint8_t busOfNode[CO_SDO_POOL_SIZE];
+    int i, b;
+
+    if(CANbaseAddress == NULL || nodeIds == NULL || count == 0 || count > CO_SDO_POOL_SIZE
+       || poolInitialized) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    /* Group nodes by CAN interface */
+    poolBusCount = 0;
+    for(i=0; i<count; i++) {
+        for(b=0; b<poolBusCount && poolBuses[b].CANbaseAddress != CANbaseAddress[i]; b++);
+        if(b == poolBusCount) {
+            if(poolBusCount == CO_SDO_POOL_BUSES) {
+                return CO_ERROR_ILLEGAL_ARGUMENT;
+            }
+            poolBuses[b].CANbaseAddress = CANbaseAddress[i];
+            poolBuses[b].count = 0;
+            poolBuses[b].enabled = false;
+            poolBusCount++;
+        }
+        busOfNode[i] = b;
+        poolBuses[b].count++;
+    }
+
+    for(b=0; b<poolBusCount; b++) {
+        CO_SDOpool_bus_t *bus = &poolBuses[b];
+
+        err = CO_CANmodule_init(&bus->CANmodule, bus->CANbaseAddress, bus->CANrx, bus->count,
+                                bus->CANtx, bus->count, OD_CANBitRate);
+        if(err != CO_ERROR_NO) {
+            poolBusesDisable();
+            return err;
+        }
+        bus->enabled = true;
+        bus->count = 0;     /* counts nodes again, as buffer index */
+    }
+
+    for(i=0; i<count; i++) {
+        CO_SDOpool_node_t *node = &poolNodes[i];
+        CO_SDOpool_bus_t *bus = &poolBuses[busOfNode[i]];
+
+        if(nodeIds[i] < 1 || nodeIds[i] > 127 || poolIndex[nodeIds[i]] != NULL) {
+            poolBusesDisable();
+            return CO_ERROR_ILLEGAL_ARGUMENT;
+        }
+
+        memset(node, 0, sizeof(*node));
+        node->nodeId = nodeIds[i];
+        node->par.maxSubIndex = 3;
+        node->par.COB_IDClientToServer = 0x600 + node->nodeId;
+        node->par.COB_IDServerToClient = 0x580 + node->nodeId;
+        node->par.nodeIDOfTheSDOServer = node->nodeId;
+
+        err = CO_SDOclient_init(&node->client, CO->SDO[0], &node->par,
+                                &bus->CANmodule, bus->count, &bus->CANmodule, bus->count);
+        if(err == CO_ERROR_NO && CO_SDOclient_setup(&node->client,
+                node->par.COB_IDClientToServer, node->par.COB_IDServerToClient,
+                node->nodeId) != CO_SDOcli_ok_communicationEnd)
+        {
+            err = CO_ERROR_ILLEGAL_ARGUMENT;
+        }
+        if(err != CO_ERROR_NO) {
+            poolBusesDisable();
+            return err;
+        }
+        bus->count++;
+        poolIndex[node->nodeId] = node;
+    }
+    poolCount = count;
+
+    for(b=0; b<poolBusCount; b++) {
+        CO_SDOpool_bus_t *bus = &poolBuses[b];
+        struct epoll_event ev;
+
+        CO_CANsetNormalMode(&bus->CANmodule);
+        CO_CANbatch_init(&bus->CANbatch, &bus->CANmodule);
+
+        ev.events = EPOLLIN;
+        ev.data.fd = bus->CANmodule.fd;
+        if(epoll_ctl(fdEpoll, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) {
+            poolBusesDisable();
+            return CO_ERROR_SYSCALL;
+        }
+    }
+
+    poolInitialized = true;
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+void CO_SDOpool_delete(void) {
+    int i;
+
+    if(!poolInitialized) {
+        return;
+    }
+
+    pthread_mutex_lock(&poolMtx);
+    for(i=0; i<poolCount; i++) {
+        if(poolNodes[i].busy) {
+            CO_SDOclientClose(&poolNodes[i].client);
+        }
+        poolNodes[i].busy = false;
+        poolNodes[i].count = 0;
+    }
+    poolCount = 0;
+    poolInitialized = false;
+    pthread_mutex_unlock(&poolMtx);
+
+    poolBusesDisable();
+}
+
+
+/******************************************************************************/
+int CO_SDOpool_post(const CO_SDOpool_req_t *req) {
+    CO_SDOpool_node_t *node;
+    int ret = -1;
+
+    if(req == NULL || (!req->upload && (req->dataSize == 0 || req->dataSize > 4))) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&poolMtx);
+    node = findNode(req->nodeId);
+    if(node != NULL && node->count < CO_SDO_POOL_QUEUE_SIZE
+       - ((req->priority > CO_SDO_POOL_PRIO_HIGH) ? CO_SDO_POOL_QUEUE_RESERVED : 0))
+    {
+        /* Insert behind requests with the same or higher priority. Request
+         * in transfer stays at head. */
+        uint8_t pos = node->count;
+        uint8_t first = node->busy ? 1 : 0;
+
+        while(pos > first
+              && node->queue[(node->head + pos - 1) % CO_SDO_POOL_QUEUE_SIZE].priority > req->priority)
+        {
+            node->queue[(node->head + pos) % CO_SDO_POOL_QUEUE_SIZE] =
+                node->queue[(node->head + pos - 1) % CO_SDO_POOL_QUEUE_SIZE];
+            pos--;
+        }
+        node->queue[(node->head + pos) % CO_SDO_POOL_QUEUE_SIZE] = *req;
+        node->count++;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&poolMtx);
+
+    /* Start the transfer in the next mainline wakeup, not on the next timeout */
+    if(ret == 0) {
+        taskMain_cbSignal();
+    }
+
+    return ret;
+}
+
+
+/******************************************************************************/
+bool_t CO_SDOpool_processRx(int fd) {
+    int b;
+
+    if(!poolInitialized) {
+        return false;
+    }
+
+    for(b=0; b<poolBusCount; b++) {
+        if(fd == poolBuses[b].CANmodule.fd) {
+            /* Responses from all drives usually arrive together */
+            CO_CANbatch_rx(&poolBuses[b].CANbatch);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Remove finished request from the queue and inform its owner. */
+static void finishRequest(CO_SDOpool_node_t *node, CO_SDOclient_return_t ret, uint32_t abortCode) {
+    CO_SDOpool_req_t req;
+
+    pthread_mutex_lock(&poolMtx);
+    req = node->queue[node->head];
+    node->head = (node->head + 1) % CO_SDO_POOL_QUEUE_SIZE;
+    node->count--;
+    node->busy = false;
+    pthread_mutex_unlock(&poolMtx);
+
+    if(req.callback != NULL) {
+        req.callback(req.object, &req, ret, abortCode);
+    }
+}
+
+
+/******************************************************************************/
+void CO_SDOpool_process(uint16_t timer1ms) {
+    uint16_t timeDifference_ms;
+    int i;
+
+    if(!poolInitialized) {
+        return;
+    }
+
+    timeDifference_ms = timer1ms - poolTmrPrev;
+    poolTmrPrev = timer1ms;
+
+    /* Don't touch CAN during communication reset. */
+    if(!CO->CANmodule[0]->CANnormal) {
+        return;
+    }
+
+    for(i=0; i<poolCount; i++) {
+        CO_SDOpool_node_t *node = &poolNodes[i];
+        uint16_t dt = timeDifference_ms;
+
+        /* Loop, so local transfers and errors don't wait for next wakeup. */
+        for(;;) {
+            CO_SDOpool_req_t *req;
+            CO_SDOclient_return_t ret;
+            uint32_t abortCode = 0;
+            bool_t start;
+
+            /* Busy head is not moved by CO_SDOpool_post() */
+            pthread_mutex_lock(&poolMtx);
+            req = (node->count > 0) ? &node->queue[node->head] : NULL;
+            start = req != NULL && !node->busy;
+            if(start) {
+                node->busy = true;
+            }
+            pthread_mutex_unlock(&poolMtx);
+
+            if(req == NULL) {
+                break;
+            }
+
+            if(start) {
+                if(req->upload) {
+                    ret = CO_SDOclientUploadInitiate(&node->client, req->index,
+                            req->subIndex, req->data, sizeof(req->data), 0);
+                }
+                else {
+                    ret = CO_SDOclientDownloadInitiate(&node->client, req->index,
+                            req->subIndex, req->data, req->dataSize, 0);
+                }
+                if(ret < 0) {
+                    finishRequest(node, ret, 0);
+                    continue;
+                }
+                dt = 0;
+            }
+
+            if(req->upload) {
+                ret = CO_SDOclientUpload(&node->client, dt, CO_SDO_POOL_TIMEOUT_MS,
+                                         &req->dataSize, &abortCode);
+            }
+            else {
+                ret = CO_SDOclientDownload(&node->client, dt, CO_SDO_POOL_TIMEOUT_MS,
+                                           &abortCode);
+            }
+
+            if(ret > 0) {
+                /* Waiting for the server. */
+                break;
+            }
+
+            CO_SDOclientClose(&node->client);
+            finishRequest(node, ret, abortCode);
+        }
+    }
+}
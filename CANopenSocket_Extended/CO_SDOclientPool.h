@@ -0,0 +1,135 @@
+/*
+ * Pool of CANopen SDO clients, one per remote node.
+ *
+ * @file        CO_SDOclientPool.h
+ *
+ * CANopenNode's CO_init() creates a single SDO client, so transfers to
+ * different nodes are serialized and a slow node stalls the others. This
+ * module owns its own CANmodule on each CAN interface with nodes (see
+ * CO_CANbus.h) and one SDO client per configured node. Requests to different nodes run concurrently,
+ * requests to the same node are queued by priority and run in order within
+ * the same priority. A transfer in progress is not preempted.
+ *
+ * All SDO client processing is done from the mainline thread. Requests may be
+ * posted from any thread.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_SDO_CLIENT_POOL_H
+#define CO_SDO_CLIENT_POOL_H
+
+#include "CANopen.h"
+
+
+/* Maximum number of SDO clients in the pool, one per remote node. Nodes are
+ * configured at runtime, X2 uses node IDs 1..4. */
+#ifndef CO_SDO_POOL_SIZE
+#define CO_SDO_POOL_SIZE            127
+#endif
+
+/* Maximum number of CAN interfaces, on which pool nodes may be. */
+#ifndef CO_SDO_POOL_BUSES
+#define CO_SDO_POOL_BUSES           4
+#endif
+
+/* Number of requests, which may be queued for each node. */
+#ifndef CO_SDO_POOL_QUEUE_SIZE
+#define CO_SDO_POOL_QUEUE_SIZE      16
+#endif
+
+/* Number of queue entries of each node, which only requests with
+ * CO_SDO_POOL_PRIO_HIGH may use, so diagnostics can't block motion commands. */
+#ifndef CO_SDO_POOL_QUEUE_RESERVED
+#define CO_SDO_POOL_QUEUE_RESERVED  4
+#endif
+
+/* Request priorities, lower value is served first. */
+#define CO_SDO_POOL_PRIO_HIGH       0       /* Motion and safety */
+#define CO_SDO_POOL_PRIO_NORMAL     1
+#define CO_SDO_POOL_PRIO_LOW        2       /* Diagnostics */
+
+/* SDO timeout in milliseconds. */
+#ifndef CO_SDO_POOL_TIMEOUT_MS
+#define CO_SDO_POOL_TIMEOUT_MS      500
+#endif
+
+
+/**
+ * SDO request. Only expedited transfers (up to 4 bytes) are supported.
+ */
+typedef struct CO_SDOpool_req {
+    uint8_t             nodeId;     /**< Node-ID of the SDO server. */
+    uint16_t            index;      /**< Object Dictionary index. */
+    uint8_t             subIndex;   /**< Object Dictionary subIndex. */
+    bool_t              upload;     /**< True for read (upload), false for write (download). */
+    uint8_t             data[4];    /**< Data to write or data read (little endian). */
+    uint32_t            dataSize;   /**< Size of data in bytes. For upload it is set on completion. */
+    uint8_t             priority;   /**< CO_SDO_POOL_PRIO_*, 0 is highest. */
+    /**
+     * Called from mainline, when transfer is finished. ret is
+     * CO_SDOcli_ok_communicationEnd on success or negative on error.
+     */
+    void              (*callback)(void *object, const struct CO_SDOpool_req *req,
+                                  CO_SDOclient_return_t ret, uint32_t abortCode);
+    void               *object;     /**< Passed to callback. */
+} CO_SDOpool_req_t;
+
+
+/**
+ * Initialize SDO client pool.
+ *
+ * Must be called once after first CO_init(). Creates own CANmodule on each
+ * used CAN interface and one SDO client for each node.
+ *
+ * @param CANbaseAddress CAN interface index of each node. Up to
+ * CO_SDO_POOL_BUSES different interfaces.
+ * @param nodeIds Node-IDs of SDO servers. Up to CO_SDO_POOL_SIZE.
+ * @param count Number of nodeIds.
+ * @param fdEpoll epoll file descriptor of the mainline. CAN sockets of the
+ * pool are added to it.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_SDOpool_init(
+        const int32_t           CANbaseAddress[],
+        const uint8_t           nodeIds[],
+        uint8_t                 count,
+        int                     fdEpoll);
+
+
+/**
+ * Delete SDO client pool. Queued requests are dropped without callback.
+ */
+void CO_SDOpool_delete(void);
+
+
+/**
+ * Post a request. Thread safe. Request is copied and the mainline is woken
+ * with taskMain_cbSignal(), so it starts the transfer without delay.
+ *
+ * @return 0 on success, -1 if node is not in the pool or its queue is full
+ * (for the priority of the request).
+ */
+int CO_SDOpool_post(const CO_SDOpool_req_t *req);
+
+
+/**
+ * Process CAN reception on the pool sockets. Call from mainline for each
+ * ready file descriptor.
+ *
+ * @return True, if fd was one of the pool CAN sockets and was processed.
+ */
+bool_t CO_SDOpool_processRx(int fd);
+
+
+/**
+ * Advance all SDO clients. Call from mainline on each wakeup.
+ *
+ * @param timer1ms Variable, which increments each millisecond.
+ */
+void CO_SDOpool_process(uint16_t timer1ms);
+
+
+#endif
@@ -0,0 +1,309 @@
+/*
+ * SYNC producer with own timer and phase-locked setpoints.
+ *
+ * @file        CO_SYNCproducer.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_SYNCproducer.h"
+#include "CO_CANbus.h"
+#include "CO_lockStats.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+
+#define IDLE_CHECK_NS       100000000ULL    /* Check 0x1006 and NMT state, while paused */
+
+/* Upper limits of latency histogram bins in microseconds, last bin is above */
+static const uint32_t histLimits_us[CO_SYNC_PRODUCER_HIST - 1] = {10, 20, 50, 100, 200, 500, 1000};
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void armTimer(CO_SYNCproducer_t *sp, uint64_t expire_ns) {
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = expire_ns / 1000000000ULL;
+    its.it_value.tv_nsec = expire_ns % 1000000000ULL;
+    timerfd_settime(sp->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+/* Queue synchronous TPDOs, which are due on the next SYNC. TPDOs of nodes on
+ * additional CAN interfaces are queued on their interface. */
+static void queueSetpoints(CO_SYNCproducer_t *sp) {
+    int i;
+
+    for(i=0; i<CO_NO_TPDO; i++) {
+        CO_TPDO_t *TPDO = CO->TPDO[i];
+        uint8_t type = TPDO->TPDOCommPar->transmissionType;
+        CO_CANbatch_t *busBatch;
+
+        if(!TPDO->valid || type == 0 || type > 240) {
+            continue;
+        }
+        if(++sp->tpdoCounter[i] < type) {
+            continue;
+        }
+        sp->tpdoCounter[i] = 0;
+
+        if(TPDO->CANdevTx == sp->batch->CANmodule) {
+            CO_CANbatch_txQueueTPDO(sp->batch, TPDO);
+        }
+        else if((busBatch = CO_CANbus_batch(TPDO->CANdevTx)) != NULL) {
+            CO_CANbatch_txQueueTPDO(busBatch, TPDO);
+        }
+        else if(*TPDO->operatingState == CO_NMT_OPERATIONAL) {
+            CO_TPDOsend(TPDO);
+        }
+    }
+}
+
+
+/* Queue SYNC message from the buffer of CANopenNode SYNC object. */
+static void queueSync(CO_SYNCproducer_t *sp) {
+    CO_SYNC_t *SYNC = CO->SYNC;
+
+    if(SYNC->counterOverflowValue > 1) {
+        if(++sp->counter > SYNC->counterOverflowValue) {
+            sp->counter = 1;
+        }
+        SYNC->CANtxBuff->data[0] = sp->counter;
+        SYNC->counter = sp->counter;
+    }
+    if(CO_CANbatch_txQueue(sp->batch, SYNC->CANtxBuff) != CO_ERROR_NO) {
+        sp->txErrors++;
+    }
+    /* The same SYNC on additional interfaces, not bridged from this one */
+    CO_CANbus_txQueue(SYNC->CANtxBuff);
+    /* SYNC consumer of CANopenNode does not receive own SYNC, keep its
+     * timeout from expiring. */
+    SYNC->timer = 0;
+}
+
+
+static void recordStats(CO_SYNCproducer_t *sp, uint64_t sent_ns, uint32_t period_us) {
+    uint32_t latency_us = (sent_ns > sp->nextSync_ns) ? (uint32_t)((sent_ns - sp->nextSync_ns) / 1000) : 0;
+    int bin;
+
+    sp->cycles++;
+    if(latency_us < sp->latencyMin_us) sp->latencyMin_us = latency_us;
+    if(latency_us > sp->latencyMax_us) sp->latencyMax_us = latency_us;
+    sp->latencySum_us += latency_us;
+    for(bin=0; bin<CO_SYNC_PRODUCER_HIST-1 && latency_us >= histLimits_us[bin]; bin++);
+    sp->histogram[bin]++;
+
+    /* Jitter only between consecutive cycles */
+    if(sp->lastSent_ns != 0 && sent_ns - sp->lastSent_ns < 2ULL * period_us * 1000) {
+        int64_t dev_ns = (int64_t)(sent_ns - sp->lastSent_ns) - (int64_t)period_us * 1000;
+        uint32_t jitter_us = (uint32_t)((dev_ns < 0 ? -dev_ns : dev_ns) / 1000);
+
+        if(jitter_us > sp->jitterMax_us) sp->jitterMax_us = jitter_us;
+        sp->jitterSum_us += jitter_us;
+        sp->jitterCount++;
+        if(sp->jitter_us != NULL) {
+            sp->jitter_us[0] = (jitter_us > 0xFFFF) ? 0xFFFF : (uint16_t)jitter_us;
+            sp->jitter_us[1] = (sp->jitterMax_us > 0xFFFF) ? 0xFFFF : (uint16_t)sp->jitterMax_us;
+        }
+    }
+    sp->lastSent_ns = sent_ns;
+}
+
+
+/* Schedule next cycle, skip cycles, which are already late. */
+static void scheduleNext(CO_SYNCproducer_t *sp, uint32_t period_us) {
+    uint64_t now = now_ns();
+    uint64_t period_ns = (uint64_t)period_us * 1000;
+
+    sp->nextSync_ns += period_ns;
+    while(sp->nextSync_ns - sp->lead_us * 1000ULL <= now) {
+        sp->nextSync_ns += period_ns;
+        sp->missed++;
+    }
+    sp->setpointsSent = false;
+    armTimer(sp, sp->nextSync_ns - sp->lead_us * 1000ULL);
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_SYNCproducer_init(
+        CO_SYNCproducer_t      *sp,
+        int                     epoll_fd,
+        uint32_t                period_us,
+        uint32_t                lead_us,
+        uint16_t               *jitter_us)
+{
+    struct epoll_event ev;
+
+    if(sp == NULL || (period_us != 0 && lead_us >= period_us)) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    memset(sp, 0, sizeof(*sp));
+    sp->lead_us = lead_us;
+    sp->jitter_us = jitter_us;
+    sp->latencyMin_us = UINT32_MAX;
+    if(period_us != 0) {
+        OD_communicationCyclePeriod = period_us;
+    }
+
+    sp->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if(sp->fd < 0) {
+        return CO_ERROR_SYSCALL;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = sp->fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sp->fd, &ev) != 0) {
+        close(sp->fd);
+        sp->fd = -1;
+        return CO_ERROR_SYSCALL;
+    }
+
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+void CO_SYNCproducer_initCallback(
+        CO_SYNCproducer_t      *sp,
+        void                   *object,
+        void                  (*pFunct)(void *object, uint32_t period_us))
+{
+    if(sp != NULL) {
+        sp->functSetpointsObject = object;
+        sp->pFunctSetpoints = pFunct;
+    }
+}
+
+
+/******************************************************************************/
+void CO_SYNCproducer_bind(CO_SYNCproducer_t *sp, CO_CANbatch_t *batch) {
+    CO_SYNC_t *SYNC = CO->SYNC;
+
+    if(sp == NULL || sp->fd < 0) {
+        return;
+    }
+
+    CO_LOCK_OD();
+    SYNC->isProducer = false;
+    SYNC->periodTime = OD_communicationCyclePeriod;
+    SYNC->periodTimeoutTime = OD_communicationCyclePeriod / 2 * 3;
+    CO_UNLOCK_OD();
+
+    sp->batch = batch;
+    sp->counter = 0;
+    sp->lastSent_ns = 0;
+    memset(sp->tpdoCounter, 0, sizeof(sp->tpdoCounter));
+
+    /* First SYNC one period after start */
+    sp->nextSync_ns = now_ns();
+    scheduleNext(sp, OD_communicationCyclePeriod ? OD_communicationCyclePeriod : IDLE_CHECK_NS / 1000);
+}
+
+
+/******************************************************************************/
+bool_t CO_SYNCproducer_process(CO_SYNCproducer_t *sp, int fd) {
+    uint64_t expirations;
+    uint32_t period_us;
+    uint8_t state;
+
+    if(sp == NULL || fd != sp->fd || fd < 0) {
+        return false;
+    }
+
+    if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if(errno != EAGAIN) {
+            CO_error(0x13700000L + errno);
+        }
+        return true;
+    }
+
+    period_us = OD_communicationCyclePeriod;
+    state = CO->NMT->operatingState;
+    if(period_us == 0 || period_us <= sp->lead_us || sp->batch == NULL || !CO->CANmodule[0]->CANnormal
+       || (state != CO_NMT_OPERATIONAL && state != CO_NMT_PRE_OPERATIONAL)) {
+        /* Paused, check again later */
+        sp->lastSent_ns = 0;
+        sp->nextSync_ns = now_ns() + IDLE_CHECK_NS;
+        sp->setpointsSent = false;
+        armTimer(sp, sp->nextSync_ns);
+        return true;
+    }
+
+    if(!sp->setpointsSent) {
+        /* Setpoints for the next SYNC */
+        CO_LOCK_OD();
+        if(sp->pFunctSetpoints != NULL) {
+            sp->pFunctSetpoints(sp->functSetpointsObject, period_us);
+        }
+        queueSetpoints(sp);
+        CO_UNLOCK_OD();
+        sp->setpointsSent = true;
+
+        if(sp->lead_us > 0) {
+            CO_CANbatch_txFlush(sp->batch);
+            CO_CANbus_txFlush();
+            armTimer(sp, sp->nextSync_ns);
+            return true;
+        }
+    }
+
+    queueSync(sp);
+    if(CO_CANbatch_txFlush(sp->batch) < 0) {
+        CO_error(0x13800000L + errno);
+    }
+    CO_CANbus_txFlush();
+    recordStats(sp, now_ns(), period_us);
+    scheduleNext(sp, period_us);
+
+    return true;
+}
+
+
+/******************************************************************************/
+void CO_SYNCproducer_printStats(const CO_SYNCproducer_t *sp, const char *name) {
+    int bin;
+
+    if(sp == NULL || sp->fd < 0) {
+        return;
+    }
+
+    printf("%s - %u SYNC, %u missed, %u tx errors", name, sp->cycles, sp->missed, sp->txErrors);
+    if(sp->cycles > 0) {
+        printf(", latency min/avg/max %u/%u/%u us",
+               sp->latencyMin_us, (uint32_t)(sp->latencySum_us / sp->cycles), sp->latencyMax_us);
+    }
+    if(sp->jitterCount > 0) {
+        printf(", jitter avg/max %u/%u us",
+               (uint32_t)(sp->jitterSum_us / sp->jitterCount), sp->jitterMax_us);
+    }
+    printf(", latency histogram (<10,<20,<50,<100,<200,<500,<1000,more us):");
+    for(bin=0; bin<CO_SYNC_PRODUCER_HIST; bin++) {
+        printf(" %u", sp->histogram[bin]);
+    }
+    printf("\n");
+}
+
+
+/******************************************************************************/
+void CO_SYNCproducer_close(CO_SYNCproducer_t *sp) {
+    if(sp != NULL && sp->fd >= 0) {
+        close(sp->fd);
+        sp->fd = -1;
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * SYNC producer with own timer and phase-locked setpoints.
+ *
+ * @file        CO_SYNCproducer.h
+ *
+ * SYNC object of CANopenNode produces SYNC from the 1 ms CANopen timer, so
+ * the period from 0x1006 is rounded to milliseconds and SYNC jitters with
+ * the timer. Setpoint TPDOs are sent, when the timer finds them changed, not
+ * in relation to SYNC.
+ *
+ * This module produces SYNC from own timerfd with absolute expiration times
+ * on CLOCK_MONOTONIC, so the period from 0x1006 is kept in microseconds and
+ * does not drift. In each cycle, 'lead' microseconds before SYNC:
+ *  - Application callback is called, to compute the setpoints.
+ *  - Synchronous TPDOs of canopend (transmission type 1..240) are queued,
+ *    for example controlwords and target positions to the drives.
+ * Then SYNC is queued and all frames are sent with one sendmmsg() call
+ * (CO_CANbatch.h). With additional CAN interfaces (CO_CANbus.h) their
+ * setpoints and SYNC are queued on their own interface and sent right after
+ * the first one, so all buses get SYNC from the same point of the cycle. With lead 0 setpoints and SYNC are sent in the same
+ * call, else setpoints are sent first and SYNC on time. Synchronous RPDOs of
+ * the drives take the setpoints on that SYNC, synchronous TPDOs of the
+ * drives answer it.
+ *
+ * SYNC producer of CANopenNode is disabled. 0x1006 may be changed at
+ * runtime, 0 pauses SYNC. SYNC is produced in NMT pre-operational and
+ * operational state. Own SYNC is not received by canopend, so synchronous
+ * RPDOs of canopend are not processed.
+ *
+ * Statistics: latency of each SYNC from its scheduled time, deviation of the
+ * SYNC interval from the period (jitter) and missed cycles. Jitter of the
+ * last cycle and maximum jitter in microseconds are in OD_performance
+ * (syncJitter, syncJitterMax).
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_SYNC_PRODUCER_H
+#define CO_SYNC_PRODUCER_H
+
+#include "CANopen.h"
+#include "CO_CANbatch.h"
+
+
+/* Number of bins in latency histogram, see CO_SYNCproducer_printStats(). */
+#define CO_SYNC_PRODUCER_HIST       8
+
+
+/**
+ * SYNC producer object.
+ */
+typedef struct {
+    int                 fd;             /**< timerfd. */
+    CO_CANbatch_t      *batch;          /**< From CO_SYNCproducer_bind(). */
+    uint32_t            lead_us;        /**< Setpoints are sent this before SYNC. */
+    uint64_t            nextSync_ns;    /**< Scheduled time of the next SYNC. */
+    bool_t              setpointsSent;  /**< Setpoints of the next SYNC are sent. */
+    uint8_t             counter;        /**< SYNC counter, if 0x1019 > 1. */
+    uint8_t             tpdoCounter[CO_NO_TPDO]; /**< For transmission types 2..240. */
+    /** Optional callback before setpoints, see CO_SYNCproducer_initCallback(). */
+    void              (*pFunctSetpoints)(void *object, uint32_t period_us);
+    void               *functSetpointsObject;
+    uint16_t           *jitter_us;      /**< OD_performance, last and max jitter. */
+    /* Statistics */
+    uint64_t            lastSent_ns;    /**< Time, when last SYNC was sent. */
+    uint32_t            cycles;         /**< Number of sent SYNC messages. */
+    uint32_t            missed;         /**< Number of cycles skipped due to overrun. */
+    uint32_t            txErrors;       /**< SYNC not sent. */
+    uint32_t            latencyMin_us;  /**< Scheduled time to sent, minimum. */
+    uint32_t            latencyMax_us;
+    uint64_t            latencySum_us;
+    uint32_t            jitterMax_us;   /**< Max deviation of interval from period. */
+    uint64_t            jitterSum_us;
+    uint32_t            jitterCount;
+    uint32_t            histogram[CO_SYNC_PRODUCER_HIST]; /**< Latency histogram. */
+} CO_SYNCproducer_t;
+
+
+/**
+ * Create timer and add it to epoll. Call once, after first CO_init().
+ *
+ * @param sp This object.
+ * @param epoll_fd epoll of the RT thread (of mainline if CO_SINGLE_THREAD).
+ * @param period_us SYNC period, written to 0x1006. 0 to keep 0x1006.
+ * @param lead_us Time in microseconds between setpoints and SYNC.
+ * @param jitter_us Pointer to two uint16_t variables for last and max jitter
+ * (&OD_performance[ODA_performance_syncJitter]). May be NULL.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_SYNCproducer_init(
+        CO_SYNCproducer_t      *sp,
+        int                     epoll_fd,
+        uint32_t                period_us,
+        uint32_t                lead_us,
+        uint16_t               *jitter_us);
+
+
+/**
+ * Initialize callback, which computes setpoints. Called from the RT thread
+ * with CO_LOCK_OD, before synchronous TPDOs are queued.
+ *
+ * @param sp This object.
+ * @param object Passed to pFunct, may be NULL.
+ * @param pFunct Function, period_us is the actual SYNC period.
+ */
+void CO_SYNCproducer_initCallback(
+        CO_SYNCproducer_t      *sp,
+        void                   *object,
+        void                  (*pFunct)(void *object, uint32_t period_us));
+
+
+/**
+ * Disable SYNC producer of CANopenNode and start the timer. Call after
+ * each CO_init() and CO_CANbatch_init().
+ *
+ * @param sp This object.
+ * @param batch Batched I/O of CO->CANmodule[0].
+ */
+void CO_SYNCproducer_bind(CO_SYNCproducer_t *sp, CO_CANbatch_t *batch);
+
+
+/**
+ * Process timer event. Call from the RT thread for each epoll event.
+ *
+ * @param sp This object.
+ * @param fd File descriptor of the event.
+ *
+ * @return True, if fd was the timer of this object.
+ */
+bool_t CO_SYNCproducer_process(CO_SYNCproducer_t *sp, int fd);
+
+
+/**
+ * Print statistics to stdout.
+ *
+ * @param sp This object.
+ * @param name Prefix of the line.
+ */
+void CO_SYNCproducer_printStats(const CO_SYNCproducer_t *sp, const char *name);
+
+
+/**
+ * Close timer.
+ *
+ * @param sp This object.
+ */
+void CO_SYNCproducer_close(CO_SYNCproducer_t *sp);
+
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * Clock of canopend, real or virtual for simulation.
+ *
+ * @file        CO_clock.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define LINE_SIZE                   64
+#define NSEC_PER_MSEC               1000000ULL
+#define NSEC_PER_SEC                1000000000ULL
+
+char                       *CO_clock_socketPath = "/tmp/CO_sim_socket";
+
+static bool_t               virtualMode = false;
+static uint64_t             virtual_ns = 0;     /* Written by the RT thread only */
+static uint64_t             startReal_ns;
+static void               (*cycleFunct)(void) = NULL;
+static uint64_t             steps = 0;
+static uint64_t             tick_ns = 0;        /* Written by the RT thread only */
+static int64_t              realToMono_ns = 0;  /* CLOCK_REALTIME - CLOCK_MONOTONIC at tick */
+
+static int                  epollFd = -1;
+static int                  fdSocket = -1;
+static int                  fdClients[CO_CLOCK_SIM_CLIENTS];
+static char                 lineBuf[CO_CLOCK_SIM_CLIENTS][LINE_SIZE];
+static size_t               lineLen[CO_CLOCK_SIM_CLIENTS];
+
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_clock_initVirtual(int rt_epoll_fd, void (*cycle)(void)) {
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    int i;
+
+    if(cycle == NULL) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+    for(i=0; i<CO_CLOCK_SIM_CLIENTS; i++) {
+        fdClients[i] = -1;
+    }
+    epollFd = rt_epoll_fd;
+    cycleFunct = cycle;
+    startReal_ns = monotonic_ns();
+
+    fdSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(fdSocket < 0) {
+        return CO_ERROR_SYSCALL;
+    }
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, CO_clock_socketPath, sizeof(addr.sun_path) - 1);
+    unlink(CO_clock_socketPath);
+    if(bind(fdSocket, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) != 0
+       || listen(fdSocket, 5) != 0) {
+        close(fdSocket);
+        fdSocket = -1;
+        return CO_ERROR_SYSCALL;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = fdSocket;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fdSocket, &ev) != 0) {
+        return CO_ERROR_SYSCALL;
+    }
+
+    virtualMode = true;
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+bool_t CO_clock_isVirtual(void) {
+    return virtualMode;
+}
+
+
+/******************************************************************************/
+uint64_t CO_clock_ns(void) {
+    if(virtualMode) {
+        return __atomic_load_n(&virtual_ns, __ATOMIC_RELAXED);
+    }
+    return monotonic_ns();
+}
+
+
+/******************************************************************************/
+void CO_clock_tick(void) {
+    uint64_t t;
+
+    if(virtualMode) {
+        t = __atomic_load_n(&virtual_ns, __ATOMIC_RELAXED);
+    }
+    else {
+        struct timespec real;
+
+        t = monotonic_ns();
+        clock_gettime(CLOCK_REALTIME, &real);
+        __atomic_store_n(&realToMono_ns, (int64_t)((uint64_t)real.tv_sec * NSEC_PER_SEC + real.tv_nsec - t),
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&tick_ns, t, __ATOMIC_RELAXED);
+}
+
+
+/******************************************************************************/
+uint64_t CO_clock_tickNs(void) {
+    return __atomic_load_n(&tick_ns, __ATOMIC_RELAXED);
+}
+
+
+/******************************************************************************/
+uint64_t CO_clock_fromRealtime(const struct timespec *ts) {
+    uint64_t tick = CO_clock_tickNs();
+    uint64_t t;
+
+    if(virtualMode || ts == NULL || tick == 0) {
+        return CO_clock_ns();
+    }
+    t = (uint64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec
+      - __atomic_load_n(&realToMono_ns, __ATOMIC_RELAXED);
+    /* Hardware clock is not related to CLOCK_REALTIME */
+    if(t + NSEC_PER_SEC < tick || t > tick + NSEC_PER_SEC) {
+        return CO_clock_ns();
+    }
+    return t;
+}
+
+
+/* Execute one command line, write response. */
+static void command(int fd, char *line) {
+    char resp[LINE_SIZE];
+    unsigned long ms;
+    int len;
+
+    if(sscanf(line, "step %lu", &ms) == 1) {
+        unsigned long i;
+
+        for(i=0; i<ms; i++) {
+            __atomic_store_n(&virtual_ns, virtual_ns + NSEC_PER_MSEC, __ATOMIC_RELAXED);
+            cycleFunct();
+        }
+        steps++;
+        len = snprintf(resp, sizeof(resp), "OK %llu\n", (unsigned long long)virtual_ns);
+    }
+    else if(strncmp(line, "time", 4) == 0) {
+        len = snprintf(resp, sizeof(resp), "%llu\n", (unsigned long long)virtual_ns);
+    }
+    else {
+        len = snprintf(resp, sizeof(resp), "ERROR\n");
+    }
+    if(write(fd, resp, len) != len) {
+        /* Client is gone or does not read, it is closed on next input */
+    }
+}
+
+
+/******************************************************************************/
+bool_t CO_clock_process(int fd) {
+    int i;
+
+    if(fdSocket < 0) {
+        return false;
+    }
+
+    if(fd == fdSocket) {
+        int fdNew = accept(fdSocket, NULL, NULL);
+
+        if(fdNew >= 0) {
+            struct epoll_event ev;
+
+            for(i=0; i<CO_CLOCK_SIM_CLIENTS && fdClients[i] >= 0; i++);
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fdNew;
+            if(i == CO_CLOCK_SIM_CLIENTS || epoll_ctl(epollFd, EPOLL_CTL_ADD, fdNew, &ev) != 0) {
+                close(fdNew);
+            }
+            else {
+                fdClients[i] = fdNew;
+                lineLen[i] = 0;
+            }
+        }
+        return true;
+    }
+
+    for(i=0; i<CO_CLOCK_SIM_CLIENTS; i++) {
+        if(fd == fdClients[i]) {
+            char buf[LINE_SIZE];
+            ssize_t n = read(fd, buf, sizeof(buf));
+            ssize_t j;
+
+            if(n <= 0) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                fdClients[i] = -1;
+                return true;
+            }
+            for(j=0; j<n; j++) {
+                if(buf[j] == '\n') {
+                    lineBuf[i][lineLen[i]] = 0;
+                    command(fd, lineBuf[i]);
+                    lineLen[i] = 0;
+                }
+                else if(lineLen[i] < LINE_SIZE - 1) {
+                    lineBuf[i][lineLen[i]++] = buf[j];
+                }
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/******************************************************************************/
+void CO_clock_printStats(const char *name) {
+    double real = (monotonic_ns() - startReal_ns) / 1e9;
+    double sim = virtual_ns / 1e9;
+
+    printf("%s - virtual %.3f s in %.3f s real time (%.1fx), %llu steps\n",
+           name, sim, real, real > 0 ? sim / real : 0.0, (unsigned long long)steps);
+}
+
+
+/******************************************************************************/
+void CO_clock_close(void) {
+    int i;
+
+    for(i=0; i<CO_CLOCK_SIM_CLIENTS; i++) {
+        if(fdClients[i] >= 0) {
+            close(fdClients[i]);
+            fdClients[i] = -1;
+        }
+    }
+    if(fdSocket >= 0) {
+        close(fdSocket);
+        unlink(CO_clock_socketPath);
+        fdSocket = -1;
+    }
+}
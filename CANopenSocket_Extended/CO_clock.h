@@ -0,0 +1,126 @@
+/*
+ * Clock of canopend, real or virtual for simulation.
+ *
+ * @file        CO_clock.h
+ *
+ * canopend has one timebase: 64-bit nanoseconds of CLOCK_MONOTONIC, which
+ * does not jump with NTP or date and does not wrap like the 16-bit
+ * CO_timer1ms. The RT thread calls CO_clock_tick() at each 1 ms cycle and
+ * CO_clock_tickNs() returns that time without a system call, so samples,
+ * log records and events of one cycle share the same stamp. Kernel receive
+ * timestamps of CAN frames (CLOCK_REALTIME) are converted to the timebase
+ * with CO_clock_fromRealtime(). CO_timer1ms stays for the 16-bit time
+ * differences of CANopenNode.
+ *
+ * By default the RT thread is driven by the 1 ms timer of CO_Linux_tasks
+ * and time is CLOCK_MONOTONIC. In virtual mode (canopend -V) the timer is
+ * not used. Time only advances, when a simulation harness (driveSim -V)
+ * requests it on the simulation socket, and the RT thread runs one cycle
+ * per simulated millisecond, as fast as it can:
+ *
+ *   step <ms>      Run <ms> RT cycles, each one receives all frames waiting
+ *                  on the CAN socket first. Response "OK <time ns>".
+ *   time           Response "<time ns>", current virtual time.
+ *
+ * Lines end with '\n'. A harness steps canopend and the simulated drives
+ * alternately, so frames sent in one step are received in the next one
+ * and a run is repeatable, independent of the speed of the computer.
+ * Control programs may read the virtual time with 'time'.
+ *
+ * Everything, which is counted in RT cycles, follows the virtual time:
+ * CO_timer1ms, CO_time, trace, PDO timers, the data logger. Mainline
+ * (heartbeat producer, SDO timeouts) uses CO_timer1ms, but runs at its own
+ * real time pace, so its timing is coarser in faster than real time runs.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_CLOCK_H
+#define CO_CLOCK_H
+
+#include "CANopen.h"
+#include <time.h>
+
+
+/* Simulation socket path, may be changed before CO_clock_initVirtual(). */
+extern char *CO_clock_socketPath;
+
+
+/* Maximum number of connected clients of the simulation socket. */
+#ifndef CO_CLOCK_SIM_CLIENTS
+#define CO_CLOCK_SIM_CLIENTS        4
+#endif
+
+
+/**
+ * Switch to virtual time and open the simulation socket. Call once, before
+ * the RT thread starts.
+ *
+ * @param rt_epoll_fd epoll of the RT thread.
+ * @param cycle Function, which runs one RT cycle. Called from
+ * CO_clock_process() with virtual time already advanced.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_clock_initVirtual(int rt_epoll_fd, void (*cycle)(void));
+
+
+/**
+ * True in virtual mode.
+ */
+bool_t CO_clock_isVirtual(void);
+
+
+/**
+ * Monotonic time in nanoseconds: CLOCK_MONOTONIC, or virtual time since
+ * program start.
+ */
+uint64_t CO_clock_ns(void);
+
+
+/**
+ * Take time of the RT cycle. Call from the RT thread at each 1 ms cycle.
+ */
+void CO_clock_tick(void);
+
+
+/**
+ * Time of the last CO_clock_tick() in nanoseconds, same timebase as
+ * CO_clock_ns(). May be called from any thread, no system call. Zero before
+ * the first cycle.
+ */
+uint64_t CO_clock_tickNs(void);
+
+
+/**
+ * Convert CLOCK_REALTIME timestamp (kernel receive timestamp of a frame) to
+ * the timebase of CO_clock_ns(), with the offset from the last
+ * CO_clock_tick(). Timestamps, which are not near the tick (hardware clock),
+ * and all timestamps in virtual mode give CO_clock_ns().
+ */
+uint64_t CO_clock_fromRealtime(const struct timespec *ts);
+
+
+/**
+ * Process event on file descriptor of the simulation socket. Call from the
+ * RT thread.
+ *
+ * @return true, if fd was processed.
+ */
+bool_t CO_clock_process(int fd);
+
+
+/**
+ * Print statistics (virtual time, real time, speed) to stdout.
+ */
+void CO_clock_printStats(const char *name);
+
+
+/**
+ * Close the simulation socket.
+ */
+void CO_clock_close(void);
+
+
+#endif
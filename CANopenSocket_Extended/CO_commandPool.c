@@ -0,0 +1,792 @@
+/*
+ * Parallel command interface for CANopen SDO transfers.
+ *
+ * @file        CO_commandPool.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_commandPool.h"
+#include "CO_SDOclientPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/* Maximum length of a request line */
+#define LINE_SIZE           200
+/* Maximum length of a response line */
+#define RESP_SIZE           160
+/* Size of response queue of each client */
+#define TX_SIZE             4096
+/* epoll data of the sockets, which are not clients */
+#define EV_LISTEN           0xFFFF
+#define EV_WAKE             0xFFFE
+
+/* Mode of a connection, known after its first byte */
+#define MODE_NEW            0
+#define MODE_TEXT           1
+#define MODE_BINARY         2
+
+
+/* Datatypes, only expedited */
+typedef struct {
+    const char         *name;
+    uint8_t             size;
+    bool_t              isSigned;
+    bool_t              hex;
+} cmdType_t;
+
+static const cmdType_t cmdTypes[] = {
+    {"i8",  1, true,  false},
+    {"i16", 2, true,  false},
+    {"i32", 4, true,  false},
+    {"u8",  1, false, false},
+    {"u16", 2, false, false},
+    {"u32", 4, false, false},
+    {"x8",  1, false, true},
+    {"x16", 2, false, true},
+    {"x32", 4, false, true}
+};
+
+
+/* Request in progress, owned by SDO client pool until callback. */
+typedef struct {
+    uint32_t            sequence;
+    int                 slot;           /* client, which sent the request */
+    uint32_t            id;             /* valid, if client in slot has the same id */
+    const cmdType_t    *type;           /* NULL for binary request */
+    uint8_t             binSize;        /* Size of binary read */
+    uint64_t            received_ns;
+} cmdPending_t;
+
+
+/* Connected client. Response queue and statistics are protected by connMtx,
+ * because responses are queued from mainline. */
+typedef struct {
+    int                 fd;             /* -1 if slot is free */
+    uint32_t            id;             /* Unique for each connection */
+    uint8_t             priority;       /* CO_SDO_POOL_PRIO_* of its requests */
+    uint8_t             mode;           /* MODE_* */
+    char                rx[LINE_SIZE];  /* Incomplete request line or frame */
+    size_t              rxLen;
+    bool_t              rxDiscard;      /* Dropping rest of a too long line */
+    char                tx[TX_SIZE];    /* Responses not sent yet */
+    size_t              txLen;
+    bool_t              txWait;         /* EPOLLOUT is enabled */
+    bool_t              txOverflow;     /* Response was dropped, client is closed */
+    uint32_t            requests;
+    uint32_t            errors;
+    uint32_t            rejected;
+    uint32_t            dropped;
+    uint32_t            inFlight;
+    uint32_t            inFlightMax;
+    uint32_t            latencyMin_us;
+    uint32_t            latencyMax_us;
+    uint64_t            latencySum_us;
+} cmdClient_t;
+
+
+/* Globals */
+char                       *CO_commandPool_socketPath = "/tmp/CO_command_socket_parallel";
+
+static int                  fdSocket = -1;
+static int                  fdEpoll = -1;
+static int                  fdWake = -1;        /* eventfd, responses queued or end */
+static cmdClient_t          clients[CO_CMDPOOL_CLIENTS];
+static uint32_t             clientIdNext = 1;
+static pthread_mutex_t      connMtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t            command_thread_id;
+static volatile int         endProgram = 0;
+
+static const char          *prioNames[] = {"high", "normal", "low"};
+
+
+static void* command_thread(void* arg);
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void wakeThread(void) {
+    uint64_t one = 1;
+
+    if(write(fdWake, &one, sizeof(one)) != sizeof(one)) {
+        /* Counter overflow only, thread is woken anyway */
+    }
+}
+
+
+/******************************************************************************/
+int CO_commandPool_init(void) {
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    int i;
+
+    endProgram = 0;
+    for(i=0; i<CO_CMDPOOL_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+
+    /* Create, bind and listen socket */
+    fdSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(fdSocket < 0) {
+        perror("CO_commandPool_init - socket failed");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, CO_commandPool_socketPath, sizeof(addr.sun_path) - 1);
+
+    unlink(CO_commandPool_socketPath);
+    if(bind(fdSocket, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) != 0) {
+        perror("CO_commandPool_init - bind failed");
+        close(fdSocket);
+        return -1;
+    }
+
+    if(listen(fdSocket, CO_CMDPOOL_CLIENTS) != 0) {
+        perror("CO_commandPool_init - listen failed");
+        close(fdSocket);
+        return -1;
+    }
+
+    /* One epoll set for listening socket, all clients and wakeup */
+    fdEpoll = epoll_create(CO_CMDPOOL_CLIENTS + 2);
+    fdWake = eventfd(0, EFD_NONBLOCK);
+    if(fdEpoll < 0 || fdWake < 0) {
+        perror("CO_commandPool_init - epoll failed");
+        close(fdSocket);
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u32 = EV_LISTEN;
+    epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdSocket, &ev);
+    ev.data.u32 = EV_WAKE;
+    epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdWake, &ev);
+
+    /* Create thread */
+    if(pthread_create(&command_thread_id, NULL, command_thread, NULL) != 0) {
+        perror("CO_commandPool_init - thread creation failed");
+        close(fdSocket);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/******************************************************************************/
+int CO_commandPool_clear(void) {
+    int ret = 0;
+    int i;
+
+    endProgram = 1;
+    wakeThread();
+
+    if(pthread_join(command_thread_id, NULL) != 0) {
+        ret = -1;
+    }
+
+    pthread_mutex_lock(&connMtx);
+    for(i=0; i<CO_CMDPOOL_CLIENTS; i++) {
+        if(clients[i].fd >= 0) {
+            close(clients[i].fd);
+            clients[i].fd = -1;
+        }
+    }
+    pthread_mutex_unlock(&connMtx);
+
+    close(fdSocket);
+    close(fdEpoll);
+    close(fdWake);
+    unlink(CO_commandPool_socketPath);
+
+    return ret;
+}
+
+
+/* Space in tx, which is kept for the response of each request in flight. */
+static size_t respReserve(const cmdClient_t *client) {
+    return (client->mode == MODE_BINARY) ? sizeof(CO_cmdPoolBinResp_t) : RESP_SIZE;
+}
+
+
+/* Queue response data, whole or nothing. Space reserved for requests in
+ * flight is not used, so their responses always fit. If the response does
+ * not fit, client does not read its responses and is closed, instead of
+ * waiting forever for a lost one. Call with connMtx locked. */
+static void queueData(cmdClient_t *client, const void *data, size_t len) {
+    if(client->txLen + len + client->inFlight * respReserve(client) <= TX_SIZE) {
+        memcpy(client->tx + client->txLen, data, len);
+        client->txLen += len;
+    }
+    else {
+        client->dropped++;
+        client->txOverflow = true;
+    }
+}
+
+
+/* Queue text response. Call with connMtx locked. */
+static void queueResponse(cmdClient_t *client, const char *resp) {
+    queueData(client, resp, strlen(resp));
+}
+
+
+/* Queue binary response. Call with connMtx locked. */
+static void queueBinResponse(cmdClient_t *client, uint32_t sequence, uint32_t result,
+                             const uint8_t *data, uint8_t size)
+{
+    CO_cmdPoolBinResp_t resp;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.sequence = sequence;
+    resp.result = result;
+    if(data != NULL) {
+        resp.size = size;
+        memcpy(resp.data, data, size);
+    }
+    queueData(client, &resp, sizeof(resp));
+}
+
+
+/* Called from mainline by SDO client pool. */
+static void transferDone(void *object, const CO_SDOpool_req_t *req,
+                         CO_SDOclient_return_t ret, uint32_t abortCode)
+{
+    cmdPending_t *pending = (cmdPending_t *)object;
+    const cmdType_t *type = pending->type;
+    cmdClient_t *client = &clients[pending->slot];
+    char resp[RESP_SIZE];
+
+    if(ret != CO_SDOcli_ok_communicationEnd && abortCode == 0) {
+        abortCode = (ret == CO_SDOcli_endedWithTimeout) ? CO_SDO_AB_TIMEOUT : CO_SDO_AB_GENERAL;
+    }
+    if(type == NULL) {
+        /* Binary, response is queued below */
+        if(ret == CO_SDOcli_ok_communicationEnd && req->upload && req->dataSize != pending->binSize) {
+            abortCode = CO_SDO_AB_TYPE_MISMATCH;
+        }
+    }
+    else if(ret != CO_SDOcli_ok_communicationEnd) {
+        snprintf(resp, RESP_SIZE, "[%u] ERROR: 0x%08X\r\n", pending->sequence, abortCode);
+    }
+    else if(!req->upload) {
+        snprintf(resp, RESP_SIZE, "[%u] OK\r\n", pending->sequence);
+    }
+    else if(req->dataSize != type->size) {
+        snprintf(resp, RESP_SIZE, "[%u] ERROR: 0x%08X\r\n", pending->sequence, CO_SDO_AB_TYPE_MISMATCH);
+    }
+    else {
+        uint32_t u = req->data[0];
+
+        if(type->size >= 2) u |= (uint32_t)req->data[1] << 8;
+        if(type->size == 4) u |= ((uint32_t)req->data[2] << 16) | ((uint32_t)req->data[3] << 24);
+
+        if(type->hex) {
+            snprintf(resp, RESP_SIZE, "[%u] 0x%0*X\r\n", pending->sequence, type->size * 2, u);
+        }
+        else if(type->isSigned) {
+            int32_t i = (type->size == 1) ? (int8_t)u : (type->size == 2) ? (int16_t)u : (int32_t)u;
+            snprintf(resp, RESP_SIZE, "[%u] %d\r\n", pending->sequence, i);
+        }
+        else {
+            snprintf(resp, RESP_SIZE, "[%u] %u\r\n", pending->sequence, u);
+        }
+    }
+
+    pthread_mutex_lock(&connMtx);
+    if(client->fd >= 0 && client->id == pending->id) {
+        uint32_t latency_us = (uint32_t)((now_ns() - pending->received_ns) / 1000);
+
+        if(latency_us < client->latencyMin_us) client->latencyMin_us = latency_us;
+        if(latency_us > client->latencyMax_us) client->latencyMax_us = latency_us;
+        client->latencySum_us += latency_us;
+        if(ret != CO_SDOcli_ok_communicationEnd) client->errors++;
+        client->inFlight--;
+        if(type != NULL) {
+            queueResponse(client, resp);
+        }
+        else {
+            queueBinResponse(client, pending->sequence, abortCode,
+                             (abortCode == 0 && req->upload) ? req->data : NULL, pending->binSize);
+        }
+    }
+    pthread_mutex_unlock(&connMtx);
+
+    wakeThread();
+    free(pending);
+}
+
+
+/* Respond to 'stats' request. Call from command thread. */
+static void processStats(cmdClient_t *own, uint32_t sequence) {
+    char resp[RESP_SIZE];
+    int i;
+
+    pthread_mutex_lock(&connMtx);
+    for(i=0; i<CO_CMDPOOL_CLIENTS; i++) {
+        cmdClient_t *c = &clients[i];
+        uint32_t done = c->requests - c->inFlight;
+
+        if(c->fd < 0) {
+            continue;
+        }
+        snprintf(resp, RESP_SIZE, "[%u] client %u%s prio %s requests %u errors %u rejected %u "
+                 "dropped %u inflight %u/%u latency_us %u/%u/%u\r\n",
+                 sequence, c->id, (c == own) ? "*" : "", prioNames[c->priority],
+                 c->requests, c->errors, c->rejected, c->dropped, c->inFlight, c->inFlightMax,
+                 done > 0 ? c->latencyMin_us : 0, done > 0 ? (uint32_t)(c->latencySum_us / done) : 0,
+                 c->latencyMax_us);
+        queueResponse(own, resp);
+    }
+    snprintf(resp, RESP_SIZE, "[%u] OK\r\n", sequence);
+    queueResponse(own, resp);
+    pthread_mutex_unlock(&connMtx);
+}
+
+
+static int postRequest(CO_SDOpool_req_t *req, int slot, uint32_t sequence,
+                       const cmdType_t *type, uint8_t binSize);
+
+
+/* Parse one request line and post it to the SDO client pool. Returns local
+ * error code or 0. */
+static int processLine(char *line, int slot, uint32_t *sequence) {
+    cmdClient_t *client = &clients[slot];
+    char *tok, *save, *end;
+    CO_SDOpool_req_t req;
+    const cmdType_t *type = NULL;
+    long node, index, subIndex;
+    unsigned int i;
+
+    /* [sequence] */
+    tok = strtok_r(line, " \t\r", &save);
+    if(tok == NULL || sscanf(tok, "[%u]", sequence) != 1) {
+        return CO_CMDPOOL_ERR_SYNTAX;
+    }
+
+    memset(&req, 0, sizeof(req));
+
+    /* node or local command */
+    tok = strtok_r(NULL, " \t\r", &save);
+    if(tok == NULL) return CO_CMDPOOL_ERR_SYNTAX;
+    if(strcmp(tok, "stats") == 0) {
+        if(strtok_r(NULL, " \t\r", &save) != NULL) return CO_CMDPOOL_ERR_SYNTAX;
+        processStats(client, *sequence);
+        return 0;
+    }
+    if(strcmp(tok, "priority") == 0) {
+        char resp[RESP_SIZE];
+
+        tok = strtok_r(NULL, " \t\r", &save);
+        if(tok == NULL || strtok_r(NULL, " \t\r", &save) != NULL) return CO_CMDPOOL_ERR_SYNTAX;
+        for(i=0; i<sizeof(prioNames)/sizeof(prioNames[0]) && strcmp(tok, prioNames[i]) != 0; i++);
+        if(i == sizeof(prioNames)/sizeof(prioNames[0])) return CO_CMDPOOL_ERR_SYNTAX;
+        snprintf(resp, RESP_SIZE, "[%u] OK\r\n", *sequence);
+        pthread_mutex_lock(&connMtx);
+        client->priority = (uint8_t)i;
+        queueResponse(client, resp);
+        pthread_mutex_unlock(&connMtx);
+        return 0;
+    }
+    node = strtol(tok, &end, 0);
+    if(*end != 0 || node < 1 || node > 127) return CO_CMDPOOL_ERR_SYNTAX;
+    req.nodeId = (uint8_t)node;
+
+    /* command */
+    tok = strtok_r(NULL, " \t\r", &save);
+    if(tok == NULL) return CO_CMDPOOL_ERR_SYNTAX;
+    if(strcmp(tok, "read") == 0 || strcmp(tok, "r") == 0) {
+        req.upload = true;
+    }
+    else if(strcmp(tok, "write") == 0 || strcmp(tok, "w") == 0) {
+        req.upload = false;
+    }
+    else {
+        return CO_CMDPOOL_ERR_NOT_SUPPORTED;
+    }
+
+    /* index, subindex */
+    tok = strtok_r(NULL, " \t\r", &save);
+    if(tok == NULL) return CO_CMDPOOL_ERR_SYNTAX;
+    index = strtol(tok, &end, 0);
+    if(*end != 0 || index < 0 || index > 0xFFFF) return CO_CMDPOOL_ERR_SYNTAX;
+    req.index = (uint16_t)index;
+
+    tok = strtok_r(NULL, " \t\r", &save);
+    if(tok == NULL) return CO_CMDPOOL_ERR_SYNTAX;
+    subIndex = strtol(tok, &end, 0);
+    if(*end != 0 || subIndex < 0 || subIndex > 0xFF) return CO_CMDPOOL_ERR_SYNTAX;
+    req.subIndex = (uint8_t)subIndex;
+
+    /* datatype */
+    tok = strtok_r(NULL, " \t\r", &save);
+    if(tok == NULL) return CO_CMDPOOL_ERR_SYNTAX;
+    for(i=0; i<sizeof(cmdTypes)/sizeof(cmdTypes[0]); i++) {
+        if(strcmp(tok, cmdTypes[i].name) == 0) {
+            type = &cmdTypes[i];
+            break;
+        }
+    }
+    if(type == NULL) return CO_CMDPOOL_ERR_NOT_SUPPORTED;
+
+    /* value */
+    if(!req.upload) {
+        long long value;
+
+        tok = strtok_r(NULL, " \t\r", &save);
+        if(tok == NULL) return CO_CMDPOOL_ERR_SYNTAX;
+        errno = 0;
+        value = strtoll(tok, &end, 0);
+        if(*end != 0 || errno != 0) return CO_CMDPOOL_ERR_SYNTAX;
+        if(type->isSigned) {
+            long long max = (1LL << (type->size * 8 - 1)) - 1;
+            if(value > max || value < -max - 1) return CO_CMDPOOL_ERR_SYNTAX;
+        }
+        else if(value < 0 || value > (long long)((1ULL << (type->size * 8)) - 1)) {
+            return CO_CMDPOOL_ERR_SYNTAX;
+        }
+        CO_setUint32(req.data, (uint32_t)value);
+        req.dataSize = type->size;
+    }
+
+    if(strtok_r(NULL, " \t\r", &save) != NULL) {
+        return CO_CMDPOOL_ERR_SYNTAX;
+    }
+
+    return postRequest(&req, slot, *sequence, type, 0);
+}
+
+
+/* Process one binary request. Returns local error code or 0. */
+static int processFrame(const CO_cmdPoolBinReq_t *frame, int slot) {
+    cmdClient_t *client = &clients[slot];
+    CO_SDOpool_req_t req;
+
+    if(frame->op == CO_CMDPOOL_BIN_PRIORITY) {
+        if(frame->data[0] > CO_SDO_POOL_PRIO_LOW) return CO_CMDPOOL_ERR_SYNTAX;
+        pthread_mutex_lock(&connMtx);
+        client->priority = frame->data[0];
+        queueBinResponse(client, frame->sequence, 0, NULL, 0);
+        pthread_mutex_unlock(&connMtx);
+        return 0;
+    }
+    if(frame->op != CO_CMDPOOL_BIN_READ && frame->op != CO_CMDPOOL_BIN_WRITE) {
+        return CO_CMDPOOL_ERR_NOT_SUPPORTED;
+    }
+    if(frame->nodeId < 1 || frame->nodeId > 127
+       || (frame->size != 1 && frame->size != 2 && frame->size != 4)) {
+        return CO_CMDPOOL_ERR_SYNTAX;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nodeId = frame->nodeId;
+    req.index = frame->index;
+    req.subIndex = frame->subIndex;
+    req.upload = frame->op == CO_CMDPOOL_BIN_READ;
+    if(!req.upload) {
+        memcpy(req.data, frame->data, frame->size);
+        req.dataSize = frame->size;
+    }
+
+    return postRequest(&req, slot, frame->sequence, NULL, frame->size);
+}
+
+
+/* Process all complete binary requests in the receive buffer. */
+static void processFrames(int slot) {
+    cmdClient_t *client = &clients[slot];
+    size_t pos = 0;
+
+    while(client->rxLen - pos >= sizeof(CO_cmdPoolBinReq_t)) {
+        CO_cmdPoolBinReq_t frame;
+        int err;
+
+        memcpy(&frame, client->rx + pos, sizeof(frame));
+        pos += sizeof(frame);
+        err = processFrame(&frame, slot);
+        if(err != 0) {
+            pthread_mutex_lock(&connMtx);
+            client->rejected++;
+            queueBinResponse(client, frame.sequence, err, NULL, 0);
+            pthread_mutex_unlock(&connMtx);
+        }
+    }
+
+    client->rxLen -= pos;
+    memmove(client->rx, client->rx + pos, client->rxLen);
+}
+
+
+/* Post request to the SDO client pool, response is queued by
+ * transferDone(). Returns local error code or 0. */
+static int postRequest(CO_SDOpool_req_t *req, int slot, uint32_t sequence,
+                       const cmdType_t *type, uint8_t binSize)
+{
+    cmdClient_t *client = &clients[slot];
+    cmdPending_t *pending;
+
+    pending = (cmdPending_t *)malloc(sizeof(cmdPending_t));
+    if(pending == NULL) {
+        return CO_CMDPOOL_ERR_NOT_PROCESSED;
+    }
+    pending->sequence = sequence;
+    pending->slot = slot;
+    pending->id = client->id;
+    pending->type = type;
+    pending->binSize = binSize;
+    pending->received_ns = now_ns();
+
+    req->priority = client->priority;
+    req->callback = transferDone;
+    req->object = pending;
+
+    /* Counted before post, transferDone() may run before it returns. Rejected,
+     * if its response would not fit into the response queue. */
+    pthread_mutex_lock(&connMtx);
+    if(client->txLen + (client->inFlight + 1) * respReserve(client) > TX_SIZE) {
+        pthread_mutex_unlock(&connMtx);
+        free(pending);
+        return CO_CMDPOOL_ERR_NOT_PROCESSED;
+    }
+    client->requests++;
+    if(++client->inFlight > client->inFlightMax) client->inFlightMax = client->inFlight;
+    pthread_mutex_unlock(&connMtx);
+
+    if(CO_SDOpool_post(req) != 0) {
+        pthread_mutex_lock(&connMtx);
+        client->requests--;
+        client->inFlight--;
+        pthread_mutex_unlock(&connMtx);
+        free(pending);
+        return CO_CMDPOOL_ERR_NOT_PROCESSED;
+    }
+
+    return 0;
+}
+
+
+/* Remove client, its responses in progress are dropped. */
+static void closeClient(int slot) {
+    cmdClient_t *client = &clients[slot];
+
+    pthread_mutex_lock(&connMtx);
+    epoll_ctl(fdEpoll, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+    pthread_mutex_unlock(&connMtx);
+}
+
+
+/* Send queued responses without blocking. Returns false, if client is gone. */
+static bool_t flushClient(int slot) {
+    cmdClient_t *client = &clients[slot];
+    bool_t ok = true;
+
+    pthread_mutex_lock(&connMtx);
+    if(client->txOverflow) {
+        ok = false;
+    }
+    else if(client->txLen > 0) {
+        ssize_t n = send(client->fd, client->tx, client->txLen, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if(n > 0) {
+            client->txLen -= n;
+            memmove(client->tx, client->tx + n, client->txLen);
+        }
+        else if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            ok = false;
+        }
+    }
+    /* Wait for EPOLLOUT only while client does not read */
+    if(ok && (client->txLen > 0) != client->txWait) {
+        struct epoll_event ev;
+
+        client->txWait = client->txLen > 0;
+        ev.events = EPOLLIN | (client->txWait ? EPOLLOUT : 0);
+        ev.data.u32 = slot;
+        epoll_ctl(fdEpoll, EPOLL_CTL_MOD, client->fd, &ev);
+    }
+    pthread_mutex_unlock(&connMtx);
+
+    return ok;
+}
+
+
+/* Read available data and process all complete lines or binary requests.
+ * Returns false, if client is gone. */
+static bool_t readClient(int slot) {
+    cmdClient_t *client = &clients[slot];
+    char *start, *nl;
+    ssize_t n;
+
+    n = read(client->fd, client->rx + client->rxLen, sizeof(client->rx) - 1 - client->rxLen);
+    if(n <= 0) {
+        return n < 0 && (errno == EINTR || errno == EAGAIN);
+    }
+    client->rxLen += n;
+
+    /* Binary mode is selected by the first byte of the connection */
+    if(client->mode == MODE_NEW) {
+        if((uint8_t)client->rx[0] == CO_CMDPOOL_BIN_MAGIC) {
+            client->mode = MODE_BINARY;
+            client->rxLen--;
+            memmove(client->rx, client->rx + 1, client->rxLen);
+        }
+        else {
+            client->mode = MODE_TEXT;
+        }
+    }
+    if(client->mode == MODE_BINARY) {
+        processFrames(slot);
+        return true;
+    }
+
+    client->rx[client->rxLen] = 0;
+
+    start = client->rx;
+    /* Rest of a too long line is not a request, drop it up to its newline */
+    if(client->rxDiscard) {
+        nl = strchr(start, '\n');
+        if(nl == NULL) {
+            client->rxLen = 0;
+            return true;
+        }
+        client->rxDiscard = false;
+        start = nl + 1;
+    }
+    while((nl = strchr(start, '\n')) != NULL) {
+        uint32_t sequence = 0;
+        int err;
+
+        *nl = 0;
+        err = processLine(start, slot, &sequence);
+        if(err != 0) {
+            char resp[RESP_SIZE];
+
+            snprintf(resp, RESP_SIZE, "[%u] ERROR: %d\r\n", sequence, err);
+            pthread_mutex_lock(&connMtx);
+            client->rejected++;
+            queueResponse(client, resp);
+            pthread_mutex_unlock(&connMtx);
+        }
+        start = nl + 1;
+    }
+
+    client->rxLen -= start - client->rx;
+    memmove(client->rx, start, client->rxLen);
+
+    /* Line too long, drop it together with the rest up to its newline. */
+    if(client->rxLen >= sizeof(client->rx) - 1) {
+        char resp[RESP_SIZE];
+
+        snprintf(resp, RESP_SIZE, "[0] ERROR: %d\r\n", CO_CMDPOOL_ERR_SYNTAX);
+        pthread_mutex_lock(&connMtx);
+        client->rejected++;
+        queueResponse(client, resp);
+        pthread_mutex_unlock(&connMtx);
+        client->rxLen = 0;
+        client->rxDiscard = true;
+    }
+
+    return true;
+}
+
+
+static void acceptClient(void) {
+    struct epoll_event ev;
+    int fd, slot;
+
+    fd = accept(fdSocket, NULL, NULL);
+    if(fd < 0) {
+        if(errno != EAGAIN && errno != EINTR) {
+            CO_error(0x15100000L + errno);
+        }
+        return;
+    }
+
+    for(slot=0; slot<CO_CMDPOOL_CLIENTS && clients[slot].fd >= 0; slot++);
+    if(slot == CO_CMDPOOL_CLIENTS) {
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&connMtx);
+    memset(&clients[slot], 0, sizeof(cmdClient_t));
+    clients[slot].fd = fd;
+    clients[slot].id = clientIdNext++;
+    clients[slot].priority = CO_SDO_POOL_PRIO_NORMAL;
+    clients[slot].latencyMin_us = UINT32_MAX;
+    ev.events = EPOLLIN;
+    ev.data.u32 = slot;
+    if(epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        clients[slot].fd = -1;
+    }
+    pthread_mutex_unlock(&connMtx);
+}
+
+
+/* Command thread, serves all connections. */
+static void* command_thread(void* arg) {
+    while(endProgram == 0) {
+        struct epoll_event ev[8];
+        int ready, i;
+
+        ready = epoll_wait(fdEpoll, ev, 8, -1);
+        if(ready < 0) {
+            if(errno != EINTR) {
+                CO_error(0x15200000L + errno);
+            }
+            continue;
+        }
+
+        for(i=0; i<ready; i++) {
+            uint32_t slot = ev[i].data.u32;
+
+            if(slot == EV_LISTEN) {
+                acceptClient();
+            }
+            else if(slot == EV_WAKE) {
+                uint64_t n;
+
+                if(read(fdWake, &n, sizeof(n)) != sizeof(n)) {
+                    /* nothing */
+                }
+            }
+            else if(clients[slot].fd >= 0
+                    && (((ev[i].events & EPOLLIN) && !readClient(slot))
+                        || (ev[i].events & (EPOLLERR | EPOLLHUP))))
+            {
+                closeClient(slot);
+            }
+        }
+
+        /* Responses from mainline and from local requests */
+        for(i=0; i<CO_CMDPOOL_CLIENTS; i++) {
+            if(clients[i].fd >= 0 && !flushClient(i)) {
+                closeClient(i);
+            }
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,135 @@
+/*
+ * Parallel command interface for CANopen SDO transfers.
+ *
+ * @file        CO_commandPool.h
+ *
+ * Socket command interface with the same request syntax as canopencomm, but
+ * SDO requests are dispatched to CO_SDOclientPool, one client per node.
+ * Client may send many requests without waiting for responses (pipelining).
+ * Requests to different nodes run concurrently, requests to the same node run
+ * in order. Responses are sent as transfers finish, so they may come out of
+ * order and must be matched by the sequence number.
+ *
+ * Up to CO_CMDPOOL_CLIENTS clients may be connected at the same time. All are
+ * served by one thread with epoll, each has own request line buffer and
+ * response queue, so a slow client does not delay the others. Each client
+ * has a priority for its SDO requests (CO_SDO_POOL_PRIO_*, normal by
+ * default): on each node, queued requests with higher priority run first,
+ * and low priority requests can't fill the queue. For example the walking
+ * program sets 'high' and diagnostic scripts set 'low'.
+ *
+ * Each request is one line, terminated by '\n':
+ *   [<sequence>] <node> read  <index> <subindex> <datatype>
+ *   [<sequence>] <node> write <index> <subindex> <datatype> <value>
+ *   [<sequence>] priority <high|normal|low>
+ *   [<sequence>] stats
+ *
+ * Datatypes are i8, i16, i32, u8, u16, u32, x8, x16 and x32 (expedited
+ * transfers only). Responses:
+ *   [<sequence>] OK
+ *   [<sequence>] <value>
+ *   [<sequence>] ERROR: 0x<SDO abort code>
+ *   [<sequence>] ERROR: <CO_CMDPOOL_ERR_*>
+ *
+ * 'stats' responds with one line for each connected client (own client is
+ * marked with '*'), followed by OK:
+ *   [<sequence>] client <id>[*] prio <p> requests <n> errors <n> rejected <n>
+ *     dropped <n> inflight <n>/<max> latency_us <min>/<avg>/<max>
+ * Latency is from reception of the request line to its response, errors are
+ * SDO aborts and timeouts, rejected are requests with local error and dropped
+ * are responses, which did not fit into the response queue.
+ *
+ * Each request in flight has space for its response reserved in the response
+ * queue of the client. A request is rejected with CO_CMDPOOL_ERR_NOT_PROCESSED,
+ * if there is no space left. So a response is never lost, while the client
+ * is connected. If a local response (rejection, stats) does not fit, the
+ * client does not read its responses and is disconnected.
+ *
+ * Binary mode: if the first byte sent on a connection is
+ * CO_CMDPOOL_BIN_MAGIC, the connection uses fixed size frames instead of
+ * text lines, so clients (see CO_ODclient.hpp) don't format and parse
+ * text. Requests are CO_cmdPoolBinReq_t, responses CO_cmdPoolBinResp_t,
+ * numbers in host byte order and data little endian, as on CAN. Sequence,
+ * pipelining, priorities and statistics are the same as in text mode.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_COMMAND_POOL_H
+#define CO_COMMAND_POOL_H
+
+#include <stdint.h>
+
+
+/* Maximum number of connected clients. */
+#ifndef CO_CMDPOOL_CLIENTS
+#define CO_CMDPOOL_CLIENTS              16
+#endif
+
+
+/* Local error codes in responses */
+#define CO_CMDPOOL_ERR_NOT_SUPPORTED    100     /* Request or datatype not supported */
+#define CO_CMDPOOL_ERR_SYNTAX           101     /* Syntax error */
+#define CO_CMDPOOL_ERR_NOT_PROCESSED    102     /* Node not in pool, its queue or response queue is full */
+
+
+/* First byte of a binary mode connection, can't start a text request. */
+#define CO_CMDPOOL_BIN_MAGIC            0xB1
+
+/* Binary request operations */
+#define CO_CMDPOOL_BIN_READ             1       /* SDO upload of size bytes */
+#define CO_CMDPOOL_BIN_WRITE            2       /* SDO download of size bytes */
+#define CO_CMDPOOL_BIN_PRIORITY         3       /* data[0] is CO_SDO_POOL_PRIO_* */
+
+
+/**
+ * Binary request, 16 bytes.
+ */
+typedef struct {
+    uint32_t            sequence;       /**< Returned in the response. */
+    uint8_t             op;             /**< CO_CMDPOOL_BIN_*. */
+    uint8_t             nodeId;         /**< 1..127. */
+    uint16_t            index;          /**< Object Dictionary index. */
+    uint8_t             subIndex;       /**< Object Dictionary subindex. */
+    uint8_t             size;           /**< 1, 2 or 4 bytes. */
+    uint8_t             reserved[2];
+    uint8_t             data[4];        /**< Data to write, little endian. */
+} CO_cmdPoolBinReq_t;
+
+
+/**
+ * Binary response, 16 bytes.
+ */
+typedef struct {
+    uint32_t            sequence;       /**< From the request. */
+    uint32_t            result;         /**< 0, SDO abort code or CO_CMDPOOL_ERR_*. */
+    uint8_t             size;           /**< Size of data read. */
+    uint8_t             reserved[3];
+    uint8_t             data[4];        /**< Data read, little endian. */
+} CO_cmdPoolBinResp_t;
+
+
+/* Socket path, may be changed before CO_commandPool_init(). */
+extern char *CO_commandPool_socketPath;
+
+
+/**
+ * Create socket and thread, which serves all clients of the parallel command
+ * interface.
+ * Call after CO_SDOpool_init().
+ *
+ * @return 0 on success.
+ */
+int CO_commandPool_init(void);
+
+
+/**
+ * Close sockets and join the thread. Responses in progress are dropped.
+ *
+ * @return 0 on success.
+ */
+int CO_commandPool_clear(void);
+
+
+#endif
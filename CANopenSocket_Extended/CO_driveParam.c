@@ -0,0 +1,167 @@
+/*
+ * Synchronization of profile parameters to all drives.
+ *
+ * @file        CO_driveParam.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_driveParam.h"
+#include "CO_SDOclientPool.h"
+#include "CO_Linux_tasks.h"
+#include "CO_lockStats.h"
+#include <string.h>
+
+
+/* CiA 402 profile objects */
+#define OD_6081_PROFILE_VELOCITY        0x6081
+#define OD_6083_PROFILE_ACCELERATION    0x6083
+#define OD_6084_PROFILE_DECELERATION    0x6084
+
+
+/* State of the synchronization in progress. Used from mainline only:
+ * CO_driveParam_sync() and CO_driveParam_process() run there, SDO client pool
+ * calls driveParam_sdoDone() from CO_SDOpool_process(). */
+static uint8_t      syncPending = 0;
+static int          syncResult;
+static void       (*syncDone)(void *object, int result);
+static void        *syncObject;
+
+/* Set by CO_ODF_driveParam() in the thread of the SDO server or command
+ * interface, taken by CO_driveParam_process() in mainline. */
+static bool_t       odRequest = false;
+
+
+/* Called by SDO client pool for each finished write. */
+static void driveParam_sdoDone(void *object, const CO_SDOpool_req_t *req,
+                               CO_SDOclient_return_t ret, uint32_t abortCode)
+{
+    if(ret != CO_SDOcli_ok_communicationEnd && syncResult == CO_DRIVE_PARAM_DONE) {
+        syncResult = -(int)req->nodeId;
+        CO_error(0x21100000L | ((uint32_t)req->nodeId << 16) | req->index);
+    }
+
+    if(--syncPending == 0 && syncDone != NULL) {
+        syncDone(syncObject, syncResult);
+    }
+}
+
+
+/******************************************************************************/
+int CO_driveParam_sync(
+        const CO_driveParam_t   params[],
+        uint8_t                 count,
+        void                  (*done)(void *object, int result),
+        void                   *object)
+{
+    CO_SDOpool_req_t req;
+    int i, j;
+
+    if(syncPending > 0 || params == NULL || count == 0 || count > CO_SDO_POOL_SIZE) {
+        return -1;
+    }
+
+    syncResult = CO_DRIVE_PARAM_DONE;
+    syncDone = done;
+    syncObject = object;
+
+    memset(&req, 0, sizeof(req));
+    req.upload = false;
+    req.dataSize = 4;
+    req.callback = driveParam_sdoDone;
+
+    /* Queue all writes first. Pool processes the drives concurrently. */
+    for(i=0; i<count; i++) {
+        const uint16_t index[3] = {OD_6081_PROFILE_VELOCITY, OD_6083_PROFILE_ACCELERATION, OD_6084_PROFILE_DECELERATION};
+        const int32_t value[3] = {params[i].profileVelocity, params[i].profileAcceleration, params[i].profileDeceleration};
+
+        req.nodeId = params[i].nodeId;
+        for(j=0; j<3; j++) {
+            req.index = index[j];
+            req.subIndex = 0;
+            CO_setUint32(req.data, (uint32_t)value[j]);
+            if(CO_SDOpool_post(&req) == 0) {
+                syncPending++;
+            }
+            else if(syncResult == CO_DRIVE_PARAM_DONE) {
+                syncResult = -(int)req.nodeId;
+            }
+        }
+    }
+
+    /* Nothing could be queued, report immediately. */
+    if(syncPending == 0 && syncDone != NULL) {
+        syncDone(syncObject, syncResult);
+    }
+
+    return 0;
+}
+
+
+/* Completion of synchronization started through Object Dictionary. */
+static void driveParam_odDone(void *object, int result) {
+    (void)object;
+    CO_LOCK_OD();
+    OD_variableInt32[CO_DRIVE_PARAM_SUB_CTRL - 1] = result;
+    CO_UNLOCK_OD();
+}
+
+
+/* Object Dictionary function for 0x2110. */
+static CO_SDO_abortCode_t CO_ODF_driveParam(CO_ODF_arg_t *ODF_arg) {
+    int32_t value;
+
+    if(ODF_arg->reading || ODF_arg->subIndex != CO_DRIVE_PARAM_SUB_CTRL) {
+        return CO_SDO_AB_NONE;
+    }
+
+    value = (int32_t)CO_getUint32(ODF_arg->data);
+    if(value != 1) {
+        return CO_SDO_AB_INVALID_VALUE;
+    }
+
+    /* Status is written with the OD locked, as this function is called */
+    if(OD_variableInt32[CO_DRIVE_PARAM_SUB_CTRL - 1] == CO_DRIVE_PARAM_BUSY) {
+        return CO_SDO_AB_DATA_DEV_STATE;
+    }
+
+    /* Only record the request, mainline starts it. Stored value becomes
+     * status, which is updated on completion. */
+    __atomic_store_n(&odRequest, true, __ATOMIC_RELEASE);
+    taskMain_cbSignal();
+    CO_setUint32(ODF_arg->data, (uint32_t)CO_DRIVE_PARAM_BUSY);
+
+    return CO_SDO_AB_NONE;
+}
+
+
+/******************************************************************************/
+void CO_driveParam_process(void) {
+    CO_driveParam_t params[CO_DRIVE_PARAM_JOINTS];
+    int i;
+
+    if(!__atomic_load_n(&odRequest, __ATOMIC_ACQUIRE) || syncPending > 0) {
+        return;
+    }
+    __atomic_store_n(&odRequest, false, __ATOMIC_RELAXED);
+
+    /* Parameters are stored in sub 1..12, this node is holding them. */
+    CO_LOCK_OD();
+    for(i=0; i<CO_DRIVE_PARAM_JOINTS; i++) {
+        params[i].nodeId = i + 1;
+        params[i].profileVelocity = OD_variableInt32[i*3];
+        params[i].profileAcceleration = OD_variableInt32[i*3 + 1];
+        params[i].profileDeceleration = OD_variableInt32[i*3 + 2];
+    }
+    CO_UNLOCK_OD();
+
+    CO_driveParam_sync(params, CO_DRIVE_PARAM_JOINTS, driveParam_odDone, NULL);
+}
+
+
+/******************************************************************************/
+void CO_driveParam_init(CO_SDO_t *SDO) {
+    CO_OD_configure(SDO, OD_2110_variableInt32, CO_ODF_driveParam, NULL, 0, 0U);
+}
@@ -0,0 +1,87 @@
+/*
+ * Synchronization of profile parameters to all drives.
+ *
+ * @file        CO_driveParam.h
+ *
+ * Writes profile velocity (0x6081), profile acceleration (0x6083) and
+ * profile deceleration (0x6084) of all joints with expedited SDOs. Each drive
+ * has its own SDO client in CO_SDOclientPool, so all drives are written
+ * concurrently and the owner gets a single completion callback.
+ *
+ * Parameter set may also be applied through Object Dictionary of this node,
+ * so canFeast programs can use it with local SDO writes only:
+ *  - 0x2110, sub 1..12: velocity, acceleration and deceleration for joint 1,
+ *    then joint 2, ... (joint N is node-ID N).
+ *  - 0x2110, sub 13: write 1 to start the synchronization. Reads
+ *    CO_DRIVE_PARAM_BUSY while in progress, CO_DRIVE_PARAM_DONE on success or
+ *    -node-ID of the first failed drive. Write while busy is aborted. The
+ *    write only records the request, CO_driveParam_process() starts it.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_DRIVE_PARAM_H
+#define CO_DRIVE_PARAM_H
+
+#include "CANopen.h"
+
+
+/* Number of joints handled by Object Dictionary interface. */
+#define CO_DRIVE_PARAM_JOINTS       4
+
+/* Status values in 0x2110, sub 13 */
+#define CO_DRIVE_PARAM_DONE         0
+#define CO_DRIVE_PARAM_BUSY         1
+
+/* Subindex of 0x2110 used for start and status */
+#define CO_DRIVE_PARAM_SUB_CTRL     (CO_DRIVE_PARAM_JOINTS * 3 + 1)
+
+
+/**
+ * Profile parameters for one drive.
+ */
+typedef struct {
+    uint8_t             nodeId;
+    int32_t             profileVelocity;        /**< 0x6081 */
+    int32_t             profileAcceleration;    /**< 0x6083 */
+    int32_t             profileDeceleration;    /**< 0x6084 */
+} CO_driveParam_t;
+
+
+/**
+ * Initialize drive parameter synchronization. Registers Object Dictionary
+ * function for 0x2110. Call after each CO_init().
+ *
+ * @param SDO SDO server object.
+ */
+void CO_driveParam_init(CO_SDO_t *SDO);
+
+
+/**
+ * Start synchronization requested through 0x2110, sub 13. Call from mainline
+ * on each wakeup, before CO_SDOpool_process().
+ */
+void CO_driveParam_process(void);
+
+
+/**
+ * Start synchronization of parameter sets to drives. Call from mainline.
+ *
+ * @param params Parameter sets, one per drive. Copied.
+ * @param count Number of parameter sets, up to CO_SDO_POOL_SIZE.
+ * @param done Called from mainline, when all drives are written. result is
+ * CO_DRIVE_PARAM_DONE or -node-ID of the first failed drive.
+ * @param object Passed to done.
+ *
+ * @return 0 on success, -1 if synchronization is already in progress or
+ * arguments are wrong.
+ */
+int CO_driveParam_sync(
+        const CO_driveParam_t   params[],
+        uint8_t                 count,
+        void                  (*done)(void *object, int result),
+        void                   *object);
+
+
+#endif
@@ -0,0 +1,454 @@
+/*
+ * Fault monitor for the drives with reaction in the RT thread.
+ *
+ * @file        CO_faultMonitor.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_faultMonitor.h"
+#include "CO_CANbus.h"
+#include "CO_lockStats.h"
+#include "CO_clock.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define NO_HB_NODES         (sizeof(OD_consumerHeartbeatTime) / sizeof(OD_consumerHeartbeatTime[0]))
+#define NO_MOTORS           4
+#define EVENT_QUEUE_SIZE    32      /* Events from RT to mainline, power of 2 */
+#define CW_QUICK_STOP       0x0002
+#define SW_FAULT            0x0008
+
+
+/* Heartbeat consumer state of one 0x1016 entry */
+typedef struct {
+    uint8_t             nodeId;
+    uint16_t            time_ms;
+    uint64_t            last_ns;        /* 0 until first heartbeat */
+    uint8_t             NMTstate;
+    bool_t              timedOut;
+} hbNode_t;
+
+/* Event for the mainline */
+typedef struct {
+    uint32_t            count;          /* 0 for 'cleared' */
+    uint8_t             nodeId;
+    uint8_t             type;
+    uint32_t            code;
+    bool_t              latched;
+    uint64_t            time_ns;        /* CO_clock_tickNs() of detection */
+} faultEvent_t;
+
+
+char                       *CO_faultMonitor_socketPath = "/tmp/CO_fault_socket";
+
+static pthread_mutex_t      monMtx;
+static hbNode_t             hbNodes[NO_HB_NODES];
+static uint16_t             swPrev[NO_MOTORS];
+static bool_t               reactPending = false;
+static bool_t               latched = false;
+static faultEvent_t         events[EVENT_QUEUE_SIZE];
+static uint32_t             eventHead = 0;  /* written under monMtx */
+static uint32_t             eventTail = 0;  /* mainline only */
+static uint32_t             eventsDropped = 0;
+static int                  fdEvent = -1;
+static int                  fdSocket = -1;
+static int                  fdClients[CO_FAULT_MON_CLIENTS];
+static int                  epollFd = -1;
+
+static const char          *typeNames[] = {"", "heartbeat-timeout", "heartbeat-state", "emcy", "statusword"};
+
+
+/* Record fault and queue event. Call with monMtx locked. */
+static void reportFault(uint8_t nodeId, CO_faultType_t type, uint32_t code) {
+    uint64_t one = 1;
+
+    OD_faultMonitor[ODA_faultMonitor_count]++;
+    OD_faultMonitor[ODA_faultMonitor_node] = nodeId;
+    OD_faultMonitor[ODA_faultMonitor_type] = type;
+    OD_faultMonitor[ODA_faultMonitor_code] = code;
+    if(OD_faultMonitor[ODA_faultMonitor_reaction] != 0) {
+        reactPending = true;
+    }
+
+    if(eventHead - eventTail < EVENT_QUEUE_SIZE) {
+        faultEvent_t *ev = &events[eventHead % EVENT_QUEUE_SIZE];
+
+        ev->count = OD_faultMonitor[ODA_faultMonitor_count];
+        ev->nodeId = nodeId;
+        ev->type = type;
+        ev->code = code;
+        ev->latched = reactPending || latched;
+        ev->time_ns = CO_clock_tickNs();
+        __atomic_store_n(&eventHead, eventHead + 1, __ATOMIC_RELEASE);
+    }
+    else {
+        eventsDropped++;
+    }
+    if(fdEvent >= 0 && write(fdEvent, &one, sizeof(one)) != sizeof(one)) {
+        /* eventfd counter overflow only, mainline is woken anyway */
+    }
+}
+
+
+/* Write quick stop to all controlwords. Call with OD locked.
+ *
+ * @return True, if any controlword was changed. */
+static bool_t setQuickStop(void) {
+    if(OD_controlWords.motor1 == CW_QUICK_STOP && OD_controlWords.motor2 == CW_QUICK_STOP
+       && OD_controlWords.motor3 == CW_QUICK_STOP && OD_controlWords.motor4 == CW_QUICK_STOP)
+    {
+        return false;
+    }
+    OD_controlWords.motor1 = CW_QUICK_STOP;
+    OD_controlWords.motor2 = CW_QUICK_STOP;
+    OD_controlWords.motor3 = CW_QUICK_STOP;
+    OD_controlWords.motor4 = CW_QUICK_STOP;
+    return true;
+}
+
+
+/* Write quick stop to all controlwords, send TPDOs with changed ones. Call
+ * from the RT thread. */
+static void enforceQuickStop(void) {
+    int i;
+
+    CO_LOCK_OD();
+    if(setQuickStop()) {
+        for(i=0; i<CO_NO_TPDO; i++) {
+            CO_TPDO_t *TPDO = CO->TPDO[i];
+
+            if(TPDO->valid && *TPDO->operatingState == CO_NMT_OPERATIONAL
+               && (OD_TPDOMappingParameter[i].mappedObject1 >> 16) == 0x6040) {
+                CO_TPDOsend(TPDO);
+            }
+        }
+    }
+    CO_UNLOCK_OD();
+}
+
+
+/* Controlwords by SDO: only quick stop is accepted while latched. */
+static CO_SDO_abortCode_t CO_ODF_controlWords(CO_ODF_arg_t *ODF_arg) {
+    if(ODF_arg->reading || ODF_arg->subIndex == 0 || !__atomic_load_n(&latched, __ATOMIC_ACQUIRE)) {
+        return CO_SDO_AB_NONE;
+    }
+    if(CO_getUint16(ODF_arg->data) != CW_QUICK_STOP) {
+        return CO_SDO_AB_DATA_DEV_STATE;
+    }
+
+    return CO_SDO_AB_NONE;
+}
+
+
+/******************************************************************************/
+CO_ReturnError_t CO_faultMonitor_init(int mainline_epoll_fd, bool_t socketEnable) {
+    pthread_mutexattr_t mattr;
+    struct epoll_event ev;
+    int i;
+
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&monMtx, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    for(i=0; i<CO_FAULT_MON_CLIENTS; i++) {
+        fdClients[i] = -1;
+    }
+    epollFd = mainline_epoll_fd;
+
+    fdEvent = eventfd(0, EFD_NONBLOCK);
+    if(fdEvent < 0) {
+        return CO_ERROR_SYSCALL;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = fdEvent;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fdEvent, &ev) != 0) {
+        return CO_ERROR_SYSCALL;
+    }
+
+    if(socketEnable) {
+        struct sockaddr_un addr;
+
+        fdSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if(fdSocket < 0) {
+            return CO_ERROR_SYSCALL;
+        }
+        memset(&addr, 0, sizeof(struct sockaddr_un));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, CO_faultMonitor_socketPath, sizeof(addr.sun_path) - 1);
+        unlink(CO_faultMonitor_socketPath);
+        if(bind(fdSocket, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) != 0
+           || listen(fdSocket, 5) != 0) {
+            close(fdSocket);
+            fdSocket = -1;
+            return CO_ERROR_SYSCALL;
+        }
+        ev.data.fd = fdSocket;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fdSocket, &ev) != 0) {
+            return CO_ERROR_SYSCALL;
+        }
+    }
+
+    return CO_ERROR_NO;
+}
+
+
+/******************************************************************************/
+void CO_faultMonitor_bind(CO_CANbatch_t *batch) {
+    /* Entries are filled from 0x1016 in the next CO_faultMonitor_process() */
+    pthread_mutex_lock(&monMtx);
+    memset(hbNodes, 0, sizeof(hbNodes));
+    memset(swPrev, 0, sizeof(swPrev));
+    pthread_mutex_unlock(&monMtx);
+
+    CO_CANbatch_initCallback(batch, NULL, CO_faultMonitor_rxFrame);
+    CO_CANbus_initCallback(NULL, CO_faultMonitor_rxFrame);
+    CO_OD_configure(CO->SDO[0], OD_6040_controlWords, CO_ODF_controlWords, NULL, 0, 0U);
+}
+
+
+/******************************************************************************/
+void CO_faultMonitor_rxFrame(void *object, const CO_CANrxMsg_t *msg, const struct timespec *timestamp) {
+    uint16_t ident = msg->ident & 0x7FF;
+    uint8_t nodeId = ident & 0x7F;
+    unsigned i;
+
+    if(nodeId == 0 || nodeId == CO->NMT->nodeId) {
+        return;
+    }
+
+    if((ident & 0x780) == 0x700 && msg->DLC >= 1) {
+        /* Heartbeat or boot-up */
+        uint8_t state = msg->data[0] & 0x7F;
+
+        pthread_mutex_lock(&monMtx);
+        for(i=0; i<NO_HB_NODES; i++) {
+            hbNode_t *hb = &hbNodes[i];
+
+            if(hb->nodeId != nodeId || hb->time_ms == 0) {
+                continue;
+            }
+            if(hb->NMTstate == CO_NMT_OPERATIONAL && state != CO_NMT_OPERATIONAL) {
+                reportFault(nodeId, CO_FAULT_HB_STATE, state);
+            }
+            hb->NMTstate = state;
+            hb->last_ns = CO_clock_tickNs();
+            hb->timedOut = false;
+        }
+        pthread_mutex_unlock(&monMtx);
+    }
+    else if((ident & 0x780) == 0x080 && msg->DLC >= 3) {
+        /* Emergency, error code 0 is error reset */
+        uint16_t errorCode = msg->data[0] | ((uint16_t)msg->data[1] << 8);
+
+        if(errorCode != 0) {
+            pthread_mutex_lock(&monMtx);
+            reportFault(nodeId, CO_FAULT_EMCY, errorCode | ((uint32_t)msg->data[2] << 16));
+            pthread_mutex_unlock(&monMtx);
+        }
+    }
+}
+
+
+/******************************************************************************/
+void CO_faultMonitor_process(void) {
+    const uint16_t *sw[NO_MOTORS] = {&OD_statusWords.motor1, &OD_statusWords.motor2,
+                                     &OD_statusWords.motor3, &OD_statusWords.motor4};
+    uint64_t now = CO_clock_tickNs();
+    bool_t react, clear = false;
+    unsigned i;
+
+    pthread_mutex_lock(&monMtx);
+
+    /* Consumer heartbeat entries may be changed by SDO */
+    for(i=0; i<NO_HB_NODES; i++) {
+        hbNode_t *hb = &hbNodes[i];
+        uint32_t entry = OD_consumerHeartbeatTime[i];
+        uint8_t nodeId = (entry >> 16) & 0x7F;
+
+        if(hb->nodeId != nodeId || hb->time_ms != (entry & 0xFFFF)) {
+            memset(hb, 0, sizeof(*hb));
+            hb->nodeId = nodeId;
+            hb->time_ms = entry & 0xFFFF;
+        }
+        if(hb->time_ms != 0 && hb->last_ns != 0 && !hb->timedOut
+           && now - hb->last_ns > (uint64_t)hb->time_ms * 1000000ULL) {
+            hb->timedOut = true;
+            hb->NMTstate = CO_NMT_INITIALIZING;
+            reportFault(nodeId, CO_FAULT_HB_TIMEOUT, hb->time_ms);
+        }
+    }
+
+    /* Fault bit of statusword, rising edge */
+    for(i=0; i<NO_MOTORS; i++) {
+        uint16_t s = *sw[i];
+
+        if((s & SW_FAULT) && !(swPrev[i] & SW_FAULT)) {
+            reportFault(i + 1, CO_FAULT_STATUSWORD, s);
+        }
+        swPrev[i] = s;
+    }
+
+    /* Latch is cleared by writing 0 to OD */
+    if(latched && OD_faultMonitor[ODA_faultMonitor_latched] == 0 && !reactPending) {
+        __atomic_store_n(&latched, false, __ATOMIC_RELEASE);
+        clear = true;
+    }
+    if(reactPending) {
+        reactPending = false;
+        __atomic_store_n(&latched, true, __ATOMIC_RELEASE);
+        OD_faultMonitor[ODA_faultMonitor_latched] = 1;
+    }
+    react = latched;
+
+    if(clear && eventHead - eventTail < EVENT_QUEUE_SIZE) {
+        uint64_t one = 1;
+
+        memset(&events[eventHead % EVENT_QUEUE_SIZE], 0, sizeof(faultEvent_t));
+        events[eventHead % EVENT_QUEUE_SIZE].time_ns = now;
+        __atomic_store_n(&eventHead, eventHead + 1, __ATOMIC_RELEASE);
+        if(write(fdEvent, &one, sizeof(one)) != sizeof(one)) {
+            /* mainline is woken anyway */
+        }
+    }
+
+    pthread_mutex_unlock(&monMtx);
+
+    if(react) {
+        enforceQuickStop();
+    }
+}
+
+
+/* Send line to all clients, close the ones, which don't accept it. */
+static void publish(const char *line) {
+    size_t len = strlen(line);
+    int i;
+
+    for(i=0; i<CO_FAULT_MON_CLIENTS; i++) {
+        if(fdClients[i] >= 0 && send(fdClients[i], line, len, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)len) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fdClients[i], NULL);
+            close(fdClients[i]);
+            fdClients[i] = -1;
+        }
+    }
+}
+
+
+/******************************************************************************/
+void CO_faultMonitor_enforce(void) {
+    if(__atomic_load_n(&latched, __ATOMIC_ACQUIRE)) {
+        setQuickStop();
+    }
+}
+
+
+/******************************************************************************/
+bool_t CO_faultMonitor_processFd(int fd) {
+    int i;
+
+    if(fd < 0) {
+        return false;
+    }
+
+    if(fd == fdEvent) {
+        uint64_t n;
+        uint32_t head;
+
+        if(read(fdEvent, &n, sizeof(n)) != sizeof(n)) {
+            return true;
+        }
+        head = __atomic_load_n(&eventHead, __ATOMIC_ACQUIRE);
+        while(eventTail != head) {
+            faultEvent_t *ev = &events[eventTail % EVENT_QUEUE_SIZE];
+            char line[120];
+
+            if(ev->count == 0) {
+                snprintf(line, sizeof(line), "CLEARED time=%llu\n", (unsigned long long)ev->time_ns);
+            }
+            else {
+                snprintf(line, sizeof(line), "FAULT %u node=%u type=%s code=0x%08X latched=%d time=%llu\n",
+                         ev->count, ev->nodeId, typeNames[ev->type], ev->code, ev->latched ? 1 : 0,
+                         (unsigned long long)ev->time_ns);
+            }
+            eventTail++;
+            fprintf(stderr, "canopend fault monitor: %s", line);
+            publish(line);
+        }
+        if(eventsDropped > 0) {
+            fprintf(stderr, "canopend fault monitor: %u events dropped\n", eventsDropped);
+            eventsDropped = 0;
+        }
+        return true;
+    }
+
+    if(fd == fdSocket) {
+        int fdNew = accept(fdSocket, NULL, NULL);
+
+        if(fdNew >= 0) {
+            struct epoll_event ev;
+
+            for(i=0; i<CO_FAULT_MON_CLIENTS && fdClients[i] >= 0; i++);
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fdNew;
+            if(i == CO_FAULT_MON_CLIENTS || epoll_ctl(epollFd, EPOLL_CTL_ADD, fdNew, &ev) != 0) {
+                close(fdNew);
+            }
+            else {
+                fdClients[i] = fdNew;
+            }
+        }
+        return true;
+    }
+
+    /* Clients only listen, input is discarded, hang-up or error closes them. */
+    for(i=0; i<CO_FAULT_MON_CLIENTS; i++) {
+        if(fd == fdClients[i]) {
+            char buf[64];
+
+            if(read(fd, buf, sizeof(buf)) <= 0) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                fdClients[i] = -1;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/******************************************************************************/
+void CO_faultMonitor_close(void) {
+    int i;
+
+    for(i=0; i<CO_FAULT_MON_CLIENTS; i++) {
+        if(fdClients[i] >= 0) {
+            close(fdClients[i]);
+            fdClients[i] = -1;
+        }
+    }
+    if(fdSocket >= 0) {
+        close(fdSocket);
+        unlink(CO_faultMonitor_socketPath);
+        fdSocket = -1;
+    }
+    if(fdEvent >= 0) {
+        close(fdEvent);
+        fdEvent = -1;
+    }
+}
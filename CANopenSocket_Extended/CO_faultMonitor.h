@@ -0,0 +1,135 @@
+/*
+ * Fault monitor for the drives with reaction in the RT thread.
+ *
+ * @file        CO_faultMonitor.h
+ *
+ * Drive faults were only found by polling 0x6041 and 0x1002 with SDO
+ * (errorStatusCheck.sh). This module detects them from the messages, which
+ * canopend receives anyway:
+ *  - Heartbeat of the nodes from the consumer heartbeat entries (0x1016,
+ *    node ID in bits 16..22, time in ms in bits 0..15): timeout after the
+ *    first heartbeat, or change from operational to other NMT state.
+ *  - Emergency messages (0x80 + node ID) with error code other than 0.
+ *  - Fault bit (3) of statusword of each motor (0x6041, motor n is node n),
+ *    as received by RPDO.
+ * Heartbeat and emergency frames are examined by the receive callback of
+ * CO_CANbatch (also of additional CAN interfaces), statusword in each 1 ms
+ * cycle of the RT thread.
+ *
+ * Reaction is also done in the 1 ms cycle of the RT thread, after RPDOs and
+ * TPDOs are processed, so within 1 ms from reception of the fault: if
+ * enabled, quick stop controlword (0x0002) is written to all motors (0x6040)
+ * and TPDOs with controlwords are sent immediately. Quick stop is latched
+ * until latch is cleared: SDO writes of other controlwords are aborted and
+ * CO_faultMonitor_enforce() overwrites controlwords written by the
+ * application before each TPDO processing and SYNC producer transmission.
+ *
+ * Object Dictionary 0x2113 (UNSIGNED32 array):
+ *  1 reaction:  0 = report only, 1 = quick stop all motors.
+ *  2 latched:   1 while quick stop is latched, write 0 to clear.
+ *  3 count:     Number of detected faults.
+ *  4 node:      Node ID of the last fault.
+ *  5 type:      Type of the last fault (CO_faultType_t).
+ *  6 code:      EMCY error code and register (bits 16..23), statusword or
+ *               NMT state of the last fault.
+ *
+ * Events are also passed to the mainline and published as text lines to
+ * clients of optional unix socket, for example with
+ * 'socat - UNIX-CONNECT:/tmp/CO_fault_socket':
+ *   FAULT <count> node=<node ID> type=<type> code=0x<code> latched=<0|1> time=<ns>
+ *   CLEARED time=<ns>
+ * Time is the RT cycle of detection, CO_clock_tickNs().
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_FAULT_MONITOR_H
+#define CO_FAULT_MONITOR_H
+
+#include "CANopen.h"
+#include "CO_CANbatch.h"
+
+
+/* Maximum number of connected clients of the event socket. */
+#ifndef CO_FAULT_MON_CLIENTS
+#define CO_FAULT_MON_CLIENTS        8
+#endif
+
+
+/**
+ * Type of a fault.
+ */
+typedef enum {
+    CO_FAULT_HB_TIMEOUT     = 1,    /**< No heartbeat within consumer time. */
+    CO_FAULT_HB_STATE       = 2,    /**< Node left NMT operational state. */
+    CO_FAULT_EMCY           = 3,    /**< Emergency message. */
+    CO_FAULT_STATUSWORD     = 4     /**< Fault bit in statusword. */
+} CO_faultType_t;
+
+
+/* Socket path, may be changed before CO_faultMonitor_init(). */
+extern char *CO_faultMonitor_socketPath;
+
+
+/**
+ * Initialize event passing to the mainline and optional event socket. Call
+ * once, after first CO_init().
+ *
+ * @param mainline_epoll_fd epoll of the mainline.
+ * @param socketEnable Open event socket on CO_faultMonitor_socketPath.
+ *
+ * @return CO_ERROR_NO on success.
+ */
+CO_ReturnError_t CO_faultMonitor_init(int mainline_epoll_fd, bool_t socketEnable);
+
+
+/**
+ * Reset monitoring state, set receive callback and 0x6040 access function.
+ * Call after each CO_init(), CO_CANbatch_init() and CO_CANbus_bind().
+ *
+ * @param batch Batched receive of CO->CANmodule[0].
+ */
+void CO_faultMonitor_bind(CO_CANbatch_t *batch);
+
+
+/**
+ * Receive callback for CO_CANbatch_initCallback(). May be called from RT
+ * threads of additional CAN interfaces.
+ */
+void CO_faultMonitor_rxFrame(void *object, const CO_CANrxMsg_t *msg, const struct timespec *timestamp);
+
+
+/**
+ * Check heartbeat timeouts and statusword, react on faults. Call from the RT
+ * thread after each CANrx_taskTmr_process(), which processed the timer.
+ */
+void CO_faultMonitor_process(void);
+
+
+/**
+ * Overwrite controlwords with quick stop, if latched. Call from the RT thread
+ * with OD locked, before TPDOs are processed by CANrx_taskTmr_process() and
+ * after setpoints of the SYNC producer are computed.
+ */
+void CO_faultMonitor_enforce(void);
+
+
+/**
+ * Publish events and serve event socket. Call from the mainline for each
+ * epoll event.
+ *
+ * @param fd File descriptor of the event.
+ *
+ * @return True, if fd belongs to the fault monitor.
+ */
+bool_t CO_faultMonitor_processFd(int fd);
+
+
+/**
+ * Close event socket and its clients.
+ */
+void CO_faultMonitor_close(void);
+
+
+#endif
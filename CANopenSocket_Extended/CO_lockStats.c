@@ -0,0 +1,140 @@
+/*
+ * Hold time and contention statistics of mutexes shared with the RT thread.
+ *
+ * @file        CO_lockStats.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* pthread_getname_np */
+#endif
+
+#include "CO_lockStats.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+
+CO_lockStats_t CO_lockStats_OD = {&CO_OD_mutex};
+
+static __thread bool_t rtThread = false;
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static uint32_t clip32(uint64_t t) {
+    return (t > UINT32_MAX) ? UINT32_MAX : (uint32_t)t;
+}
+
+
+/******************************************************************************/
+void CO_lockStats_init(CO_lockStats_t *ls, pthread_mutex_t *mtx) {
+    memset(ls, 0, sizeof(*ls));
+    ls->mtx = mtx;
+}
+
+
+/******************************************************************************/
+void CO_lockStats_setRtThread(void) {
+    rtThread = true;
+}
+
+
+/******************************************************************************/
+int CO_lockStats_lock(CO_lockStats_t *ls) {
+    int err = pthread_mutex_trylock(ls->mtx);
+    uint64_t now;
+
+    if(err == EBUSY) {
+        uint64_t start = now_ns();
+        uint32_t wait_ns;
+
+        err = pthread_mutex_lock(ls->mtx);
+        if(err != 0) {
+            return err;
+        }
+        now = now_ns();
+        wait_ns = clip32(now - start);
+
+        ls->contended++;
+        ls->waitSum_ns += wait_ns;
+        if(wait_ns > ls->waitMax_ns) ls->waitMax_ns = wait_ns;
+        if(rtThread) {
+            ls->rtContended++;
+            if(wait_ns > ls->rtWaitMax_ns) ls->rtWaitMax_ns = wait_ns;
+        }
+    }
+    else if(err != 0) {
+        return err;
+    }
+    else {
+        now = now_ns();
+    }
+
+    ls->locks++;
+    ls->lockedAt_ns = now;
+    return 0;
+}
+
+
+/******************************************************************************/
+int CO_lockStats_trylock(CO_lockStats_t *ls) {
+    int err = pthread_mutex_trylock(ls->mtx);
+
+    if(err == 0) {
+        ls->locks++;
+        ls->lockedAt_ns = now_ns();
+    }
+    return err;
+}
+
+
+/******************************************************************************/
+void CO_lockStats_unlock(CO_lockStats_t *ls) {
+    uint32_t hold_ns = clip32(now_ns() - ls->lockedAt_ns);
+
+    ls->holdSum_ns += hold_ns;
+    if(hold_ns > ls->holdMax_ns) {
+        ls->holdMax_ns = hold_ns;
+        if(pthread_getname_np(pthread_self(), ls->holdMaxThread, sizeof(ls->holdMaxThread)) != 0) {
+            ls->holdMaxThread[0] = 0;
+        }
+    }
+    pthread_mutex_unlock(ls->mtx);
+}
+
+
+/******************************************************************************/
+void CO_lockStats_toOD(const CO_lockStats_t *ls, uint32_t *od) {
+    od[0] = ls->locks;
+    od[1] = ls->contended;
+    od[2] = ls->waitMax_ns / 1000;
+    od[3] = ls->holdMax_ns / 1000;
+    od[4] = ls->rtWaitMax_ns / 1000;
+}
+
+
+/******************************************************************************/
+void CO_lockStats_printStats(const CO_lockStats_t *ls, const char *name) {
+    printf("%s - %u locks, %u contended (%u by RT threads)", name, ls->locks, ls->contended, ls->rtContended);
+    if(ls->contended > 0) {
+        printf(", wait avg/max %u/%u us, RT wait max %u us",
+               (uint32_t)(ls->waitSum_ns / ls->contended / 1000), ls->waitMax_ns / 1000, ls->rtWaitMax_ns / 1000);
+    }
+    if(ls->locks > 0) {
+        printf(", hold avg/max %u/%u us (%s)",
+               (uint32_t)(ls->holdSum_ns / ls->locks / 1000), ls->holdMax_ns / 1000,
+               ls->holdMaxThread[0] != 0 ? ls->holdMaxThread : "?");
+    }
+    printf("\n");
+}
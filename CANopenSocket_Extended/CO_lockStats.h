@@ -0,0 +1,123 @@
+/*
+ * Hold time and contention statistics of mutexes shared with the RT thread.
+ *
+ * @file        CO_lockStats.h
+ *
+ * rt_thread, the mainline, the command interface and the storage thread
+ * share the Object Dictionary under CO_LOCK_OD(). With priority inheritance
+ * (CO_rt_mutexInitPI()) a thread holding the lock runs with the priority of
+ * the waiting RT thread, but the RT thread still waits as long as the lock
+ * is held. Statistics here show, how long locks are held and by which
+ * thread, and how long the RT thread waited for them.
+ *
+ * Including this header after CANopen.h routes CO_LOCK_OD() and
+ * CO_UNLOCK_OD() of the including file through CO_lockStats_OD. Lock sites
+ * inside CANopenNode (SDO server, PDO processing in the timer task) use
+ * CO_driver.h directly and are counted, if its macros are defined the same
+ * way.
+ *
+ * Object Dictionary 0x2114 (UNSIGNED32 array) for the OD lock, updated by
+ * the mainline:
+ *  1 locks:     Number of locks.
+ *  2 contended: Number of locks, which had to wait.
+ *  3 waitMax:   Maximum wait time in microseconds.
+ *  4 holdMax:   Maximum hold time in microseconds.
+ *  5 rtWaitMax: Maximum wait time of RT threads in microseconds.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_LOCK_STATS_H
+#define CO_LOCK_STATS_H
+
+#include "CANopen.h"
+#include <pthread.h>
+
+
+/**
+ * Lock statistics object. Counters are modified only by the thread, which
+ * holds the mutex.
+ */
+typedef struct {
+    pthread_mutex_t    *mtx;            /**< Instrumented mutex. */
+    uint64_t            lockedAt_ns;    /**< Time of the current lock. */
+    uint32_t            locks;          /**< Number of locks. */
+    uint32_t            contended;      /**< Locks, which found mutex locked. */
+    uint32_t            rtContended;    /**< Of them by RT threads. */
+    uint32_t            waitMax_ns;
+    uint32_t            rtWaitMax_ns;   /**< Maximum wait of RT threads. */
+    uint64_t            waitSum_ns;
+    uint32_t            holdMax_ns;
+    uint64_t            holdSum_ns;
+    char                holdMaxThread[16]; /**< Name of the thread with holdMax_ns. */
+} CO_lockStats_t;
+
+
+/* Statistics of CO_OD_mutex. */
+extern CO_lockStats_t CO_lockStats_OD;
+
+
+/**
+ * Initialize statistics for a mutex.
+ *
+ * @param ls This object.
+ * @param mtx Mutex.
+ */
+void CO_lockStats_init(CO_lockStats_t *ls, pthread_mutex_t *mtx);
+
+
+/**
+ * Mark the calling thread as RT thread, its waits are counted also in
+ * rtWaitMax_ns.
+ */
+void CO_lockStats_setRtThread(void);
+
+
+/**
+ * Lock the mutex and record wait time, if it was locked.
+ *
+ * @return 0 on success, error number from pthread_mutex_lock() otherwise.
+ */
+int CO_lockStats_lock(CO_lockStats_t *ls);
+
+
+/**
+ * Lock the mutex, if it is free.
+ *
+ * @return 0 on success, EBUSY if locked by other thread.
+ */
+int CO_lockStats_trylock(CO_lockStats_t *ls);
+
+
+/**
+ * Record hold time and unlock the mutex.
+ */
+void CO_lockStats_unlock(CO_lockStats_t *ls);
+
+
+/**
+ * Copy statistics to Object Dictionary array.
+ *
+ * @param ls This object.
+ * @param od Array of five UNSIGNED32 (OD_lockStats).
+ */
+void CO_lockStats_toOD(const CO_lockStats_t *ls, uint32_t *od);
+
+
+/**
+ * Print statistics to stdout.
+ *
+ * @param ls This object.
+ * @param name Prefix of the line.
+ */
+void CO_lockStats_printStats(const CO_lockStats_t *ls, const char *name);
+
+
+#undef CO_LOCK_OD
+#undef CO_UNLOCK_OD
+#define CO_LOCK_OD()        CO_lockStats_lock(&CO_lockStats_OD)
+#define CO_UNLOCK_OD()      CO_lockStats_unlock(&CO_lockStats_OD)
+
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * Realtime configuration of canopend: memory locking, prefaulting, CPU
+ * affinity and SCHED_DEADLINE.
+ *
+ * @file        CO_rtConfig.c
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#include "CO_rtConfig.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE              6
+#endif
+
+/* struct sched_attr from the kernel, glibc does not provide it. */
+typedef struct {
+    uint32_t            size;
+    uint32_t            sched_policy;
+    uint64_t            sched_flags;
+    int32_t             sched_nice;
+    uint32_t            sched_priority;
+    uint64_t            sched_runtime;
+    uint64_t            sched_deadline;
+    uint64_t            sched_period;
+} CO_rt_schedAttr_t;
+
+
+/******************************************************************************/
+int CO_rt_parseCpuList(const char *list, cpu_set_t *set) {
+    const char *p = list;
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+
+    CPU_ZERO(set);
+    while(*p != 0) {
+        char *end;
+        long first, last, cpu;
+
+        first = strtol(p, &end, 10);
+        last = (*end == '-') ? strtol(end + 1, &end, 10) : first;
+        if(end == p || (*end != ',' && *end != 0) || first < 0 || first > last
+           || last >= CPU_SETSIZE || (ncpu > 0 && last >= ncpu)) {
+            return -1;
+        }
+        for(cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return (CPU_COUNT(set) > 0) ? 0 : -1;
+}
+
+
+/******************************************************************************/
+int CO_rt_parseDeadline(const char *str, CO_rt_deadline_t *dl) {
+    unsigned long runtime, deadline, period;
+    char c;
+
+    if(sscanf(str, "%lu,%lu,%lu%c", &runtime, &deadline, &period, &c) != 3) {
+        return -1;
+    }
+    /* Kernel requires at least 1024 ns runtime and ordered parameters. */
+    if(runtime < 2 || runtime > deadline || deadline > period || period > 1000000) {
+        return -1;
+    }
+
+    dl->runtime_us = runtime;
+    dl->deadline_us = deadline;
+    dl->period_us = period;
+    return 0;
+}
+
+
+/******************************************************************************/
+int CO_rt_lockMemory(void) {
+    /* Freed memory stays in the process and large blocks come from the heap,
+     * not from separate mappings, which would be unmapped on free. */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    return mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+
+/******************************************************************************/
+void CO_rt_prefaultHeap(size_t size) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    volatile char *buf;
+    size_t i;
+
+    if(size == 0 || (buf = malloc(size)) == NULL) {
+        return;
+    }
+    for(i=0; i<size; i+=pageSize) {
+        buf[i] = 0;
+    }
+    free((void *)buf);
+}
+
+
+/******************************************************************************/
+void CO_rt_prefaultStack(size_t size) {
+    long pageSize = sysconf(_SC_PAGESIZE);
+    volatile char *buf;
+    size_t i;
+
+    if(size == 0) {
+        return;
+    }
+    buf = alloca(size);
+    for(i=0; i<size; i+=pageSize) {
+        buf[i] = 0;
+    }
+}
+
+
+/******************************************************************************/
+int CO_rt_setDeadline(const CO_rt_deadline_t *dl) {
+    CO_rt_schedAttr_t attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = (uint64_t)dl->runtime_us * 1000;
+    attr.sched_deadline = (uint64_t)dl->deadline_us * 1000;
+    attr.sched_period = (uint64_t)dl->period_us * 1000;
+
+    return (int)syscall(SYS_sched_setattr, 0, &attr, 0);
+}
+
+
+/******************************************************************************/
+int CO_rt_mutexInitPI(pthread_mutex_t *mtx) {
+    pthread_mutexattr_t mattr;
+    int err;
+
+    if(pthread_mutex_destroy(mtx) != 0) {
+        return EBUSY;
+    }
+    pthread_mutexattr_init(&mattr);
+    err = pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+    if(err == 0) {
+        err = pthread_mutex_init(mtx, &mattr);
+    }
+    if(err != 0) {
+        pthread_mutex_init(mtx, NULL);
+    }
+    pthread_mutexattr_destroy(&mattr);
+
+    return err;
+}
+
+
+/* Print CPU set as list of ranges. */
+static void printCpuSet(const cpu_set_t *set) {
+    int cpu, first = -1;
+    bool comma = false;
+
+    for(cpu=0; cpu<=CPU_SETSIZE; cpu++) {
+        bool isSet = cpu < CPU_SETSIZE && CPU_ISSET(cpu, set);
+
+        if(isSet && first < 0) {
+            first = cpu;
+        }
+        else if(!isSet && first >= 0) {
+            printf(comma ? ",%d" : "%d", first);
+            if(cpu - 1 > first) {
+                printf("-%d", cpu - 1);
+            }
+            comma = true;
+            first = -1;
+        }
+    }
+}
+
+
+/* Print scheduling and affinity of one thread. */
+static void reportThread(const char *progName, pid_t tid) {
+    char path[64], comm[32] = "?";
+    CO_rt_schedAttr_t attr;
+    cpu_set_t set;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", (int)tid);
+    fp = fopen(path, "r");
+    if(fp != NULL) {
+        if(fgets(comm, sizeof(comm), fp) != NULL) {
+            comm[strcspn(comm, "\n")] = 0;
+        }
+        fclose(fp);
+    }
+
+    printf("%s - RT check: thread %d (%s): ", progName, (int)tid, comm);
+
+    memset(&attr, 0, sizeof(attr));
+    if(syscall(SYS_sched_getattr, tid, &attr, sizeof(attr), 0) != 0) {
+        printf("policy unknown (%s)", strerror(errno));
+    }
+    else if(attr.sched_policy == SCHED_DEADLINE) {
+        printf("SCHED_DEADLINE %llu/%llu/%llu us",
+               (unsigned long long)attr.sched_runtime / 1000,
+               (unsigned long long)attr.sched_deadline / 1000,
+               (unsigned long long)attr.sched_period / 1000);
+    }
+    else if(attr.sched_policy == SCHED_FIFO || attr.sched_policy == SCHED_RR) {
+        printf("%s %u", attr.sched_policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR",
+               attr.sched_priority);
+    }
+    else {
+        printf("SCHED_OTHER nice %d", attr.sched_nice);
+    }
+
+    if(sched_getaffinity(tid, sizeof(set), &set) == 0) {
+        printf(", CPUs ");
+        printCpuSet(&set);
+    }
+    printf("\n");
+}
+
+
+/* Read one line starting with key from a file. Returns false if not found. */
+static bool readLine(const char *file, const char *key, char *line, size_t size) {
+    FILE *fp = fopen(file, "r");
+    bool found = false;
+
+    if(fp == NULL) {
+        return false;
+    }
+    while(!found && fgets(line, size, fp) != NULL) {
+        if(strncmp(line, key, strlen(key)) == 0) {
+            line[strcspn(line, "\n")] = 0;
+            found = true;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+
+/******************************************************************************/
+void CO_rt_report(const char *progName, bool memLockRequested) {
+    char line[128];
+    struct utsname uts;
+    DIR *dir;
+    long lockedKB = 0;
+
+    /* Threads */
+    dir = opendir("/proc/self/task");
+    if(dir != NULL) {
+        struct dirent *ent;
+
+        while((ent = readdir(dir)) != NULL) {
+            if(ent->d_name[0] != '.') {
+                reportThread(progName, (pid_t)strtol(ent->d_name, NULL, 10));
+            }
+        }
+        closedir(dir);
+    }
+
+    /* Memory */
+    if(readLine("/proc/self/status", "VmLck:", line, sizeof(line))) {
+        lockedKB = strtol(line + 6, NULL, 10);
+    }
+    printf("%s - RT check: locked memory %ld kB", progName, lockedKB);
+    if(readLine("/proc/self/status", "VmRSS:", line, sizeof(line))) {
+        printf(", resident %ld kB", strtol(line + 6, NULL, 10));
+    }
+    printf("\n");
+    if(memLockRequested && lockedKB == 0) {
+        printf("%s - RT check: WARNING - memory is not locked\n", progName);
+    }
+    CO_rt_printPageFaults(progName);
+
+    /* Kernel */
+    if(uname(&uts) == 0) {
+        bool preemptRT = strstr(uts.version, "PREEMPT_RT") != NULL
+                      || strstr(uts.version, "PREEMPT RT") != NULL;
+
+        if(readLine("/sys/kernel/realtime", "1", line, sizeof(line))) {
+            preemptRT = true;
+        }
+        printf("%s - RT check: kernel %s%s\n", progName, uts.release,
+               preemptRT ? " PREEMPT_RT" : " (not PREEMPT_RT)");
+    }
+    if(readLine("/proc/sys/kernel/sched_rt_runtime_us", "", line, sizeof(line))) {
+        long rtRuntime = strtol(line, NULL, 10);
+
+        if(rtRuntime >= 0) {
+            printf("%s - RT check: RT throttling is active (sched_rt_runtime_us=%ld)\n",
+                   progName, rtRuntime);
+        }
+    }
+}
+
+
+/******************************************************************************/
+void CO_rt_printPageFaults(const char *progName) {
+    static long minfltPrev = 0, majfltPrev = 0;
+    struct rusage usage;
+
+    if(getrusage(RUSAGE_SELF, &usage) != 0) {
+        return;
+    }
+    printf("%s - RT check: page faults %ld minor, %ld major\n", progName,
+           usage.ru_minflt - minfltPrev, usage.ru_majflt - majfltPrev);
+    minfltPrev = usage.ru_minflt;
+    majfltPrev = usage.ru_majflt;
+}
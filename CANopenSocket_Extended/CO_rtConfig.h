@@ -0,0 +1,139 @@
+/*
+ * Realtime configuration of canopend: memory locking, prefaulting, CPU
+ * affinity and SCHED_DEADLINE.
+ *
+ * @file        CO_rtConfig.h
+ *
+ * Page faults and migrations between CPUs cause latency spikes in the
+ * realtime thread, especially under load (see RT Tests/results). Functions
+ * here lock and prefault memory, pin threads to CPUs and set
+ * SCHED_DEADLINE policy. Mutexes shared with the realtime thread get
+ * priority inheritance. CO_rt_report() prints the configuration, which
+ * threads of the process actually ended up with.
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CO_RT_CONFIG_H
+#define CO_RT_CONFIG_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* cpu_set_t, pthread_setaffinity_np */
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+#include <pthread.h>
+
+
+/* Stack, which is reserved above prefaulted size of the rt_thread stack. */
+#ifndef CO_RT_STACK_RESERVE
+#define CO_RT_STACK_RESERVE         (64 * 1024)
+#endif
+
+
+/**
+ * SCHED_DEADLINE parameters in microseconds. Policy is used, if period_us
+ * is not zero. runtime_us <= deadline_us <= period_us.
+ */
+typedef struct {
+    uint32_t            runtime_us;
+    uint32_t            deadline_us;
+    uint32_t            period_us;
+} CO_rt_deadline_t;
+
+
+/**
+ * Parse list of CPUs, for example "1" or "0,2-3".
+ *
+ * @param list String with the list.
+ * @param set Result.
+ *
+ * @return 0 on success, -1 on syntax error or no CPU.
+ */
+int CO_rt_parseCpuList(const char *list, cpu_set_t *set);
+
+
+/**
+ * Parse SCHED_DEADLINE parameters "<runtime>,<deadline>,<period>" in
+ * microseconds and check them.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int CO_rt_parseDeadline(const char *str, CO_rt_deadline_t *dl);
+
+
+/**
+ * Lock all current and future memory pages (mlockall) and configure malloc
+ * to never return memory to the system, so locked heap stays mapped.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int CO_rt_lockMemory(void);
+
+
+/**
+ * Touch heap of the given size, so its pages are mapped in advance. Use
+ * after CO_rt_lockMemory(), otherwise malloc may return memory to the system.
+ *
+ * @param size Size in bytes.
+ */
+void CO_rt_prefaultHeap(size_t size);
+
+
+/**
+ * Touch stack of the calling thread, so its pages are mapped in advance.
+ *
+ * @param size Size in bytes. Must be smaller than the stack of the thread.
+ */
+void CO_rt_prefaultStack(size_t size);
+
+
+/**
+ * Set SCHED_DEADLINE policy for the calling thread.
+ *
+ * Note that kernel refuses SCHED_DEADLINE for a thread, which is restricted
+ * to a subset of CPUs of its root domain.
+ *
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int CO_rt_setDeadline(const CO_rt_deadline_t *dl);
+
+
+/**
+ * Reinitialize mutex with priority inheritance protocol, so a thread of
+ * lower priority, which holds the mutex, runs with the priority of the
+ * realtime thread waiting for it. Use on statically initialized mutexes,
+ * before any other thread uses them.
+ *
+ * @param mtx Unlocked mutex.
+ *
+ * @return 0 on success, error number otherwise (mutex is then default).
+ */
+int CO_rt_mutexInitPI(pthread_mutex_t *mtx);
+
+
+/**
+ * Print realtime configuration of all threads of the process (policy,
+ * priority or deadline parameters, CPU affinity), memory locking, page
+ * faults and kernel settings to stdout.
+ *
+ * @param progName Printed in front of each line.
+ * @param memLockRequested If true, warn when memory is not locked.
+ */
+void CO_rt_report(const char *progName, bool memLockRequested);
+
+
+/**
+ * Print number of page faults since the previous call (or start of the
+ * program) to stdout.
+ *
+ * @param progName Printed in front of the line.
+ */
+void CO_rt_printPageFaults(const char *progName);
+
+
+#endif
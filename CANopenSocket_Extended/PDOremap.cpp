@@ -1,158 +1,404 @@
+/*
+ * PDO remapping of the X2 drives.
+ *
+ * Mapping is described by pdoTable below. Each entry is applied to all nodes
+ * in NODES in the order required by CiA 301: disable PDO, clear mapping, set
+ * transmission type, write mapped objects, set number of mapped objects,
+ * enable PDO. Each step is done on all nodes at once through the parallel
+ * command interface of canopend (canopend ... -C ""), then read back and
+ * verified.
+ *
+ * Usage: PDOremap [--gen-od] [--no-verify]
+ *   --gen-od     Print the matching RPDO/TPDO entries of the master CO_OD.c
+ *                instead of remapping the drives.
+ *   --no-verify  Skip read back of the mapping.
+ */
+
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #define CANMESSAGELENGTH 100
+#define COMMAND_SOCKET "/tmp/CO_command_socket"
+#define PARALLEL_SOCKET "/tmp/CO_command_socket_parallel"
+#define PDO_DISABLED 0x80000000UL
+#define MAX_MAPPED 8
+//Number of RPDOs/TPDOs in the master CO_OD (CO_NO_RPDO, CO_NO_TPDO)
+#define MASTER_NO_PDO 16
+
+enum PdoDir { RPDO, TPDO };
+
+//Object mapped into a PDO. Master maps the same index with subindex = node ID.
+struct PdoObject {
+    uint16_t index;
+    uint8_t sub;
+    uint8_t bits;
+};
+
+//PDO of a drive. COB-ID is cobBase + node ID.
+struct PdoEntry {
+    PdoDir dir;             //direction seen from the drive
+    uint8_t num;            //PDO number 1..4 -> 0x1400/0x1800 + num - 1
+    uint16_t cobBase;
+    uint8_t transType;
+    bool master;            //consumed/produced by master OD (for --gen-od)
+    std::vector<PdoObject> objects;
+};
+
+static const uint8_t NODES[] = {1, 2, 3, 4};
+
+static const PdoEntry pdoTable[] = {
+    //Statusword to master
+    {TPDO, 1, 0x180, 0xFF, true,  {{0x6041, 0, 16}}},
+    //Actual position and velocity to master
+    {TPDO, 2, 0x280, 0x01, true,  {{0x6064, 0, 32}, {0x606C, 0, 32}}},
+    //Actual torque, logged from the bus only
+    {TPDO, 3, 0x380, 0x01, false, {{0x6077, 0, 16}}},
+    //Controlword from master
+    {RPDO, 1, 0x200, 0xFF, true,  {{0x6040, 0, 16}}},
+    //Target position from master
+    {RPDO, 2, 0x300, 0xFF, true,  {{0x607A, 0, 32}}},
+    //Target velocity from master
+    {RPDO, 3, 0x400, 0xFF, true,  {{0x60FF, 0, 32}}},
+};
+
+static const int NUM_NODES = sizeof(NODES) / sizeof(NODES[0]);
+static const int NUM_PDOS = sizeof(pdoTable) / sizeof(pdoTable[0]);
+
+int remapPDO(bool verify);
+int applyStep(const std::vector<std::string> *requests, bool *failed, const char *step);
+int verifyPDO(const PdoEntry &pdo, bool *failed);
+void genOD();
+int parallelTransfer(const std::vector<std::string> &requests, std::vector<std::string> &responses);
+int cancomm_socketFree(const char *command, char *ret);
+
+static int parallelSocket = -1;
+
+int main(int argc, char *argv[]) {
+    bool verify = true;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--gen-od") == 0) {
+            genOD();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--no-verify") == 0) {
+            verify = false;
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--gen-od] [--no-verify]" << std::endl;
+            return 1;
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, PARALLEL_SOCKET, sizeof(addr.sun_path) - 1);
+    parallelSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (parallelSocket < 0 || connect(parallelSocket, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("Can't connect to " PARALLEL_SOCKET ", start canopend with -C \"\"");
+        return 1;
+    }
+
+    int ret = remapPDO(verify);
+    close(parallelSocket);
+    return ret;
+}
+
+//Index of PDO communication and mapping parameter on the drive
+static uint16_t commIndex(const PdoEntry &pdo) {
+    return (pdo.dir == RPDO ? 0x1400 : 0x1800) + pdo.num - 1;
+}
+static uint16_t mapIndex(const PdoEntry &pdo) {
+    return (pdo.dir == RPDO ? 0x1600 : 0x1A00) + pdo.num - 1;
+}
+static uint32_t mapValue(const PdoObject &obj, uint8_t sub) {
+    return ((uint32_t)obj.index << 16) | ((uint32_t)sub << 8) | obj.bits;
+}
+
+static std::string writeCmd(uint8_t node, uint16_t index, uint8_t sub, const char *type, uint32_t value) {
+    char buf[CANMESSAGELENGTH];
+    snprintf(buf, sizeof(buf), "%d write 0x%04X %d %s 0x%X", node, index, sub, type, value);
+    return buf;
+}
+
+static std::string readCmd(uint8_t node, uint16_t index, uint8_t sub, const char *type) {
+    char buf[CANMESSAGELENGTH];
+    snprintf(buf, sizeof(buf), "%d read 0x%04X %d %s", node, index, sub, type);
+    return buf;
+}
+
+//Applies pdoTable to all nodes. Returns number of failed nodes.
+int remapPDO(bool verify) {
+    bool failed[NUM_NODES] = {false};
+    char ret[CANMESSAGELENGTH];
+
+    for (int p = 0; p < NUM_PDOS; p++) {
+        const PdoEntry &pdo = pdoTable[p];
+        std::vector<std::string> req[NUM_NODES];
+
+        //1. disable PDO
+        for (int n = 0; n < NUM_NODES; n++)
+            req[n] = {writeCmd(NODES[n], commIndex(pdo), 1, "u32", PDO_DISABLED | (pdo.cobBase + NODES[n]))};
+        applyStep(req, failed, "disable");
+
+        //2. clear mapping, 3. transmission type
+        for (int n = 0; n < NUM_NODES; n++)
+            req[n] = {writeCmd(NODES[n], mapIndex(pdo), 0, "u8", 0),
+                      writeCmd(NODES[n], commIndex(pdo), 2, "u8", pdo.transType)};
+        applyStep(req, failed, "clear");
+
+        //4. mapped objects, 5. number of mapped objects
+        for (int n = 0; n < NUM_NODES; n++) {
+            req[n].clear();
+            for (size_t i = 0; i < pdo.objects.size(); i++)
+                req[n].push_back(writeCmd(NODES[n], mapIndex(pdo), i + 1, "u32", mapValue(pdo.objects[i], pdo.objects[i].sub)));
+            req[n].push_back(writeCmd(NODES[n], mapIndex(pdo), 0, "u8", pdo.objects.size()));
+        }
+        applyStep(req, failed, "map");
+
+        //6. enable PDO
+        for (int n = 0; n < NUM_NODES; n++)
+            req[n] = {writeCmd(NODES[n], commIndex(pdo), 1, "u32", pdo.cobBase + NODES[n])};
+        applyStep(req, failed, "enable");
+
+        if (verify)
+            verifyPDO(pdo, failed);
+    }
+
+    //Start nodes and clear controlword
+    std::vector<std::string> req[NUM_NODES];
+    for (int n = 0; n < NUM_NODES; n++) {
+        char comm[CANMESSAGELENGTH];
+        snprintf(comm, sizeof(comm), "[1] %d start", NODES[n]);
+        cancomm_socketFree(comm, ret);
+        req[n] = {writeCmd(NODES[n], 0x6040, 0, "i16", 0)};
+    }
+    applyStep(req, failed, "controlword");
+
+    int numFailed = 0;
+    for (int n = 0; n < NUM_NODES; n++) {
+        if (failed[n]) {
+            std::cerr << "Node " << (int)NODES[n] << ": PDO remap failed" << std::endl;
+            numFailed++;
+        }
+    }
+    if (numFailed == 0)
+        std::cout << "PDO remap of " << NUM_NODES << " nodes done" << std::endl;
+    return numFailed;
+}
 
-void remapPDO(char* returnMessage);
-void cancomm_socketFree(char* command, char* ret);
+//Sends requests of all nodes at once. Nodes, which already failed, are skipped.
+//Node is marked as failed on the first error.
+int applyStep(const std::vector<std::string> *requests, bool *failed, const char *step) {
+    std::vector<std::string> all, responses;
+    std::vector<int> owner;
 
-int main() {
-    char* returnMessage;
-    remapPDO(returnMessage);
+    for (int n = 0; n < NUM_NODES; n++) {
+        if (failed[n])
+            continue;
+        for (size_t i = 0; i < requests[n].size(); i++) {
+            all.push_back(requests[n][i]);
+            owner.push_back(n);
+        }
+    }
+    if (all.empty())
+        return 0;
+
+    if (parallelTransfer(all, responses) != 0) {
+        for (int n = 0; n < NUM_NODES; n++)
+            failed[n] = true;
+        return -1;
+    }
+
+    for (size_t i = 0; i < all.size(); i++) {
+        if (responses[i].compare(0, 5, "ERROR") == 0 && !failed[owner[i]]) {
+            std::cerr << "Node " << (int)NODES[owner[i]] << " " << step << ": '" << all[i] << "' " << responses[i] << std::endl;
+            failed[owner[i]] = true;
+        }
+    }
     return 0;
 }
 
-void remapPDO(char* returnMessage){
-    char PDO_MessageList[][CANMESSAGELENGTH] = {
-            "[1] 1 write 0x1801 1 u32 0x80000281",
-            "[1] 2 write 0x1801 1 u32 0x80000282",
-            "[1] 3 write 0x1801 1 u32 0x80000283",
-            "[1] 4 write 0x1801 1 u32 0x80000284",
-            "[1] 1 write 0x1A01 0 u8 0",
-            "[1] 1 write 0x1801 2 u8 1",
-            "[1] 1 write 0x1A01 1 u32 0x60640020",
-            "[1] 1 write 0x1A01 2 u32 0x606C0020",
-            "[1] 1 write 0x1A01 0 u8 2",
-            "[1] 2 write 0x1A01 0 u8 0",
-            "[1] 2 write 0x1801 2 u8 1",
-            "[1] 2 write 0x1A01 1 u32 0x60640020",
-            "[1] 2 write 0x1A01 2 u32 0x606C0020",
-            "[1] 2 write 0x1A01 0 u8 2",
-            "[1] 3 write 0x1A01 0 u8 0",
-            "[1] 3 write 0x1801 2 u8 1",
-            "[1] 3 write 0x1A01 1 u32 0x60640020",
-            "[1] 3 write 0x1A01 2 u32 0x606C0020",
-            "[1] 3 write 0x1A01 0 u8 2",
-            "[1] 4 write 0x1A01 0 u8 0",
-            "[1] 4 write 0x1801 2 u8 1",
-            "[1] 4 write 0x1A01 1 u32 0x60640020",
-            "[1] 4 write 0x1A01 2 u32 0x606C0020",
-            "[1] 4 write 0x1A01 0 u8 2",
-            "[1] 1 write 0x1801 1 u32 0x281",
-            "[1] 2 write 0x1801 1 u32 0x282",
-            "[1] 3 write 0x1801 1 u32 0x283",
-            "[1] 4 write 0x1801 1 u32 0x284",
-            "[1] 1 write 0x1800 1 u32 0x80000181",
-            "[1] 2 write 0x1800 1 u32 0x80000182",
-            "[1] 3 write 0x1800 1 u32 0x80000183",
-            "[1] 4 write 0x1800 1 u32 0x80000184",
-            "[1] 1 write 0x1A00 0 u8 0",
-            "[1] 1 write 0x1800 2 u8 0xFF",
-            "[1] 1 write 0x1A00 1 u32 0x60410010",
-            "[1] 1 write 0x1A00 0 u8 1",
-            "[1] 2 write 0x1A00 0 u8 0",
-            "[1] 2 write 0x1800 2 u8 0xFF",
-            "[1] 2 write 0x1A00 1 u32 0x60410010",
-            "[1] 2 write 0x1A00 0 u8 1",
-            "[1] 3 write 0x1A00 0 u8 0",
-            "[1] 3 write 0x1800 2 u8 0xFF",
-            "[1] 3 write 0x1A00 1 u32 0x60410010",
-            "[1] 3 write 0x1A00 0 u8 1",
-            "[1] 4 write 0x1A00 0 u8 0",
-            "[1] 4 write 0x1800 2 u8 0xFF",
-            "[1] 4 write 0x1A00 1 u32 0x60410010",
-            "[1] 4 write 0x1A00 0 u8 1",
-            "[1] 1 write 0x1800 1 u32 0x181",
-            "[1] 2 write 0x1800 1 u32 0x182",
-            "[1] 3 write 0x1800 1 u32 0x183",
-            "[1] 4 write 0x1800 1 u32 0x184",
-            "[1] 1 write 0x1800 1 u32 0x80000381",
-            "[1] 2 write 0x1800 1 u32 0x80000382",
-            "[1] 3 write 0x1800 1 u32 0x80000383",
-            "[1] 4 write 0x1800 1 u32 0x80000384",
-            "[1] 1 write 0x1A00 0 u8 0",
-            "[1] 1 write 0x1800 2 u8 0x01",
-            "[1] 1 write 0x1A00 1 u32 0x60770010",
-            "[1] 1 write 0x1A00 0 u8 1",
-            "[1] 2 write 0x1A00 0 u8 0",
-            "[1] 2 write 0x1800 2 u8 0x01",
-            "[1] 2 write 0x1A00 1 u32 0x60770010",
-            "[1] 2 write 0x1A00 0 u8 1",
-            "[1] 3 write 0x1A00 0 u8 0",
-            "[1] 3 write 0x1800 2 u8 0x01",
-            "[1] 3 write 0x1A00 1 u32 0x60770010",
-            "[1] 3 write 0x1A00 0 u8 1",
-            "[1] 4 write 0x1A00 0 u8 0",
-            "[1] 4 write 0x1800 2 u8 0x01",
-            "[1] 4 write 0x1A00 1 u32 0x60770010",
-            "[1] 4 write 0x1A00 0 u8 1",
-            "[1] 1 write 0x1800 1 u32 0x381",
-            "[1] 2 write 0x1800 1 u32 0x382",
-            "[1] 3 write 0x1800 1 u32 0x383",
-            "[1] 4 write 0x1800 1 u32 0x384",
-            "[1] 1 write 0x1401 1 u32 0x80000301",
-            "[1] 2 write 0x1401 1 u32 0x80000302",
-            "[1] 3 write 0x1401 1 u32 0x80000303",
-            "[1] 4 write 0x1401 1 u32 0x80000304",
-            "[1] 1 write 0x1601 0 u8 0",
-            "[1] 1 write 0x1401 2 u8 0xFF",
-            "[1] 1 write 0x1601 1 u32 0x607A0020",
-            "[1] 1 write 0x1601 0 u8 1",
-            "[1] 2 write 0x1601 0 u8 0",
-            "[1] 2 write 0x1401 2 u8 0xFF",
-            "[1] 2 write 0x1601 1 u32 0x607A0020",
-            "[1] 2 write 0x1601 0 u8 1",
-            "[1] 3 write 0x1601 0 u8 0",
-            "[1] 3 write 0x1401 2 u8 0xFF",
-            "[1] 3 write 0x1601 1 u32 0x607A0020",
-            "[1] 3 write 0x1601 0 u8 1",
-            "[1] 4 write 0x1601 0 u8 0",
-            "[1] 4 write 0x1401 2 u8 0xFF",
-            "[1] 4 write 0x1601 1 u32 0x607A0020",
-            "[1] 4 write 0x1601 0 u8 1",
-            "[1] 1 write 0x1401 1 u32 0x301",
-            "[1] 2 write 0x1401 1 u32 0x302",
-            "[1] 3 write 0x1401 1 u32 0x303",
-            "[1] 4 write 0x1401 1 u32 0x304",
-            "[1] 1 write 0x1402 1 u32 0x80000401",
-            "[1] 2 write 0x1402 1 u32 0x80000402",
-            "[1] 3 write 0x1402 1 u32 0x80000403",
-            "[1] 4 write 0x1402 1 u32 0x80000404",
-            "[1] 1 write 0x1602 0 u8 0",
-            "[1] 1 write 0x1402 2 u8 0xFF",
-            "[1] 1 write 0x1602 1 u32 0x60FF0020",
-            "[1] 1 write 0x1602 0 u8 1",
-            "[1] 2 write 0x1602 0 u8 0",
-            "[1] 2 write 0x1402 2 u8 0xFF",
-            "[1] 2 write 0x1602 1 u32 0x60FF0020",
-            "[1] 2 write 0x1602 0 u8 1",
-            "[1] 3 write 0x1602 0 u8 0",
-            "[1] 3 write 0x1402 2 u8 0xFF",
-            "[1] 3 write 0x1602 1 u32 0x60FF0020",
-            "[1] 3 write 0x1602 0 u8 1",
-            "[1] 4 write 0x1602 0 u8 0",
-            "[1] 4 write 0x1402 2 u8 0xFF",
-            "[1] 4 write 0x1602 1 u32 0x60FF0020",
-            "[1] 4 write 0x1602 0 u8 1",
-            "[1] 1 write 0x1402 1 u32 0x401",
-            "[1] 2 write 0x1402 1 u32 0x402",
-            "[1] 3 write 0x1402 1 u32 0x403",
-            "[1] 4 write 0x1402 1 u32 0x404",
-            "[1] 1 start",
-            "[1] 2 start",
-            "[1] 3 start",
-            "[1] 4 start",
-            "[1] 1 write 0x6040 0 i16 0",
-            "[1] 2 write 0x6040 0 i16 0",
-            "[1] 3 write 0x6040 0 i16 0",
-            "[1] 4 write 0x6040 0 i16 0"
-    };
-    int num_of_Messages = sizeof(PDO_MessageList) / sizeof(PDO_MessageList[0]);
-//    printf("Num of messages: %d\n", num_of_Messages);
-    for (int i = 0; i < num_of_Messages; ++i){
-        cancomm_socketFree(PDO_MessageList[i], returnMessage);
+//Reads back communication and mapping parameters of one PDO on all nodes.
+int verifyPDO(const PdoEntry &pdo, bool *failed) {
+    std::vector<std::string> all, responses;
+    std::vector<uint32_t> expected;
+    std::vector<int> owner;
+
+    for (int n = 0; n < NUM_NODES; n++) {
+        if (failed[n])
+            continue;
+        all.push_back(readCmd(NODES[n], commIndex(pdo), 1, "u32"));
+        expected.push_back(pdo.cobBase + NODES[n]);
+        all.push_back(readCmd(NODES[n], commIndex(pdo), 2, "u8"));
+        expected.push_back(pdo.transType);
+        all.push_back(readCmd(NODES[n], mapIndex(pdo), 0, "u8"));
+        expected.push_back(pdo.objects.size());
+        for (size_t i = 0; i < pdo.objects.size(); i++) {
+            all.push_back(readCmd(NODES[n], mapIndex(pdo), i + 1, "u32"));
+            expected.push_back(mapValue(pdo.objects[i], pdo.objects[i].sub));
+        }
+        for (size_t i = owner.size(); i < all.size(); i++)
+            owner.push_back(n);
     }
+    if (all.empty())
+        return 0;
+
+    if (parallelTransfer(all, responses) != 0)
+        return -1;
 
+    for (size_t i = 0; i < all.size(); i++) {
+        uint32_t value = strtoul(responses[i].c_str(), NULL, 0);
+        if ((responses[i].compare(0, 5, "ERROR") == 0 || value != expected[i]) && !failed[owner[i]]) {
+            std::cerr << "Node " << (int)NODES[owner[i]] << " verify: '" << all[i] << "' returned " << responses[i]
+                      << ", expected 0x" << std::hex << expected[i] << std::dec << std::endl;
+            failed[owner[i]] = true;
+        }
+    }
+    return 0;
 }
 
-void cancomm_socketFree(char* command, char* ret){
-//    printf("%s, %s\n", command, ret);
-}
\ No newline at end of file
+//Sends all requests to the parallel command interface, tagged by sequence
+//number, and waits for all responses. responses[i] is the text after "[seq] ".
+int parallelTransfer(const std::vector<std::string> &requests, std::vector<std::string> &responses) {
+    static uint32_t sequence = 0;
+    std::map<uint32_t, size_t> pending;
+    std::string out, in;
+
+    responses.assign(requests.size(), "");
+    for (size_t i = 0; i < requests.size(); i++) {
+        char seq[16];
+        snprintf(seq, sizeof(seq), "[%u] ", ++sequence);
+        out += seq + requests[i] + "\n";
+        pending[sequence] = i;
+    }
+
+    if (write(parallelSocket, out.c_str(), out.size()) != (ssize_t)out.size()) {
+        perror("Socket write failed");
+        return -1;
+    }
+
+    while (!pending.empty()) {
+        char buf[CANMESSAGELENGTH * 4];
+        ssize_t n = read(parallelSocket, buf, sizeof(buf));
+        if (n <= 0) {
+            perror("Socket read failed");
+            return -1;
+        }
+        in.append(buf, n);
+
+        size_t nl;
+        while ((nl = in.find('\n')) != std::string::npos) {
+            std::string line = in.substr(0, nl);
+            in.erase(0, nl + 1);
+            if (!line.empty() && line[line.size() - 1] == '\r')
+                line.erase(line.size() - 1);
+
+            uint32_t seq;
+            int pos = 0;
+            if (sscanf(line.c_str(), "[%u] %n", &seq, &pos) < 1 || pending.count(seq) == 0)
+                continue;
+            responses[pending[seq]] = line.substr(pos);
+            pending.erase(seq);
+        }
+    }
+    return 0;
+}
+
+//Sends single command to the canopend command interface, for NMT commands,
+//which are not supported by the parallel interface. ret holds the response.
+int cancomm_socketFree(const char *command, char *ret) {
+    struct sockaddr_un addr;
+    int fd, ok = -1;
+    ssize_t n;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, COMMAND_SOCKET, sizeof(addr.sun_path) - 1);
+
+    ret[0] = 0;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("Can't connect to " COMMAND_SOCKET);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    if (write(fd, command, strlen(command)) == (ssize_t)strlen(command)) {
+        n = read(fd, ret, CANMESSAGELENGTH - 1);
+        if (n > 0) {
+            ret[n] = 0;
+            ok = strstr(ret, "ERROR") == NULL ? 0 : -1;
+        }
+    }
+    if (ok != 0)
+        std::cerr << "'" << command << "' failed: " << ret << std::endl;
+
+    close(fd);
+    return ok;
+}
+
+//Prints RPDO/TPDO communication and mapping entries for the master CO_OD.c,
+//so master side stays consistent with pdoTable. Drive TPDOs become master
+//RPDOs and vice versa. Master maps the same object with subindex = node ID.
+void genOD() {
+    std::vector<std::string> comm[2], map[2];
+
+    for (int p = 0; p < NUM_PDOS; p++) {
+        const PdoEntry &pdo = pdoTable[p];
+        if (!pdo.master)
+            continue;
+
+        int m = (pdo.dir == TPDO) ? RPDO : TPDO;
+        for (int n = 0; n < NUM_NODES; n++) {
+            char buf[200];
+            std::string line;
+
+            //Master processes received PDOs immediately (0xFF), whatever the drive's transmission type.
+            if (m == RPDO)
+                snprintf(buf, sizeof(buf), "{0x2L, 0x%04XL, 0xffL}", pdo.cobBase + NODES[n]);
+            else
+                snprintf(buf, sizeof(buf), "{0x6L, 0x%04XL, 0x%02xL, 0x00, 0x0L, 0x00, 0x0L}", pdo.cobBase + NODES[n], pdo.transType);
+            comm[m].push_back(buf);
+
+            snprintf(buf, sizeof(buf), "{0x%XL", (unsigned)pdo.objects.size());
+            line = buf;
+            for (int i = 0; i < MAX_MAPPED; i++) {
+                if (i < (int)pdo.objects.size())
+                    snprintf(buf, sizeof(buf), ", 0x%08xL", mapValue(pdo.objects[i], NODES[n]));
+                else
+                    snprintf(buf, sizeof(buf), ", 0x0000L");
+                line += buf;
+            }
+            map[m].push_back(line + "}");
+        }
+    }
+
+    const char *disabled[2] = {"{0x2L, 0x80000000L, 0xfeL}", "{0x6L, 0x80000000L, 0xfeL, 0x00, 0x0L, 0x00, 0x0L}"};
+    const char *unmapped = "{0x0L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L}";
+    const uint16_t commBase[2] = {0x1400, 0x1800}, mapBase[2] = {0x1600, 0x1A00};
+
+    for (int m = RPDO; m <= TPDO; m++) {
+        if (comm[m].size() > MASTER_NO_PDO) {
+            std::cerr << "Too many PDOs for master OD" << std::endl;
+            return;
+        }
+        for (int i = 0; i < MASTER_NO_PDO; i++)
+            printf("/*%04x*/ %s%s%s\n", commBase[m] + i, i == 0 ? "{" : "",
+                   i < (int)comm[m].size() ? comm[m][i].c_str() : disabled[m], i == MASTER_NO_PDO - 1 ? "}," : ",");
+        for (int i = 0; i < MASTER_NO_PDO; i++)
+            printf("/*%04x*/ %s%s%s\n", mapBase[m] + i, i == 0 ? "{" : "",
+                   i < (int)map[m].size() ? map[m][i].c_str() : unmapped, i == MASTER_NO_PDO - 1 ? "}," : ",");
+    }
+}
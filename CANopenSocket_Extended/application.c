@@ -24,6 +24,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "CANopen.h"
+#include "CO_ODsnapshot.h"
 #include "stdio.h"
 #include <stdint.h>
 #include <sys/time.h>
@@ -34,6 +35,7 @@ void fileLogHeader();
 void fileLogger();
 void strreverse(char *begin, char *end);
 void itoa(int value, char *str, int base);
+static void readMotors(int32_t pos[4], uint16_t sw[4], uint64_t *time_ns);
 /******************************************************************************/
 void app_programStart(void){
     //void fileLogHeader();
@@ -69,6 +71,35 @@ void app_program1ms(void){
 	fileLoggerBinary();
 }
 /******************************************************************************/
+/* Called by SYNC producer (-S option) before each SYNC. Setpoints written here
+ * (OD_controlWords, OD_targetMotorPositions, ...) go out with synchronous
+ * TPDOs just before SYNC. */
+void app_programSync(void *object, uint32_t period_us){
+}
+/******************************************************************************/
+/* Positions and statuswords of the motors from the same RT cycle, read from
+ * the lock-free OD snapshot, and time of that cycle (CO_clock.h). Variables,
+ * which are not PDO mapped, are read from the OD directly. */
+static void readMotors(int32_t pos[4], uint16_t sw[4], uint64_t *time_ns){
+    int32_t *odPos[4] = {&CO_OD_RAM.actualMotorPositions.motor1, &CO_OD_RAM.actualMotorPositions.motor2,
+                         &CO_OD_RAM.actualMotorPositions.motor3, &CO_OD_RAM.actualMotorPositions.motor4};
+    uint16_t *odSw[4] = {&CO_OD_RAM.statusWords.motor1, &CO_OD_RAM.statusWords.motor2,
+                         &CO_OD_RAM.statusWords.motor3, &CO_OD_RAM.statusWords.motor4};
+    uint32_t cycle;
+    int i, tries = 0;
+
+    do {
+        cycle = CO_ODsnapshot_cycle();
+        *time_ns = CO_ODsnapshot_time();
+        for(i=0; i<4; i++) {
+            if(!CO_ODsnapshot_read(&pos[i], odPos[i], sizeof(pos[i])))
+                pos[i] = *odPos[i];
+            if(!CO_ODsnapshot_read(&sw[i], odSw[i], sizeof(sw[i])))
+                sw[i] = *odSw[i];
+        }
+    } while(CO_ODsnapshot_cycle() != cycle && ++tries < 3);
+}
+/******************************************************************************/
 void itoa(int value, char *str, int base)
 {
     static char num[] = "0123456789abcdefghijklmnopqrstuvwxyz";
@@ -110,46 +141,28 @@ void fileLogger(){
 	char timestamp [50];
     char torque[50];
     char comma[] = ", ";
+    int32_t pos[4];
+    uint16_t sw[4];
+    uint64_t time_ns;
+    int i;
 	
-	//Getting timestamp
-	//printf("time(s): %lu, (us): %lu\n",tv.tv_sec, tv.tv_usec);
-    //itoa(timer1msDiff, position, 10);
-	struct timeval tv;
-	gettimeofday(&tv,NULL);
-	itoa(tv.tv_sec, timestamp, 10);
+    // Motors 1..4: Left Hip, Left Knee, Right Hip, Right Knee position and Torque
+    readMotors(pos, sw, &time_ns);
+
+	//Timestamp, CLOCK_MONOTONIC in ns of the RT cycle
+	snprintf(timestamp, sizeof(timestamp), "%llu", (unsigned long long)time_ns);
     fputs(timestamp, fp);
-    fputs(comma, fp);
-	itoa(tv.tv_usec, timestamp, 10);
-	fputs(timestamp, fp);
     fputs(comma, fp);
 	
-    // Motor 1: Left Hip position and Torque
-    itoa(CO_OD_RAM.actualMotorPositions.motor1, position, 10);
-    itoa(((int16_t)CO_OD_RAM.statusWords.motor1), torque, 10);
-    fputs(position, fp);
-    fputs(comma, fp);
-    fputs(torque, fp);
-    fputs(comma, fp);
-    // Motor 2: Left Knee position and Torque
-    itoa(CO_OD_RAM.actualMotorPositions.motor2, position, 10);
-    itoa(((int16_t)CO_OD_RAM.statusWords.motor2), torque, 10);
-    fputs(position, fp);
-    fputs(comma, fp);
-    fputs(torque, fp);
-    fputs(comma, fp);
-    // Motor 3: Right Hip position and Torque
-    itoa(CO_OD_RAM.actualMotorPositions.motor3, position, 10);
-    itoa(((int16_t)CO_OD_RAM.statusWords.motor3), torque, 10);
-    fputs(position, fp);
-    fputs(comma, fp);
-    fputs(torque, fp);
-    fputs(comma, fp);
-    // Motor 4: Right Knee position and Torque
-    itoa(CO_OD_RAM.actualMotorPositions.motor4, position, 10);
-    itoa(((int16_t)CO_OD_RAM.statusWords.motor4), torque, 10);
-    fputs(position, fp);
-    fputs(comma, fp);
-    fputs(torque, fp);
+    for(i=0; i<4; i++) {
+        itoa(pos[i], position, 10);
+        itoa(((int16_t)sw[i]), torque, 10);
+        fputs(position, fp);
+        fputs(comma, fp);
+        fputs(torque, fp);
+        if(i < 3)
+            fputs(comma, fp);
+    }
     fputs("\n", fp);
 	
     fclose(fp);
@@ -161,7 +174,7 @@ void fileLogHeader(){
     char header1[] = "======================================\n";
     char header2[] = "X2 exoskeleton torque and position log\n";
     char header3[] = "======================================\n";
-    char header4[]= "Time(s), time(ms) LHPos, LHT, LKPos, LKT, RHPos, RHT,RKPos, RKT\n";
+    char header4[]= "Time(ns), LHPos, LHT, LKPos, LKT, RHPos, RHT,RKPos, RKT\n";
     fputs(header1, fp);
     fputs(header2, fp);
     fputs(header3, fp);
@@ -176,23 +189,22 @@ void fileLoggerBinary(){
 	if(fp==NULL)
 		printf("\nFILE CREATION ERROR\n");
 
-    struct timeval tv;
-    gettimeofday(&tv,NULL);
+    int32_t pos[4];
+    uint16_t sw[4];
+    uint64_t time_ns;   /* CLOCK_MONOTONIC of the RT cycle, virtual time in simulation */
+    readMotors(pos, sw, &time_ns);
 
-    uint32_t motor1pos=CO_OD_RAM.actualMotorPositions.motor1;
-    uint32_t motor2pos=CO_OD_RAM.actualMotorPositions.motor2;
-    uint32_t motor3pos=CO_OD_RAM.actualMotorPositions.motor3;
-    uint32_t motor4pos=CO_OD_RAM.actualMotorPositions.motor4;
-    uint16_t motor1Tor=CO_OD_RAM.statusWords.motor1;
-    uint16_t motor2Tor=CO_OD_RAM.statusWords.motor2;
-    uint16_t motor3Tor=CO_OD_RAM.statusWords.motor3;
-    uint16_t motor4Tor=CO_OD_RAM.statusWords.motor4;
-    long long timesec=tv.tv_sec;
-    long timeusec=tv.tv_usec;
+    uint32_t motor1pos=pos[0];
+    uint32_t motor2pos=pos[1];
+    uint32_t motor3pos=pos[2];
+    uint32_t motor4pos=pos[3];
+    uint16_t motor1Tor=sw[0];
+    uint16_t motor2Tor=sw[1];
+    uint16_t motor3Tor=sw[2];
+    uint16_t motor4Tor=sw[3];
 
 
-    fwrite(&timesec, sizeof(timesec), 1, fp);
-    fwrite(&timeusec, sizeof(timeusec), 1, fp);
+    fwrite(&time_ns, sizeof(time_ns), 1, fp);
     fwrite(&motor1pos, sizeof(sizeInt), 1, fp);
     fwrite(&motor1Tor, sizeof(sizeInt), 1, fp);
     fwrite(&motor2pos, sizeof(sizeInt), 1, fp);
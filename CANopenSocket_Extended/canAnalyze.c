@@ -0,0 +1,719 @@
+/*
+ * CAN bus load and latency analyzer.
+ *
+ * @file        canAnalyze.c
+ *
+ * Shows how close the bus is to saturation with the PDOs of PDOremap on
+ * all drives. Frames come from a CAN interface (live, until Ctrl+C or -t)
+ * or from a canCapture file. Report:
+ *   - bus utilization, average and peak over windows of -w ms,
+ *   - per COB-ID: frames, rate, mean period, period jitter (standard
+ *     deviation and largest deviation from the mean), bits and share of
+ *     the load,
+ *   - per node: latency from SYNC to its first TPDO (min/avg/p99/max) and
+ *     from SYNC to the last TPDO of the cycle on the bus.
+ * Frame time is exact: the bit stuffing of each frame is computed from its
+ * identifier, data and CRC, as the controller sends it.
+ *
+ * Planning mode (-P) predicts the load of a PDO and SYNC configuration
+ * before it is deployed, with the best (no stuff bits) and worst case
+ * (maximum stuff bits) frame length. Plan file, one message per line:
+ *   <name> <COB-ID> <data length> <period> [<nodes>]
+ * period is in us, 'sync' for each SYNC or 'syncN' for each N-th SYNC,
+ * 'event' for event driven messages, which are counted as each SYNC in the
+ * worst case only.
+ * With nodes (for example 1-4) the COB-ID is a base, node ID is added.
+ * '-P default' uses the mapping of PDOremap.cpp, printed with -P show.
+ *
+ * Compile: gcc canAnalyze.c -o canAnalyze -Wall -lm
+ *
+ * Examples:
+ *   ./canAnalyze can1 -t 10
+ *   ./canAnalyze /tmp/can1.cap -b 1000000 -w 1
+ *   ./canAnalyze -P default -S 1000
+ *   ./canAnalyze -P myplan.txt -S 500 -b 500000
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "canCapture.h"
+
+
+#define BATCH_SIZE              32
+#define NUM_COB                 (CAN_SFF_MASK + 1)
+#define COB_EFF                 NUM_COB         /* All extended frames */
+#define COB_COUNT               (NUM_COB + 1)
+#define LAT_BUCKET_US           10
+#define LAT_BUCKETS             1000            /* 0 .. 10 ms */
+#define MAX_PLAN                64
+#define LINE_SIZE               200
+
+#define COB_SYNC                0x080
+
+
+/* Statistics of one COB-ID */
+typedef struct {
+    uint64_t    frames;
+    uint64_t    bits;
+    uint64_t    last_ns;
+    uint64_t    intervals;
+    double      intSum;                 /* us */
+    double      intSumSq;
+    double      intMin, intMax;
+} cobStats_t;
+
+/* Latency from SYNC to TPDOs of one node */
+typedef struct {
+    uint64_t    count;
+    double      sum;                    /* us */
+    double      min, max;
+    uint32_t    hist[LAT_BUCKETS + 1];  /* Last bucket is overflow */
+} latStats_t;
+
+/* Message of the plan */
+typedef struct {
+    char        name[24];
+    uint32_t    cob;
+    uint8_t     len;
+    uint32_t    period_us;              /* 0 for each SYNC */
+    uint32_t    syncDivider;
+    bool        event;                  /* Worst case each SYNC */
+    uint8_t     nodeFirst, nodeLast;    /* 0 without nodes */
+} planMsg_t;
+
+
+static volatile sig_atomic_t endProgram = 0;
+
+static uint32_t     bitrate = 1000000;
+static uint64_t     window_ns = 10000000;
+
+static cobStats_t   cobs[COB_COUNT];
+static uint64_t     totalFrames = 0, totalBits = 0, errorFrames = 0, stuffBits = 0;
+static uint64_t     first_ns = 0, last_ns = 0;
+
+/* Peak load */
+static uint64_t     windowStart_ns = 0, windowBits = 0, windowMaxBits = 0;
+
+/* SYNC to TPDO */
+static latStats_t   nodeLat[128];
+static latStats_t   cycleLat;               /* SYNC to last TPDO of the cycle */
+static uint64_t     sync_ns = 0, cycleLast_ns = 0;
+static bool         answered[128];
+static uint64_t     syncs = 0;
+
+
+static void sigHandler(int sig) {
+    (void)sig;
+    endProgram = 1;
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/******************************************************************************/
+/* Frame length                                                               */
+/******************************************************************************/
+/* CRC-15 of CAN over bits[0..n-1]. */
+static uint16_t crc15(const uint8_t *bits, int n) {
+    uint16_t crc = 0;
+    int i;
+
+    for(i=0; i<n; i++) {
+        bool next = bits[i] ^ ((crc >> 14) & 1);
+
+        crc = (crc << 1) & 0x7FFF;
+        if(next) {
+            crc ^= 0x4599;
+        }
+    }
+    return crc;
+}
+
+
+static int putBits(uint8_t *bits, int n, uint32_t value, int count) {
+    while(count-- > 0) {
+        bits[n++] = (value >> count) & 1;
+    }
+    return n;
+}
+
+
+/* Bits of a frame on the bus including stuff bits and interframe space.
+ * *stuff is set to the number of stuff bits. */
+static int frameBits(uint32_t id, uint8_t len, const uint8_t *data, int *stuff) {
+    uint8_t bits[160];
+    bool rtr = (id & CAN_RTR_FLAG) != 0;
+    int n = 0, i, run = 0, stuffed = 0;
+    uint8_t prev = 2;
+    uint16_t crc;
+
+    bits[n++] = 0;                                          /* SOF */
+    if(id & CAN_EFF_FLAG) {
+        n = putBits(bits, n, (id & CAN_EFF_MASK) >> 18, 11);
+        bits[n++] = 1;                                      /* SRR */
+        bits[n++] = 1;                                      /* IDE */
+        n = putBits(bits, n, id & 0x3FFFF, 18);
+        bits[n++] = rtr;
+        bits[n++] = 0;                                      /* r1 */
+        bits[n++] = 0;                                      /* r0 */
+    }
+    else {
+        n = putBits(bits, n, id & CAN_SFF_MASK, 11);
+        bits[n++] = rtr;
+        bits[n++] = 0;                                      /* IDE */
+        bits[n++] = 0;                                      /* r0 */
+    }
+    n = putBits(bits, n, len > 8 ? 8 : len, 4);
+    for(i=0; !rtr && i<len && i<8; i++) {
+        n = putBits(bits, n, data[i], 8);
+    }
+    crc = crc15(bits, n);
+    n = putBits(bits, n, crc, 15);
+
+    /* After five equal bits a complement bit is inserted, which starts the
+     * next run. */
+    for(i=0; i<n; i++) {
+        if(bits[i] == prev) {
+            run++;
+        }
+        else {
+            prev = bits[i];
+            run = 1;
+        }
+        if(run == 5) {
+            stuffed++;
+            prev = !prev;
+            run = 1;
+        }
+    }
+
+    *stuff = stuffed;
+    /* CRC delimiter, ACK slot and delimiter, EOF, intermission */
+    return n + stuffed + 1 + 2 + 7 + 3;
+}
+
+
+/* Frame bits without stuff bits and with the maximum number of them. */
+static void frameBitsRange(bool ext, uint8_t len, int *min, int *max) {
+    int stuffedRegion = (ext ? 54 : 34) + 8 * len;
+
+    *min = stuffedRegion + 13;
+    *max = *min + (stuffedRegion - 1) / 4;
+}
+
+
+/******************************************************************************/
+/* Analysis                                                                   */
+/******************************************************************************/
+static bool isTPDO(uint32_t cob) {
+    uint32_t base = cob & 0x780;
+
+    return (cob & 0x7F) != 0 && (base == 0x180 || base == 0x280 || base == 0x380 || base == 0x480);
+}
+
+
+static void latAdd(latStats_t *l, double us) {
+    int b = (int)(us / LAT_BUCKET_US);
+
+    if(l->count == 0 || us < l->min) l->min = us;
+    if(l->count == 0 || us > l->max) l->max = us;
+    l->count++;
+    l->sum += us;
+    l->hist[b < 0 ? 0 : (b > LAT_BUCKETS ? LAT_BUCKETS : b)]++;
+}
+
+
+/* Upper bound of the bucket, which contains percentile p. */
+static double latPercentile(const latStats_t *l, double p) {
+    uint64_t target = (uint64_t)ceil(l->count * p), sum = 0;
+    int b;
+
+    for(b=0; b<=LAT_BUCKETS; b++) {
+        sum += l->hist[b];
+        if(sum >= target) {
+            return b < LAT_BUCKETS ? fmin((b + 1) * LAT_BUCKET_US, l->max) : l->max;
+        }
+    }
+    return l->max;
+}
+
+
+static void processFrame(uint64_t ts, uint32_t id, uint8_t len, const uint8_t *data) {
+    cobStats_t *c;
+    int stuff, bits;
+    uint32_t cob;
+
+    if(id & CAN_ERR_FLAG) {
+        errorFrames++;
+        return;
+    }
+    bits = frameBits(id, len, data, &stuff);
+    cob = (id & CAN_EFF_FLAG) ? COB_EFF : (id & CAN_SFF_MASK);
+
+    if(totalFrames == 0) {
+        first_ns = windowStart_ns = ts;
+    }
+    totalFrames++;
+    totalBits += bits;
+    stuffBits += stuff;
+    last_ns = ts;
+
+    /* Peak load. Bits of the frame count in the window, where it started. */
+    while(ts >= windowStart_ns + window_ns) {
+        if(windowBits > windowMaxBits) {
+            windowMaxBits = windowBits;
+        }
+        windowBits = 0;
+        windowStart_ns += window_ns;
+    }
+    windowBits += bits;
+
+    c = &cobs[cob];
+    if(c->frames > 0) {
+        double d = (ts - c->last_ns) / 1000.0;
+
+        if(c->intervals == 0 || d < c->intMin) c->intMin = d;
+        if(c->intervals == 0 || d > c->intMax) c->intMax = d;
+        c->intervals++;
+        c->intSum += d;
+        c->intSumSq += d * d;
+    }
+    c->frames++;
+    c->bits += bits;
+    c->last_ns = ts;
+
+    /* SYNC to TPDO */
+    if(cob == COB_SYNC) {
+        if(cycleLast_ns > sync_ns && sync_ns > 0) {
+            latAdd(&cycleLat, (cycleLast_ns - sync_ns) / 1000.0);
+        }
+        sync_ns = ts;
+        cycleLast_ns = 0;
+        memset(answered, 0, sizeof(answered));
+        syncs++;
+    }
+    else if(cob < NUM_COB && isTPDO(cob) && sync_ns > 0) {
+        uint8_t node = cob & 0x7F;
+
+        if(!answered[node]) {
+            answered[node] = true;
+            latAdd(&nodeLat[node], (ts - sync_ns) / 1000.0);
+        }
+        cycleLast_ns = ts;
+    }
+}
+
+
+static const char *cobName(uint32_t cob, char *buf, size_t size) {
+    static const struct {
+        uint32_t base;
+        const char *name;
+    } names[] = {
+        {0x080, "EMCY"}, {0x180, "TPDO1"}, {0x200, "RPDO1"}, {0x280, "TPDO2"},
+        {0x300, "RPDO2"}, {0x380, "TPDO3"}, {0x400, "RPDO3"}, {0x480, "TPDO4"},
+        {0x500, "RPDO4"}, {0x580, "SDO tx"}, {0x600, "SDO rx"}, {0x700, "Heartbeat"}
+    };
+    size_t i;
+
+    if(cob == COB_EFF) return "extended";
+    if(cob == 0x000) return "NMT";
+    if(cob == COB_SYNC) return "SYNC";
+    if(cob == 0x100) return "TIME";
+    for(i=0; i<sizeof(names)/sizeof(names[0]); i++) {
+        if((cob & 0x780) == names[i].base && (cob & 0x7F) != 0) {
+            snprintf(buf, size, "%s %u", names[i].name, cob & 0x7F);
+            return buf;
+        }
+    }
+    return "";
+}
+
+
+static void printReport(void) {
+    double seconds = (last_ns - first_ns) / 1e9;
+    double busy = (double)totalBits / bitrate;
+    uint32_t cob;
+    int node;
+
+    if(windowBits > windowMaxBits) {
+        windowMaxBits = windowBits;
+    }
+    if(totalFrames < 2 || seconds <= 0) {
+        printf("canAnalyze - %llu frames, not enough for a report\n", (unsigned long long)totalFrames);
+        return;
+    }
+
+    printf("canAnalyze - %llu frames in %.3f s at %u bit/s, bus load %.1f %% (peak %.1f %% in %.0f ms), "
+           "%.1f bits/frame (%.1f stuff bits), %llu error frames\n",
+           (unsigned long long)totalFrames, seconds, bitrate, busy / seconds * 100,
+           (double)windowMaxBits / bitrate / (window_ns / 1e9) * 100, window_ns / 1e6,
+           (double)totalBits / totalFrames, (double)stuffBits / totalFrames,
+           (unsigned long long)errorFrames);
+
+    printf("\n  COB-ID %-12s %9s %9s %11s %21s %7s %7s\n",
+           "name", "frames", "rate/s", "period us", "jitter std/max us", "bits", "load %");
+    for(cob=0; cob<COB_COUNT; cob++) {
+        const cobStats_t *c = &cobs[cob];
+        char buf[24], idStr[8];
+        double mean = 0, std = 0, dev = 0;
+
+        if(c->frames == 0) {
+            continue;
+        }
+        if(c->intervals > 0) {
+            mean = c->intSum / c->intervals;
+            std = sqrt(fmax(0, c->intSumSq / c->intervals - mean * mean));
+            dev = fmax(c->intMax - mean, mean - c->intMin);
+        }
+        snprintf(idStr, sizeof(idStr), cob == COB_EFF ? "-" : "0x%03X", cob);
+        printf("  %-6s %-12s %9llu %9.1f %11.1f %10.1f/%10.1f %7.1f %7.2f\n",
+               idStr, cobName(cob, buf, sizeof(buf)), (unsigned long long)c->frames,
+               c->frames / seconds, mean, std, dev, (double)c->bits / c->frames,
+               (double)c->bits / bitrate / seconds * 100);
+    }
+
+    if(syncs == 0) {
+        return;
+    }
+    printf("\n  SYNC to TPDO latency, %llu SYNC\n  %-8s %9s %9s %9s %9s %9s\n",
+           (unsigned long long)syncs, "node", "count", "min us", "avg us", "p99 us", "max us");
+    for(node=1; node<128; node++) {
+        const latStats_t *l = &nodeLat[node];
+
+        if(l->count > 0) {
+            printf("  %-8d %9llu %9.1f %9.1f %9.0f %9.1f\n", node, (unsigned long long)l->count,
+                   l->min, l->sum / l->count, latPercentile(l, 0.99), l->max);
+        }
+    }
+    if(cycleLat.count > 0) {
+        printf("  %-8s %9llu %9.1f %9.1f %9.0f %9.1f\n", "last", (unsigned long long)cycleLat.count,
+               cycleLat.min, cycleLat.sum / cycleLat.count, latPercentile(&cycleLat, 0.99), cycleLat.max);
+    }
+}
+
+
+/******************************************************************************/
+/* Input                                                                      */
+/******************************************************************************/
+static int analyzeCapture(const char *path) {
+    canCapture_header_t *hdr;
+    size_t size;
+    uint64_t n, written;
+
+    hdr = canCapture_map(path, &size);
+    if(hdr == NULL) {
+        return -1;
+    }
+    written = __atomic_load_n(&hdr->written, __ATOMIC_ACQUIRE);
+    n = written > hdr->capacity ? written - hdr->capacity : 0;
+    if(n < hdr->first) {
+        n = hdr->first;
+    }
+    for(; n < written && !endProgram; n++) {
+        const canCapture_record_t *rec = canCapture_record(hdr, n);
+
+        processFrame(rec->timestamp_ns, rec->id, rec->len, rec->data);
+    }
+    if(hdr->droppedKernel > 0 || hdr->droppedRing > 0) {
+        printf("canAnalyze - capture dropped %llu frames, load is higher\n",
+               (unsigned long long)(hdr->droppedKernel + hdr->droppedRing));
+    }
+    munmap(hdr, size);
+    return 0;
+}
+
+
+static int analyzeLive(const char *dev, double duration) {
+    struct sockaddr_can addr;
+    struct can_frame frames[BATCH_SIZE];
+    struct iovec iov[BATCH_SIZE];
+    struct mmsghdr msgs[BATCH_SIZE];
+    char ctrl[BATCH_SIZE][CMSG_SPACE(sizeof(struct timespec))];
+    uint64_t end_ns = duration > 0 ? now_ns() + (uint64_t)(duration * 1e9) : UINT64_MAX;
+    can_err_mask_t errMask = CAN_ERR_MASK;
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    int one = 1, i;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(dev);
+    if(fd < 0 || addr.can_ifindex == 0
+       || setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != 0
+       || setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errMask, sizeof(errMask)) != 0
+       || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    for(i=0; i<BATCH_SIZE; i++) {
+        iov[i].iov_base = &frames[i];
+        iov[i].iov_len = sizeof(frames[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while(!endProgram && now_ns() < end_ns) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int n;
+
+        if(poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        for(i=0; i<BATCH_SIZE; i++) {
+            msgs[i].msg_hdr.msg_control = ctrl[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+        }
+        n = recvmmsg(fd, msgs, BATCH_SIZE, MSG_DONTWAIT, NULL);
+        for(i=0; i<n; i++) {
+            struct cmsghdr *cmsg;
+            uint64_t ts = 0;
+
+            if(msgs[i].msg_len != sizeof(struct can_frame)) {
+                continue;
+            }
+            for(cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL;
+                cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+                if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS) {
+                    struct timespec kt;
+
+                    memcpy(&kt, CMSG_DATA(cmsg), sizeof(kt));
+                    ts = (uint64_t)kt.tv_sec * 1000000000ULL + kt.tv_nsec;
+                }
+            }
+            processFrame(ts, frames[i].can_id, frames[i].can_dlc, frames[i].data);
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+
+/******************************************************************************/
+/* Planning                                                                   */
+/******************************************************************************/
+/* PDOs of PDOremap.cpp, SYNC and heartbeats. */
+static const char *defaultPlan =
+    "# name      COB-ID  length  period  nodes\n"
+    "SYNC        0x080   0       sync\n"
+    "TPDO1       0x180   2       event   1-4     # 0x6041 statusword\n"
+    "TPDO2       0x280   8       sync    1-4     # 0x6064 position, 0x606C velocity\n"
+    "TPDO3       0x380   2       sync    1-4     # 0x6077 torque\n"
+    "RPDO1       0x200   2       event   1-4     # 0x6040 controlword\n"
+    "RPDO2       0x300   4       sync    1-4     # 0x607A target position\n"
+    "RPDO3       0x400   4       event   1-4     # 0x60FF target velocity\n"
+    "Heartbeat   0x700   1       50000   1-4\n";
+
+
+static int parsePlan(FILE *fp, planMsg_t *plan) {
+    char line[LINE_SIZE];
+    int n = 0, lineNo = 0;
+
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        char period[16], nodes[16] = "";
+        unsigned cob, len, a, b;
+        planMsg_t *m = &plan[n];
+        char *hash = strchr(line, '#');
+        int fields;
+
+        lineNo++;
+        if(hash != NULL) {
+            *hash = 0;
+        }
+        fields = sscanf(line, "%23s %i %u %15s %15s", m->name, (int *)&cob, &len, period, nodes);
+        if(fields <= 0) {
+            continue;
+        }
+        if(fields < 4 || len > 8 || n >= MAX_PLAN) {
+            fprintf(stderr, "canAnalyze: plan line %d not understood\n", lineNo);
+            return -1;
+        }
+        m->cob = cob;
+        m->len = len;
+        m->period_us = 0;
+        m->syncDivider = 1;
+        m->event = strcmp(period, "event") == 0;
+        if(strcmp(period, "sync") == 0 || m->event) {
+            /* Event driven messages at most each SYNC */
+        }
+        else if(strncmp(period, "sync", 4) == 0) {
+            m->syncDivider = atoi(period + 4);
+        }
+        else {
+            m->period_us = atoi(period);
+        }
+        m->nodeFirst = m->nodeLast = 0;
+        if(fields == 5) {
+            if(sscanf(nodes, "%u-%u", &a, &b) == 2) {
+                m->nodeFirst = a;
+                m->nodeLast = b;
+            }
+            else if(sscanf(nodes, "%u", &a) == 1) {
+                m->nodeFirst = m->nodeLast = a;
+            }
+        }
+        if(m->syncDivider == 0 || m->nodeFirst > m->nodeLast || m->nodeLast > 127) {
+            fprintf(stderr, "canAnalyze: plan line %d not understood\n", lineNo);
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+
+static void printPlan(const planMsg_t *plan, int count, uint32_t syncPeriod_us) {
+    double loadMin = 0, loadMax = 0, cycleMin = 0, cycleMax = 0;
+    int i;
+
+    printf("canAnalyze plan - %u bit/s, SYNC period %u us\n\n", bitrate, syncPeriod_us);
+    printf("  %-12s %6s %6s %10s %13s %15s\n", "name", "frames", "length", "rate/s", "bits min/max", "load % min/max");
+    for(i=0; i<count; i++) {
+        const planMsg_t *m = &plan[i];
+        int frames = m->nodeFirst > 0 ? m->nodeLast - m->nodeFirst + 1 : 1;
+        int bitsMin, bitsMax;
+        double rate, rateMin;
+
+        frameBitsRange(m->cob > CAN_SFF_MASK, m->len, &bitsMin, &bitsMax);
+        if(m->period_us > 0) {
+            rate = 1e6 / m->period_us;
+        }
+        else {
+            rate = 1e6 / syncPeriod_us / m->syncDivider;
+            /* Messages sent on each SYNC have to fit into one cycle */
+            if(m->syncDivider == 1) {
+                cycleMin += m->event ? 0 : (double)frames * bitsMin;
+                cycleMax += (double)frames * bitsMax;
+            }
+        }
+        rate *= frames;
+        rateMin = m->event ? 0 : rate;
+        loadMin += rateMin * bitsMin / bitrate * 100;
+        loadMax += rate * bitsMax / bitrate * 100;
+        printf("  %-12s %6d %6u %9.0f%s %6d/%6d %7.2f/%7.2f\n", m->name, frames, m->len, rate,
+               m->event ? "*" : " ", bitsMin, bitsMax, rateMin * bitsMin / bitrate * 100,
+               rate * bitsMax / bitrate * 100);
+    }
+    printf("\n  * event driven, at most each SYNC, only in the maximum\n");
+    printf("  bus load %.1f .. %.1f %%%s\n", loadMin, loadMax,
+           loadMax >= 100 ? ", OVERLOADED" : (loadMax >= 70 ? ", above 70 %, little margin for SDO and retransmissions" : ""));
+    printf("  messages of each SYNC take %.0f .. %.0f us of the %u us cycle (%.0f .. %.0f %%)\n",
+           cycleMin * 1e6 / bitrate, cycleMax * 1e6 / bitrate, syncPeriod_us,
+           cycleMin * 1e6 / bitrate / syncPeriod_us * 100, cycleMax * 1e6 / bitrate / syncPeriod_us * 100);
+}
+
+
+/******************************************************************************/
+static void printUsage(char *progName) {
+    fprintf(stderr,
+"Usage: %s <CAN device | capture file> [options]\n"
+"       %s -P <plan file | default | show> [options]\n"
+"\n"
+"Options:\n"
+"  -b <bit/s>          Bitrate (default 1000000).\n"
+"  -t <seconds>        Duration of live analysis (default until Ctrl+C).\n"
+"  -w <ms>             Window for peak load (default 10).\n"
+"  -P <plan>           Predict bus load of a configuration, see the file\n"
+"                      header. 'show' prints the default plan.\n"
+"  -S <us>             SYNC period for the plan (default 1000).\n", progName, progName);
+}
+
+
+int main(int argc, char *argv[]) {
+    char *planPath = NULL;
+    uint32_t syncPeriod_us = 1000;
+    double duration = 0;
+    int opt;
+
+    if(argc < 2 || strcmp(argv[1], "--help") == 0) {
+        printUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+
+    while((opt = getopt(argc, argv, "b:t:w:P:S:")) != -1) {
+        switch(opt) {
+            case 'b': bitrate = strtoul(optarg, NULL, 0);               break;
+            case 't': duration = atof(optarg);                          break;
+            case 'w': window_ns = (uint64_t)(atof(optarg) * 1e6);       break;
+            case 'P': planPath = optarg;                                break;
+            case 'S': syncPeriod_us = strtoul(optarg, NULL, 0);         break;
+            default:
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(bitrate == 0 || window_ns == 0 || syncPeriod_us == 0 || (planPath == NULL && optind >= argc)) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if(planPath != NULL) {
+        planMsg_t plan[MAX_PLAN];
+        FILE *fp;
+        int count;
+
+        if(strcmp(planPath, "show") == 0) {
+            printf("%s", defaultPlan);
+            exit(EXIT_SUCCESS);
+        }
+        fp = strcmp(planPath, "default") == 0
+           ? fmemopen((void *)defaultPlan, strlen(defaultPlan), "r") : fopen(planPath, "r");
+        if(fp == NULL) {
+            fprintf(stderr, "canAnalyze: %s: %s\n", planPath, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        count = parsePlan(fp, plan);
+        fclose(fp);
+        if(count < 0) {
+            exit(EXIT_FAILURE);
+        }
+        printPlan(plan, count, syncPeriod_us);
+        exit(EXIT_SUCCESS);
+    }
+
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+
+    if(if_nametoindex(argv[optind]) != 0) {
+        if(analyzeLive(argv[optind], duration) != 0) {
+            perror("canAnalyze: CAN socket");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if(analyzeCapture(argv[optind]) != 0) {
+        fprintf(stderr, "canAnalyze: %s: %s\n", argv[optind],
+                errno == EINVAL ? "not a capture file" : strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    printReport();
+    return EXIT_SUCCESS;
+}
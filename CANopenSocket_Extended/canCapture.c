@@ -0,0 +1,611 @@
+/*
+ * High rate CAN capture into a binary ring file.
+ *
+ * @file        canCapture.c
+ *
+ * Replacement for 'candump can1 > file' during 1 kHz PDO traffic. Frames
+ * are read in batches with recvmmsg(), each with its kernel receive
+ * software timestamp (CLOCK_REALTIME), and copied into a
+ * preallocated, mmapped ring file (format in canCapture.h, 24 bytes per
+ * frame). Nothing is formatted or written with write() while capturing.
+ *
+ * Modes:
+ *   ring     - default. Capture until Ctrl+C, oldest frames are overwritten
+ *              when the ring is full.
+ *   trigger  - -t <pre>,<post>. Capture into the ring until a trigger
+ *              frame arrives: an emergency (0x081..0x0FF) with nonzero error
+ *              code, the COB-ID given with -T, or SIGUSR1. Capture continues
+ *              for <post> seconds, then frames from <pre> seconds before the
+ *              trigger to the end are written to <ring file>.<n>. With -R
+ *              capture is re-armed for the next trigger, otherwise it ends.
+ *              Ring must hold <pre> + <post> seconds of traffic, at 1 kHz
+ *              SYNC with four drives about 10000 frames per second.
+ *
+ * Dropped frames are counted and stored in the header: frames dropped by
+ * the socket receive queue (SO_RXQ_OVFL, increase -b or use -p) and frames
+ * not stored, because the ring would overwrite the trigger frame before
+ * the post-trigger time elapsed. Error frames are captured and counted.
+ *
+ * -d prints a capture file in 'candump -l' format, so existing scripts and
+ * can-utils (canplayer, log2asc) can be used.
+ *
+ * Compile: gcc canCapture.c -o canCapture -Wall
+ *
+ * Examples:
+ *   ./canCapture can1 -o /tmp/can1.cap -n 2000000
+ *   ./canCapture can1 -o /tmp/can1.cap -t 10,2 -f 0x081:0x780,0x181:0x7F0
+ *   ./canCapture -d /tmp/can1.cap.1 | less
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#include "canCapture.h"
+
+
+#define BATCH_SIZE              64
+#define MAX_FILTERS             32
+#define POLL_MS                 100
+#define DEFAULT_CAPACITY        1048576     /* 24 MB */
+#define DEFAULT_RCVBUF          (1024 * 1024)
+
+/* Control messages of one frame: timestamps and drop counter */
+#define CTRL_SIZE   (CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(uint32_t)))
+
+
+static volatile sig_atomic_t endProgram = 0;
+static volatile sig_atomic_t manualTrigger = 0;
+
+static canCapture_header_t *ring = NULL;
+static canCapture_record_t *records;
+
+/* Trigger mode */
+static bool         triggerMode = false;
+static uint64_t     pre_ns, post_ns;
+static int32_t      triggerCob = -1;        /* -1 for emergency */
+static bool         rearm = false;
+static int          dumps = 0;
+static uint64_t     triggerTime_ns;
+
+/* Statistics not in the header */
+static uint32_t     batchMax = 0;
+static uint32_t     truncated = 0;          /* Dumps missing part of pre-trigger time */
+
+
+static void sigHandler(int sig) {
+    if(sig == SIGUSR1) {
+        manualTrigger = 1;
+    }
+    else {
+        endProgram = 1;
+    }
+}
+
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/******************************************************************************/
+/* CAN                                                                        */
+/******************************************************************************/
+/* Parse "id[:mask],..." into filters. Default mask matches the standard
+ * identifier exactly. Returns number of filters or -1. */
+static int parseFilters(char *str, struct can_filter *filters) {
+    char *tok, *save;
+    int n = 0;
+
+    for(tok = strtok_r(str, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+
+        if(n >= MAX_FILTERS) {
+            return -1;
+        }
+        filters[n].can_id = strtoul(tok, &end, 0);
+        filters[n].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        if(*end == ':') {
+            filters[n].can_mask = strtoul(end + 1, &end, 0) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        }
+        if(*end != 0) {
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+
+static int canOpen(const char *dev, const struct can_filter *filters, int filterCount, int rcvbuf) {
+    struct sockaddr_can addr;
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    int one = 1;
+    int tsFlags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    can_err_mask_t errMask = CAN_ERR_MASK;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(dev);
+    if(fd < 0 || addr.can_ifindex == 0
+       || setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &tsFlags, sizeof(tsFlags)) != 0
+       || setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) != 0
+       || setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &errMask, sizeof(errMask)) != 0
+       || (filterCount > 0
+           && setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters, filterCount * sizeof(filters[0])) != 0)
+       || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    /* Larger receive queue bridges scheduling delays. FORCE needs root. */
+    if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    return fd;
+}
+
+
+/* Fill record from received message and its control messages. */
+static void recordFromMsg(canCapture_record_t *rec, const struct can_frame *f, struct msghdr *msg) {
+    struct cmsghdr *cmsg;
+
+    memset(rec, 0, sizeof(*rec));
+    rec->id = f->can_id;
+    rec->len = f->can_dlc > 8 ? 8 : f->can_dlc;
+    memcpy(rec->data, f->data, rec->len);
+    rec->flags = CAN_CAPTURE_REC_NO_TS;
+
+    for(cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if(cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if(cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping *stamp = (struct scm_timestamping *)CMSG_DATA(cmsg);
+            /* ts[0] is the software timestamp, CLOCK_REALTIME like the trigger time from
+             * realtime_ns(). The hardware one (ts[2]) runs on the controller's clock. */
+            if(stamp->ts[0].tv_sec != 0 || stamp->ts[0].tv_nsec != 0) {
+                rec->timestamp_ns = (uint64_t)stamp->ts[0].tv_sec * 1000000000ULL + stamp->ts[0].tv_nsec;
+                rec->flags = 0;
+            }
+        }
+        else if(cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+
+            /* Total number of frames dropped by the socket so far */
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            ring->droppedKernel = drops;
+        }
+    }
+    if(rec->flags & CAN_CAPTURE_REC_NO_TS) {
+        rec->timestamp_ns = realtime_ns();
+    }
+}
+
+
+static bool isTrigger(const canCapture_record_t *rec) {
+    uint32_t id = rec->id;
+
+    if(id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG)) {
+        return false;
+    }
+    if(triggerCob >= 0) {
+        return id == (uint32_t)triggerCob;
+    }
+    /* Emergency with error code, not 'error reset' */
+    return id > 0x080 && id <= 0x0FF && rec->len >= 2 && (rec->data[0] != 0 || rec->data[1] != 0);
+}
+
+
+/******************************************************************************/
+/* Ring file                                                                  */
+/******************************************************************************/
+static int ringCreate(const char *path, uint64_t capacity, const char *dev, const char *filter) {
+    size_t size = canCapture_fileSize(capacity);
+    struct timespec tsMono, tsReal;
+    int fd, err;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return -1;
+    }
+    /* Allocate all blocks now, so capture never waits for the filesystem. */
+    err = posix_fallocate(fd, 0, size);
+    if(err != 0) {
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(ring == MAP_FAILED) {
+        ring = NULL;
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    memcpy(ring->magic, CAN_CAPTURE_MAGIC, sizeof(ring->magic));
+    ring->version = CAN_CAPTURE_VERSION;
+    ring->headerSize = sizeof(canCapture_header_t);
+    ring->recordSize = sizeof(canCapture_record_t);
+    ring->capacity = capacity;
+    ring->trigger = CAN_CAPTURE_NO_TRIGGER;
+    clock_gettime(CLOCK_MONOTONIC, &tsMono);
+    clock_gettime(CLOCK_REALTIME, &tsReal);
+    ring->realToMono_ns = ((int64_t)tsMono.tv_sec - tsReal.tv_sec) * 1000000000LL
+                        + (tsMono.tv_nsec - tsReal.tv_nsec);
+    ring->startTime_ns = (uint64_t)tsReal.tv_sec * 1000000000ULL + tsReal.tv_nsec;
+    strncpy(ring->ifname, dev, sizeof(ring->ifname) - 1);
+    strncpy(ring->filter, filter, sizeof(ring->filter) - 1);
+    records = canCapture_record(ring, 0);
+    return 0;
+}
+
+
+/* Write records from..to-1 of the ring into a new capture file. */
+static int writeWindow(const char *path, uint64_t from, uint64_t to) {
+    canCapture_header_t hdr = *ring;
+    uint64_t n = to - from;
+    uint64_t i = from % ring->capacity;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok;
+
+    if(fd < 0) {
+        return -1;
+    }
+    hdr.capacity = n > 0 ? n : 1;
+    hdr.first = 0;
+    hdr.written = n;
+    hdr.trigger = (ring->trigger != CAN_CAPTURE_NO_TRIGGER) ? ring->trigger - from : CAN_CAPTURE_NO_TRIGGER;
+    hdr.stopTime_ns = realtime_ns();
+    ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr);
+
+    /* Up to two parts, if window wraps around the end of the ring */
+    while(ok && n > 0) {
+        uint64_t part = (i + n > ring->capacity) ? ring->capacity - i : n;
+        size_t len = part * sizeof(canCapture_record_t);
+
+        ok = write(fd, &records[i], len) == (ssize_t)len;
+        n -= part;
+        i = 0;
+    }
+    if(ok && to == from) {
+        canCapture_record_t empty;
+
+        memset(&empty, 0, sizeof(empty));
+        ok = write(fd, &empty, sizeof(empty)) == sizeof(empty);
+    }
+    if(close(fd) != 0 || !ok) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Post-trigger time elapsed: write window, re-arm or end. */
+static void triggerDone(const char *ringPath) {
+    uint64_t oldest = ring->written > ring->capacity ? ring->written - ring->capacity : 0;
+    uint64_t from = ring->trigger;
+    char path[256];
+
+    /* Search back for pre-trigger start */
+    while(from > oldest && records[(from - 1) % ring->capacity].timestamp_ns + pre_ns >= triggerTime_ns) {
+        from--;
+    }
+    if(from == oldest && oldest > 0) {
+        truncated++;
+    }
+
+    snprintf(path, sizeof(path), "%s.%d", ringPath, ++dumps);
+    if(writeWindow(path, from, ring->written) == 0) {
+        fprintf(stderr, "canCapture: trigger %d, %llu frames (%llu before trigger) written to %s%s\n",
+                dumps, (unsigned long long)(ring->written - from),
+                (unsigned long long)(ring->trigger - from), path,
+                (from == oldest && oldest > 0) ? ", ring too small for pre-trigger time" : "");
+    }
+    else {
+        fprintf(stderr, "canCapture: %s: %s\n", path, strerror(errno));
+    }
+
+    if(rearm) {
+        ring->trigger = CAN_CAPTURE_NO_TRIGGER;
+    }
+    else {
+        endProgram = 1;
+    }
+}
+
+
+/******************************************************************************/
+/* Print capture file                                                         */
+/******************************************************************************/
+static int dumpFile(const char *path) {
+    canCapture_header_t *hdr;
+    size_t size;
+    uint64_t n, written;
+
+    hdr = canCapture_map(path, &size);
+    if(hdr == NULL) {
+        fprintf(stderr, "canCapture: %s: %s\n", path,
+                errno == EINVAL ? "not a capture file" : strerror(errno));
+        return -1;
+    }
+    written = __atomic_load_n(&hdr->written, __ATOMIC_ACQUIRE);
+    n = written > hdr->capacity ? written - hdr->capacity : 0;
+    if(n < hdr->first) {
+        n = hdr->first;
+    }
+
+    fprintf(stderr, "canCapture: %s, %s, %llu frames (%llu in file), dropped %llu by socket, %llu ring full, %llu error frames%s\n",
+            path, hdr->ifname, (unsigned long long)written, (unsigned long long)(written - n),
+            (unsigned long long)hdr->droppedKernel, (unsigned long long)hdr->droppedRing,
+            (unsigned long long)hdr->errorFrames, hdr->stopTime_ns == 0 ? ", capture running" : "");
+
+    for(; n < written; n++) {
+        const canCapture_record_t *rec = canCapture_record(hdr, n);
+        int i;
+
+        if(n == hdr->trigger) {
+            printf("# trigger\n");
+        }
+        printf("(%llu.%06llu) %s ", (unsigned long long)(rec->timestamp_ns / 1000000000ULL),
+               (unsigned long long)(rec->timestamp_ns % 1000000000ULL / 1000), hdr->ifname);
+        if(rec->id & (CAN_EFF_FLAG | CAN_ERR_FLAG)) {
+            printf("%08X#", rec->id & (CAN_EFF_MASK | CAN_ERR_FLAG));
+        }
+        else {
+            printf("%03X#", rec->id & CAN_SFF_MASK);
+        }
+        if(rec->id & CAN_RTR_FLAG) {
+            printf("R");
+        }
+        else {
+            for(i=0; i<rec->len && i<8; i++) {
+                printf("%02X", rec->data[i]);
+            }
+        }
+        printf("\n");
+    }
+    munmap(hdr, size);
+    return 0;
+}
+
+
+/******************************************************************************/
+static void printUsage(char *progName) {
+    fprintf(stderr,
+"Usage: %s <CAN device> [options]\n"
+"       %s -d <capture file>\n"
+"\n"
+"Options:\n"
+"  -o <file>           Ring file (default /tmp/canCapture.cap).\n"
+"  -n <frames>         Ring capacity, 24 bytes per frame (default %d).\n"
+"  -f <id[:mask],...>  Capture only matching frames (kernel filter). Mask\n"
+"                      default 0x7FF. Error frames are always captured.\n"
+"  -t <pre>,<post>     Trigger mode, seconds before and after the trigger.\n"
+"                      Emergencies pass the filter in this mode.\n"
+"  -T <COB-ID>         Trigger on this COB-ID instead of an emergency with\n"
+"                      error code. SIGUSR1 triggers too.\n"
+"  -R                  Re-arm after trigger, otherwise capture ends.\n"
+"  -b <bytes>          Socket receive buffer (default %d).\n"
+"  -p <priority>       Run with SCHED_FIFO priority and locked memory.\n"
+"  -d <file>           Print capture file in candump -l format.\n",
+            progName, progName, DEFAULT_CAPACITY, DEFAULT_RCVBUF);
+}
+
+
+int main(int argc, char *argv[]) {
+    char *ringPath = "/tmp/canCapture.cap";
+    char *filterStr = "";
+    struct can_filter filters[MAX_FILTERS + 1];
+    int filterCount = 0;
+    uint64_t capacity = DEFAULT_CAPACITY;
+    int rcvbuf = DEFAULT_RCVBUF, priority = -1;
+    struct can_frame frames[BATCH_SIZE];
+    struct iovec iov[BATCH_SIZE];
+    struct mmsghdr msgs[BATCH_SIZE];
+    char ctrl[BATCH_SIZE][CTRL_SIZE];
+    bool triggered = false;
+    uint64_t triggerEnd_ns = 0, frameCount = 0;
+    double seconds;
+    int fd, opt, i;
+
+    if(argc < 2 || strcmp(argv[1], "--help") == 0) {
+        printUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+
+    while((opt = getopt(argc, argv, "o:n:f:t:T:Rb:p:d:")) != -1) {
+        switch(opt) {
+            case 'o': ringPath = optarg;                    break;
+            case 'n': capacity = strtoull(optarg, NULL, 0); break;
+            case 'f': {
+                char copy[256];
+
+                filterStr = optarg;
+                snprintf(copy, sizeof(copy), "%s", optarg);
+                filterCount = parseFilters(copy, filters);
+                if(filterCount < 0) {
+                    fprintf(stderr, "Invalid filter (%s)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 't': {
+                double pre, post;
+
+                if(sscanf(optarg, "%lf,%lf", &pre, &post) != 2 || pre < 0 || post < 0) {
+                    fprintf(stderr, "Invalid trigger times (%s)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                pre_ns = (uint64_t)(pre * 1e9);
+                post_ns = (uint64_t)(post * 1e9);
+                triggerMode = true;
+                break;
+            }
+            case 'T': triggerCob = strtol(optarg, NULL, 0);  break;
+            case 'R': rearm = true;                          break;
+            case 'b': rcvbuf = atoi(optarg);                 break;
+            case 'p': priority = atoi(optarg);               break;
+            case 'd': exit(dumpFile(optarg) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+            default:
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(optind >= argc || capacity < BATCH_SIZE) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Trigger frames must pass the filter */
+    if(triggerMode && filterCount > 0) {
+        filters[filterCount].can_id = triggerCob >= 0 ? (canid_t)triggerCob : 0x080;
+        filters[filterCount].can_mask = (triggerCob >= 0 ? CAN_SFF_MASK : 0x780) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        filterCount++;
+    }
+
+    fd = canOpen(argv[optind], filters, filterCount, rcvbuf);
+    if(fd < 0) {
+        perror("canCapture: CAN socket");
+        exit(EXIT_FAILURE);
+    }
+    if(ringCreate(ringPath, capacity, argv[optind], filterStr) != 0) {
+        fprintf(stderr, "canCapture: %s: %s\n", ringPath, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if(priority >= 0) {
+        struct sched_param param = {.sched_priority = priority};
+
+        if(sched_setscheduler(0, SCHED_FIFO, &param) != 0 || mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            perror("canCapture: realtime priority");
+        }
+    }
+
+    for(i=0; i<BATCH_SIZE; i++) {
+        iov[i].iov_base = &frames[i];
+        iov[i].iov_len = sizeof(frames[i]);
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+    signal(SIGUSR1, sigHandler);
+    fprintf(stderr, "canCapture - %s to %s, %llu frames ring%s\n", argv[optind], ringPath,
+            (unsigned long long)capacity, triggerMode ? ", trigger mode" : "");
+
+    while(!endProgram) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        uint64_t written = ring->written;
+        int n;
+
+        if(poll(&pfd, 1, POLL_MS) > 0) {
+            for(i=0; i<BATCH_SIZE; i++) {
+                msgs[i].msg_hdr.msg_control = ctrl[i];
+                msgs[i].msg_hdr.msg_controllen = CTRL_SIZE;
+            }
+            n = recvmmsg(fd, msgs, BATCH_SIZE, MSG_DONTWAIT, NULL);
+            if(n < 0 && errno != EAGAIN && errno != EINTR) {
+                perror("canCapture: recvmmsg");
+                break;
+            }
+            if(n > 0) {
+                ring->batches++;
+                if((uint32_t)n > batchMax) {
+                    batchMax = n;
+                }
+            }
+            for(i=0; i<n; i++) {
+                canCapture_record_t rec;
+
+                if(msgs[i].msg_len != sizeof(struct can_frame)) {
+                    continue;
+                }
+                frameCount++;
+                recordFromMsg(&rec, &frames[i], &msgs[i].msg_hdr);
+                if(rec.id & CAN_ERR_FLAG) {
+                    ring->errorFrames++;
+                }
+
+                /* Do not overwrite the trigger frame before post-trigger time ends */
+                if(triggered && written - ring->trigger >= ring->capacity) {
+                    ring->droppedRing++;
+                    continue;
+                }
+                records[written % ring->capacity] = rec;
+
+                if(triggerMode && !triggered && isTrigger(&rec)) {
+                    triggered = true;
+                    ring->trigger = written;
+                    triggerTime_ns = rec.timestamp_ns;
+                    triggerEnd_ns = realtime_ns() + post_ns;
+                }
+                written++;
+            }
+        }
+
+        if(triggerMode && !triggered && manualTrigger) {
+            /* Trigger is the next frame */
+            triggered = true;
+            ring->trigger = written;
+            triggerTime_ns = realtime_ns();
+            triggerEnd_ns = triggerTime_ns + post_ns;
+        }
+        manualTrigger = 0;
+
+        /* Publish records, then header */
+        ring->first = written > ring->capacity ? written - ring->capacity : 0;
+        __atomic_store_n(&ring->written, written, __ATOMIC_RELEASE);
+
+        if(triggered && realtime_ns() >= triggerEnd_ns) {
+            triggerDone(ringPath);
+            triggered = false;
+        }
+    }
+
+    ring->stopTime_ns = realtime_ns();
+    msync(ring, canCapture_fileSize(ring->capacity), MS_SYNC);
+
+    seconds = (ring->stopTime_ns - ring->startTime_ns) / 1e9;
+    fprintf(stderr, "canCapture - %llu frames in %.1f s (%.0f/s), %llu batches (max %u), dropped %llu by socket, %llu ring full, %llu error frames",
+            (unsigned long long)frameCount, seconds, seconds > 0 ? frameCount / seconds : 0.0,
+            (unsigned long long)ring->batches, batchMax, (unsigned long long)ring->droppedKernel,
+            (unsigned long long)ring->droppedRing, (unsigned long long)ring->errorFrames);
+    if(triggerMode) {
+        fprintf(stderr, ", %d triggers, %u with short pre-trigger", dumps, truncated);
+    }
+    fprintf(stderr, "\n");
+
+    close(fd);
+    munmap(ring, canCapture_fileSize(ring->capacity));
+    return EXIT_SUCCESS;
+}
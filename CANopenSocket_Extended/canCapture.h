@@ -0,0 +1,143 @@
+/*
+ * Binary CAN capture file, written by canCapture.
+ *
+ * @file        canCapture.h
+ *
+ * File is a header followed by a ring of fixed size records. It is
+ * preallocated and written through mmap, so capturing costs a memcpy per
+ * frame. Records are numbered from the start of the capture, record n is
+ * stored at ring index n % capacity. Valid records are first .. written-1,
+ * older ones were overwritten. Records are in receive order.
+ *
+ * Header fields are updated after each receive batch, so other programs may
+ * read the file while it is being captured: read 'written' with acquire
+ * semantics, then the records before it. A record may be overwritten while
+ * it is read, if it is older than written - capacity + batch size.
+ *
+ * All values are in host byte order (little endian on the BBB and PC).
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+#ifndef CAN_CAPTURE_H
+#define CAN_CAPTURE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define CAN_CAPTURE_MAGIC           "COCAPT\r\n"
+#define CAN_CAPTURE_VERSION         1
+#define CAN_CAPTURE_NO_TRIGGER      UINT64_MAX
+
+/* Record flags */
+#define CAN_CAPTURE_REC_HW_TS       0x01    /* Reserved, hardware timestamps are not recorded */
+#define CAN_CAPTURE_REC_NO_TS       0x02    /* No kernel timestamp, time of read */
+
+
+/**
+ * File header, 256 bytes.
+ */
+typedef struct {
+    char        magic[8];           /**< CAN_CAPTURE_MAGIC */
+    uint32_t    version;            /**< CAN_CAPTURE_VERSION */
+    uint32_t    headerSize;         /**< Offset of the first record */
+    uint32_t    recordSize;         /**< sizeof(canCapture_record_t) */
+    uint32_t    reserved0;
+    uint64_t    capacity;           /**< Number of records in the ring */
+    uint64_t    written;            /**< Number of records written */
+    uint64_t    first;              /**< Number of the oldest valid record */
+    uint64_t    trigger;            /**< Number of the trigger record or CAN_CAPTURE_NO_TRIGGER */
+    int64_t     realToMono_ns;      /**< CLOCK_MONOTONIC - CLOCK_REALTIME at start */
+    uint64_t    startTime_ns;       /**< CLOCK_REALTIME at start */
+    uint64_t    stopTime_ns;        /**< CLOCK_REALTIME at end, 0 while capturing */
+    uint64_t    droppedKernel;      /**< Frames dropped by the socket (SO_RXQ_OVFL) */
+    uint64_t    droppedRing;        /**< Frames not stored, because ring was full */
+    uint64_t    errorFrames;        /**< CAN error frames, stored with CAN_ERR_FLAG */
+    uint64_t    batches;            /**< recvmmsg() calls, which returned frames */
+    char        ifname[16];         /**< CAN interface */
+    char        filter[64];         /**< COB-ID filter as given on command line */
+    uint8_t     reserved[64];
+} canCapture_header_t;
+
+
+/**
+ * One frame, 24 bytes.
+ */
+typedef struct {
+    uint64_t    timestamp_ns;       /**< Kernel receive time, CLOCK_REALTIME */
+    uint32_t    id;                 /**< can_id with CAN_EFF_FLAG, CAN_RTR_FLAG, CAN_ERR_FLAG */
+    uint8_t     len;                /**< Data length, 0..8 */
+    uint8_t     flags;              /**< CAN_CAPTURE_REC_* */
+    uint8_t     reserved[2];
+    uint8_t     data[8];
+} canCapture_record_t;
+
+
+_Static_assert(sizeof(canCapture_header_t) == 256, "canCapture_header_t size");
+_Static_assert(sizeof(canCapture_record_t) == 24, "canCapture_record_t size");
+
+
+/**
+ * Size of a capture file with capacity records.
+ */
+static inline size_t canCapture_fileSize(uint64_t capacity) {
+    return sizeof(canCapture_header_t) + (size_t)capacity * sizeof(canCapture_record_t);
+}
+
+
+/**
+ * Record n of the capture (first <= n < written).
+ */
+static inline canCapture_record_t *canCapture_record(canCapture_header_t *hdr, uint64_t n) {
+    return (canCapture_record_t *)((uint8_t *)hdr + hdr->headerSize) + (n % hdr->capacity);
+}
+
+
+/**
+ * Map capture file for reading.
+ *
+ * @param path File name.
+ * @param size Size of the mapping, for munmap().
+ *
+ * @return Header or NULL, if file can not be opened or is not a capture
+ * file (errno is EINVAL then).
+ */
+static inline canCapture_header_t *canCapture_map(const char *path, size_t *size) {
+    canCapture_header_t *hdr;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) {
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(canCapture_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(hdr == MAP_FAILED) {
+        return NULL;
+    }
+    if(memcmp(hdr->magic, CAN_CAPTURE_MAGIC, sizeof(hdr->magic)) != 0
+       || hdr->version != CAN_CAPTURE_VERSION || hdr->headerSize < sizeof(*hdr)
+       || hdr->recordSize != sizeof(canCapture_record_t) || hdr->capacity == 0
+       || canCapture_fileSize(hdr->capacity) + hdr->headerSize - sizeof(*hdr) > (size_t)st.st_size) {
+        munmap(hdr, st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    *size = st.st_size;
+    return hdr;
+}
+
+
+#endif
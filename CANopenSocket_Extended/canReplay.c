@@ -0,0 +1,544 @@
+/*
+ * Replay captured CAN traffic with original timing.
+ *
+ * @file        canReplay.c
+ *
+ * Sends frames from a canCapture file or a candump log onto a CAN
+ * interface, normally vcan, to re-run a recorded bus session against
+ * canopend and the control programs, or to load canopend's receive path
+ * with real traffic. Accepted inputs:
+ *   - capture file of canCapture (canCapture.h), also a trigger dump,
+ *   - 'candump -l' log or 'canCapture -d' output:  (1697040000.123456) can1 181#0011
+ *   - candump text output (CANdump_script.sh), with or without timestamps
+ *     (-ta):  (1697040000.123456)  can1  181   [2]  00 11
+ *     Without timestamps only -F and -g can be used.
+ *
+ * Timing:
+ *   original - default. Each frame is sent at its capture time relative to
+ *              the first frame, on an absolute CLOCK_MONOTONIC schedule,
+ *              so errors do not accumulate.
+ *   scaled   - -s <factor>, 2 replays twice as fast, 0.5 half as fast.
+ *   fastest  - -F, as fast as the interface accepts frames.
+ *   gap      - -g <us>, fixed gap between frames.
+ * The thread sleeps until shortly before the frame (-b, default 100 us) and
+ * then spins, which gives errors of a few microseconds on an idle machine
+ * with -p. Timing error is the time after write() returned minus the
+ * scheduled time. Its distribution is printed at the end, with the number
+ * of late frames and retries because of a full transmit queue (ENOBUFS).
+ *
+ * Compile: gcc canReplay.c -o canReplay -Wall -lm
+ *
+ * Examples:
+ *   ./canReplay vcan0 /tmp/can1.cap.1
+ *   ./canReplay vcan0 can1.log -s 10 -x 0x080,0x1E4:0x7FF
+ *   ./canReplay vcan0 /tmp/can1.cap -F -l 100 -p 50
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "canCapture.h"
+
+
+#define MAX_FILTERS             32
+#define LINE_SIZE               256
+#define DEFAULT_BUSYWAIT_US     100
+#define LATE_NS                 100000      /* Frame is late after 100 us */
+
+
+typedef struct {
+    canid_t     id;
+    canid_t     mask;
+} filter_t;
+
+static volatile sig_atomic_t endProgram = 0;
+
+static canCapture_record_t *frames = NULL;
+static uint64_t     frameCount = 0;
+static bool         hasTimestamps = true;
+
+static filter_t     include[MAX_FILTERS], exclude[MAX_FILTERS];
+static int          includeCount = 0, excludeCount = 0;
+
+
+static void sigHandler(int sig) {
+    (void)sig;
+    endProgram = 1;
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Sleep until t_ns (CLOCK_MONOTONIC), busy wait the last busy_ns. */
+static void waitUntil(uint64_t t_ns, uint64_t busy_ns) {
+    if(t_ns > busy_ns) {
+        struct timespec ts;
+        uint64_t wake = t_ns - busy_ns;
+
+        ts.tv_sec = wake / 1000000000ULL;
+        ts.tv_nsec = wake % 1000000000ULL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !endProgram);
+    }
+    while(now_ns() < t_ns && !endProgram);
+}
+
+
+/******************************************************************************/
+/* Input                                                                      */
+/******************************************************************************/
+static void addFrame(const canCapture_record_t *rec) {
+    static uint64_t allocated = 0;
+
+    if(frameCount == allocated) {
+        allocated = allocated > 0 ? allocated * 2 : 65536;
+        frames = realloc(frames, allocated * sizeof(frames[0]));
+        if(frames == NULL) {
+            perror("canReplay");
+            exit(EXIT_FAILURE);
+        }
+    }
+    frames[frameCount++] = *rec;
+}
+
+
+/* Copy valid records of a capture file in order. */
+static int loadCapture(const char *path) {
+    canCapture_header_t *hdr;
+    size_t size;
+    uint64_t n, written;
+
+    hdr = canCapture_map(path, &size);
+    if(hdr == NULL) {
+        return -1;
+    }
+    written = __atomic_load_n(&hdr->written, __ATOMIC_ACQUIRE);
+    n = written > hdr->capacity ? written - hdr->capacity : 0;
+    if(n < hdr->first) {
+        n = hdr->first;
+    }
+    for(; n < written; n++) {
+        addFrame(canCapture_record(hdr, n));
+    }
+    if(hdr->droppedKernel > 0 || hdr->droppedRing > 0) {
+        fprintf(stderr, "canReplay: warning, capture dropped %llu frames\n",
+                (unsigned long long)(hdr->droppedKernel + hdr->droppedRing));
+    }
+    munmap(hdr, size);
+    return 0;
+}
+
+
+/* Parse one line of candump output, return false if it is not a frame. */
+static bool parseLine(char *line, canCapture_record_t *rec) {
+    unsigned long long sec = 0, usec = 0;
+    char idStr[16];
+    char *p = line;
+    int pos, len, i;
+
+    memset(rec, 0, sizeof(*rec));
+    while(*p == ' ' || *p == '\t') p++;
+    if(*p == '(') {
+        if(sscanf(p, "(%llu.%llu)%n", &sec, &usec, &pos) != 2) {
+            return false;
+        }
+        rec->timestamp_ns = sec * 1000000000ULL + usec * 1000ULL;
+        p += pos;
+    }
+    else {
+        hasTimestamps = false;
+    }
+
+    /* Interface, then "ID#DATA" or "ID  [len]  bytes" */
+    if(sscanf(p, " %*s %15s%n", idStr, &pos) != 1) {
+        return false;
+    }
+    p += pos;
+    if(strchr(idStr, '#') != NULL) {
+        char *hash = strchr(idStr, '#');
+        char *data;
+
+        *hash = 0;
+        /* idStr holds at most 15 characters, data is in the rest of the line */
+        data = strchr(line, '#') + 1;
+        rec->id = strtoul(idStr, NULL, 16);
+        if(strlen(idStr) > 3) {
+            rec->id |= (rec->id & CAN_ERR_FLAG) ? 0 : CAN_EFF_FLAG;
+        }
+        if(*data == 'R') {
+            rec->id |= CAN_RTR_FLAG;
+            return true;
+        }
+        for(len=0; len<8 && sscanf(data + len * 2, "%2hhx", &rec->data[len]) == 1; len++);
+        rec->len = len;
+        return true;
+    }
+
+    rec->id = strtoul(idStr, NULL, 16);
+    if(strlen(idStr) > 3) {
+        rec->id |= CAN_EFF_FLAG;
+    }
+    if(sscanf(p, " [%d]%n", &len, &pos) != 1 || len < 0 || len > 8) {
+        return false;
+    }
+    p += pos;
+    rec->len = len;
+    if(strstr(p, "remote request") != NULL) {
+        rec->id |= CAN_RTR_FLAG;
+        return true;
+    }
+    for(i=0; i<len; i++) {
+        if(sscanf(p, " %2hhx%n", &rec->data[i], &pos) != 1) {
+            return false;
+        }
+        p += pos;
+    }
+    return true;
+}
+
+
+static int loadLog(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[LINE_SIZE];
+    int skipped = 0;
+
+    if(fp == NULL) {
+        return -1;
+    }
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        canCapture_record_t rec;
+
+        if(line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if(parseLine(line, &rec)) {
+            addFrame(&rec);
+        }
+        else {
+            skipped++;
+        }
+    }
+    fclose(fp);
+    if(skipped > 0) {
+        fprintf(stderr, "canReplay: %d lines of %s not understood\n", skipped, path);
+    }
+    return 0;
+}
+
+
+/* Parse "id[:mask],..." into filters, default mask 0x7FF. */
+static int parseFilters(char *str, filter_t *filters) {
+    char *tok, *save;
+    int n = 0;
+
+    for(tok = strtok_r(str, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+
+        if(n >= MAX_FILTERS) {
+            return -1;
+        }
+        filters[n].id = strtoul(tok, &end, 0);
+        filters[n].mask = CAN_SFF_MASK;
+        if(*end == ':') {
+            filters[n].mask = strtoul(end + 1, &end, 0);
+        }
+        if(*end != 0) {
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
+
+
+static bool matches(canid_t id, const filter_t *filters, int count) {
+    int i;
+
+    for(i=0; i<count; i++) {
+        if(((id ^ filters[i].id) & filters[i].mask) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Frame is sent, if it passes include and exclude filters. */
+static bool selected(const canCapture_record_t *rec) {
+    canid_t id = rec->id & ((rec->id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+
+    if(rec->id & CAN_ERR_FLAG) {
+        return false;
+    }
+    if(includeCount > 0 && !matches(id, include, includeCount)) {
+        return false;
+    }
+    return !matches(id, exclude, excludeCount);
+}
+
+
+/******************************************************************************/
+/* Output                                                                     */
+/******************************************************************************/
+static int canOpen(const char *dev) {
+    struct sockaddr_can addr;
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(dev);
+    /* Nothing is received */
+    if(fd < 0 || addr.can_ifindex == 0
+       || setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0) != 0
+       || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+
+/* Send frame, wait while transmit queue is full. Returns number of retries
+ * or -1. */
+static int canSend(int fd, const canCapture_record_t *rec) {
+    struct can_frame f;
+    int retries = 0;
+
+    memset(&f, 0, sizeof(f));
+    f.can_id = rec->id;
+    f.can_dlc = rec->len;
+    memcpy(f.data, rec->data, rec->len);
+    while(write(fd, &f, sizeof(f)) != sizeof(f)) {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+
+        if(errno != ENOBUFS || endProgram) {
+            return -1;
+        }
+        poll(&pfd, 1, 10);
+        retries++;
+    }
+    return retries;
+}
+
+
+static int cmpInt64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/******************************************************************************/
+static void printUsage(char *progName) {
+    fprintf(stderr,
+"Usage: %s <CAN device> <capture file or candump log> [options]\n"
+"\n"
+"Options:\n"
+"  -s <factor>         Speed, 1 is original timing (default), 10 ten\n"
+"                      times faster.\n"
+"  -F                  As fast as possible.\n"
+"  -g <us>             Fixed gap between frames instead of log timing.\n"
+"  -l <count>          Replay count times (default 1, 0 forever).\n"
+"  -f <id[:mask],...>  Send only matching frames (mask default 0x7FF).\n"
+"  -x <id[:mask],...>  Do not send matching frames, for example the\n"
+"                      frames of the node, which runs live.\n"
+"  -b <us>             Busy wait before each frame (default %d).\n"
+"  -p <priority>       Run with SCHED_FIFO priority and locked memory.\n",
+            progName, DEFAULT_BUSYWAIT_US);
+}
+
+
+int main(int argc, char *argv[]) {
+    double scale = 1.0;
+    bool fastest = false;
+    int gap_us = -1, loops = 1, busy_us = DEFAULT_BUSYWAIT_US, priority = -1;
+    int64_t *errors;
+    uint64_t sent = 0, skipped = 0, late = 0, retries = 0, failed = 0;
+    uint64_t start_ns, loopStart_ns, end_ns, lastErrCount = 0;
+    int64_t errMax = INT64_MIN;
+    double errSum = 0;
+    int fd, opt, loop;
+
+    if(argc < 3 || strcmp(argv[1], "--help") == 0) {
+        printUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+
+    while((opt = getopt(argc, argv, "s:Fg:l:f:x:b:p:")) != -1) {
+        switch(opt) {
+            case 's': scale = atof(optarg);     break;
+            case 'F': fastest = true;           break;
+            case 'g': gap_us = atoi(optarg);    break;
+            case 'l': loops = atoi(optarg);     break;
+            case 'f':
+            case 'x': {
+                int n = parseFilters(optarg, opt == 'f' ? include : exclude);
+
+                if(n < 0) {
+                    fprintf(stderr, "Invalid filter (%s)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                *(opt == 'f' ? &includeCount : &excludeCount) = n;
+                break;
+            }
+            case 'b': busy_us = atoi(optarg);   break;
+            case 'p': priority = atoi(optarg);  break;
+            default:
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(optind + 2 != argc || scale <= 0) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if(loadCapture(argv[optind + 1]) != 0) {
+        if(errno != EINVAL || loadLog(argv[optind + 1]) != 0) {
+            fprintf(stderr, "canReplay: %s: %s\n", argv[optind + 1], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(frameCount == 0) {
+        fprintf(stderr, "canReplay: no frames in %s\n", argv[optind + 1]);
+        exit(EXIT_FAILURE);
+    }
+    if(!hasTimestamps && !fastest && gap_us < 0) {
+        fprintf(stderr, "canReplay: log has no timestamps, use -F or -g (or candump -l)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fd = canOpen(argv[optind]);
+    errors = malloc(frameCount * sizeof(errors[0]));
+    if(fd < 0 || errors == NULL) {
+        perror("canReplay: CAN socket");
+        exit(EXIT_FAILURE);
+    }
+    if(priority >= 0) {
+        struct sched_param param = {.sched_priority = priority};
+
+        if(sched_setscheduler(0, SCHED_FIFO, &param) != 0 || mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            perror("canReplay: realtime priority");
+        }
+    }
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+
+    fprintf(stderr, "canReplay - %llu frames, %.3f s, to %s\n", (unsigned long long)frameCount,
+            (int64_t)(frames[frameCount - 1].timestamp_ns - frames[0].timestamp_ns) / 1e9, argv[optind]);
+
+    start_ns = loopStart_ns = now_ns();
+    for(loop = 0; !endProgram && (loops == 0 || loop < loops); loop++) {
+        uint64_t i, errCount = 0, next_ns = loopStart_ns;
+
+        for(i=0; i<frameCount && !endProgram; i++) {
+            const canCapture_record_t *rec = &frames[i];
+            uint64_t target_ns;
+            int r;
+
+            if(!selected(rec)) {
+                skipped++;
+                continue;
+            }
+
+            if(fastest) {
+                target_ns = 0;
+            }
+            else if(gap_us >= 0) {
+                target_ns = next_ns;
+                next_ns += (uint64_t)gap_us * 1000;
+            }
+            else {
+                /* Timestamps may go back (clock step, merged captures), never wait before the previous frame */
+                int64_t delta_ns = (int64_t)(rec->timestamp_ns - frames[0].timestamp_ns);
+
+                target_ns = delta_ns > 0 ? loopStart_ns + (uint64_t)(delta_ns / scale) : loopStart_ns;
+                if(target_ns < next_ns) {
+                    target_ns = next_ns;
+                }
+                next_ns = target_ns;
+            }
+            if(target_ns > 0) {
+                waitUntil(target_ns, (uint64_t)busy_us * 1000);
+            }
+
+            r = canSend(fd, rec);
+            if(r < 0) {
+                failed++;
+                continue;
+            }
+            retries += r;
+            sent++;
+            if(target_ns > 0) {
+                int64_t err = (int64_t)(now_ns() - target_ns);
+
+                errors[errCount++] = err;
+                errSum += err;
+                if(err > errMax) {
+                    errMax = err;
+                }
+                if(err > LATE_NS) {
+                    late++;
+                }
+            }
+        }
+
+        /* Percentiles are from the last loop */
+        qsort(errors, errCount, sizeof(errors[0]), cmpInt64);
+        lastErrCount = errCount;
+        /* Next loop starts one mean frame interval after the last frame */
+        loopStart_ns = now_ns();
+        if(frameCount > 1 && !fastest && gap_us < 0) {
+            int64_t span_ns = (int64_t)(frames[frameCount - 1].timestamp_ns - frames[0].timestamp_ns);
+
+            if(span_ns > 0) {
+                loopStart_ns += (uint64_t)(span_ns / scale / (frameCount - 1));
+            }
+        }
+    }
+    end_ns = now_ns();
+
+    printf("canReplay - %llu frames sent in %.3f s (%.0f/s), %llu filtered, %llu failed, %llu retries (queue full)",
+           (unsigned long long)sent, (end_ns - start_ns) / 1e9, sent / ((end_ns - start_ns) / 1e9),
+           (unsigned long long)skipped, (unsigned long long)failed, (unsigned long long)retries);
+    if(!fastest && lastErrCount > 0) {
+        uint64_t n = lastErrCount;
+
+        printf(", timing error avg/max %.1f/%.1f us, %llu late > %d us, last loop min/p50/p99 %.1f/%.1f/%.1f us",
+               errSum / sent / 1000, errMax / 1000.0, (unsigned long long)late, LATE_NS / 1000,
+               errors[0] / 1000.0, errors[n / 2] / 1000.0, errors[n * 99 / 100] / 1000.0);
+    }
+    printf("\n");
+
+    close(fd);
+    free(errors);
+    free(frames);
+    return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,1300 @@
+/*
+ * Simulator of CiA 402 drives for testing without the exoskeleton.
+ *
+ * @file        driveSim.c
+ *
+ * Simulates several Copley-like drives on one (virtual) CAN interface:
+ *  - NMT slave with boot-up and heartbeat producer (0x1017).
+ *  - SDO server, expedited transfers only.
+ *  - Four RPDOs and four TPDOs with configurable COB-ID, transmission type
+ *    and mapping (0x1400.., 0x1600.., 0x1800.., 0x1A00..), so PDOremap may
+ *    be used. Synchronous TPDOs are sent on SYNC, asynchronous (0xFE, 0xFF)
+ *    on change of mapped data. Synchronous RPDOs take effect on next SYNC.
+ *    Default mapping is the one from PDOremap:
+ *      TPDO1 0x180+id 6041             (0xFF)
+ *      TPDO2 0x280+id 6064, 606C       (SYNC)
+ *      TPDO3 0x380+id 6077             (SYNC)
+ *      RPDO1 0x200+id 6040
+ *      RPDO2 0x300+id 607A
+ *      RPDO3 0x400+id 60FF
+ *  - CiA 402 state machine (controlword 0x6040, statusword 0x6041).
+ *  - Profile position (1), profile velocity (3) and homing (6) modes with
+ *    trapezoidal joint motion. Units as Copley: velocity 0.1 counts/s,
+ *    acceleration 10 counts/s^2.
+ *  - Fault injection: writing 1 to 0x2F00 sets the drive to fault state and
+ *    sends emergency 0x8611 (following error). Controlword bit 7 resets it.
+ *  - Configurable response latency and jitter for SDO responses and TPDOs.
+ *  - Optional trace of all received and sent frames with CLOCK_MONOTONIC
+ *    timestamps, for latency measurements.
+ *  - Virtual time (-V): driveSim is the simulation harness of canopend -V.
+ *    It steps the drives and canopend alternately by 1 ms, as fast as
+ *    possible or at a given speed, independent of real time and of the load
+ *    of the computer. Trace timestamps are virtual then.
+ *
+ * Compile: gcc driveSim.c -o driveSim -Wall -lm
+ *
+ * Usage: driveSim <CAN device> [-n <node IDs>] [-l <latency us>]
+ *                 [-j <jitter us>] [-t <trace file>]
+ *                 [-V <socket> [-d <seconds>] [-s <speed>]]
+ *
+ * Example with canopend on vcan (see 'BBB Scripts/VirtualCan'):
+ *   sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+ *   ./driveSim vcan0 -n 1-4 &
+ *   app/canopend vcan0 -i 100 -c "" -C ""
+ *
+ * The same with virtual time, 60 s of simulation as fast as possible:
+ *   app/canopend vcan0 -i 100 -c "" -C "" -V "" &
+ *   ./driveSim vcan0 -n 1-4 -V /tmp/CO_sim_socket -d 60
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+
+#define MAX_NODES               16
+#define NO_PDO                  4
+#define MAX_MAPPED              8
+#define TICK_NS                 1000000         /* Simulation step, 1 ms */
+#define TX_QUEUE_SIZE           256             /* Delayed frames */
+
+#define NMT_INITIALIZING        0
+#define NMT_STOPPED             4
+#define NMT_OPERATIONAL         5
+#define NMT_PRE_OPERATIONAL     127
+
+#define PDO_DISABLED            0x80000000UL
+
+/* SDO abort codes */
+#define SDO_AB_CMD              0x05040001UL    /* Command specifier not valid */
+#define SDO_AB_READONLY         0x06010002UL    /* Attempt to write a read only object */
+#define SDO_AB_NOT_EXIST        0x06020000UL    /* Object does not exist */
+#define SDO_AB_NO_MAP           0x06040041UL    /* Object cannot be mapped to the PDO */
+#define SDO_AB_MAP_LEN          0x06040042UL    /* Number and length of objects exceed PDO */
+#define SDO_AB_TYPE_MISMATCH    0x06070010UL    /* Length of service parameter does not match */
+#define SDO_AB_SUB_UNKNOWN      0x06090011UL    /* Sub-index does not exist */
+#define SDO_AB_INVALID_VALUE    0x06090030UL    /* Invalid value for parameter */
+#define SDO_AB_DATA_DEV_STATE   0x08000022UL    /* Not possible because of present device state */
+
+/* CiA 402 states */
+typedef enum {
+    DS_SWITCH_ON_DISABLED,
+    DS_READY_TO_SWITCH_ON,
+    DS_SWITCHED_ON,
+    DS_OPERATION_ENABLED,
+    DS_QUICK_STOP_ACTIVE,
+    DS_FAULT
+} driveState_t;
+
+/* Modes of operation */
+#define MODE_PROFILE_POSITION   1
+#define MODE_PROFILE_VELOCITY   3
+#define MODE_HOMING             6
+
+
+/* PDO communication and mapping parameters with runtime state */
+typedef struct {
+    uint32_t            cobId;
+    uint8_t             transType;
+    uint16_t            inhibitTime;    /* 100 us */
+    uint16_t            eventTimer;     /* ms */
+    uint8_t             count;          /* number of mapped objects */
+    uint32_t            map[MAX_MAPPED];
+    /* runtime */
+    uint8_t             syncCounter;
+    uint8_t             last[8];        /* last sent data, for change of state */
+    bool                sent;
+    uint64_t            lastSent_ns;
+    bool                rxPending;      /* synchronous RPDO waits for SYNC */
+    uint8_t             rxData[8];
+} pdo_t;
+
+/* One simulated drive */
+typedef struct {
+    uint8_t             nodeId;
+    uint8_t             nmtState;
+    uint16_t            hbTime;         /* 0x1017, ms */
+    uint64_t            hbNext_ns;
+    uint8_t             errorRegister;  /* 0x1001 */
+    uint32_t            commCycle;      /* 0x1006, us */
+    uint8_t             fault;          /* 0x2F00 */
+    /* CiA 402 objects */
+    uint16_t            controlword;    /* 0x6040 */
+    uint16_t            controlwordPrev;
+    uint16_t            statusword;     /* 0x6041 */
+    int8_t              mode;           /* 0x6060 */
+    int8_t              modeDisplay;    /* 0x6061 */
+    int32_t             posActual;      /* 0x6064 */
+    int32_t             velActual;      /* 0x606C */
+    int16_t             torqueActual;   /* 0x6077 */
+    int32_t             targetPos;      /* 0x607A */
+    int32_t             homeOffset;     /* 0x607C */
+    uint32_t            profileVel;     /* 0x6081 */
+    uint32_t            profileAcc;     /* 0x6083 */
+    uint32_t            profileDec;     /* 0x6084 */
+    int8_t              homingMethod;   /* 0x6098 */
+    int32_t             targetVel;      /* 0x60FF */
+    /* Motion */
+    driveState_t        state;
+    double              pos;            /* counts */
+    double              vel;            /* counts/s */
+    double              setpoint;       /* active position setpoint */
+    bool                setpointValid;
+    bool                targetReached;
+    bool                setpointAck;
+    bool                homingAttained;
+    /* PDOs */
+    pdo_t               rpdo[NO_PDO];
+    pdo_t               tpdo[NO_PDO];
+} drive_t;
+
+/* Object Dictionary entry of a drive */
+typedef struct {
+    void               *ptr;
+    uint8_t             size;
+    bool                writable;
+    bool                mappable;
+    uint32_t            value;          /* storage for constant entries */
+} odEntry_t;
+
+/* Frame waiting for its latency */
+typedef struct {
+    uint64_t            due_ns;
+    struct can_frame    frame;
+} txItem_t;
+
+
+static drive_t              drives[MAX_NODES];
+static int                  driveCount = 0;
+static int                  canSocket = -1;
+static uint32_t             latency_us = 0;
+static uint32_t             jitter_us = 0;
+static FILE                *traceFile = NULL;
+static txItem_t             txQueue[TX_QUEUE_SIZE];
+static int                  txCount = 0;
+static int                  txTimerFd = -1;
+static volatile sig_atomic_t endProgram = 0;
+static bool                 virtualTime = false;
+static uint64_t             virtual_ns = 0;
+
+
+static void sigHandler(int sig) {
+    (void)sig;
+    endProgram = 1;
+}
+
+
+static uint64_t real_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static uint64_t now_ns(void) {
+    return virtualTime ? virtual_ns : real_ns();
+}
+
+
+static void trace(const char *dir, const struct can_frame *f) {
+    int i;
+
+    if(traceFile == NULL) {
+        return;
+    }
+    fprintf(traceFile, "%llu,%s,0x%03X,%d,", (unsigned long long)now_ns(), dir,
+            f->can_id & CAN_SFF_MASK, f->can_dlc);
+    for(i=0; i<f->can_dlc; i++) {
+        fprintf(traceFile, "%02X", f->data[i]);
+    }
+    fprintf(traceFile, "\n");
+}
+
+
+/* Send frame now or after configured latency. */
+static void sendFrame(uint32_t cobId, const uint8_t *data, uint8_t len) {
+    struct can_frame f;
+
+    memset(&f, 0, sizeof(f));
+    f.can_id = cobId & CAN_SFF_MASK;
+    f.can_dlc = len;
+    if(len > 0) {
+        memcpy(f.data, data, len);
+    }
+
+    if(latency_us == 0 && jitter_us == 0) {
+        trace("tx", &f);
+        if(write(canSocket, &f, sizeof(f)) != sizeof(f)) {
+            fprintf(stderr, "driveSim: CAN write failed: %s\n", strerror(errno));
+        }
+    }
+    else if(txCount < TX_QUEUE_SIZE) {
+        uint64_t due = now_ns() + (uint64_t)latency_us * 1000;
+        int i;
+
+        if(jitter_us > 0) {
+            due += (uint64_t)(rand() % (jitter_us + 1)) * 1000;
+        }
+        /* Keep queue sorted, frames with the same due time stay in order. */
+        for(i=txCount; i>0 && txQueue[i-1].due_ns > due; i--) {
+            txQueue[i] = txQueue[i-1];
+        }
+        txQueue[i].due_ns = due;
+        txQueue[i].frame = f;
+        txCount++;
+    }
+    else {
+        fprintf(stderr, "driveSim: transmit queue full\n");
+    }
+}
+
+
+/* Send due frames and arm timer for the next one. */
+static void txQueueProcess(void) {
+    uint64_t now = now_ns();
+    struct itimerspec its;
+    int n = 0, i;
+
+    while(n < txCount && txQueue[n].due_ns <= now) {
+        trace("tx", &txQueue[n].frame);
+        if(write(canSocket, &txQueue[n].frame, sizeof(struct can_frame)) != sizeof(struct can_frame)) {
+            fprintf(stderr, "driveSim: CAN write failed: %s\n", strerror(errno));
+        }
+        n++;
+    }
+    for(i=n; i<txCount; i++) {
+        txQueue[i-n] = txQueue[i];
+    }
+    txCount -= n;
+
+    if(virtualTime) {
+        return;         /* checked on each step */
+    }
+    memset(&its, 0, sizeof(its));
+    if(txCount > 0) {
+        its.it_value.tv_sec = txQueue[0].due_ns / 1000000000ULL;
+        its.it_value.tv_nsec = txQueue[0].due_ns % 1000000000ULL;
+    }
+    timerfd_settime(txTimerFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+/******************************************************************************/
+/* Object Dictionary                                                          */
+/******************************************************************************/
+#define OD_RW(var, map)     do { e->ptr = &(var); e->size = sizeof(var); e->writable = true; e->mappable = (map); } while(0)
+#define OD_RO(var, map)     do { e->ptr = &(var); e->size = sizeof(var); e->writable = false; e->mappable = (map); } while(0)
+#define OD_CONST(val, sz)   do { e->value = (val); e->ptr = &e->value; e->size = (sz); e->writable = false; e->mappable = false; } while(0)
+
+/* Find entry. Returns 0 or SDO abort code. */
+static uint32_t odFind(drive_t *d, uint16_t index, uint8_t sub, odEntry_t *e) {
+    memset(e, 0, sizeof(*e));
+
+    /* PDO parameters */
+    if(index >= 0x1400 && index < 0x1400 + NO_PDO) {
+        pdo_t *p = &d->rpdo[index - 0x1400];
+        switch(sub) {
+            case 0: OD_CONST(2, 1); return 0;
+            case 1: OD_RW(p->cobId, false); return 0;
+            case 2: OD_RW(p->transType, false); return 0;
+            default: return SDO_AB_SUB_UNKNOWN;
+        }
+    }
+    if(index >= 0x1800 && index < 0x1800 + NO_PDO) {
+        pdo_t *p = &d->tpdo[index - 0x1800];
+        switch(sub) {
+            case 0: OD_CONST(5, 1); return 0;
+            case 1: OD_RW(p->cobId, false); return 0;
+            case 2: OD_RW(p->transType, false); return 0;
+            case 3: OD_RW(p->inhibitTime, false); return 0;
+            case 5: OD_RW(p->eventTimer, false); return 0;
+            default: return SDO_AB_SUB_UNKNOWN;
+        }
+    }
+    if((index >= 0x1600 && index < 0x1600 + NO_PDO) || (index >= 0x1A00 && index < 0x1A00 + NO_PDO)) {
+        pdo_t *p = (index < 0x1A00) ? &d->rpdo[index - 0x1600] : &d->tpdo[index - 0x1A00];
+        if(sub == 0) {
+            OD_RW(p->count, false);
+            return 0;
+        }
+        if(sub <= MAX_MAPPED) {
+            OD_RW(p->map[sub - 1], false);
+            return 0;
+        }
+        return SDO_AB_SUB_UNKNOWN;
+    }
+
+    if(sub != 0 && index != 0x1018) {
+        return SDO_AB_SUB_UNKNOWN;
+    }
+
+    switch(index) {
+        case 0x1000: OD_CONST(0x00020192, 4); break;    /* CiA 402 servo drive */
+        case 0x1001: OD_RO(d->errorRegister, false); break;
+        case 0x1006: OD_RW(d->commCycle, false); break;
+        case 0x1017: OD_RW(d->hbTime, false); break;
+        case 0x1018:
+            switch(sub) {
+                case 0: OD_CONST(4, 1); break;
+                case 1: OD_CONST(0x000000AB, 4); break; /* vendor ID of Copley */
+                case 2: OD_CONST(0x00005150, 4); break;
+                case 3: OD_CONST(0x00010000, 4); break;
+                case 4: OD_CONST(d->nodeId, 4); break;  /* serial number */
+                default: return SDO_AB_SUB_UNKNOWN;
+            }
+            break;
+        case 0x2F00: OD_RW(d->fault, false); break;
+        case 0x6040: OD_RW(d->controlword, true); break;
+        case 0x6041: OD_RO(d->statusword, true); break;
+        case 0x6060: OD_RW(d->mode, true); break;
+        case 0x6061: OD_RO(d->modeDisplay, true); break;
+        case 0x6064: OD_RO(d->posActual, true); break;
+        case 0x606C: OD_RO(d->velActual, true); break;
+        case 0x6077: OD_RO(d->torqueActual, true); break;
+        case 0x607A: OD_RW(d->targetPos, true); break;
+        case 0x607C: OD_RW(d->homeOffset, true); break;
+        case 0x6081: OD_RW(d->profileVel, true); break;
+        case 0x6083: OD_RW(d->profileAcc, true); break;
+        case 0x6084: OD_RW(d->profileDec, true); break;
+        case 0x6098: OD_RW(d->homingMethod, true); break;
+        case 0x60FF: OD_RW(d->targetVel, true); break;
+        default: return SDO_AB_NOT_EXIST;
+    }
+    return 0;
+}
+
+
+static void odRead(const odEntry_t *e, uint8_t *buf) {
+    /* Little endian host (BBB and PC) */
+    memcpy(buf, e->ptr, e->size);
+}
+
+
+static void odWrite(const odEntry_t *e, const uint8_t *buf) {
+    memcpy(e->ptr, buf, e->size);
+}
+
+
+/* Check PDO mapping entry. Returns 0 or SDO abort code. */
+static uint32_t checkMapEntry(drive_t *d, uint32_t map, bool rx) {
+    odEntry_t e;
+    uint32_t ab = odFind(d, map >> 16, (map >> 8) & 0xFF, &e);
+
+    if(ab != 0) {
+        return ab;
+    }
+    if(!e.mappable || (rx && !e.writable)) {
+        return SDO_AB_NO_MAP;
+    }
+    if((map & 0xFF) != e.size * 8) {
+        return SDO_AB_MAP_LEN;
+    }
+    return 0;
+}
+
+
+/* Number of bytes mapped into the PDO */
+static uint8_t pdoLength(const pdo_t *p) {
+    uint8_t len = 0;
+    int i;
+
+    for(i=0; i<p->count && i<MAX_MAPPED; i++) {
+        len += (p->map[i] & 0xFF) / 8;
+    }
+    return len;
+}
+
+
+/* Check write to PDO parameters, as CiA 301 requires. Returns 0 or abort code. */
+static uint32_t checkPdoWrite(drive_t *d, uint16_t index, uint8_t sub, uint32_t value) {
+    bool rx = index < 0x1A00;
+    pdo_t *p;
+
+    if(index >= 0x1600 && index < 0x1600 + NO_PDO) p = &d->rpdo[index - 0x1600];
+    else if(index >= 0x1A00 && index < 0x1A00 + NO_PDO) p = &d->tpdo[index - 0x1A00];
+    else return 0;
+
+    /* Mapping may only be changed, when PDO is disabled. */
+    if(!(p->cobId & PDO_DISABLED)) {
+        return SDO_AB_DATA_DEV_STATE;
+    }
+    if(sub == 0) {
+        uint8_t len = 0;
+        int i;
+
+        if(value > MAX_MAPPED) {
+            return SDO_AB_MAP_LEN;
+        }
+        for(i=0; i<(int)value; i++) {
+            uint32_t ab = checkMapEntry(d, p->map[i], rx);
+            if(ab != 0) {
+                return ab;
+            }
+            len += (p->map[i] & 0xFF) / 8;
+        }
+        if(len > 8) {
+            return SDO_AB_MAP_LEN;
+        }
+    }
+    else if(p->count != 0) {
+        /* Number of mapped objects must be zero while mapping is changed. */
+        return SDO_AB_DATA_DEV_STATE;
+    }
+    else if(value != 0) {
+        return checkMapEntry(d, value, rx);
+    }
+    return 0;
+}
+
+
+/******************************************************************************/
+/* CiA 402 drive                                                              */
+/******************************************************************************/
+static void updateStatusword(drive_t *d) {
+    uint16_t sw;
+
+    switch(d->state) {
+        case DS_SWITCH_ON_DISABLED: sw = 0x0040; break;
+        case DS_READY_TO_SWITCH_ON: sw = 0x0031; break;
+        case DS_SWITCHED_ON:        sw = 0x0033; break;
+        case DS_OPERATION_ENABLED:  sw = 0x0037; break;
+        case DS_QUICK_STOP_ACTIVE:  sw = 0x0017; break;
+        default:                    sw = 0x0008; break;
+    }
+    sw |= 0x0200;                                       /* remote */
+    if(d->targetReached) sw |= 0x0400;
+    if(d->mode == MODE_PROFILE_POSITION && d->setpointAck) sw |= 0x1000;
+    if(d->mode == MODE_HOMING && d->homingAttained) sw |= 0x1000;
+    if(d->mode == MODE_PROFILE_VELOCITY && fabs(d->vel) < 1.0) sw |= 0x1000;   /* speed zero */
+    d->statusword = sw;
+}
+
+
+static void enterFault(drive_t *d, uint16_t emcyCode) {
+    uint8_t emcy[8] = {0};
+
+    d->state = DS_FAULT;
+    d->vel = 0;
+    d->setpointAck = false;
+    d->errorRegister |= 0x01;
+    emcy[0] = emcyCode & 0xFF;
+    emcy[1] = emcyCode >> 8;
+    emcy[2] = d->errorRegister;
+    sendFrame(0x80 + d->nodeId, emcy, 8);
+}
+
+
+/* React on new controlword, CiA 402 device control. */
+static void processControlword(drive_t *d) {
+    uint16_t cw = d->controlword;
+    uint16_t rising = cw & ~d->controlwordPrev;
+
+    if(d->state == DS_FAULT) {
+        if(rising & 0x0080) {
+            d->fault = 0;
+            d->errorRegister = 0;
+            d->state = DS_SWITCH_ON_DISABLED;
+            sendFrame(0x80 + d->nodeId, (const uint8_t[8]){0}, 8);  /* error reset */
+        }
+    }
+    else if((cw & 0x0002) == 0) {                           /* disable voltage */
+        d->state = DS_SWITCH_ON_DISABLED;
+    }
+    else if((cw & 0x0004) == 0) {                           /* quick stop */
+        d->state = (d->state == DS_OPERATION_ENABLED) ? DS_QUICK_STOP_ACTIVE : DS_SWITCH_ON_DISABLED;
+    }
+    else if((cw & 0x0087) == 0x0006) {                      /* shutdown */
+        d->state = DS_READY_TO_SWITCH_ON;
+    }
+    else if((cw & 0x008F) == 0x0007) {                      /* switch on / disable operation */
+        if(d->state == DS_READY_TO_SWITCH_ON || d->state == DS_OPERATION_ENABLED) {
+            d->state = DS_SWITCHED_ON;
+        }
+    }
+    else if((cw & 0x008F) == 0x000F) {                      /* enable operation */
+        if(d->state == DS_SWITCHED_ON || d->state == DS_QUICK_STOP_ACTIVE
+           || d->state == DS_READY_TO_SWITCH_ON) {
+            if(d->state != DS_OPERATION_ENABLED) {
+                d->setpoint = d->pos;
+                d->setpointValid = false;
+            }
+            d->state = DS_OPERATION_ENABLED;
+        }
+    }
+
+    if(d->state != DS_OPERATION_ENABLED) {
+        d->vel = 0;
+        d->setpointAck = false;
+    }
+    else if(d->mode == MODE_PROFILE_POSITION) {
+        /* New set-point on rising edge of bit 4, bit 6 relative */
+        if(rising & 0x0010) {
+            d->setpoint = (cw & 0x0040) ? d->setpoint + d->targetPos : d->targetPos;
+            d->setpointValid = true;
+            d->setpointAck = true;
+            d->targetReached = false;
+        }
+        if(!(cw & 0x0010)) {
+            d->setpointAck = false;
+        }
+    }
+    else if(d->mode == MODE_HOMING) {
+        /* Homing to the current position, completes immediately. */
+        if(rising & 0x0010) {
+            d->pos = d->homeOffset;
+            d->setpoint = d->pos;
+            d->vel = 0;
+            d->homingAttained = true;
+            d->targetReached = true;
+        }
+    }
+
+    d->controlwordPrev = cw;
+    updateStatusword(d);
+}
+
+
+/* Move velocity towards target with acceleration limit. */
+static double rampVelocity(double vel, double target, double acc, double dec, double dt) {
+    double limit = (fabs(target) < fabs(vel) || target * vel < 0) ? dec : acc;
+
+    if(target > vel) {
+        return (vel + limit * dt > target) ? target : vel + limit * dt;
+    }
+    return (vel - limit * dt < target) ? target : vel - limit * dt;
+}
+
+
+/* Simple joint dynamics, called each TICK_NS. */
+static void simulate(drive_t *d, double dt) {
+    double acc = d->profileAcc * 10.0;
+    double dec = (d->profileDec != 0) ? d->profileDec * 10.0 : acc;
+    double velPrev = d->vel;
+
+    if(acc <= 0) acc = 1e6;
+    if(dec <= 0) dec = acc;
+
+    d->modeDisplay = d->mode;
+
+    if(d->fault && d->state != DS_FAULT) {
+        enterFault(d, 0x8611);
+    }
+
+    if(d->state == DS_QUICK_STOP_ACTIVE) {
+        d->vel = rampVelocity(d->vel, 0, dec, dec, dt);
+    }
+    else if(d->state != DS_OPERATION_ENABLED) {
+        d->vel = 0;
+    }
+    else if(d->mode == MODE_PROFILE_POSITION && d->setpointValid) {
+        double maxVel = d->profileVel * 0.1;
+        double dist = d->setpoint - d->pos;
+        double stopDist = d->vel * d->vel / (2 * dec);
+        double target;
+
+        if(fabs(dist) < 1.0 && fabs(d->vel) < dec * dt) {
+            d->pos = d->setpoint;
+            d->vel = 0;
+            d->targetReached = true;
+        }
+        else {
+            /* Brake if overshooting or close enough, else go to max velocity */
+            if(d->vel * dist < 0 || stopDist >= fabs(dist)) {
+                target = 0;
+            }
+            else {
+                target = (dist > 0) ? maxVel : -maxVel;
+            }
+            d->vel = rampVelocity(d->vel, target, acc, dec, dt);
+            /* Don't oscillate around small distances */
+            if(fabs(d->vel * dt) > fabs(dist) && d->vel * dist > 0) {
+                d->vel = dist / dt;
+            }
+            d->targetReached = false;
+        }
+    }
+    else if(d->mode == MODE_PROFILE_VELOCITY) {
+        double target = d->targetVel * 0.1;
+
+        d->vel = rampVelocity(d->vel, target, acc, dec, dt);
+        d->targetReached = fabs(d->vel - target) < 1.0;
+    }
+    else if(d->mode != MODE_PROFILE_POSITION) {
+        d->vel = 0;
+    }
+
+    d->pos += d->vel * dt;
+    d->posActual = (int32_t)lround(d->pos);
+    d->velActual = (int32_t)lround(d->vel * 10.0);
+    /* Torque proportional to acceleration, in 0.1 % of rated torque */
+    d->torqueActual = (int16_t)fmax(-3000.0, fmin(3000.0, (d->vel - velPrev) / dt / 1000.0));
+
+    updateStatusword(d);
+}
+
+
+/******************************************************************************/
+/* CANopen communication                                                      */
+/******************************************************************************/
+static void resetCommunication(drive_t *d) {
+    int i;
+
+    memset(d->rpdo, 0, sizeof(d->rpdo));
+    memset(d->tpdo, 0, sizeof(d->tpdo));
+    for(i=0; i<NO_PDO; i++) {
+        d->rpdo[i].cobId = PDO_DISABLED | (0x200 + 0x100 * i + d->nodeId);
+        d->rpdo[i].transType = 0xFF;
+        d->tpdo[i].cobId = PDO_DISABLED | (0x180 + 0x100 * i + d->nodeId);
+        d->tpdo[i].transType = 0xFF;
+    }
+
+    /* Mapping from PDOremap */
+    d->tpdo[0].cobId = 0x180 + d->nodeId;
+    d->tpdo[0].count = 1;
+    d->tpdo[0].map[0] = 0x60410010;
+    d->tpdo[1].cobId = 0x280 + d->nodeId;
+    d->tpdo[1].transType = 1;
+    d->tpdo[1].count = 2;
+    d->tpdo[1].map[0] = 0x60640020;
+    d->tpdo[1].map[1] = 0x606C0020;
+    d->tpdo[2].cobId = 0x380 + d->nodeId;
+    d->tpdo[2].transType = 1;
+    d->tpdo[2].count = 1;
+    d->tpdo[2].map[0] = 0x60770010;
+    d->rpdo[0].cobId = 0x200 + d->nodeId;
+    d->rpdo[0].count = 1;
+    d->rpdo[0].map[0] = 0x60400010;
+    d->rpdo[1].cobId = 0x300 + d->nodeId;
+    d->rpdo[1].count = 1;
+    d->rpdo[1].map[0] = 0x607A0020;
+    d->rpdo[2].cobId = 0x400 + d->nodeId;
+    d->rpdo[2].count = 1;
+    d->rpdo[2].map[0] = 0x60FF0020;
+
+    d->nmtState = NMT_PRE_OPERATIONAL;
+    d->hbNext_ns = now_ns();
+    sendFrame(0x700 + d->nodeId, (const uint8_t[1]){0}, 1);    /* boot-up */
+}
+
+
+static void resetNode(drive_t *d) {
+    uint8_t nodeId = d->nodeId;
+
+    memset(d, 0, sizeof(*d));
+    d->nodeId = nodeId;
+    d->state = DS_SWITCH_ON_DISABLED;
+    d->profileVel = 200000;
+    d->profileAcc = 30000;
+    d->profileDec = 30000;
+    updateStatusword(d);
+    resetCommunication(d);
+}
+
+
+static drive_t *findDrive(uint8_t nodeId) {
+    int i;
+
+    for(i=0; i<driveCount; i++) {
+        if(drives[i].nodeId == nodeId) {
+            return &drives[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void processNMT(const struct can_frame *f) {
+    int i;
+
+    if(f->can_dlc < 2) {
+        return;
+    }
+    for(i=0; i<driveCount; i++) {
+        drive_t *d = &drives[i];
+
+        if(f->data[1] != 0 && f->data[1] != d->nodeId) {
+            continue;
+        }
+        switch(f->data[0]) {
+            case 0x01: d->nmtState = NMT_OPERATIONAL; break;
+            case 0x02: d->nmtState = NMT_STOPPED; break;
+            case 0x80: d->nmtState = NMT_PRE_OPERATIONAL; break;
+            case 0x81: resetNode(d); break;
+            case 0x82: resetCommunication(d); break;
+        }
+    }
+}
+
+
+static void sdoAbort(drive_t *d, uint16_t index, uint8_t sub, uint32_t code) {
+    uint8_t r[8] = {0x80, index & 0xFF, index >> 8, sub,
+                    code & 0xFF, (code >> 8) & 0xFF, (code >> 16) & 0xFF, code >> 24};
+    sendFrame(0x580 + d->nodeId, r, 8);
+}
+
+
+static void processSDO(drive_t *d, const struct can_frame *f) {
+    uint8_t ccs = f->data[0] >> 5;
+    uint16_t index = f->data[1] | (f->data[2] << 8);
+    uint8_t sub = f->data[3];
+    uint8_t r[8] = {0};
+    odEntry_t e;
+    uint32_t ab;
+
+    if(f->can_dlc != 8 || d->nmtState == NMT_STOPPED) {
+        return;
+    }
+    if(ccs == 4) {
+        return;     /* abort from client */
+    }
+    if(ccs != 1 && ccs != 2) {
+        sdoAbort(d, index, sub, SDO_AB_CMD);
+        return;
+    }
+
+    ab = odFind(d, index, sub, &e);
+    if(ab != 0) {
+        sdoAbort(d, index, sub, ab);
+        return;
+    }
+
+    if(ccs == 2) {
+        /* Expedited upload */
+        r[0] = 0x43 | ((4 - e.size) << 2);
+        r[1] = f->data[1];
+        r[2] = f->data[2];
+        r[3] = sub;
+        odRead(&e, &r[4]);
+        sendFrame(0x580 + d->nodeId, r, 8);
+        return;
+    }
+
+    /* Expedited download only */
+    if(!(f->data[0] & 0x02)) {
+        sdoAbort(d, index, sub, SDO_AB_CMD);
+        return;
+    }
+    if((f->data[0] & 0x01) && (4 - ((f->data[0] >> 2) & 0x03)) != e.size) {
+        sdoAbort(d, index, sub, SDO_AB_TYPE_MISMATCH);
+        return;
+    }
+    if(!e.writable) {
+        sdoAbort(d, index, sub, SDO_AB_READONLY);
+        return;
+    }
+    {
+        uint32_t value = 0;
+
+        memcpy(&value, &f->data[4], e.size);
+        ab = checkPdoWrite(d, index, sub, value);
+        if(ab == 0 && index == 0x6060 && value != MODE_PROFILE_POSITION
+           && value != MODE_PROFILE_VELOCITY && value != MODE_HOMING && value != 0) {
+            ab = SDO_AB_INVALID_VALUE;
+        }
+        if(ab != 0) {
+            sdoAbort(d, index, sub, ab);
+            return;
+        }
+    }
+    odWrite(&e, &f->data[4]);
+
+    if(index == 0x6040) {
+        processControlword(d);
+    }
+    if(index == 0x6060) {
+        d->homingAttained = false;
+        d->setpointValid = false;
+        d->setpoint = d->pos;
+    }
+
+    r[0] = 0x60;
+    r[1] = f->data[1];
+    r[2] = f->data[2];
+    r[3] = sub;
+    sendFrame(0x580 + d->nodeId, r, 8);
+}
+
+
+/* Write received PDO data into the Object Dictionary. */
+static void rpdoApply(drive_t *d, pdo_t *p, const uint8_t *data) {
+    bool cw = false;
+    int i, pos = 0;
+
+    for(i=0; i<p->count; i++) {
+        odEntry_t e;
+
+        if(odFind(d, p->map[i] >> 16, (p->map[i] >> 8) & 0xFF, &e) == 0) {
+            odWrite(&e, &data[pos]);
+            cw |= (p->map[i] >> 16) == 0x6040;
+        }
+        pos += (p->map[i] & 0xFF) / 8;
+    }
+    if(cw) {
+        processControlword(d);
+    }
+}
+
+
+static void processRPDO(drive_t *d, pdo_t *p, const struct can_frame *f) {
+    if(d->nmtState != NMT_OPERATIONAL || f->can_dlc < pdoLength(p)) {
+        return;
+    }
+    if(p->transType <= 240) {
+        memcpy(p->rxData, f->data, 8);
+        p->rxPending = true;
+    }
+    else {
+        rpdoApply(d, p, f->data);
+    }
+}
+
+
+/* Pack mapped objects. Returns length. */
+static uint8_t tpdoPack(drive_t *d, pdo_t *p, uint8_t *data) {
+    int i, pos = 0;
+
+    memset(data, 0, 8);
+    for(i=0; i<p->count; i++) {
+        odEntry_t e;
+
+        if(odFind(d, p->map[i] >> 16, (p->map[i] >> 8) & 0xFF, &e) == 0) {
+            odRead(&e, &data[pos]);
+        }
+        pos += (p->map[i] & 0xFF) / 8;
+    }
+    return pos;
+}
+
+
+static void tpdoSend(drive_t *d, pdo_t *p) {
+    uint8_t data[8];
+    uint8_t len = tpdoPack(d, p, data);
+
+    sendFrame(p->cobId, data, len);
+    memcpy(p->last, data, 8);
+    p->sent = true;
+    p->lastSent_ns = now_ns();
+}
+
+
+static void processSYNC(void) {
+    int i, j;
+
+    for(i=0; i<driveCount; i++) {
+        drive_t *d = &drives[i];
+
+        if(d->nmtState != NMT_OPERATIONAL) {
+            continue;
+        }
+        /* Synchronous RPDOs, then synchronous TPDOs */
+        for(j=0; j<NO_PDO; j++) {
+            pdo_t *p = &d->rpdo[j];
+
+            if(p->rxPending) {
+                p->rxPending = false;
+                rpdoApply(d, p, p->rxData);
+            }
+        }
+        for(j=0; j<NO_PDO; j++) {
+            pdo_t *p = &d->tpdo[j];
+            uint8_t data[8];
+
+            if((p->cobId & PDO_DISABLED) || p->count == 0 || p->transType > 240) {
+                continue;
+            }
+            if(p->transType == 0) {
+                /* Acyclic synchronous, on change only */
+                tpdoPack(d, p, data);
+                if(!p->sent || memcmp(data, p->last, 8) != 0) {
+                    tpdoSend(d, p);
+                }
+            }
+            else if(++p->syncCounter >= p->transType) {
+                p->syncCounter = 0;
+                tpdoSend(d, p);
+            }
+        }
+    }
+}
+
+
+/* Asynchronous TPDOs and heartbeat, each tick. */
+static void processAsync(drive_t *d) {
+    uint64_t now = now_ns();
+    int j;
+
+    if(d->hbTime > 0 && now >= d->hbNext_ns) {
+        sendFrame(0x700 + d->nodeId, &d->nmtState, 1);
+        d->hbNext_ns = now + (uint64_t)d->hbTime * 1000000ULL;
+    }
+
+    if(d->nmtState != NMT_OPERATIONAL) {
+        return;
+    }
+    for(j=0; j<NO_PDO; j++) {
+        pdo_t *p = &d->tpdo[j];
+        uint8_t data[8];
+        bool timer;
+
+        if((p->cobId & PDO_DISABLED) || p->count == 0 || p->transType < 0xFE) {
+            continue;
+        }
+        if(p->sent && now - p->lastSent_ns < (uint64_t)p->inhibitTime * 100000ULL) {
+            continue;
+        }
+        timer = p->eventTimer > 0 && now - p->lastSent_ns >= (uint64_t)p->eventTimer * 1000000ULL;
+        tpdoPack(d, p, data);
+        if(!p->sent || timer || memcmp(data, p->last, 8) != 0) {
+            tpdoSend(d, p);
+        }
+    }
+}
+
+
+static void processFrame(const struct can_frame *f) {
+    uint32_t id = f->can_id & CAN_SFF_MASK;
+    int i, j;
+
+    if(f->can_id & (CAN_ERR_FLAG | CAN_EFF_FLAG | CAN_RTR_FLAG)) {
+        return;
+    }
+    trace("rx", f);
+
+    if(id == 0x000) {
+        processNMT(f);
+        return;
+    }
+    if(id == 0x080) {
+        processSYNC();
+        return;
+    }
+    if(id > 0x600 && id <= 0x67F) {
+        drive_t *d = findDrive(id - 0x600);
+        if(d != NULL) {
+            processSDO(d, f);
+        }
+        return;
+    }
+    for(i=0; i<driveCount; i++) {
+        for(j=0; j<NO_PDO; j++) {
+            pdo_t *p = &drives[i].rpdo[j];
+
+            if(!(p->cobId & PDO_DISABLED) && (p->cobId & CAN_SFF_MASK) == id) {
+                processRPDO(&drives[i], p, f);
+            }
+        }
+    }
+}
+
+
+/******************************************************************************/
+static int parseNodes(char *list) {
+    char *tok, *save;
+
+    driveCount = 0;
+    for(tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long first, last, id;
+
+        first = strtol(tok, &end, 0);
+        last = (*end == '-') ? strtol(end + 1, &end, 0) : first;
+        if(*end != 0 || first < 1 || last > 127 || first > last) {
+            return -1;
+        }
+        for(id = first; id <= last; id++) {
+            if(driveCount >= MAX_NODES) {
+                return -1;
+            }
+            if(findDrive((uint8_t)id) == NULL) {
+                drives[driveCount++].nodeId = (uint8_t)id;
+            }
+        }
+    }
+    return (driveCount > 0) ? 0 : -1;
+}
+
+
+static void printUsage(char *progName) {
+    fprintf(stderr,
+"Usage: %s <CAN device> [options]\n"
+"\n"
+"Options:\n"
+"  -n <Node IDs>       Simulated nodes, for example \"1-4\" (default).\n"
+"  -l <latency us>     Delay of SDO responses and TPDOs (0 is default).\n"
+"  -j <jitter us>      Additional random delay, 0..jitter.\n"
+"  -t <trace file>     Write received and sent frames with CLOCK_MONOTONIC\n"
+"                      timestamps in ns to CSV file.\n"
+"  -V <socket>         Virtual time, step canopend -V on its simulation\n"
+"                      socket, for example /tmp/CO_sim_socket.\n"
+"  -d <seconds>        Duration of virtual time run (0 = until Ctrl+C).\n"
+"  -s <speed>          Speed relative to real time (0 = as fast as possible,\n"
+"                      default).\n", progName);
+}
+
+
+/* Send line on simulation socket and wait for the response. */
+static int simCommand(int fd, const char *cmd, char *resp, size_t respSize) {
+    size_t len = strlen(cmd), n = 0;
+
+    if(write(fd, cmd, len) != (ssize_t)len) {
+        return -1;
+    }
+    while(n < respSize - 1) {
+        ssize_t r = read(fd, &resp[n], 1);
+
+        if(r <= 0) {
+            return -1;
+        }
+        if(resp[n] == '\n') {
+            break;
+        }
+        n++;
+    }
+    resp[n] = 0;
+    return 0;
+}
+
+
+/* Lockstep loop with canopend: frames sent by canopend in one step are
+ * processed by the drives in the next one and vice versa, each step is 1 ms
+ * of virtual time. */
+static void runVirtual(const char *socketPath, double duration_s, double speed) {
+    struct sockaddr_un addr;
+    uint64_t start_ns, end_ns, steps = 0;
+    double real_s;
+    char resp[64];
+    int fd, i;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
+    if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("driveSim: simulation socket");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Continue from the time of canopend */
+    if(simCommand(fd, "time\n", resp, sizeof(resp)) != 0) {
+        fprintf(stderr, "driveSim: no response on simulation socket\n");
+        exit(EXIT_FAILURE);
+    }
+    virtual_ns = strtoull(resp, NULL, 10);
+    for(i=0; i<driveCount; i++) {
+        drives[i].hbNext_ns = virtual_ns;
+    }
+    end_ns = virtual_ns + (uint64_t)(duration_s * 1e9);
+
+    start_ns = real_ns();
+    while(!endProgram && (duration_s <= 0 || virtual_ns < end_ns)) {
+        struct can_frame f;
+
+        /* Frames from canopend, sent in the previous step */
+        while(recv(canSocket, &f, sizeof(f), MSG_DONTWAIT) == sizeof(f)) {
+            processFrame(&f);
+        }
+
+        /* Drives */
+        virtual_ns += TICK_NS;
+        for(i=0; i<driveCount; i++) {
+            simulate(&drives[i], TICK_NS / 1e9);
+            processAsync(&drives[i]);
+        }
+        txQueueProcess();
+
+        /* canopend */
+        if(simCommand(fd, "step 1\n", resp, sizeof(resp)) != 0 || strncmp(resp, "OK", 2) != 0) {
+            fprintf(stderr, "driveSim: step failed (%s)\n", resp);
+            break;
+        }
+        steps++;
+
+        if(speed > 0) {
+            uint64_t due = start_ns + (uint64_t)(steps * TICK_NS / speed);
+            struct timespec ts;
+
+            ts.tv_sec = due / 1000000000ULL;
+            ts.tv_nsec = due % 1000000000ULL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+
+    real_s = (real_ns() - start_ns) / 1e9;
+    printf("driveSim - virtual %.3f s in %.3f s real time (%.1fx), %llu steps\n",
+           steps * TICK_NS / 1e9, real_s, real_s > 0 ? steps * TICK_NS / 1e9 / real_s : 0.0,
+           (unsigned long long)steps);
+    close(fd);
+}
+
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_can addr;
+    struct epoll_event ev;
+    struct itimerspec its;
+    char defaultNodes[] = "1-4";
+    int tickFd, epollFd, opt, i;
+    uint64_t tickPrev_ns;
+    char *simSocket = NULL;
+    double duration_s = 0, speed = 0;
+
+    if(argc < 2 || strcmp(argv[1], "--help") == 0) {
+        printUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+
+    parseNodes(defaultNodes);
+    while((opt = getopt(argc, argv, "n:l:j:t:V:d:s:")) != -1) {
+        switch(opt) {
+            case 'n':
+                if(parseNodes(optarg) != 0) {
+                    fprintf(stderr, "Wrong node ID list (%s)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l': latency_us = strtoul(optarg, NULL, 0); break;
+            case 'j': jitter_us = strtoul(optarg, NULL, 0);  break;
+            case 't':
+                traceFile = fopen(optarg, "w");
+                if(traceFile == NULL) {
+                    perror("driveSim: trace file");
+                    exit(EXIT_FAILURE);
+                }
+                fprintf(traceFile, "time_ns,dir,cob_id,dlc,data\n");
+                break;
+            case 'V': simSocket = optarg;                   break;
+            case 'd': duration_s = strtod(optarg, NULL);    break;
+            case 's': speed = strtod(optarg, NULL);         break;
+            default:
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(optind >= argc) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* CAN socket */
+    canSocket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(argv[optind]);
+    if(canSocket < 0 || addr.can_ifindex == 0
+       || bind(canSocket, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("driveSim: CAN socket");
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGINT, sigHandler);
+    signal(SIGTERM, sigHandler);
+
+    if(simSocket != NULL) {
+        virtualTime = true;
+        for(i=0; i<driveCount; i++) {
+            resetNode(&drives[i]);
+        }
+        printf("%s - simulating %d drives on %s, virtual time from '%s'\n",
+               argv[0], driveCount, argv[optind], simSocket);
+        runVirtual(simSocket, duration_s, speed);
+        if(traceFile != NULL) {
+            fclose(traceFile);
+        }
+        close(canSocket);
+        return 0;
+    }
+
+    /* Timers: simulation tick and delayed transmit */
+    tickFd = timerfd_create(CLOCK_MONOTONIC, 0);
+    txTimerFd = timerfd_create(CLOCK_MONOTONIC, 0);
+    epollFd = epoll_create(3);
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = TICK_NS;
+    its.it_interval.tv_nsec = TICK_NS;
+    if(tickFd < 0 || txTimerFd < 0 || epollFd < 0 || timerfd_settime(tickFd, 0, &its, NULL) != 0) {
+        perror("driveSim: timers");
+        exit(EXIT_FAILURE);
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = canSocket;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, canSocket, &ev);
+    ev.data.fd = tickFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, tickFd, &ev);
+    ev.data.fd = txTimerFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, txTimerFd, &ev);
+
+    for(i=0; i<driveCount; i++) {
+        resetNode(&drives[i]);
+    }
+    txQueueProcess();
+    printf("%s - simulating %d drives on %s, latency %u+%u us\n",
+           argv[0], driveCount, argv[optind], latency_us, jitter_us);
+
+    tickPrev_ns = now_ns();
+    while(!endProgram) {
+        struct epoll_event events[3];
+        int ready = epoll_wait(epollFd, events, 3, -1);
+
+        for(i=0; i<ready; i++) {
+            int fd = events[i].data.fd;
+
+            if(fd == canSocket) {
+                struct can_frame f;
+
+                if(read(canSocket, &f, sizeof(f)) == sizeof(f)) {
+                    processFrame(&f);
+                }
+            }
+            else if(fd == tickFd) {
+                uint64_t expirations, now = now_ns();
+                double dt = (now - tickPrev_ns) / 1e9;
+                int j;
+
+                if(read(tickFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                    continue;
+                }
+                tickPrev_ns = now;
+                for(j=0; j<driveCount; j++) {
+                    simulate(&drives[j], dt);
+                    processAsync(&drives[j]);
+                }
+            }
+            else if(fd == txTimerFd) {
+                uint64_t expirations;
+
+                if(read(txTimerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                    continue;
+                }
+            }
+        }
+        /* Frames may be queued by any of the above */
+        txQueueProcess();
+    }
+
+    if(traceFile != NULL) {
+        fclose(traceFile);
+    }
+    close(canSocket);
+    printf("%s - finished\n", argv[0]);
+    return 0;
+}
@@ -0,0 +1,800 @@
+/*
+ * End-to-end latency benchmark of canopend with simulated drives.
+ *
+ * @file        latencyBench.c
+ *
+ * Measures, how long a command from a client takes to reach the drive and
+ * how long the feedback takes to come back. Runs on vcan with canopend and
+ * driveSim (the drive stand-in). Each sample is timestamped at these stages
+ * (all CLOCK_MONOTONIC):
+ *   write    - client writes the request to the command socket
+ *   canReq   - request frame (SDO or RPDO) appears on the bus, kernel
+ *              timestamp of the sniffer socket
+ *   simRx    - driveSim receives the request  (from the driveSim trace)
+ *   simTx    - driveSim sends the response    (from the driveSim trace)
+ *   canResp  - response frame (SDO or TPDO) appears on the bus
+ *   done     - client gets the result
+ *
+ * Paths:
+ *   sdo  - "<node> write 0x607A 0 i32 <value>" on the command interface (-c),
+ *          canopend does the SDO download, done on "OK".
+ *   pool - the same on the parallel command interface (-C).
+ *   pdo  - Controlword of the node in the master Object Dictionary
+ *          (0x6040, sub <node>) is written on the command interface, sent by
+ *          the master TPDO. Drive acknowledges the set-point in the
+ *          statusword (bit 12), which comes back in TPDO 0x180+node. Done,
+ *          when the client reads the new statusword from the master Object
+ *          Dictionary (0x6041, sub <node>), so 'done' includes the OD update.
+ *   raw  - benchmark itself sends the RPDO and waits for the TPDO, so only
+ *          the bus and the drive are measured.
+ *
+ * Time spent parsing the command inside canopend can not be seen from
+ * outside and is included in the write -> canReq interval.
+ *
+ * Output is machine readable: summary in JSON on stdout, optionally each
+ * sample in CSV (-o). Give the commit as label (-L), to compare the results.
+ *
+ * Compile: gcc latencyBench.c -o latencyBench -Wall -lm
+ *
+ * Example:
+ *   app/canopend vcan0 -i 100 -c "" -C "" -n 1-4 &
+ *   ./latencyBench vcan0 -s ./driveSim -L $(git describe --always) > result.json
+ *
+ * This file is part of canopend from CANopenSocket and is distributed under
+ * the same GNU General Public License, version 2 or later.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+
+#define CMD_TIMEOUT_MS          1000
+#define LINE_SIZE               200
+
+/* Paths */
+typedef enum {
+    PATH_SDO,
+    PATH_POOL,
+    PATH_PDO,
+    PATH_RAW,
+    PATH_COUNT
+} path_t;
+
+static const char *pathNames[PATH_COUNT] = {"sdo", "pool", "pdo", "raw"};
+
+/* Stages of one sample */
+typedef enum {
+    ST_WRITE,
+    ST_CAN_REQ,
+    ST_SIM_RX,
+    ST_SIM_TX,
+    ST_CAN_RESP,
+    ST_DONE,
+    ST_COUNT
+} stage_t;
+
+static const char *stageNames[ST_COUNT] = {"write", "canReq", "simRx", "simTx", "canResp", "done"};
+
+/* Intervals in the summary: name, from stage, to stage */
+static const struct {
+    const char *name;
+    stage_t     from;
+    stage_t     to;
+} intervals[] = {
+    {"clientToBus", ST_WRITE,    ST_CAN_REQ},
+    {"busToDrive",  ST_CAN_REQ,  ST_SIM_RX},
+    {"drive",       ST_SIM_RX,   ST_SIM_TX},
+    {"driveToBus",  ST_SIM_TX,   ST_CAN_RESP},
+    {"busToClient", ST_CAN_RESP, ST_DONE},
+    {"total",       ST_WRITE,    ST_DONE}
+};
+#define INTERVAL_COUNT  (sizeof(intervals) / sizeof(intervals[0]))
+
+/* One measurement */
+typedef struct {
+    path_t      path;
+    int         iter;
+    bool        ok;
+    uint64_t    t[ST_COUNT];    /* ns, 0 if not observed */
+    /* Expected frames */
+    uint16_t    reqCob;
+    uint8_t     reqLen;
+    uint8_t     reqData[8];
+    uint16_t    respCob;
+    uint16_t    respMask;       /* response matches, if (data & mask) == value */
+    uint16_t    respValue;      /* first two bytes, little endian */
+} sample_t;
+
+/* Frame from driveSim trace */
+typedef struct {
+    uint64_t    ns;
+    bool        tx;
+    uint16_t    cob;
+    uint8_t     len;
+    uint8_t     data[8];
+} traceFrame_t;
+
+
+static int          canSniff = -1;      /* receives all frames with timestamps */
+static int          canTx = -1;         /* for 'raw' path and setup */
+static int64_t      realToMono_ns;      /* CLOCK_MONOTONIC - CLOCK_REALTIME */
+static sample_t    *current = NULL;     /* sample being measured */
+static uint8_t      nodeId = 1;
+static uint8_t      masterId = 100;
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+
+/******************************************************************************/
+/* CAN                                                                        */
+/******************************************************************************/
+static int canOpen(const char *dev, bool timestamp) {
+    struct sockaddr_can addr;
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(dev);
+    if(fd < 0 || addr.can_ifindex == 0
+       || (timestamp && setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != 0)
+       || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+
+static void canSend(uint16_t cob, const uint8_t *data, uint8_t len) {
+    struct can_frame f;
+
+    memset(&f, 0, sizeof(f));
+    f.can_id = cob;
+    f.can_dlc = len;
+    memcpy(f.data, data, len);
+    if(write(canTx, &f, sizeof(f)) != sizeof(f)) {
+        fprintf(stderr, "latencyBench: CAN write failed: %s\n", strerror(errno));
+    }
+}
+
+
+/* Read one frame from sniffer with its kernel timestamp converted to
+ * CLOCK_MONOTONIC. Frames are matched against current sample. */
+static bool canSniffRead(struct can_frame *f, uint64_t *ts) {
+    char ctrl[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov = {f, sizeof(*f)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if(recvmsg(canSniff, &msg, MSG_DONTWAIT) != sizeof(*f)) {
+        return false;
+    }
+
+    *ts = now_ns();
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS) {
+            struct timespec kt;
+
+            memcpy(&kt, CMSG_DATA(cmsg), sizeof(kt));
+            *ts = (uint64_t)((int64_t)kt.tv_sec * 1000000000LL + kt.tv_nsec + realToMono_ns);
+        }
+    }
+
+    if(current != NULL) {
+        sample_t *s = current;
+        uint16_t cob = f->can_id & CAN_SFF_MASK;
+
+        if(s->t[ST_CAN_REQ] == 0 && cob == s->reqCob && f->can_dlc == s->reqLen
+           && memcmp(f->data, s->reqData, s->reqLen) == 0) {
+            s->t[ST_CAN_REQ] = *ts;
+        }
+        else if(s->t[ST_CAN_REQ] != 0 && s->t[ST_CAN_RESP] == 0 && cob == s->respCob
+                && f->can_dlc >= 2 && ((f->data[0] | (f->data[1] << 8)) & s->respMask) == s->respValue) {
+            s->t[ST_CAN_RESP] = *ts;
+        }
+    }
+    return true;
+}
+
+
+static void canSniffDrain(void) {
+    struct can_frame f;
+    uint64_t ts;
+
+    while(canSniffRead(&f, &ts));
+}
+
+
+/* SDO expedited download from the benchmark, used for setup only. */
+static int sdoWrite(uint16_t index, uint8_t sub, uint32_t value, uint8_t size) {
+    uint8_t d[8] = {0x23 | ((4 - size) << 2), index & 0xFF, index >> 8, sub,
+                    value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24};
+    uint64_t deadline = now_ns() + CMD_TIMEOUT_MS * 1000000ULL;
+
+    canSniffDrain();
+    canSend(0x600 + nodeId, d, 8);
+    while(now_ns() < deadline) {
+        struct pollfd pfd = {canSniff, POLLIN, 0};
+        struct can_frame f;
+        uint64_t ts;
+
+        poll(&pfd, 1, 10);
+        while(canSniffRead(&f, &ts)) {
+            if((f.can_id & CAN_SFF_MASK) == 0x580u + nodeId && f.data[1] == d[1]
+               && f.data[2] == d[2] && f.data[3] == sub) {
+                return (f.data[0] == 0x60) ? 0 : -1;
+            }
+        }
+    }
+    return -1;
+}
+
+
+/******************************************************************************/
+/* Command interface                                                          */
+/******************************************************************************/
+typedef struct {
+    int         fd;
+    char        buf[LINE_SIZE * 4];
+    size_t      len;
+} cmdSocket_t;
+
+
+static int cmdConnect(cmdSocket_t *c, const char *path) {
+    struct sockaddr_un addr;
+
+    memset(c, 0, sizeof(*c));
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if(c->fd >= 0) {
+            close(c->fd);
+        }
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Send request and wait for the response line. Sniffer is serviced
+ * meanwhile. Returns response time or 0 on timeout. */
+static uint64_t cmdRequest(cmdSocket_t *c, const char *request, char *response, uint64_t *tWrite) {
+    uint64_t deadline;
+    size_t reqLen = strlen(request);
+
+    *tWrite = now_ns();
+    if(write(c->fd, request, reqLen) != (ssize_t)reqLen) {
+        return 0;
+    }
+    deadline = *tWrite + CMD_TIMEOUT_MS * 1000000ULL;
+
+    for(;;) {
+        struct pollfd pfd[2] = {{c->fd, POLLIN, 0}, {canSniff, POLLIN, 0}};
+        char *nl = memchr(c->buf, '\n', c->len);
+        uint64_t now;
+        int timeout_ms;
+
+        if(nl != NULL) {
+            size_t lineLen = nl - c->buf + 1;
+            uint64_t t = now_ns();
+
+            memcpy(response, c->buf, lineLen);
+            response[lineLen] = 0;
+            memmove(c->buf, c->buf + lineLen, c->len - lineLen);
+            c->len -= lineLen;
+            return t;
+        }
+
+        now = now_ns();
+        if(now >= deadline) {
+            return 0;
+        }
+        timeout_ms = (int)((deadline - now) / 1000000ULL) + 1;
+        if(poll(pfd, 2, timeout_ms) < 0 && errno != EINTR) {
+            return 0;
+        }
+        if(pfd[1].revents & POLLIN) {
+            canSniffDrain();
+        }
+        if(pfd[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+            if(n <= 0) {
+                return 0;
+            }
+            c->len += n;
+        }
+    }
+}
+
+
+/******************************************************************************/
+/* Measurement                                                                */
+/******************************************************************************/
+static void setRequestSDO(sample_t *s, int32_t value) {
+    uint8_t d[8] = {0x23, 0x7A, 0x60, 0x00,
+                    value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF};
+
+    s->reqCob = 0x600 + nodeId;
+    s->reqLen = 8;
+    memcpy(s->reqData, d, 8);
+    s->respCob = 0x580 + nodeId;
+    s->respMask = 0x00FF;
+    s->respValue = 0x0060;
+}
+
+
+static void setRequestPDO(sample_t *s, uint16_t controlword) {
+    s->reqCob = 0x200 + nodeId;
+    s->reqLen = 2;
+    s->reqData[0] = controlword & 0xFF;
+    s->reqData[1] = controlword >> 8;
+    s->respCob = 0x180 + nodeId;
+    s->respMask = 0x1000;
+    s->respValue = controlword & 0x0010 ? 0x1000 : 0;
+}
+
+
+static void measureCommandWrite(sample_t *s, cmdSocket_t *c, int seq) {
+    char req[LINE_SIZE], resp[LINE_SIZE];
+    int32_t value = (seq & 1) ? 1000 : -1000;
+    uint64_t t;
+
+    setRequestSDO(s, value);
+    snprintf(req, sizeof(req), "[%d] %d write 0x607A 0 i32 %d\n", seq, nodeId, value);
+    t = cmdRequest(c, req, resp, &s->t[ST_WRITE]);
+    if(t != 0 && strstr(resp, "OK") != NULL) {
+        s->t[ST_DONE] = t;
+        s->ok = true;
+    }
+}
+
+
+static void measurePDO(sample_t *s, cmdSocket_t *c, int seq) {
+    uint16_t cw = (seq & 1) ? 0x001F : 0x000F;
+    char req[LINE_SIZE], resp[LINE_SIZE];
+    uint64_t t, tRead;
+
+    setRequestPDO(s, cw);
+    snprintf(req, sizeof(req), "[%d] %d write 0x6040 %d u16 %d\n", seq, masterId, nodeId, cw);
+    t = cmdRequest(c, req, resp, &s->t[ST_WRITE]);
+    if(t == 0 || strstr(resp, "OK") == NULL) {
+        return;
+    }
+
+    /* Poll statusword in the master Object Dictionary. */
+    snprintf(req, sizeof(req), "[%d] %d read 0x6041 %d u16\n", seq, masterId, nodeId);
+    while(now_ns() - s->t[ST_WRITE] < CMD_TIMEOUT_MS * 1000000ULL) {
+        char *val;
+
+        t = cmdRequest(c, req, resp, &tRead);
+        if(t == 0 || (val = strchr(resp, ']')) == NULL) {
+            return;
+        }
+        if((strtoul(val + 1, NULL, 0) & s->respMask) == s->respValue) {
+            s->t[ST_DONE] = t;
+            s->ok = true;
+            return;
+        }
+    }
+}
+
+
+static void measureRaw(sample_t *s, int seq) {
+    uint16_t cw = (seq & 1) ? 0x001F : 0x000F;
+    uint64_t deadline;
+
+    setRequestPDO(s, cw);
+    s->t[ST_WRITE] = now_ns();
+    canSend(s->reqCob, s->reqData, s->reqLen);
+    deadline = s->t[ST_WRITE] + CMD_TIMEOUT_MS * 1000000ULL;
+    while(s->t[ST_CAN_RESP] == 0 && now_ns() < deadline) {
+        struct pollfd pfd = {canSniff, POLLIN, 0};
+
+        poll(&pfd, 1, 10);
+        canSniffDrain();
+    }
+    if(s->t[ST_CAN_RESP] != 0) {
+        s->t[ST_DONE] = s->t[ST_CAN_RESP];
+        s->ok = true;
+    }
+}
+
+
+/* Start the node and enable operation in profile position mode. */
+static int setupDrive(cmdSocket_t *cmd) {
+    uint8_t nmt[2] = {0x01, 0x00};
+    char req[LINE_SIZE], resp[LINE_SIZE];
+    uint64_t t;
+
+    canSend(0x000, nmt, 2);     /* start all nodes, also canopend */
+    sleep_ms(50);
+
+    /* Master TPDO sends controlword of the node, don't let it disable the drive. */
+    if(cmd != NULL && cmd->fd >= 0) {
+        snprintf(req, sizeof(req), "[0] %d write 0x6040 %d u16 15\n", masterId, nodeId);
+        if(cmdRequest(cmd, req, resp, &t) == 0 || strstr(resp, "OK") == NULL) {
+            fprintf(stderr, "latencyBench: can't write master controlword: %s", resp);
+            return -1;
+        }
+        sleep_ms(10);
+    }
+
+    if(sdoWrite(0x6060, 0, 1, 1) != 0 || sdoWrite(0x6040, 0, 6, 2) != 0
+       || sdoWrite(0x6040, 0, 7, 2) != 0 || sdoWrite(0x6040, 0, 15, 2) != 0) {
+        fprintf(stderr, "latencyBench: node %d does not respond to SDO\n", nodeId);
+        return -1;
+    }
+    return 0;
+}
+
+
+/******************************************************************************/
+/* Results                                                                    */
+/******************************************************************************/
+/* Fill simRx and simTx from the driveSim trace. Samples and trace are in
+ * time order. */
+static void mergeTrace(const char *filename, sample_t *samples, int count) {
+    traceFrame_t *tr = NULL;
+    size_t trCount = 0, trSize = 0, j = 0;
+    char line[LINE_SIZE];
+    FILE *fp = fopen(filename, "r");
+    int i;
+
+    if(fp == NULL) {
+        fprintf(stderr, "latencyBench: can't read trace '%s'\n", filename);
+        return;
+    }
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long long ns;
+        char dir[4], hex[20];
+        unsigned cob, len, k;
+
+        hex[0] = 0;
+        if(sscanf(line, "%llu,%3[^,],%x,%u,%19s", &ns, dir, &cob, &len, hex) < 4 || len > 8) {
+            continue;   /* header */
+        }
+        if(trCount == trSize) {
+            trSize = trSize ? trSize * 2 : 4096;
+            tr = realloc(tr, trSize * sizeof(*tr));
+            if(tr == NULL) {
+                fclose(fp);
+                return;
+            }
+        }
+        tr[trCount].ns = ns;
+        tr[trCount].tx = strcmp(dir, "tx") == 0;
+        tr[trCount].cob = cob;
+        tr[trCount].len = len;
+        for(k=0; k<len; k++) {
+            unsigned b = 0;
+            sscanf(&hex[k * 2], "%2x", &b);
+            tr[trCount].data[k] = b;
+        }
+        trCount++;
+    }
+    fclose(fp);
+
+    for(i=0; i<count; i++) {
+        sample_t *s = &samples[i];
+        uint64_t end = s->t[ST_DONE] ? s->t[ST_DONE] : s->t[ST_WRITE] + CMD_TIMEOUT_MS * 1000000ULL;
+
+        while(j < trCount && tr[j].ns < s->t[ST_WRITE]) {
+            j++;
+        }
+        for(; j < trCount && tr[j].ns <= end; j++) {
+            traceFrame_t *f = &tr[j];
+
+            if(s->t[ST_SIM_RX] == 0) {
+                if(!f->tx && f->cob == s->reqCob && f->len == s->reqLen
+                   && memcmp(f->data, s->reqData, s->reqLen) == 0) {
+                    s->t[ST_SIM_RX] = f->ns;
+                }
+            }
+            else if(f->tx && f->cob == s->respCob && f->len >= 2
+                    && ((f->data[0] | (f->data[1] << 8)) & s->respMask) == s->respValue) {
+                s->t[ST_SIM_TX] = f->ns;
+                break;
+            }
+        }
+    }
+    free(tr);
+}
+
+
+static int cmpU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+static void printSummary(FILE *out, const char *label, const char *dev, sample_t *samples,
+                         int count, bool pathEnabled[]) {
+    uint64_t *d = malloc(count * sizeof(uint64_t));
+    bool firstPath = true;
+    int p, i;
+    size_t k;
+
+    fprintf(out, "{\n  \"label\": \"%s\",\n  \"device\": \"%s\",\n  \"node\": %d,\n  \"paths\": [",
+            label, dev, nodeId);
+    for(p=0; p<PATH_COUNT; p++) {
+        int n = 0, errors = 0;
+
+        if(!pathEnabled[p]) {
+            continue;
+        }
+        for(i=0; i<count; i++) {
+            if(samples[i].path == (path_t)p) {
+                n++;
+                errors += samples[i].ok ? 0 : 1;
+            }
+        }
+        fprintf(out, "%s\n    {\"path\": \"%s\", \"samples\": %d, \"errors\": %d, \"intervals\": {",
+                firstPath ? "" : ",", pathNames[p], n, errors);
+        firstPath = false;
+
+        for(k=0; k<INTERVAL_COUNT; k++) {
+            int m = 0;
+            double sum = 0;
+
+            for(i=0; i<count; i++) {
+                sample_t *s = &samples[i];
+                uint64_t from = s->t[intervals[k].from], to = s->t[intervals[k].to];
+
+                if(s->path == (path_t)p && s->ok && from != 0 && to != 0 && to >= from) {
+                    d[m++] = to - from;
+                    sum += to - from;
+                }
+            }
+            fprintf(out, "%s\n      \"%s\": ", k ? "," : "", intervals[k].name);
+            if(m == 0) {
+                fprintf(out, "null");
+                continue;
+            }
+            qsort(d, m, sizeof(uint64_t), cmpU64);
+            fprintf(out, "{\"count\": %d, \"min_us\": %.1f, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+                    "\"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}",
+                    m, d[0] / 1e3, sum / m / 1e3, d[m / 2] / 1e3, d[m * 90 / 100] / 1e3,
+                    d[m * 99 / 100] / 1e3, d[m - 1] / 1e3);
+        }
+        fprintf(out, "\n    }}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    free(d);
+}
+
+
+static void writeSamples(const char *filename, sample_t *samples, int count) {
+    FILE *fp = fopen(filename, "w");
+    int i, st;
+
+    if(fp == NULL) {
+        perror("latencyBench: samples file");
+        return;
+    }
+    fprintf(fp, "path,iter,ok");
+    for(st=0; st<ST_COUNT; st++) {
+        fprintf(fp, ",%s_ns", stageNames[st]);
+    }
+    fprintf(fp, "\n");
+    for(i=0; i<count; i++) {
+        fprintf(fp, "%s,%d,%d", pathNames[samples[i].path], samples[i].iter, samples[i].ok);
+        for(st=0; st<ST_COUNT; st++) {
+            fprintf(fp, ",%llu", (unsigned long long)samples[i].t[st]);
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+}
+
+
+/******************************************************************************/
+static void printUsage(char *progName) {
+    fprintf(stderr,
+"Usage: %s <CAN device> [options]\n"
+"\n"
+"Options:\n"
+"  -p <paths>          Comma separated list of sdo, pool, pdo, raw\n"
+"                      (default all).\n"
+"  -n <node ID>        Node to measure (default 1).\n"
+"  -m <node ID>        Node ID of canopend (default 100).\n"
+"  -i <iterations>     Samples per path (default 1000).\n"
+"  -w <warmup>         Samples per path, which are not recorded (default 20).\n"
+"  -g <us>             Gap between samples (default 1000).\n"
+"  -c <socket path>    Command interface (default /tmp/CO_command_socket).\n"
+"  -C <socket path>    Parallel command interface\n"
+"                      (default /tmp/CO_command_socket_parallel).\n"
+"  -s <driveSim>       Start driveSim with trace for the node and stop it\n"
+"                      at the end.\n"
+"  -T <trace file>     driveSim trace (default /tmp/latencyBench_trace.csv).\n"
+"                      Without -s it must be complete when samples end.\n"
+"  -o <CSV file>       Write all samples with their timestamps.\n"
+"  -L <label>          Label in the summary, for example commit hash.\n", progName);
+}
+
+
+int main(int argc, char *argv[]) {
+    bool pathEnabled[PATH_COUNT] = {true, true, true, true};
+    char *cmdPath = "/tmp/CO_command_socket";
+    char *poolPath = "/tmp/CO_command_socket_parallel";
+    char *simPath = NULL, *tracePath = "/tmp/latencyBench_trace.csv";
+    char *samplesPath = NULL, *label = "";
+    int iterations = 1000, warmup = 20, gap_us = 1000;
+    bool useTrace = false;
+    cmdSocket_t cmd, pool;
+    sample_t *samples;
+    struct timespec tsMono, tsReal;
+    pid_t simPid = -1;
+    int count = 0, opt, p, i;
+
+    if(argc < 2 || strcmp(argv[1], "--help") == 0) {
+        printUsage(argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+
+    while((opt = getopt(argc, argv, "p:n:m:i:w:g:c:C:s:T:o:L:")) != -1) {
+        switch(opt) {
+            case 'p': {
+                char *tok, *save;
+
+                memset(pathEnabled, 0, sizeof(pathEnabled));
+                for(tok = strtok_r(optarg, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+                    for(p=0; p<PATH_COUNT && strcmp(tok, pathNames[p]) != 0; p++);
+                    if(p == PATH_COUNT) {
+                        fprintf(stderr, "Unknown path (%s)\n", tok);
+                        exit(EXIT_FAILURE);
+                    }
+                    pathEnabled[p] = true;
+                }
+                break;
+            }
+            case 'n': nodeId = strtoul(optarg, NULL, 0);    break;
+            case 'm': masterId = strtoul(optarg, NULL, 0);  break;
+            case 'i': iterations = atoi(optarg);            break;
+            case 'w': warmup = atoi(optarg);                break;
+            case 'g': gap_us = atoi(optarg);                break;
+            case 'c': cmdPath = optarg;                     break;
+            case 'C': poolPath = optarg;                    break;
+            case 's': simPath = optarg; useTrace = true;    break;
+            case 'T': tracePath = optarg; useTrace = true;  break;
+            case 'o': samplesPath = optarg;                 break;
+            case 'L': label = optarg;                       break;
+            default:
+                printUsage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(optind >= argc || nodeId < 1 || nodeId > 127 || iterations < 1) {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    canSniff = canOpen(argv[optind], true);
+    canTx = canOpen(argv[optind], false);
+    if(canSniff < 0 || canTx < 0) {
+        perror("latencyBench: CAN socket");
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &tsMono);
+    clock_gettime(CLOCK_REALTIME, &tsReal);
+    realToMono_ns = ((int64_t)tsMono.tv_sec - tsReal.tv_sec) * 1000000000LL
+                  + (tsMono.tv_nsec - tsReal.tv_nsec);
+
+    if(simPath != NULL) {
+        char nodeStr[4];
+
+        snprintf(nodeStr, sizeof(nodeStr), "%d", nodeId);
+        simPid = fork();
+        if(simPid == 0) {
+            execl(simPath, simPath, argv[optind], "-n", nodeStr, "-t", tracePath, (char *)NULL);
+            perror("latencyBench: driveSim");
+            _exit(EXIT_FAILURE);
+        }
+        sleep_ms(200);
+    }
+
+    cmd.fd = pool.fd = -1;
+    if((pathEnabled[PATH_SDO] || pathEnabled[PATH_PDO]) && cmdConnect(&cmd, cmdPath) != 0) {
+        fprintf(stderr, "latencyBench: command interface '%s' not available, skipping sdo, pdo\n", cmdPath);
+        pathEnabled[PATH_SDO] = pathEnabled[PATH_PDO] = false;
+    }
+    if(pathEnabled[PATH_POOL] && cmdConnect(&pool, poolPath) != 0) {
+        fprintf(stderr, "latencyBench: command interface '%s' not available, skipping pool\n", poolPath);
+        pathEnabled[PATH_POOL] = false;
+    }
+
+    samples = calloc((size_t)iterations * PATH_COUNT, sizeof(sample_t));
+    if(samples == NULL || setupDrive(&cmd) != 0) {
+        if(simPid > 0) {
+            kill(simPid, SIGTERM);
+        }
+        exit(EXIT_FAILURE);
+    }
+
+    for(p=0; p<PATH_COUNT; p++) {
+        if(!pathEnabled[p]) {
+            continue;
+        }
+        for(i = -warmup; i < iterations; i++) {
+            sample_t warm, *s = (i >= 0) ? &samples[count] : &warm;
+
+            memset(s, 0, sizeof(*s));
+            s->path = p;
+            s->iter = i;
+            canSniffDrain();
+            current = s;
+            switch(p) {
+                case PATH_SDO:  measureCommandWrite(s, &cmd, i + warmup + 1);  break;
+                case PATH_POOL: measureCommandWrite(s, &pool, i + warmup + 1); break;
+                case PATH_PDO:  measurePDO(s, &cmd, i + warmup + 1);           break;
+                case PATH_RAW:  measureRaw(s, i + warmup + 1);                 break;
+            }
+            /* Response frame may still be in the sniffer, e.g. SDO "OK" before
+             * the frame was read. */
+            canSniffDrain();
+            current = NULL;
+            if(i >= 0) {
+                count++;
+            }
+            usleep(gap_us);
+        }
+    }
+
+    if(simPid > 0) {
+        kill(simPid, SIGTERM);
+        waitpid(simPid, NULL, 0);
+    }
+    if(useTrace) {
+        mergeTrace(tracePath, samples, count);
+    }
+    if(samplesPath != NULL) {
+        writeSamples(samplesPath, samples, count);
+    }
+    printSummary(stdout, label, argv[optind], samples, count, pathEnabled);
+
+    free(samples);
+    close(canSniff);
+    close(canTx);
+    if(cmd.fd >= 0) close(cmd.fd);
+    if(pool.fd >= 0) close(pool.fd);
+    return 0;
+}
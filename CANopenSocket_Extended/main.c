@@ -25,11 +25,24 @@
  */
 
 
+#define _GNU_SOURCE     /* CPU affinity, pthread_setname_np */
+
 #include "CANopen.h"
 #include "CO_OD_storage.h"
 #include "CO_Linux_tasks.h"
 #include "CO_time.h"
 #include "application.h"
+#include "CO_SDOclientPool.h"
+#include "CO_driveParam.h"
+#include "CO_CANbatch.h"
+#include "CO_rtConfig.h"
+#include "CO_CANbus.h"
+#include "CO_OD_storageAsync.h"
+#include "CO_SYNCproducer.h"
+#include "CO_faultMonitor.h"
+#include "CO_lockStats.h"
+#include "CO_ODsnapshot.h"
+#include "CO_clock.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -41,10 +54,13 @@
 #include <net/if.h>
 #include <linux/reboot.h>
 #include <sys/reboot.h>
+#include <sys/resource.h>
 
 #ifndef CO_SINGLE_THREAD
 #include "CO_command.h"
+#include "CO_commandPool.h"
 #include <pthread.h>
+#include <semaphore.h>
 #endif
 
 
@@ -53,31 +69,66 @@
 #define TMR_TASK_INTERVAL_NS    (1000000)       /* Interval of taskTmr in nanoseconds */
 #define TMR_TASK_OVERFLOW_US    (5000)          /* Overflow detect limit for taskTmr in microseconds */
 #define INCREMENT_1MS(var)      (var++)         /* Increment 1ms variable in taskTmr */
+#define EPOLL_MAX_EVENTS        8               /* Maximum number of events handled per wakeup */
 
 
-/* Global variable increments each millisecond. */
+/* Global variable increments each millisecond. 16-bit for CANopenNode, 64-bit
+ * time of canopend is CO_clock_tickNs(). */
 volatile uint16_t           CO_timer1ms = 0U;
 
 /* Mutex is locked, when CAN is not valid (configuration state). May be used
  *  from other threads. RT threads may use CO->CANmodule[0]->CANnormal instead. */
 #ifndef CO_SINGLE_THREAD
 pthread_mutex_t             CO_CAN_VALID_mtx = PTHREAD_MUTEX_INITIALIZER;
+static CO_lockStats_t       CANvalidLockStats;
 #endif
 
 /* Other variables and objects */
 static int                  rtPriority = -1;    /* Real time priority, configurable by arguments. (-1=RT disabled) */
+static CO_rt_deadline_t     rtDeadline;         /* SCHED_DEADLINE instead of rtPriority, if period_us != 0 */
+static bool_t               rtMemLock = false;  /* mlockall, configurable by arguments */
+static size_t               rtPrefault = 0;     /* Size of prefaulted heap and stacks in bytes */
+static cpu_set_t            rtCpus, mainCpus, commandCpus; /* CPU affinity of threads, configurable by arguments */
+static cpu_set_t            startCpus;          /* CPU affinity of mainline before command interfaces */
+static bool_t               rtCpusSet = false, mainCpusSet = false, commandCpusSet = false;
 static int                  mainline_epoll_fd;  /* epoll file descriptor for mainline */
+static uint8_t              poolNodeIds[CO_SDO_POOL_SIZE] = {1, 2, 3, 4}; /* Nodes with own SDO client, configurable by arguments. */
+static uint8_t              poolNodeCount = 4;
 static CO_OD_storage_t      odStor;             /* Object Dictionary storage object for CO_OD_ROM */
 static CO_OD_storage_t      odStorAuto;         /* Object Dictionary storage object for CO_OD_EEPROM */
+static CO_OD_storageAsync_t odStorAsync;        /* Saves CO_OD_EEPROM from background thread */
 static char                *odStorFile_rom    = "od_storage";       /* Name of the file */
 static char                *odStorFile_eeprom = "od_storage_auto";  /* Name of the file */
 static CO_time_t            CO_time;            /* Object for current time */
+static CO_CANbatch_t        CANbatch0;          /* Batched receive on CANmodule[0] */
+static CO_SYNCproducer_t    syncProducer;       /* SYNC from own timer, if syncProducerEnable */
+static bool_t               syncProducerEnable = false; /* Configurable by arguments */
+static uint32_t             syncPeriod_us = 0, syncLead_us = 0;
+static bool_t               faultMonitorEnable = false; /* Configurable by arguments */
+static bool_t               clockVirtual = false; /* Virtual time for simulation, configurable by arguments */
+
+/* Application hook, computes setpoints before each SYNC (application.c) */
+void app_programSync(void *object, uint32_t period_us);
+
+/* Statistics of events per epoll wakeup */
+typedef struct {
+    uint32_t                wakeups;
+    uint32_t                events;
+    uint32_t                maxEvents;
+    uint32_t                histogram[EPOLL_MAX_EVENTS + 1];
+} epollStats_t;
+static epollStats_t         mainlineStats;
 
 /* Realtime thread */
 #ifndef CO_SINGLE_THREAD
+static epollStats_t         rt_threadStats;
 static void*                rt_thread(void* arg);
 static pthread_t            rt_thread_id;
 static int                  rt_thread_epoll_fd;
+static sem_t                rt_threadReady;     /* Posted, when rt_thread finished own RT setup */
+static int                  rt_threadSetupErr;  /* errno of rt_thread RT setup or 0 */
+static void                 rt_cycle(void);
+static void                 rt_virtualCycle(void);
 #endif
 
 
@@ -101,6 +152,93 @@ void CO_error(const uint32_t info) {
 }
 
 
+/* Parse list of node IDs like "1-4,9" into poolNodeIds. Returns 0 on success. */
+static int parseNodeList(char *list) {
+    char *tok, *save;
+    bool_t used[128] = {false};
+
+    poolNodeCount = 0;
+    for(tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long first, last, id;
+
+        first = strtol(tok, &end, 0);
+        last = (*end == '-') ? strtol(end + 1, &end, 0) : first;
+        if(*end != 0 || first < 1 || last > 127 || first > last) {
+            return -1;
+        }
+        for(id = first; id <= last; id++) {
+            if(!used[id]) {
+                used[id] = true;
+                poolNodeIds[poolNodeCount++] = (uint8_t)id;
+            }
+        }
+    }
+
+    return (poolNodeCount > 0) ? 0 : -1;
+}
+
+
+/* Parse CPU affinity of a thread like "rt:1". Returns 0 on success. */
+static int parseAffinity(const char *arg) {
+    const char *cpus = strchr(arg, ':');
+    cpu_set_t set;
+
+    if(cpus == NULL || CO_rt_parseCpuList(cpus + 1, &set) != 0) {
+        return -1;
+    }
+    if(strncmp(arg, "main:", 5) == 0) {
+        mainCpus = set;
+        mainCpusSet = true;
+    }
+#ifndef CO_SINGLE_THREAD
+    else if(strncmp(arg, "rt:", 3) == 0) {
+        rtCpus = set;
+        rtCpusSet = true;
+    }
+    else if(strncmp(arg, "command:", 8) == 0) {
+        commandCpus = set;
+        commandCpusSet = true;
+    }
+#endif
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+
+static void epollStats_add(epollStats_t *stats, int ready) {
+    stats->wakeups++;
+    stats->events += ready;
+    if((uint32_t)ready > stats->maxEvents) {
+        stats->maxEvents = ready;
+    }
+    stats->histogram[ready]++;
+}
+
+static void epollStats_print(const char *name, const epollStats_t *stats) {
+    int i;
+
+    printf("%s - %u wakeups, %u events, max %u per wakeup, histogram:",
+           name, stats->wakeups, stats->events, stats->maxEvents);
+    for(i=0; i<=EPOLL_MAX_EVENTS; i++) {
+        printf(" %u", stats->histogram[i]);
+    }
+    printf("\n");
+}
+
+
+/* SYNC producer callback: setpoints of the application, then quick stop latch
+ * of the fault monitor, before the TPDOs are queued. Called with OD locked. */
+static void syncSetpoints(void *object, uint32_t period_us) {
+    app_programSync(object, period_us);
+    if(faultMonitorEnable) {
+        CO_faultMonitor_enforce();
+    }
+}
+
+
 static void printUsage(char *progName) {
 fprintf(stderr,
 "Usage: %s <CAN device name> [options]\n", progName);
@@ -113,7 +251,41 @@ fprintf(stderr,
 "  -r                  Enable reboot on CANopen NMT reset_node command. \n"
 "  -s <ODstorage file> Set Filename for OD storage ('od_storage' is default).\n"
 "  -a <ODstorageAuto>  Set Filename for automatic storage variables from\n"
-"                      Object dictionary. ('od_storage_auto' is default).\n");
+"                      Object dictionary. ('od_storage_auto' is default).\n"
+"  -n <Node IDs>       Remote nodes with own SDO client, for example \"1-4,9\"\n"
+"                      (\"1-4\" is default). Transfers to different nodes run\n"
+"                      concurrently.\n"
+"  -b <dev>:<Node IDs> Additional CAN interface with own RT thread for the\n"
+"                      listed nodes, for example \"can1:3-4\". PDOs of these\n"
+"                      nodes are moved there. May be repeated.\n"
+"  -m                  Lock all memory (mlockall), avoids page faults.\n"
+"  -f <kB>             Prefault heap and stacks of mainline and RT thread.\n"
+"  -D <rt>,<dl>,<per>  SCHED_DEADLINE runtime, deadline and period in us for\n"
+"                      RT task, instead of '-p'. RT task may not be pinned\n"
+"                      to CPUs with '-A rt:'.\n"
+"  -S <per>[,<lead>]   Produce SYNC from own timer with period in us (0 keeps\n"
+"                      0x1006). Setpoints (synchronous TPDOs) are sent <lead>\n"
+"                      us before SYNC, together with SYNC if 0.\n"
+"  -F <Socket path>    Enable fault monitor of the drives (heartbeat, EMCY,\n"
+"                      statusword) with quick stop reaction, see 0x2113.\n"
+"                      Events are published on the socket. If socket path\n"
+"                      is specified as empty string \"\", default '%s'\n"
+"                      will be used.\n"
+, CO_faultMonitor_socketPath);
+#ifndef CO_SINGLE_THREAD
+fprintf(stderr,
+"  -A <thread>:<CPUs>  CPU affinity of thread 'rt', 'main' or 'command'\n"
+"                      (both command interfaces), for example -A rt:1.\n"
+"                      Data logger runs inside 'rt'. May be repeated.\n"
+"  -V <Socket path>    Virtual time for simulation. RT cycles run, when a\n"
+"                      harness (driveSim -V) steps the time on the socket.\n"
+"                      If socket path is specified as empty string \"\",\n"
+"                      default '%s' will be used. Not with -S, -b.\n"
+, CO_clock_socketPath);
+#else
+fprintf(stderr,
+"  -A main:<CPUs>      CPU affinity of the program, for example -A main:1.\n");
+#endif
 #ifndef CO_SINGLE_THREAD
 fprintf(stderr,
 "  -c <Socket path>    Enable command interface for master functionality. \n"
@@ -121,7 +293,11 @@ fprintf(stderr,
 "                      default '%s' will be used.\n"
 "                      Note that location of socket path may affect security.\n"
 "                      See 'canopencomm/canopencomm --help' for more info.\n"
-, CO_command_socketPath);
+"  -C <Socket path>    Enable parallel command interface. Requests to nodes\n"
+"                      from '-n' are pipelined and run concurrently. If socket\n"
+"                      path is specified as empty string \"\", default '%s'\n"
+"                      will be used.\n"
+, CO_command_socketPath, CO_commandPool_socketPath);
 #endif
 fprintf(stderr,
 "\n"
@@ -150,7 +326,9 @@ int main (int argc, char *argv[]) {
     bool_t rebootEnable = false;    /* Configurable by arguments */
 #ifndef CO_SINGLE_THREAD
     bool_t commandEnable = false;   /* Configurable by arguments */
+    bool_t commandPoolEnable = false; /* Configurable by arguments */
 #endif
+    bool_t extraBus = false;        /* Additional CAN interface given */
 
     if(argc < 2 || strcmp(argv[1], "--help") == 0){
         printUsage(argv[0]);
@@ -159,7 +337,7 @@ int main (int argc, char *argv[]) {
 
 
     /* Get program options */
-    while((opt = getopt(argc, argv, "i:p:rc:s:a:")) != -1) {
+    while((opt = getopt(argc, argv, "i:p:rc:C:s:a:n:b:mf:A:D:S:F:V:")) != -1) {
         switch (opt) {
             case 'i':
                 nodeId = strtol(optarg, NULL, 0);
@@ -175,7 +353,65 @@ int main (int argc, char *argv[]) {
                 }
                 commandEnable = true;
                 break;
+            case 'C':
+                if(strlen(optarg) != 0) {
+                    CO_commandPool_socketPath = optarg;
+                }
+                commandPoolEnable = true;
+                break;
+            case 'V':
+                if(strlen(optarg) != 0) {
+                    CO_clock_socketPath = optarg;
+                }
+                clockVirtual = true;
+                break;
 #endif
+            case 'n':
+                if(parseNodeList(optarg) != 0) {
+                    fprintf(stderr, "Wrong node ID list (%s)\n", optarg);
+                    printUsage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                if(CO_CANbus_add(optarg) != 0) {
+                    fprintf(stderr, "Wrong CAN interface or node ID list (%s)\n", optarg);
+                    printUsage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                extraBus = true;
+                break;
+            case 'm': rtMemLock = true;                     break;
+            case 'f': rtPrefault = strtoul(optarg, NULL, 0) * 1024; break;
+            case 'A':
+                if(parseAffinity(optarg) != 0) {
+                    fprintf(stderr, "Wrong CPU affinity (%s)\n", optarg);
+                    printUsage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'D':
+                if(CO_rt_parseDeadline(optarg, &rtDeadline) != 0) {
+                    fprintf(stderr, "Wrong SCHED_DEADLINE parameters (%s)\n", optarg);
+                    printUsage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'S':
+                if(sscanf(optarg, "%u,%u", &syncPeriod_us, &syncLead_us) < 1
+                   || (syncPeriod_us != 0 && syncLead_us >= syncPeriod_us)) {
+                    fprintf(stderr, "Wrong SYNC period or lead (%s)\n", optarg);
+                    printUsage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                syncProducerEnable = true;
+                break;
+            case 'F':
+                if(strlen(optarg) != 0) {
+                    CO_faultMonitor_socketPath = optarg;
+                }
+                faultMonitorEnable = true;
+                break;
             case 's': odStorFile_rom = optarg;              break;
             case 'a': odStorFile_eeprom = optarg;           break;
             default:
@@ -202,6 +438,31 @@ int main (int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    if(rtDeadline.period_us > 0 && rtPriority != -1) {
+        fprintf(stderr, "Use either RT priority or SCHED_DEADLINE\n");
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Kernel refuses SCHED_DEADLINE for a task with restricted CPU affinity */
+#ifndef CO_SINGLE_THREAD
+    if(rtDeadline.period_us > 0 && rtCpusSet) {
+        fprintf(stderr, "SCHED_DEADLINE can not be used with CPU affinity of 'rt'\n");
+#else
+    if(rtDeadline.period_us > 0 && mainCpusSet) {
+        fprintf(stderr, "SCHED_DEADLINE can not be used with CPU affinity of 'main'\n");
+#endif
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* SYNC producer and additional interfaces have own real time timers */
+    if(clockVirtual && (syncProducerEnable || extraBus)) {
+        fprintf(stderr, "Virtual time can not be used with SYNC producer or additional CAN interfaces\n");
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
     if(CANdevice0Index == 0) {
         char s[120];
         snprintf(s, 120, "Can't find CAN device \"%s\"", CANdevice);
@@ -227,9 +488,26 @@ int main (int argc, char *argv[]) {
     }
 
 
+    /* Mutexes shared with the RT thread get priority inheritance, before
+     * other threads are created. */
+    if(CO_rt_mutexInitPI(&CO_OD_mutex) != 0 || CO_rt_mutexInitPI(&CO_EMCY_mutex) != 0)
+        fprintf(stderr, "\n%s - warning: no priority inheritance for OD and EMCY mutex\n", argv[0]);
+#ifndef CO_SINGLE_THREAD
+    if(CO_rt_mutexInitPI(&CO_CAN_VALID_mtx) != 0)
+        fprintf(stderr, "\n%s - warning: no priority inheritance for CAN valid mutex\n", argv[0]);
+    CO_lockStats_init(&CANvalidLockStats, &CO_CAN_VALID_mtx);
+#else
+    /* Mainline is the RT thread */
+    CO_lockStats_setRtThread();
+#endif
+
+
     /* initialize Object Dictionary storage */
     odStorStatus_rom = CO_OD_storage_init(&odStor, (uint8_t*) &CO_OD_ROM, sizeof(CO_OD_ROM), odStorFile_rom);
     odStorStatus_eeprom = CO_OD_storage_init(&odStorAuto, (uint8_t*) &CO_OD_EEPROM, sizeof(CO_OD_EEPROM), odStorFile_eeprom);
+    if(CO_OD_storageAsync_init(&odStorAsync, (uint8_t*) &CO_OD_EEPROM, sizeof(CO_OD_EEPROM), odStorFile_eeprom,
+                               &OD_performance[ODA_performance_storageSaveTime]) != CO_ERROR_NO)
+        CO_errExit("Program init - OD storage thread creation failed");
 
 
     /* Catch signals SIGINT and SIGTERM */
@@ -238,6 +516,26 @@ int main (int argc, char *argv[]) {
     if(signal(SIGTERM, sigHandler) == SIG_ERR)
         CO_errExit("Program init - SIGTERM handler creation failed");
 
+    /* Lock and prefault memory before threads are created */
+    if(rtMemLock && CO_rt_lockMemory() != 0)
+        CO_errExit("Program init - mlockall failed");
+    CO_rt_prefaultHeap(rtPrefault);
+    {
+        struct rlimit stackLimit;
+        size_t stackPrefault = rtPrefault;
+
+        /* Mainline stack can not grow beyond RLIMIT_STACK, rt_thread has own stack */
+        if(getrlimit(RLIMIT_STACK, &stackLimit) == 0 && stackLimit.rlim_cur != RLIM_INFINITY) {
+            size_t max = (stackLimit.rlim_cur > CO_RT_STACK_RESERVE) ? stackLimit.rlim_cur - CO_RT_STACK_RESERVE : 0;
+
+            if(stackPrefault > max) {
+                fprintf(stderr, "%s - mainline stack prefault limited to %zu kB by RLIMIT_STACK\n", argv[0], max / 1024);
+                stackPrefault = max;
+            }
+        }
+        CO_rt_prefaultStack(stackPrefault);
+    }
+
     /* increase variable each startup. Variable is automatically stored in non-volatile memory. */
     printf(", count=%u ...\n", ++OD_powerOnCounter);
 
@@ -251,13 +549,14 @@ int main (int argc, char *argv[]) {
 
 #ifndef CO_SINGLE_THREAD
         /* Wait other threads (command interface). */
-        pthread_mutex_lock(&CO_CAN_VALID_mtx);
+        CO_lockStats_lock(&CANvalidLockStats);
 #endif
 
         /* Wait rt_thread. */
         if(!firstRun) {
             CO_LOCK_OD();
             CO->CANmodule[0]->CANnormal = false;
+            CO_CANbus_setNormalMode(false);
             CO_UNLOCK_OD();
         }
 
@@ -300,6 +599,24 @@ int main (int argc, char *argv[]) {
         CO_time_init(&CO_time, CO->SDO[0], &OD_time.epochTimeBaseMs, &OD_time.epochTimeOffsetMs, 0x2130);
 
 
+        /* Profile parameters of the drives through 0x2110 */
+        CO_driveParam_init(CO->SDO[0]);
+
+
+        /* Receive frames in batches with kernel timestamps */
+        CO_CANbatch_init(&CANbatch0, CO->CANmodule[0]);
+        CO_ODsnapshot_bind(&CANbatch0);
+
+
+        /* Move PDOs of nodes on additional CAN interfaces */
+        err = CO_CANbus_bind();
+        if(err != CO_ERROR_NO) {
+            char s[120];
+            snprintf(s, 120, "Communication reset - additional CAN interface initialization failed, err=%d", err);
+            CO_errExit(s);
+        }
+
+
         /* First time only initialization. */
         if(firstRun) {
             firstRun = false;
@@ -312,6 +629,25 @@ int main (int argc, char *argv[]) {
             /* Init mainline */
             taskMain_init(mainline_epoll_fd, &OD_performance[ODA_performance_mainCycleMaxTime]);
 
+            /* Init SDO clients to the remote nodes, each on its CAN interface */
+            {
+                int32_t poolInterfaces[CO_SDO_POOL_SIZE];
+                int n;
+
+                for(n=0; n<poolNodeCount; n++) {
+                    poolInterfaces[n] = CO_CANbus_nodeInterface(poolNodeIds[n], CANdevice0Index);
+                }
+                if(CO_SDOpool_init(poolInterfaces, poolNodeIds, poolNodeCount, mainline_epoll_fd) != CO_ERROR_NO)
+                    CO_errExit("Program init - SDO client pool initialization failed");
+            }
+
+            /* Fault monitor events are published from mainline */
+            if(faultMonitorEnable) {
+                if(CO_faultMonitor_init(mainline_epoll_fd, true) != CO_ERROR_NO)
+                    CO_errExit("Program init - fault monitor initialization failed");
+                printf("%s - Fault monitor events on socket '%s' ...\n", argv[0], CO_faultMonitor_socketPath);
+            }
+
 
 #ifdef CO_SINGLE_THREAD
             /* Init taskRT */
@@ -327,20 +663,58 @@ int main (int argc, char *argv[]) {
                 if(sched_setscheduler(0, SCHED_FIFO, &param) != 0)
                     CO_errExit("Program init - mainline set scheduler failed");
             }
+            else if(rtDeadline.period_us > 0 && CO_rt_setDeadline(&rtDeadline) != 0) {
+                CO_errExit("Program init - mainline SCHED_DEADLINE failed");
+            }
 #else
             /* Configure epoll for rt_thread */
             rt_thread_epoll_fd = epoll_create(2);
             if(rt_thread_epoll_fd == -1)
                 CO_errExit("Program init - epoll_create rt_thread failed");
 
-            /* Init taskRT */
-            CANrx_taskTmr_init(rt_thread_epoll_fd, TMR_TASK_INTERVAL_NS, &OD_performance[ODA_performance_timerCycleMaxTime]);
+            /* Init taskRT. With virtual time its timer and CAN receive go to an
+             * epoll, which is never waited on, RT cycles are run by CO_clock. */
+            if(clockVirtual) {
+                int idle_epoll_fd = epoll_create(2);
+
+                if(idle_epoll_fd == -1)
+                    CO_errExit("Program init - epoll_create virtual time failed");
+                CANrx_taskTmr_init(idle_epoll_fd, TMR_TASK_INTERVAL_NS, &OD_performance[ODA_performance_timerCycleMaxTime]);
+                if(CO_clock_initVirtual(rt_thread_epoll_fd, rt_virtualCycle) != CO_ERROR_NO)
+                    CO_errExit("Program init - virtual time socket failed");
+                printf("%s - Virtual time on socket '%s' ...\n", argv[0], CO_clock_socketPath);
+            }
+            else {
+                CANrx_taskTmr_init(rt_thread_epoll_fd, TMR_TASK_INTERVAL_NS, &OD_performance[ODA_performance_timerCycleMaxTime]);
+            }
 
             OD_performance[ODA_performance_timerCycleTime] = TMR_TASK_INTERVAL_NS/1000; /* informative */
 
-            /* Create rt_thread */
-            if(pthread_create(&rt_thread_id, NULL, rt_thread, NULL) != 0)
-                CO_errExit("Program init - rt_thread creation failed");
+            /* Create rt_thread with own stack size and CPU affinity */
+            {
+                pthread_attr_t attr;
+                size_t stackSize;
+
+                pthread_attr_init(&attr);
+                pthread_attr_getstacksize(&attr, &stackSize);
+                if(rtPrefault + CO_RT_STACK_RESERVE > stackSize
+                   && pthread_attr_setstacksize(&attr, rtPrefault + CO_RT_STACK_RESERVE) != 0)
+                    CO_errExit("Program init - rt_thread stack size failed");
+                if(rtCpusSet) {
+                    pthread_attr_setaffinity_np(&attr, sizeof(rtCpus), &rtCpus);
+                }
+                sem_init(&rt_threadReady, 0, 0);
+                if(pthread_create(&rt_thread_id, &attr, rt_thread, NULL) != 0)
+                    CO_errExit("Program init - rt_thread creation failed");
+                pthread_attr_destroy(&attr);
+
+                /* Wait for RT setup inside the thread */
+                sem_wait(&rt_threadReady);
+                if(rt_threadSetupErr != 0) {
+                    errno = rt_threadSetupErr;
+                    CO_errExit("Program init - rt_thread SCHED_DEADLINE failed");
+                }
+            }
 
             /* Set priority for rt_thread */
             if(rtPriority > 0) {
@@ -352,7 +726,32 @@ int main (int argc, char *argv[]) {
             }
 #endif
 
+            {
+#ifdef CO_SINGLE_THREAD
+                int rt_epoll_fd = mainline_epoll_fd;
+#else
+                int rt_epoll_fd = rt_thread_epoll_fd;
+#endif
+                /* SYNC producer in the RT thread */
+                if(syncProducerEnable) {
+                    if(CO_SYNCproducer_init(&syncProducer, rt_epoll_fd, syncPeriod_us, syncLead_us,
+                                            &OD_performance[ODA_performance_syncJitter]) != CO_ERROR_NO)
+                        CO_errExit("Program init - SYNC producer initialization failed");
+                    CO_SYNCproducer_initCallback(&syncProducer, NULL, syncSetpoints);
+                }
+
+                /* RT threads of additional CAN interfaces. Their heartbeats, emergencies and SDO
+                 * responses are dispatched in the RT thread, SYNC producer sends SYNC on them. */
+                if(CO_CANbus_init(CANdevice0Index, rtPriority, rt_epoll_fd, !syncProducerEnable) != CO_ERROR_NO)
+                    CO_errExit("Program init - additional CAN interface threads failed");
+            }
+
 #ifndef CO_SINGLE_THREAD
+            /* Threads of command interfaces inherit CPU affinity of mainline */
+            if(commandCpusSet && (sched_getaffinity(0, sizeof(startCpus), &startCpus) != 0
+                                  || sched_setaffinity(0, sizeof(commandCpus), &commandCpus) != 0))
+                CO_errExit("Program init - command interface CPU affinity failed");
+
             /* Initialize socket command interface */
             if(commandEnable) {
                 if(CO_command_init() != 0) {
@@ -360,10 +759,43 @@ int main (int argc, char *argv[]) {
                 }
                 printf("%s - Command interface on socket '%s' started ...\n", argv[0], CO_command_socketPath);
             }
+
+            /* Initialize parallel socket command interface */
+            if(commandPoolEnable) {
+                if(CO_commandPool_init() != 0) {
+                    CO_errExit("Parallel command interface initialization failed");
+                }
+                printf("%s - Parallel command interface on socket '%s' started ...\n", argv[0], CO_commandPool_socketPath);
+            }
 #endif
 
             /* Execute optional additional application code */
             app_programStart();
+
+            /* Pin mainline, or undo affinity set for command interfaces */
+            if(mainCpusSet) {
+                if(sched_setaffinity(0, sizeof(mainCpus), &mainCpus) != 0)
+                    CO_errExit("Program init - mainline CPU affinity failed");
+            }
+            else if(commandCpusSet) {
+                if(sched_setaffinity(0, sizeof(startCpus), &startCpus) != 0)
+                    CO_errExit("Program init - mainline CPU affinity restore failed");
+            }
+
+            /* Report RT configuration, which threads ended up with */
+            CO_rt_report(argv[0], rtMemLock);
+        }
+
+
+        /* Take over SYNC from CANopenNode */
+        if(syncProducerEnable) {
+            CO_SYNCproducer_bind(&syncProducer, &CANbatch0);
+        }
+
+
+        /* Heartbeats and emergencies from all CAN interfaces */
+        if(faultMonitorEnable) {
+            CO_faultMonitor_bind(&CANbatch0);
         }
 
 
@@ -373,8 +805,9 @@ int main (int argc, char *argv[]) {
 
         /* start CAN */
         CO_CANsetNormalMode(CO->CANmodule[0]);
+        CO_CANbus_setNormalMode(true);
 #ifndef CO_SINGLE_THREAD
-        pthread_mutex_unlock(&CO_CAN_VALID_mtx);
+        CO_lockStats_unlock(&CANvalidLockStats);
 #endif
 
 
@@ -385,29 +818,106 @@ int main (int argc, char *argv[]) {
 
         while(reset == CO_RESET_NOT && CO_endProgram == 0) {
 /* loop for normal program execution ******************************************/
-            int ready;
-            struct epoll_event ev;
+            int ready, i;
+            struct epoll_event ev[EPOLL_MAX_EVENTS];
+            bool_t handled[EPOLL_MAX_EVENTS] = {false};
+            bool_t mainProcessed = false;
+            bool_t sdoRx = false;
 
-            ready = epoll_wait(mainline_epoll_fd, &ev, 1, -1);
+            ready = epoll_wait(mainline_epoll_fd, ev, EPOLL_MAX_EVENTS, -1);
 
-            if(ready != 1) {
+            if(ready < 1) {
                 if(errno != EINTR) {
                     CO_error(0x11100000L + errno);
                 }
+                continue;
             }
+            epollStats_add(&mainlineStats, ready);
 
+            /* All ready events are handled in fixed order: timer, CAN receive, mainline. */
 #ifdef CO_SINGLE_THREAD
-            else if(CANrx_taskTmr_process(ev.data.fd)) {
-                /* code was processed in the above function. Additional code process below */
-                INCREMENT_1MS(CO_timer1ms);
-                /* Detect timer large overflow */
-                if(OD_performance[ODA_performance_timerCycleMaxTime] > TMR_TASK_OVERFLOW_US && rtPriority > 0) {
-                    CO_errorReport(CO->em, CO_EM_ISR_TIMER_OVERFLOW, CO_EMC_SOFTWARE_INTERNAL, 0x22400000L | OD_performance[ODA_performance_timerCycleMaxTime]);
+            for(i=0; i<ready; i++) {
+                if(syncProducerEnable && CO_SYNCproducer_process(&syncProducer, ev[i].data.fd)) {
+                    handled[i] = true;
+                }
+            }
+            for(i=0; i<ready; i++) {
+                if(handled[i]) {
+                    continue;
+                }
+                if(ev[i].data.fd == CO->CANmodule[0]->fd) {
+                    continue;
+                }
+                /* Quick stop latch before TPDOs of this cycle */
+                if(faultMonitorEnable) {
+                    CO_LOCK_OD();
+                    CO_faultMonitor_enforce();
+                    CO_UNLOCK_OD();
+                }
+                if(CANrx_taskTmr_process(ev[i].data.fd)) {
+                    handled[i] = true;
+                    /* code was processed in the above function. Additional code process below */
+                    CO_clock_tick();
+                    INCREMENT_1MS(CO_timer1ms);
+                    /* React on drive faults right after PDOs */
+                    if(faultMonitorEnable) {
+                        CO_faultMonitor_process();
+                    }
+                    CO_ODsnapshot_update();
+                    /* Detect timer large overflow */
+                    if(OD_performance[ODA_performance_timerCycleMaxTime] > TMR_TASK_OVERFLOW_US && rtPriority > 0) {
+                        CO_errorReport(CO->em, CO_EM_ISR_TIMER_OVERFLOW, CO_EMC_SOFTWARE_INTERNAL, 0x22400000L | OD_performance[ODA_performance_timerCycleMaxTime]);
+                    }
                 }
             }
 #endif
 
-            else if(taskMain_process(ev.data.fd, &reset, CO_timer1ms)) {
+            for(i=0; i<ready; i++) {
+                if(handled[i]) {
+                    continue;
+                }
+#ifdef CO_SINGLE_THREAD
+                if(ev[i].data.fd == CO->CANmodule[0]->fd) {
+                    /* All pending frames at once, instead of one per wakeup */
+                    CO_CANbatch_rx(&CANbatch0);
+                    handled[i] = true;
+                    continue;
+                }
+                if(CO_CANbus_processRx(ev[i].data.fd)) {
+                    handled[i] = true;
+                    continue;
+                }
+#endif
+                if(CO_SDOpool_processRx(ev[i].data.fd)) {
+                    /* SDO responses from the drives */
+                    handled[i] = true;
+                    sdoRx = true;
+                }
+                else if(faultMonitorEnable && CO_faultMonitor_processFd(ev[i].data.fd)) {
+                    handled[i] = true;
+                }
+            }
+
+            for(i=0; i<ready; i++) {
+                if(handled[i]) {
+                    continue;
+                }
+                if(taskMain_process(ev[i].data.fd, &reset, CO_timer1ms)) {
+                    mainProcessed = true;
+                }
+                else {
+                    /* No file descriptor was processed. */
+                    CO_error(0x11200000L);
+                }
+            }
+
+            /* SDO client timeouts and queued requests, once per wakeup */
+            if(sdoRx || mainProcessed) {
+                CO_driveParam_process();
+                CO_SDOpool_process(CO_timer1ms);
+            }
+
+            if(mainProcessed) {
                 uint16_t timer1msDiff;
                 static uint16_t tmr1msPrev = 0;
 
@@ -420,12 +930,11 @@ int main (int argc, char *argv[]) {
                 /* Execute optional additional application code */
                 app_programAsync(timer1msDiff);
 
-                CO_OD_storage_autoSave(&odStorAuto, CO_timer1ms, 60000);
-            }
+                /* OD lock statistics to 0x2114 */
+                CO_lockStats_toOD(&CO_lockStats_OD, OD_lockStats);
 
-            else {
-                /* No file descriptor was processed. */
-                CO_error(0x11200000L);
+                /* Only snapshot here, file is written by background thread */
+                CO_OD_storageAsync_process(&odStorAsync, CO_timer1ms, 60000);
             }
         }
     }
@@ -439,6 +948,11 @@ int main (int argc, char *argv[]) {
             CO_errExit("Socket command interface removal failed");
         }
     }
+    if(commandPoolEnable) {
+        if(CO_commandPool_clear() != 0) {
+            CO_errExit("Parallel command interface removal failed");
+        }
+    }
 #endif
 
     CO_endProgram = 1;
@@ -446,17 +960,40 @@ int main (int argc, char *argv[]) {
     if(pthread_join(rt_thread_id, NULL) != 0) {
         CO_errExit("Program end - pthread_join failed");
     }
+    epollStats_print("rt_thread", &rt_threadStats);
+    CO_lockStats_printStats(&CANvalidLockStats, "CAN valid lock");
 #endif
+    epollStats_print("mainline", &mainlineStats);
+    CO_rt_printPageFaults(argv[0]);
+    CO_CANbatch_printStats(&CANbatch0, "CAN");
+    if(syncProducerEnable) {
+        CO_SYNCproducer_printStats(&syncProducer, "SYNC");
+    }
+    CO_CANbus_printStats();
+    CO_lockStats_printStats(&CO_lockStats_OD, "OD lock");
+    CO_ODsnapshot_printStats("OD snapshot");
+    if(clockVirtual) {
+        CO_clock_printStats("Virtual time");
+    }
 
     /* Execute optional additional application code */
     app_programEnd();
 
     /* Store CO_OD_EEPROM */
-    CO_OD_storage_autoSave(&odStorAuto, 0, 0);
+    CO_OD_storageAsync_close(&odStorAsync);
     CO_OD_storage_autoSaveClose(&odStorAuto);
 
     /* delete objects from memory */
     CANrx_taskTmr_close();
+    if(syncProducerEnable) {
+        CO_SYNCproducer_close(&syncProducer);
+    }
+    if(faultMonitorEnable) {
+        CO_faultMonitor_close();
+    }
+    CO_clock_close();
+    CO_SDOpool_delete();
+    CO_CANbus_delete();
     taskMain_close();
     CO_delete(CANdevice0Index);
 
@@ -478,49 +1015,141 @@ int main (int argc, char *argv[]) {
 /* Realtime thread for CAN receive and taskTmr ********************************/
 static void* rt_thread(void* arg) {
 
+    /* RT setup, which must be done by the thread itself */
+    pthread_setname_np(pthread_self(), "canopend-rt");
+    CO_lockStats_setRtThread();
+    CO_rt_prefaultStack(rtPrefault);
+    rt_threadSetupErr = 0;
+    if(rtDeadline.period_us > 0 && CO_rt_setDeadline(&rtDeadline) != 0) {
+        rt_threadSetupErr = errno;
+    }
+    sem_post(&rt_threadReady);
+
     /* Endless loop */
     while(CO_endProgram == 0) {
-        int ready;
-        struct epoll_event ev;
+        int ready, i;
+        struct epoll_event ev[EPOLL_MAX_EVENTS];
+        bool_t handled[EPOLL_MAX_EVENTS] = {false};
 
-        ready = epoll_wait(rt_thread_epoll_fd, &ev, 1, -1);
+        ready = epoll_wait(rt_thread_epoll_fd, ev, EPOLL_MAX_EVENTS, -1);
 
-        if(ready != 1) {
+        if(ready < 1) {
             if(errno != EINTR) {
                 CO_error(0x12100000L + errno);
             }
+            continue;
         }
+        epollStats_add(&rt_threadStats, ready);
 
-        else if(CANrx_taskTmr_process(ev.data.fd)) {
-            int i;
-
-            /* code was processed in the above function. Additional code process below */
-            INCREMENT_1MS(CO_timer1ms);
+        /* Simulation harness steps the virtual time */
+        for(i=0; i<ready; i++) {
+            if(clockVirtual && CO_clock_process(ev[i].data.fd)) {
+                handled[i] = true;
+            }
+        }
 
-            /* Monitor variables with trace objects */
-            CO_time_process(&CO_time);
-#if CO_NO_TRACE > 0
-            for(i=0; i<OD_traceEnable && i<CO_NO_TRACE; i++) {
-                CO_trace_process(CO->trace[i], *CO_time.epochTimeOffsetMs);
+        /* SYNC producer first, its timer expires at the scheduled time of SYNC. */
+        for(i=0; i<ready; i++) {
+            if(!handled[i] && syncProducerEnable && CO_SYNCproducer_process(&syncProducer, ev[i].data.fd)) {
+                handled[i] = true;
             }
-#endif
+        }
 
-            /* Execute optional additional application code */
-			if(CO_timer1ms%10==0)
-				app_program1ms();
+        /* Timer next, so SYNC and TPDOs are not delayed by received frames. */
+        for(i=0; i<ready; i++) {
+            if(handled[i]) {
+                continue;
+            }
+            if(ev[i].data.fd == CO->CANmodule[0]->fd) {
+                continue;
+            }
+            /* Quick stop latch before TPDOs of this cycle */
+            if(faultMonitorEnable) {
+                CO_LOCK_OD();
+                CO_faultMonitor_enforce();
+                CO_UNLOCK_OD();
+            }
+            if(CANrx_taskTmr_process(ev[i].data.fd)) {
+                handled[i] = true;
 
-            /* Detect timer large overflow */
-            if(OD_performance[ODA_performance_timerCycleMaxTime] > TMR_TASK_OVERFLOW_US && rtPriority > 0 && CO->CANmodule[0]->CANnormal) {
-                CO_errorReport(CO->em, CO_EM_ISR_TIMER_OVERFLOW, CO_EMC_SOFTWARE_INTERNAL, 0x22400000L | OD_performance[ODA_performance_timerCycleMaxTime]);
+                /* code was processed in the above function. Additional code process below */
+                rt_cycle();
             }
         }
 
-        else {
-            /* No file descriptor was processed. */
-            CO_error(0x12200000L);
+        /* CAN receive, all pending frames at once */
+        for(i=0; i<ready; i++) {
+            if(handled[i]) {
+                continue;
+            }
+            if(ev[i].data.fd == CO->CANmodule[0]->fd) {
+                CO_CANbatch_rx(&CANbatch0);
+            }
+            else if(CO_CANbus_processRx(ev[i].data.fd)) {
+                /* Heartbeats, emergencies and SDO responses from additional interfaces */
+            }
+            else if(!CANrx_taskTmr_process(ev[i].data.fd)) {
+                /* No file descriptor was processed. */
+                CO_error(0x12200000L);
+            }
         }
     }
 
     return NULL;
 }
+
+
+/* Processing after each 1 ms cycle of taskTmr */
+static void rt_cycle(void) {
+    int j;
+
+    /* 64-bit timebase of this cycle, see CO_clock.h */
+    CO_clock_tick();
+    INCREMENT_1MS(CO_timer1ms);
+
+    /* React on drive faults right after PDOs */
+    if(faultMonitorEnable) {
+        CO_faultMonitor_process();
+    }
+
+    /* Lock-free copy of PDO mapped variables for other threads */
+    CO_ODsnapshot_update();
+
+    /* Monitor variables with trace objects */
+    CO_time_process(&CO_time);
+#if CO_NO_TRACE > 0
+    for(j=0; j<OD_traceEnable && j<CO_NO_TRACE; j++) {
+        CO_trace_process(CO->trace[j], *CO_time.epochTimeOffsetMs);
+    }
+#endif
+
+    /* Execute optional additional application code */
+    if(CO_timer1ms%10==0)
+        app_program1ms();
+
+    /* Detect timer large overflow */
+    if(OD_performance[ODA_performance_timerCycleMaxTime] > TMR_TASK_OVERFLOW_US && rtPriority > 0 && CO->CANmodule[0]->CANnormal) {
+        CO_errorReport(CO->em, CO_EM_ISR_TIMER_OVERFLOW, CO_EMC_SOFTWARE_INTERNAL, 0x22400000L | OD_performance[ODA_performance_timerCycleMaxTime]);
+    }
+}
+
+
+/* One simulated millisecond, called by CO_clock_process(): frames received
+ * since the previous cycle, then what taskTmr does in its timer event. */
+static void rt_virtualCycle(void) {
+    CO_CANbatch_rx(&CANbatch0);
+
+    CO_LOCK_OD();
+    if(faultMonitorEnable) {
+        CO_faultMonitor_enforce();
+    }
+    if(CO->CANmodule[0]->CANnormal) {
+        bool_t syncWas = CO_process_SYNC_RPDO(CO, TMR_TASK_INTERVAL_NS / 1000);
+
+        CO_process_TPDO(CO, syncWas, TMR_TASK_INTERVAL_NS / 1000);
+    }
+    CO_UNLOCK_OD();
+
+    rt_cycle();
+}
 #endif
@@ -0,0 +1,764 @@
+/*
+ * ALEX Exoskeleton.
+ * Sit-stand and walk modes of the Fourier X2 exoskeleton on the table driven state machine.
+ *
+ * Does the same as main() of canOpenBeagle/canFeast/CanFeast_Walk.c with sitStand() and walkMode():
+ * wait for button 4, initialise the joints, sit-stand until standing, walk through the gait table,
+ * sit-stand until seated, stop. Button 1 moves one waypoint forward (sit more, step forward),
+ * button 2 one back, button 4 goes to the next mode at the end of a table and button 3 stops the
+ * motors in any state.
+ *
+ * The modes are one transition table (StateMachine.hpp) instead of while(1) loops over movestate,
+ * sitstate and walkstate. The machine is driven by events from one event loop
+ * (CO_ODclientAsync.hpp): button events from sampling the button node every POLL_MS (a held
+ * button repeats, as before) and motion done/failed events when the drives reach the target.
+ * Timing of each state is printed at exit.
+ *
+ * Needs canopend with the parallel command interface and the button node in the SDO pool:
+ *   canopend can1 -i 100 -c "" -n 1-4,9 -C ""
+ *
+ * With -V[socket] timers follow the virtual time of canopend -V (simulation with driveSim -V). The
+ * socket is optional and must follow without a space, e.g. -V/tmp/CO_sim_socket.
+ *
+ * Compile: g++ -std=c++17 -Wall -I../CANopenSocket_Extended ExoModes.cpp -o exoModes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <getopt.h>
+#include "CO_ODclientAsync.hpp"
+#include "StateMachine.hpp"
+
+//Buffer for socket
+#ifndef BUF_SIZE
+#define BUF_SIZE 1000
+#endif
+//String Length for defining fixed sized char array
+#define STRING_LENGTH 50
+//Exo skeleton user buttons. Button n is object 0x0100+n sub 1 of BUTTON_NODE, 1.0f if pressed.
+#define NUM_BUTTONS 4
+#define BUTTON_NODE 9
+#define BUTTON_PRESSED 0x3F800000
+//Node ID for the 4 joints
+#define LHIP 1
+#define LKNEE 2
+#define RHIP 3
+#define RKNEE 4
+#define NUM_JOINTS 4
+//canopend sockets
+#define COMMAND_SOCKET "/tmp/CO_command_socket"
+#define PARALLEL_SOCKET "/tmp/CO_command_socket_parallel"
+//Clearance used when doing point to point motion
+#define POSCLEARANCE 10000
+//Velocity and acceleration for position mode move
+#define PROFILEVELOCITY 200000
+#define PROFILEACCELERATION 40000
+//Controlword values, which start a position mode move (new setpoint bit low, then high)
+#define CW_SETPOINT_LOW 47
+#define CW_SETPOINT_HIGH 63
+//Sampling period of buttons and positions. Positions are printed every PRINT_TICKS while waiting.
+#define POLL_MS 10
+#define PRINT_TICKS 50
+//Knee motor reading and corresponding angle. Used for mapping between degree and motor values.
+#define KNEE_MOTOR_POS1 250880
+#define KNEE_MOTOR_DEG1 90
+#define KNEE_MOTOR_POS2 0
+#define KNEE_MOTOR_DEG2 0
+//Hip motor reading and corresponding angle. Used for mapping between degree and motor values.
+#define HIP_MOTOR_POS1 250880
+#define HIP_MOTOR_DEG1 90
+#define HIP_MOTOR_POS2 0
+#define HIP_MOTOR_DEG2 180
+
+static const int joints[NUM_JOINTS] = {LHIP, LKNEE, RHIP, RKNEE};
+
+//Array of trajectory points from R&D team, smallest index is standing.
+static const double sitStandArrHip_degrees[] = {
+        171.59,
+        169.97,
+        161.72,
+        147.06,
+        130.51,
+        117.26,
+        109.84,
+        107.45,
+        107.89,
+        108.86,
+        109.13
+};
+static const double sitStandArrKnee_degrees[] = {
+        18.19,
+        20.59,
+        32.71,
+        53.84,
+        76.85,
+        93.64,
+        100.35,
+        98.88,
+        93.91,
+        90.07,
+        89.20
+};
+static const int sitStandSize = sizeof(sitStandArrHip_degrees) / sizeof(sitStandArrHip_degrees[0]);
+
+//Walking trajectory points from R&D team, same as in CanFeast_Walk.c.
+static const double walkArrLHip_degrees[] = {
+        171.59,
+        170.89,
+        167.41,
+        161.52,
+        155.55,
+        152.03,
+        152.17,
+        155.05,
+        158.61,
+        160.91,
+        161.39,
+        161.61,
+        162.80,
+        165.12,
+        168.21,
+        171.59,
+        174.97,
+        178.07,
+        180.39,
+        181.58,
+        181.80,
+        180.68,
+        175.16,
+        165.94,
+        156.83,
+        152.03,
+        153.46,
+        159.47,
+        166.36,
+        170.70,
+        171.59
+};
+static const double walkArrLKnee_degrees[] = {
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19
+};
+
+static const double walkArrRHip_degrees[] = {
+        171.59,
+        171.50,
+        171.07,
+        170.56,
+        170.55,
+        171.59,
+        173.93,
+        177.04,
+        179.87,
+        181.48,
+        181.80,
+        180.78,
+        175.68,
+        166.97,
+        157.88,
+        152.03,
+        151.12,
+        154.02,
+        158.09,
+        160.81,
+        161.39,
+        161.70,
+        163.32,
+        166.15,
+        169.26,
+        171.59,
+        172.64,
+        172.62,
+        172.12,
+        171.69,
+        171.59
+};
+static const double walkArrRKnee_degrees[] = {
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19
+};
+static const int walkSize = sizeof(walkArrLHip_degrees) / sizeof(walkArrLHip_degrees[0]);
+
+//States and events
+enum ExoState
+{
+    S_WAITSTART,    //Prints positions until button 4
+    S_INIT,         //Start mode, position mode and motion profile of the joints
+    S_SITSTAND,     //Sit-stand mode, not moving
+    S_SITTINGDOWN,
+    S_STANDINGUP,
+    S_WALK,         //Walk mode, not moving
+    S_WALKFORWARD,
+    S_WALKBACK,
+    S_STOPPED,      //Joints in preop, end of program
+    S_FAULT,        //SDO error, joints in preop, end of program
+    S_COUNT,
+    S_ANY = S_COUNT
+};
+
+enum ExoEvent
+{
+    EV_BUTTON1,
+    EV_BUTTON2,
+    EV_BUTTON3,
+    EV_BUTTON4,
+    EV_DONE,        //Initialisation or motion finished
+    EV_FAILED       //Initialisation or motion failed
+};
+
+//Context of the state machine.
+struct Exo
+{
+    CO::EventLoop loop;
+    CO::AsyncODclient od{loop};
+    CO::SimClock simClock;
+    //Positions of the waypoint tables in motor counts
+    long sitStand[sitStandSize][NUM_JOINTS];
+    long walk[walkSize][NUM_JOINTS];
+    //Index into the tables, one position outside the table before the first move
+    int sitstate = sitStandSize;
+    int walkstate = -1;
+    int target = 0;
+    bool walked = false;
+    bool stopped = false;
+    //Outstanding requests of the current step. Replies of an older motion are ignored.
+    int pending = 0;
+    uint32_t error = 0;
+    unsigned motion = 0;
+    long moveTarget[NUM_JOINTS];
+    //Last read of the actual positions
+    long position[NUM_JOINTS];
+    int positionsPending = 0;
+    uint32_t positionError = 0;
+    int ticks = 0;
+    int buttonsPending = 0;
+    uint32_t buttonError = 0;
+    bool button[NUM_BUTTONS];
+};
+
+//Hooks, guards and actions.
+void waitStartDuring(Exo &exo);
+void initEntry(Exo &exo);
+void sittingDownEntry(Exo &exo);
+void standingUpEntry(Exo &exo);
+void walkForwardEntry(Exo &exo);
+void walkBackEntry(Exo &exo);
+void stoppedEntry(Exo &exo);
+void faultEntry(Exo &exo);
+bool canSit(const Exo &exo);
+bool canStand(const Exo &exo);
+bool standingBeforeWalk(const Exo &exo);
+bool seatedAfterWalk(const Exo &exo);
+bool canStepForward(const Exo &exo);
+bool canStepBack(const Exo &exo);
+bool walkEnd(const Exo &exo);
+bool running(const Exo &exo);
+void positionReached(Exo &exo);
+void startWalk(Exo &exo);
+void startSitStand(Exo &exo);
+void endWalk(Exo &exo);
+void terminateProgram(Exo &exo);
+
+static constexpr std::array<SM::State<Exo>, S_COUNT> states = {{
+    {"Wait start", nullptr, waitStartDuring, nullptr},
+    {"Init", initEntry, nullptr, nullptr},
+    {"Sit stand", nullptr, nullptr, nullptr},
+    {"Sitting down", sittingDownEntry, nullptr, nullptr},
+    {"Standing up", standingUpEntry, nullptr, nullptr},
+    {"Walk", nullptr, nullptr, nullptr},
+    {"Walk forward", walkForwardEntry, nullptr, nullptr},
+    {"Walk back", walkBackEntry, nullptr, nullptr},
+    {"Stopped", stoppedEntry, nullptr, nullptr},
+    {"Fault", faultEntry, nullptr, nullptr}}};
+
+static constexpr std::array<SM::Transition<Exo, ExoState, ExoEvent>, 20> transitions = {{
+    {S_WAITSTART,   EV_BUTTON4, S_INIT,        nullptr,            nullptr},
+    {S_INIT,        EV_DONE,    S_SITSTAND,    nullptr,            startSitStand},
+    {S_INIT,        EV_FAILED,  S_FAULT,       nullptr,            nullptr},
+    {S_SITSTAND,    EV_BUTTON1, S_SITTINGDOWN, canSit,             nullptr},
+    {S_SITSTAND,    EV_BUTTON2, S_STANDINGUP,  canStand,           nullptr},
+    {S_SITSTAND,    EV_BUTTON4, S_WALK,        standingBeforeWalk, startWalk},
+    {S_SITSTAND,    EV_BUTTON4, S_STOPPED,     seatedAfterWalk,    nullptr},
+    {S_SITTINGDOWN, EV_DONE,    S_SITSTAND,    nullptr,            positionReached},
+    {S_SITTINGDOWN, EV_FAILED,  S_FAULT,       nullptr,            nullptr},
+    {S_STANDINGUP,  EV_DONE,    S_SITSTAND,    nullptr,            positionReached},
+    {S_STANDINGUP,  EV_FAILED,  S_FAULT,       nullptr,            nullptr},
+    {S_WALK,        EV_BUTTON1, S_WALKFORWARD, canStepForward,     nullptr},
+    {S_WALK,        EV_BUTTON2, S_WALKBACK,    canStepBack,        nullptr},
+    {S_WALK,        EV_BUTTON4, S_SITSTAND,    walkEnd,            endWalk},
+    {S_WALKFORWARD, EV_DONE,    S_WALK,        nullptr,            positionReached},
+    {S_WALKFORWARD, EV_FAILED,  S_FAULT,       nullptr,            nullptr},
+    {S_WALKBACK,    EV_DONE,    S_WALK,        nullptr,            positionReached},
+    {S_WALKBACK,    EV_FAILED,  S_FAULT,       nullptr,            nullptr},
+    //Button 3 stops the motors whatever the exo does
+    {S_ANY,         EV_BUTTON3, S_STOPPED,     running,            terminateProgram},
+    {S_ANY,         EV_FAILED,  S_FAULT,       running,            nullptr}}};
+
+static_assert(SM::checkTable(transitions, S_COUNT), "Invalid transition table");
+
+static Exo exo;
+static SM::Machine<Exo, ExoState, ExoEvent, S_COUNT, transitions.size()> machine(states, transitions, exo);
+
+//Sends a single command on the canopend command socket (NMT). Returns 0 on success.
+int canFeastSingle(const char *command);
+//Converts joint angle in degrees to motor counts.
+long degreesToMotor(double degrees, int nodeid);
+//Starts a move of all joints to the waypoint, EV_DONE when all are within POSCLEARANCE.
+void moveTo(Exo &exo, const long waypoint[NUM_JOINTS]);
+//Calls moveTo() completion with EV_DONE, if all joints are within POSCLEARANCE, or reads again.
+void checkPosition(Exo &exo);
+//Reads actual position of all joints into exo.position, then calls done.
+void readPositions(Exo &exo, void (*done)(Exo &exo));
+//Samples the buttons every POLL_MS, dispatches button events and calls during().
+void sampleButtons(Exo &exo);
+//Puts all joints to preop.
+void stopExo();
+
+int main(int argc, char *argv[])
+{
+    const char *simSocket = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "V::")) != -1)
+    {
+        if (opt != 'V')
+        {
+            fprintf(stderr, "Usage: %s [-V[<simulation socket>]]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        simSocket = optarg != NULL ? optarg : CO_SIM_SOCKET;
+    }
+
+    printf("Welcome to CANfeast!\n");
+
+    for (int i = 0; i < sitStandSize; i++)
+    {
+        exo.sitStand[i][0] = degreesToMotor(sitStandArrHip_degrees[i], LHIP);
+        exo.sitStand[i][1] = degreesToMotor(sitStandArrKnee_degrees[i], LKNEE);
+        exo.sitStand[i][2] = degreesToMotor(sitStandArrHip_degrees[i], RHIP);
+        exo.sitStand[i][3] = degreesToMotor(sitStandArrKnee_degrees[i], RKNEE);
+    }
+    for (int i = 0; i < walkSize; i++)
+    {
+        exo.walk[i][0] = degreesToMotor(walkArrLHip_degrees[i], LHIP);
+        exo.walk[i][1] = degreesToMotor(walkArrLKnee_degrees[i], LKNEE);
+        exo.walk[i][2] = degreesToMotor(walkArrRHip_degrees[i], RHIP);
+        exo.walk[i][3] = degreesToMotor(walkArrRKnee_degrees[i], RKNEE);
+    }
+
+    if (exo.od.open(PARALLEL_SOCKET) != 0)
+    {
+        perror("Socket connection failed");
+        fprintf(stderr, "Start canopend with the parallel command interface (-C \"\")\n");
+        exit(EXIT_FAILURE);
+    }
+    exo.od.setPriority(CO::ODclient::PRIO_HIGH);
+    if (simSocket != NULL)
+    {
+        if (exo.simClock.open(simSocket) != 0)
+        {
+            perror("Simulation socket connection failed");
+            fprintf(stderr, "Start canopend with virtual time (-V \"\")\n");
+            exit(EXIT_FAILURE);
+        }
+        exo.loop.setClock(exo.simClock);
+    }
+
+    printf("Press button 4 to start\n");
+    machine.start(S_WAITSTART);
+    sampleButtons(exo);
+    exo.loop.run();
+
+    exo.od.close();
+    machine.printTiming("State timing");
+    return machine.current() == S_STOPPED ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void waitStartDuring(Exo &exo)
+{
+    if (++exo.ticks % PRINT_TICKS != 0)
+        return;
+    readPositions(exo, [](Exo &exo) {
+        if (exo.positionError == 0 && machine.current() == S_WAITSTART)
+            printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", exo.position[0], exo.position[1], exo.position[2], exo.position[3]);
+    });
+}
+
+void initEntry(Exo &exo)
+{
+    unsigned motion = ++exo.motion;
+
+    //Go from preop to start mode
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        char command[STRING_LENGTH];
+        snprintf(command, sizeof(command), "[1] %d start", joints[i]);
+        canFeastSingle(command);
+    }
+
+    //Position mode and profile of all joints at once
+    exo.pending = NUM_JOINTS * 4;
+    exo.error = 0;
+    auto done = [&exo, motion](uint32_t result) {
+        if (motion != exo.motion)
+            return;
+        if (exo.error == 0)
+            exo.error = result;
+        if (--exo.pending == 0)
+            machine.dispatch(exo.error == 0 ? EV_DONE : EV_FAILED);
+    };
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        exo.od.write<CO::drive::modesOfOperation>(joints[i], 1).then([done](const CO::Reply<int8_t> &r) { done(r.result); });
+        exo.od.write<CO::drive::profileVelocity>(joints[i], PROFILEVELOCITY).then([done](const CO::Reply<uint32_t> &r) { done(r.result); });
+        exo.od.write<CO::drive::profileAcceleration>(joints[i], PROFILEACCELERATION).then([done](const CO::Reply<uint32_t> &r) { done(r.result); });
+        exo.od.write<CO::drive::profileDeceleration>(joints[i], PROFILEACCELERATION).then([done](const CO::Reply<uint32_t> &r) { done(r.result); });
+    }
+}
+
+void sittingDownEntry(Exo &exo)
+{
+    printf("Sitting down\n");
+    exo.target = exo.sitstate + 1;
+    moveTo(exo, exo.sitStand[exo.target]);
+}
+
+void standingUpEntry(Exo &exo)
+{
+    printf("Standing up\n");
+    exo.target = exo.sitstate - 1;
+    moveTo(exo, exo.sitStand[exo.target]);
+}
+
+void walkForwardEntry(Exo &exo)
+{
+    printf("Walking forward\n");
+    exo.target = exo.walkstate + 1;
+    moveTo(exo, exo.walk[exo.target]);
+}
+
+void walkBackEntry(Exo &exo)
+{
+    printf("Walking backward\n");
+    exo.target = exo.walkstate - 1;
+    moveTo(exo, exo.walk[exo.target]);
+}
+
+void stoppedEntry(Exo &exo)
+{
+    exo.stopped = true;
+    stopExo();
+    exo.loop.stop();
+}
+
+void faultEntry(Exo &exo)
+{
+    fprintf(stderr, "SDO error 0x%08X in state %s\n", exo.error, machine.currentName());
+    exo.stopped = true;
+    stopExo();
+    exo.loop.stop();
+}
+
+bool canSit(const Exo &exo) { return exo.sitstate < sitStandSize - 1; }
+bool canStand(const Exo &exo) { return exo.sitstate > 0; }
+//Sit-stand ends, when the exo has gone from sitting to standing (before walking) or back (after).
+bool standingBeforeWalk(const Exo &exo) { return !exo.walked && exo.sitstate == 0; }
+bool seatedAfterWalk(const Exo &exo) { return exo.walked && exo.sitstate == sitStandSize - 1; }
+bool canStepForward(const Exo &exo) { return exo.walkstate < walkSize - 1; }
+bool canStepBack(const Exo &exo) { return exo.walkstate > 0; }
+//Only exit walk mode at end of walking array.
+bool walkEnd(const Exo &exo) { return exo.walkstate == walkSize - 1; }
+bool running(const Exo &exo) { return !exo.stopped; }
+
+void positionReached(Exo &exo)
+{
+    printf("Position reached.\n");
+    switch (machine.current())
+    {
+    case S_SITTINGDOWN:
+        exo.sitstate = exo.target;
+        if (exo.sitstate == sitStandSize - 1)
+            printf("fully seated position\n");
+        break;
+    case S_STANDINGUP:
+        exo.sitstate = exo.target;
+        if (exo.sitstate == 0)
+            printf("full standing position\n");
+        break;
+    case S_WALKFORWARD:
+        exo.walkstate = exo.target;
+        if (exo.walkstate == walkSize - 1)
+            printf("final array position\n");
+        break;
+    case S_WALKBACK:
+        exo.walkstate = exo.target;
+        if (exo.walkstate == 0)
+            printf("first array position\n");
+        break;
+    default:
+        break;
+    }
+}
+
+void startWalk(Exo &exo)
+{
+    printf("Walk Mode\n");
+    exo.walkstate = -1;
+}
+
+void startSitStand(Exo &exo)
+{
+    (void)exo;
+    printf("Sit Stand Mode\n");
+}
+
+//Standing at the end of the walk table, which is the first sit-stand waypoint.
+void endWalk(Exo &exo)
+{
+    exo.walked = true;
+    exo.sitstate = -1;
+    startSitStand(exo);
+}
+
+void terminateProgram(Exo &exo)
+{
+    (void)exo;
+    printf("Terminating Program (%s)\n", machine.currentName());
+}
+
+void moveTo(Exo &exo, const long waypoint[NUM_JOINTS])
+{
+    unsigned motion = ++exo.motion;
+
+    memcpy(exo.moveTarget, waypoint, sizeof(exo.moveTarget));
+    exo.pending = NUM_JOINTS * 3;
+    exo.error = 0;
+    auto done = [&exo, motion](uint32_t result) {
+        if (motion != exo.motion)
+            return;
+        if (exo.error == 0)
+            exo.error = result;
+        if (--exo.pending > 0)
+            return;
+        if (exo.error != 0)
+            machine.dispatch(EV_FAILED);
+        else
+            readPositions(exo, checkPosition);
+    };
+
+    //Requests to the same drive are done in order: target, then new setpoint bit low and high.
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        exo.od.write<CO::drive::targetPosition>(joints[i], waypoint[i]).then([done](const CO::Reply<int32_t> &r) { done(r.result); });
+        exo.od.write<CO::drive::controlword>(joints[i], CW_SETPOINT_LOW).then([done](const CO::Reply<uint16_t> &r) { done(r.result); });
+        exo.od.write<CO::drive::controlword>(joints[i], CW_SETPOINT_HIGH).then([done](const CO::Reply<uint16_t> &r) { done(r.result); });
+    }
+}
+
+void checkPosition(Exo &exo)
+{
+    unsigned motion = exo.motion;
+
+    if (exo.positionError != 0)
+    {
+        exo.error = exo.positionError;
+        machine.dispatch(EV_FAILED);
+        return;
+    }
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        if (exo.position[i] <= exo.moveTarget[i] - POSCLEARANCE || exo.position[i] >= exo.moveTarget[i] + POSCLEARANCE)
+        {
+            //Not there yet, check again after POLL_MS, unless the move was abandoned
+            exo.loop.after(POLL_MS, [&exo, motion]() {
+                if (motion == exo.motion && !exo.stopped)
+                    readPositions(exo, checkPosition);
+            });
+            return;
+        }
+    }
+    machine.dispatch(EV_DONE);
+}
+
+void readPositions(Exo &exo, void (*done)(Exo &exo))
+{
+    exo.positionsPending = NUM_JOINTS;
+    exo.positionError = 0;
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        exo.od.read<CO::drive::positionActualInternal>(joints[i]).then([&exo, i, done](const CO::Reply<int32_t> &r) {
+            if (r)
+                exo.position[i] = r.value;
+            else if (exo.positionError == 0)
+                exo.positionError = r.result;
+            if (--exo.positionsPending == 0)
+                done(exo);
+        });
+    }
+}
+
+void sampleButtons(Exo &exo)
+{
+    if (exo.stopped)
+        return;
+    exo.buttonsPending = NUM_BUTTONS;
+    exo.buttonError = 0;
+    for (int i = 0; i < NUM_BUTTONS; i++)
+    {
+        exo.od.readAt<uint32_t>(BUTTON_NODE, 0x0101 + i, 1).then([&exo, i](const CO::Reply<uint32_t> &r) {
+            exo.button[i] = r && r.value == BUTTON_PRESSED;
+            if (!r && exo.buttonError == 0)
+                exo.buttonError = r.result;
+            if (--exo.buttonsPending > 0)
+                return;
+
+            //Unknown buttons, stop (button 3) may be pressed. Abandon the motion and fault.
+            if (exo.buttonError != 0)
+            {
+                exo.motion++;
+                exo.error = exo.buttonError;
+                machine.dispatch(EV_FAILED);
+                return;
+            }
+
+            //Button 3 (stop) first, then the others in order
+            if (exo.button[2])
+                machine.dispatch(EV_BUTTON3);
+            if (exo.button[0])
+                machine.dispatch(EV_BUTTON1);
+            if (exo.button[1])
+                machine.dispatch(EV_BUTTON2);
+            if (exo.button[3])
+                machine.dispatch(EV_BUTTON4);
+            machine.during();
+            exo.loop.after(POLL_MS, [&exo]() { sampleButtons(exo); });
+        });
+    }
+}
+
+void stopExo()
+{
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        char command[STRING_LENGTH];
+        snprintf(command, sizeof(command), "[1] %d preop", joints[i]);
+        canFeastSingle(command);
+    }
+}
+
+long degreesToMotor(double degrees, int nodeid)
+{
+    double y1, x1, y2, x2;
+
+    if (nodeid == LHIP || nodeid == RHIP)
+    {
+        y1 = HIP_MOTOR_POS1; x1 = HIP_MOTOR_DEG1; y2 = HIP_MOTOR_POS2; x2 = HIP_MOTOR_DEG2;
+    }
+    else
+    {
+        y1 = KNEE_MOTOR_POS1; x1 = KNEE_MOTOR_DEG1; y2 = KNEE_MOTOR_POS2; x2 = KNEE_MOTOR_DEG2;
+    }
+    //y=Ax+B through both calibration points
+    return (long)((y2 - y1) / (x2 - x1) * degrees + (y1 * x2 - y2 * x1) / (x2 - x1));
+}
+
+int canFeastSingle(const char *command)
+{
+    struct sockaddr_un addr;
+    char buf[BUF_SIZE];
+    int commandLength = strlen(command);
+    int canSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    ssize_t n;
+
+    if (canSocket == -1)
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, COMMAND_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(canSocket, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1
+        || write(canSocket, command, commandLength) != commandLength)
+    {
+        perror("Socket connection failed");
+        close(canSocket);
+        return -1;
+    }
+    n = read(canSocket, buf, sizeof(buf) - 1);
+    close(canSocket);
+    if (n <= 0)
+    {
+        perror("Socket read failed");
+        return -1;
+    }
+    buf[n] = 0;
+    if (strstr(buf, "ERROR") != NULL)
+    {
+        fprintf(stderr, "%s: %s", command, buf);
+        return -1;
+    }
+    return 0;
+}
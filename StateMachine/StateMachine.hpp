@@ -0,0 +1,334 @@
+/*
+ * Table driven finite state machine for exoskeleton modes.
+ *
+ * @file        StateMachine.hpp
+ *
+ * States, events and transitions as in docs/StateMachine.md, but the
+ * states and the transition table are constant arrays, which are checked
+ * at compile time, and the machine is driven by events instead of being
+ * polled by update():
+ *
+ *  - A state has a name and entry, during and exit hooks. Hooks are plain
+ *    functions of the context (the object with robot, trajectories etc.),
+ *    any of them may be nullptr.
+ *  - A transition is {from, event, to, guard, action}. The first
+ *    transition of the current state with matching event and passing
+ *    guard fires: exit hook of the current state, action, entry hook of
+ *    the new state. Events without transition are ignored. Transitions
+ *    with from equal to the number of states match in any state, after
+ *    the transitions of the state itself (emergency stop etc.).
+ *  - dispatch() may be called from hooks and actions. Such events are
+ *    queued and processed after the current transition, in order.
+ *  - during() calls the during hook of the current state, call it
+ *    periodically if states need it.
+ *
+ * Nothing is allocated. The table must be sorted by from state, so the
+ * transitions of each state are found by index. checkTable() verifies the
+ * table with static_assert:
+ *
+ *   enum State { S_SEATED, S_STANDING_UP, S_STANDING, S_COUNT, S_ANY = S_COUNT };
+ *   enum Event { EV_BUTTON_UP, EV_MOTION_DONE };
+ *   static constexpr std::array<SM::State<Exo>, S_COUNT> states = {{
+ *       {"Seated", nullptr, nullptr, nullptr},
+ *       {"Standing up", startStanding, nullptr, nullptr},
+ *       {"Standing", nullptr, nullptr, nullptr}}};
+ *   static constexpr std::array<SM::Transition<Exo, State, Event>, 2> table = {{
+ *       {S_SEATED, EV_BUTTON_UP, S_STANDING_UP, isCalibrated, nullptr},
+ *       {S_STANDING_UP, EV_MOTION_DONE, S_STANDING, nullptr, nullptr}}};
+ *   static_assert(SM::checkTable(table, S_COUNT), "Invalid transition table");
+ *
+ *   SM::Machine<Exo, State, Event, S_COUNT, 2> machine(states, table, exo);
+ *   machine.start(S_SEATED);
+ *   machine.dispatch(EV_BUTTON_UP);
+ *
+ * Each state records the number of entries, the time spent in it and the
+ * longest execution of its hooks, printed by printTiming().
+ *
+ * Requires C++17. Not thread safe, dispatch from one thread.
+ */
+
+#ifndef STATE_MACHINE_HPP
+#define STATE_MACHINE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <time.h>
+
+
+/* Number of events, which may be queued by hooks and actions. */
+#ifndef SM_EVENT_QUEUE_SIZE
+#define SM_EVENT_QUEUE_SIZE     8
+#endif
+
+
+namespace SM {
+
+/**
+ * State with its hooks.
+ */
+template<class Context>
+struct State {
+    const char *name;
+    void (*entry)(Context &);       /**< Called when the state is entered. */
+    void (*during)(Context &);      /**< Called by Machine::during(). */
+    void (*exit)(Context &);        /**< Called when the state is left. */
+};
+
+
+/**
+ * Transition from state from to state to on event, if guard returns true.
+ */
+template<class Context, typename StateId, typename EventId>
+struct Transition {
+    StateId from;                   /**< Number of states for any state. */
+    EventId event;
+    StateId to;
+    bool (*guard)(const Context &); /**< nullptr for always. */
+    void (*action)(Context &);      /**< Called between exit and entry, may be nullptr. */
+};
+
+
+/**
+ * Verify transition table at compile time: states are in range, table is
+ * sorted by from state and no transition is hidden by an earlier one
+ * without guard.
+ */
+template<class Context, typename StateId, typename EventId, size_t N>
+constexpr bool checkTable(const std::array<Transition<Context, StateId, EventId>, N> &table, size_t nStates) {
+    for (size_t i = 0; i < N; i++) {
+        const Transition<Context, StateId, EventId> &t = table[i];
+        if ((size_t)t.from > nStates || (size_t)t.to >= nStates)
+            return false;
+        if (i > 0 && t.from < table[i - 1].from)
+            return false;
+        for (size_t j = 0; j < i; j++) {
+            if (table[j].from == t.from && table[j].event == t.event && table[j].guard == nullptr)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Index of the first transition of each state in the sorted table. Entry
+ * nStates is the first transition for any state, entry nStates + 1 is N.
+ */
+template<size_t NStates, class Context, typename StateId, typename EventId, size_t N>
+constexpr std::array<uint16_t, NStates + 2> tableIndex(const std::array<Transition<Context, StateId, EventId>, N> &table) {
+    std::array<uint16_t, NStates + 2> index{};
+    size_t i = 0;
+
+    for (size_t s = 0; s <= NStates + 1; s++) {
+        while (i < N && (size_t)table[i].from < s)
+            i++;
+        index[s] = (uint16_t)i;
+    }
+    return index;
+}
+
+
+/**
+ * Timing of one state.
+ */
+struct StateTiming {
+    uint32_t entries;               /**< Number of times entered. */
+    uint64_t timeTotal_ns;          /**< Time spent in the state. */
+    uint64_t timeMax_ns;            /**< Longest stay. */
+    uint32_t hookMax_ns;            /**< Longest entry, during or exit hook. */
+};
+
+
+/**
+ * State machine over constant state and transition tables.
+ *
+ * @tparam Context Object passed to hooks, guards and actions.
+ * @tparam StateId Enum of states, 0 .. NStates - 1.
+ * @tparam EventId Enum of events.
+ */
+template<class Context, typename StateId, typename EventId, size_t NStates, size_t NTransitions>
+class Machine {
+public:
+    typedef std::array<State<Context>, NStates> States;
+    typedef std::array<Transition<Context, StateId, EventId>, NTransitions> Table;
+
+    Machine(const States &states, const Table &table, Context &context)
+        : states(states), table(table), index(tableIndex<NStates>(table)), context(context),
+          state(0), running(false), dispatching(false), queueHead(0), queueCount(0),
+          enteredAt_ns(0), timing{} {}
+
+    Machine(const Machine &) = delete;
+    Machine &operator=(const Machine &) = delete;
+
+    /** Enter the initial state. */
+    void start(StateId initial) {
+        state = (size_t)initial;
+        running = true;
+        enter();
+        processQueue();
+    }
+
+    /**
+     * Process event. Called from a hook or action, event is processed after
+     * the current transition.
+     *
+     * @return true if a transition fired (false if queued, ignored or queue
+     * is full).
+     */
+    bool dispatch(EventId event) {
+        if (dispatching || !running) {
+            if (queueCount >= SM_EVENT_QUEUE_SIZE) {
+                dropped++;
+                return false;
+            }
+            queue[(queueHead + queueCount++) % SM_EVENT_QUEUE_SIZE] = event;
+            return false;
+        }
+        bool fired = process(event);
+        processQueue();
+        return fired;
+    }
+
+    /** Call the during hook of the current state. */
+    void during() {
+        if (!running || states[state].during == nullptr)
+            return;
+        dispatching = true;
+        uint64_t t = now_ns();
+        states[state].during(context);
+        recordHook(t);
+        dispatching = false;
+        processQueue();
+    }
+
+    StateId current() const { return (StateId)state; }
+
+    const char *currentName() const { return states[state].name; }
+
+    const StateTiming &stateTiming(StateId s) const { return timing[(size_t)s]; }
+
+    /** Print timing of all states to stdout. */
+    void printTiming(const char *name) const {
+        printf("%s - %u transitions, %u ignored events, %u dropped events\n",
+               name, transitions, ignored, dropped);
+        for (size_t s = 0; s < NStates; s++) {
+            const StateTiming &t = timing[s];
+            uint64_t total = t.timeTotal_ns;
+            uint64_t max = t.timeMax_ns;
+
+            /* Include the current stay */
+            if (running && s == state) {
+                uint64_t stay = now_ns() - enteredAt_ns;
+                total += stay;
+                if (stay > max) max = stay;
+            }
+            printf("  %-20s entries %4u  time total/max %8.1f/%8.1f ms  hook max %6u us\n",
+                   states[s].name, t.entries, total / 1e6, max / 1e6, t.hookMax_ns / 1000);
+        }
+    }
+
+private:
+    static uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    void recordHook(uint64_t start) {
+        uint64_t d = now_ns() - start;
+        StateTiming &t = timing[state];
+        if (d > t.hookMax_ns)
+            t.hookMax_ns = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+    }
+
+    void enter() {
+        StateTiming &t = timing[state];
+        t.entries++;
+        enteredAt_ns = now_ns();
+        if (states[state].entry != nullptr) {
+            dispatching = true;
+            states[state].entry(context);
+            recordHook(enteredAt_ns);
+            dispatching = false;
+        }
+    }
+
+    void leave() {
+        uint64_t t0 = now_ns();
+        StateTiming &t = timing[state];
+        uint64_t stay = t0 - enteredAt_ns;
+
+        t.timeTotal_ns += stay;
+        if (stay > t.timeMax_ns)
+            t.timeMax_ns = stay;
+        if (states[state].exit != nullptr) {
+            states[state].exit(context);
+            recordHook(t0);
+        }
+    }
+
+    /* Find transition of the current state, then of any state */
+    const Transition<Context, StateId, EventId> *find(EventId event) const {
+        const size_t from[2] = {state, NStates};
+
+        for (size_t f : from) {
+            for (size_t i = index[f]; i < index[f + 1]; i++) {
+                const Transition<Context, StateId, EventId> &t = table[i];
+                if (t.event == event && (t.guard == nullptr || t.guard(context)))
+                    return &t;
+            }
+        }
+        return nullptr;
+    }
+
+    bool process(EventId event) {
+        const Transition<Context, StateId, EventId> *t;
+
+        dispatching = true;
+        t = find(event);
+        if (t == nullptr) {
+            ignored++;
+            dispatching = false;
+            return false;
+        }
+        leave();
+        if (t->action != nullptr)
+            t->action(context);
+        state = (size_t)t->to;
+        transitions++;
+        dispatching = false;
+        enter();
+        return true;
+    }
+
+    void processQueue() {
+        while (queueCount > 0 && running && !dispatching) {
+            EventId event = queue[queueHead];
+            queueHead = (queueHead + 1) % SM_EVENT_QUEUE_SIZE;
+            queueCount--;
+            process(event);
+        }
+    }
+
+    const States &states;
+    const Table &table;
+    const std::array<uint16_t, NStates + 2> index;
+    Context &context;
+    size_t state;
+    bool running;
+    bool dispatching;
+    EventId queue[SM_EVENT_QUEUE_SIZE];
+    size_t queueHead;
+    size_t queueCount;
+    uint64_t enteredAt_ns;
+    StateTiming timing[NStates];
+    uint32_t transitions = 0;
+    uint32_t ignored = 0;
+    uint32_t dropped = 0;
+};
+
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <errno.h>
 
 //Buffer for socket
 #ifndef BUF_SIZE
@@ -16,6 +17,18 @@
 #endif
 //String Length for defining fixed sized char array
 #define STRING_LENGTH 50
+//Connect attempts to canopend before a command fails. Delay is doubled after each attempt, up to max.
+#define MAX_RECONNECTS 10
+#define RECONNECT_DELAY_US 10000
+#define RECONNECT_MAX_DELAY_US 500000
+//Return codes of canFeast functions
+#define CANFEAST_OK 0
+#define CANFEAST_ERR_SOCKET -1  //socket() failed
+#define CANFEAST_ERR_CONNECT -2 //canopend not reachable
+#define CANFEAST_ERR_WRITE -3   //command not sent
+#define CANFEAST_ERR_READ -4    //no response, or canopend closed the connection
+//Return code of the state machine. Negative values are canFeast errors.
+#define EXO_STOP 1              //button 3 pressed
 //Base for int to str conversion
 #define DECIMAL 10
 //Exo skeleton user buttons
@@ -56,16 +69,25 @@
  Therefore, it can be used by the calling function for error-handling.
  */
 
-//State machine with sit-stand logic
-void sitStand(int state);
-//For sending socket commands
-static void sendCommand(int fd, char *command, size_t commandLength, char *canReturnMessage);
-//Sets up sockets and calls sendCommand()
-void canFeast (char *buf, char *canReturnMessage);
-//Used to read button status. Returns 1 if button is pressed
+/*
+ Socket errors do not end the program. canFeast() retries the connection to canopend a bounded number
+ of times and returns a CANFEAST_ERR_ code, if all of them fail. The first such error is kept in canFeastError.
+ The state machine checks it in each loop and stops the exo in a controlled way.
+ */
+int canFeastError = CANFEAST_OK;
+
+//State machine with sit-stand logic. Returns EXO_STOP or canFeast error.
+int sitStand(int state);
+//For sending socket commands. Returns CANFEAST_OK or CANFEAST_ERR_ code.
+static int sendCommand(int fd, char *command, size_t commandLength, char *canReturnMessage);
+//Sets up sockets and calls sendCommand(). Returns CANFEAST_OK or CANFEAST_ERR_ code.
+int canFeast (char *buf, char *canReturnMessage);
+//Used to read button status. Returns 1 if button is pressed, 0 if not or on canFeast error.
 int getButton(int button, char *canReturnMessage);
-//Reads position of specified node
-long getPos(int nodeid, char *canReturnMessage);
+//Reads position of specified node. Returns CANFEAST_OK or canFeast error, position is not set then.
+int getPos(int nodeid, long *position);
+//Prints position of the 4 joints.
+void printPos(void);
 //Sets target position of node and moves it to that position.
 void setAbsPosSmart(int nodeide, int position, char *canReturnMessage);
 //Converts integer to string
@@ -77,10 +99,11 @@ void stringExtract(char *origStr, char **extractStr, int pos);
 //Converts strings to integer and returns it.
 long strToInt(char str[]);
 //Sets specified node to preop mode
-void preop(int nodeid);
+int preop(int nodeid);
 //Sets node to start mode and sets it to position move mode.
 void initMotorPos(int nodeid);
-//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true.
+//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true,
+//0 if not or canFeast error, if a position can not be read.
 int checkPos(long hipTarget, long kneeTarget);
 //Sets profile velocity for position mode motion.
 void setProfileVelocity(int nodeid, long velocity);
@@ -93,12 +116,11 @@ void calcAB(long y1, long x1, long y2, long x2, double *A, double *B);
 
 int main (){
     printf("Welcome to CANfeast!\n");
-    sitStand(SITTING);
-    return 0;
+    return (sitStand(SITTING) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 //State machine with sit-stand logic
-void sitStand(int state){
+int sitStand(int state){
 
     //Array of trajectory points from R&D team
     //smallest index is standing
@@ -150,8 +172,8 @@ void sitStand(int state){
     //Should pass this to calling function for possible error handling.
     char junk[STRING_LENGTH];
 
-    while(getButton(BUTTON_FOUR, junk)==0){
-        printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", getPos(LHIP, junk), getPos(LKNEE, junk), getPos(RHIP, junk), getPos(RKNEE, junk));
+    while(getButton(BUTTON_FOUR, junk)==0 && canFeastError==CANFEAST_OK){
+        printPos();
     }
 
     //Initialise 4 joints
@@ -180,10 +202,11 @@ void sitStand(int state){
     int button1Status=0;
     int button2Status=0;
     int button3Status=0;
+    int status=EXO_STOP;
 
 
     //Statemachine loop.
-    //Exits when button 3 is pressed.
+    //Exits when button 3 is pressed or canopend is not reachable.
     //Button 1 sits more, button 2 stands more.
     while(1){
 
@@ -192,6 +215,13 @@ void sitStand(int state){
         button2Status=getButton(BUTTON_TWO, junk);
         button3Status=getButton(BUTTON_THREE, junk);
 
+        //Connection to canopend lost, also after retries. Button states are not valid then.
+        if(canFeastError!=CANFEAST_OK){
+            printf("canopend not reachable (sitstand)\n");
+            status=canFeastError;
+            break;
+        }
+
         //Button has to be pressed & Exo not moving & array not at end. If true, execute move.
         if(button1Status==1 && movestate==0 && sitstate<(arrSize-1)){
             movestate=1;
@@ -204,7 +234,12 @@ void sitStand(int state){
 
         //If target position is reached, then increment sitstate and set movestate to 0.
         if(sitstate<10 && movestate==1){
-            if(checkPos(sitStandArrayHip[sitstate+1], sitStandArrayKnee[sitstate+1])==1){
+            int reached=checkPos(sitStandArrayHip[sitstate+1], sitStandArrayKnee[sitstate+1]);
+            if(reached<0){
+                status=reached;
+                break;
+            }
+            if(reached==1){
                 printf("Position reached.\n");
                 sitstate++;
                 movestate=0;
@@ -223,7 +258,12 @@ void sitStand(int state){
 
         //If target position is reached, then decrease sitstate and set movestate to 0.
         if(sitstate>0 && movestate==1){
-            if(checkPos(sitStandArrayHip[sitstate-1], sitStandArrayKnee[sitstate-1])==1){
+            int reached=checkPos(sitStandArrayHip[sitstate-1], sitStandArrayKnee[sitstate-1]);
+            if(reached<0){
+                status=reached;
+                break;
+            }
+            if(reached==1){
                 printf("Position reached.\n");
                 sitstate--;
                 movestate=0;
@@ -232,19 +272,22 @@ void sitStand(int state){
 
         //if button 3 pressed, then set to preop and exit.
         if(button3Status==1){
-            preop(1);
-            preop(2);
-            preop(3);
-            preop(4);
             break;
         }
     }
+
+    //Single stop path: button 3 or lost connection to canopend. Gives up after the first node,
+    //which canopend can not be reached for.
+    if(status<0)
+        printf("Stopping exo after canFeast error %d\n", status);
+    for(int nodeid=LHIP; nodeid<=RKNEE && preop(nodeid)==CANFEAST_OK; nodeid++);
+    return status;
 }
 
 //Used to read button status. Returns 1 if button is pressed
 int getButton(int button, char *canReturnMessage){
     //char canReturnMessage[STRING_LENGTH];
-    char *buttonMessage;
+    char *buttonMessage = canReturnMessage;
     char *buttonPressed = "0x3F800000";
 
     char buttons[][STRING_LENGTH]=
@@ -254,7 +297,9 @@ int getButton(int button, char *canReturnMessage){
                     "[1] 9 read 0x0103 1 u32", //button 3
                     "[1] 9 read 0x0104 1 u32"//button 4
             };
-    canFeast(buttons[button-1], canReturnMessage);
+    //Not pressed, if canopend is not reachable. Caller checks canFeastError.
+    if(canFeast(buttons[button-1], canReturnMessage)!=CANFEAST_OK)
+        return 0;
 
     //printf("CAN return on button press is: %s", canReturnMessage);
     //Button pressed returns "[1] 0x3F800000\n". Extracting 2nd string to compare.
@@ -269,11 +314,11 @@ int getButton(int button, char *canReturnMessage){
 }
 
 //Reads position of specified node
-long getPos(int nodeid, char *canReturnMessage){
+int getPos(int nodeid, long *position){
     char node[STRING_LENGTH], getpos[STRING_LENGTH], dataType[STRING_LENGTH], buffer[STRING_LENGTH];
     char positionMessage[STRING_LENGTH];
-    char *positionStr;
-    long position;
+    char *positionStr = positionMessage;
+    int err;
 
     //Create a message to be sent using canFeast. "[1] <nodeid> read 0x6063 0 i32"
     //Return should be "[1] <position value>\r"
@@ -284,8 +329,9 @@ long getPos(int nodeid, char *canReturnMessage){
     //concatenate message
     strcat(getpos, node);
     strcat(getpos, dataType);
-    //Send message
-    canFeast(getpos, positionMessage);
+    //Send message. Position is not known, if canopend is not reachable.
+    if((err=canFeast(getpos, positionMessage))!=CANFEAST_OK)
+        return err;
 
     //printf("Position Message for node %d: %s",nodeid, positionMessage);
 
@@ -294,11 +340,21 @@ long getPos(int nodeid, char *canReturnMessage){
     // printf("Extracted Message for node %d: %s\n",nodeid, positionStr);
 
     //Converting string to int
-    position=strToInt(positionStr);
-    // printf("Position of node %d: %ld\n", nodeid, position);
+    *position=strToInt(positionStr);
+    // printf("Position of node %d: %ld\n", nodeid, *position);
 
-    return position;
+    return CANFEAST_OK;
+}
 
+//Prints position of the 4 joints. Nothing is printed, if a position can not be read.
+void printPos(void){
+    long position[4];
+
+    for(int nodeid=LHIP; nodeid<=RKNEE; nodeid++){
+        if(getPos(nodeid, &position[nodeid-LHIP])!=CANFEAST_OK)
+            return;
+    }
+    printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", position[0], position[1], position[2], position[3]);
 }
 
 //Sets target position of node and moves it to that position.
@@ -345,48 +401,77 @@ void setAbsPosSmart(int nodeid, int position, char *canReturnMessage){
         canFeast(commList[i],canReturnMessage);
 }
 
-//Sets up sockets and calls sendCommand()
-void canFeast(char *buf, char *canReturnMessage) {
+//Sets up sockets and calls sendCommand(). Each command has its own connection, so a failed one is
+//retried on a new connection, up to MAX_RECONNECTS times with exponential backoff. Commands are
+//absolute (positions, controlwords, NMT), so sending them twice is harmless.
+int canFeast(char *buf, char *canReturnMessage) {
     char *socketPath = "/tmp/CO_command_socket";  /* Name of the local domain socket, configurable by arguments. */
     int fd;
     struct sockaddr_un addr;
+    useconds_t delay = RECONNECT_DELAY_US;
+    int err = CANFEAST_OK;
 
-    fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd == -1){
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
+    canReturnMessage[0] = '\0';
     memset(&addr, 0, sizeof(struct sockaddr_un));
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
-    // Try to make a connection to the local UNIT AF_UNIX SOCKET, quit if unavailable
-    if (connect(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1){
-        perror("Socket connection failed");
-        exit(EXIT_FAILURE);
+
+    for (int attempt = 0; attempt <= MAX_RECONNECTS; attempt++){
+        if (attempt > 0){
+            usleep(delay);
+            printf("Reconnecting to canopend, attempt %d\n", attempt);
+            delay = (delay * 2 > RECONNECT_MAX_DELAY_US) ? RECONNECT_MAX_DELAY_US : delay * 2;
+        }
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1){
+            perror("Socket creation failed");
+            err = CANFEAST_ERR_SOCKET;
+            continue;
+        }
+        // Try to make a connection to the local UNIT AF_UNIX SOCKET, try again if unavailable
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1){
+            perror("Socket connection failed");
+            close(fd);
+            err = CANFEAST_ERR_CONNECT;
+            continue;
+        }
+        err = sendCommand(fd, buf, strlen(buf),canReturnMessage);
+        //close socket
+        close(fd);
+        if (err == CANFEAST_OK)
+            return CANFEAST_OK;
     }
-    sendCommand(fd, buf, strlen(buf),canReturnMessage);
-    //close socket
-    close(fd);
+
+    if (canFeastError == CANFEAST_OK)
+        canFeastError = err;
+    return err;
 }
 
-//For sending socket commands
-static void sendCommand(int fd, char *command, size_t commandLength, char *canReturnMessage)
+//For sending socket commands. Copies response (at most STRING_LENGTH - 1 chars) into canReturnMessage.
+static int sendCommand(int fd, char *command, size_t commandLength, char *canReturnMessage)
 {
-    size_t n;
+    ssize_t n;
     char buf[BUF_SIZE];
 
-    if (write(fd, command, commandLength) != commandLength){
+    //MSG_NOSIGNAL: closed canopend socket must not kill the program with SIGPIPE
+    if (send(fd, command, commandLength, MSG_NOSIGNAL) != (ssize_t)commandLength){
         perror("Socket write failed");
-        exit(EXIT_FAILURE);
+        return CANFEAST_ERR_WRITE;
     }
 
-    n = read(fd, buf, sizeof(buf));
-    if (n == -1){
+    n = read(fd, buf, sizeof(buf) - 1);
+    if (n <= 0){
+        if (n == 0)
+            errno = ECONNRESET;
         perror("Socket read failed");
-        exit(EXIT_FAILURE);
+        return CANFEAST_ERR_READ;
     }
+    buf[n] = '\0';
     //printf("%s", buf);
-    strcpy(canReturnMessage,buf);
+    strncpy(canReturnMessage, buf, STRING_LENGTH - 1);
+    canReturnMessage[STRING_LENGTH - 1] = '\0';
+    return CANFEAST_OK;
 }
 
 //Definitionof itoa(int to string conversion) and helper Kernighan & Ritchie's Ansi C.
@@ -464,7 +549,7 @@ long strToInt(char str[]){
 }
 
 //set node to preop mode
-void preop(int nodeid){
+int preop(int nodeid){
     char junk[STRING_LENGTH];
     char node[STRING_LENGTH], preop[STRING_LENGTH], dataTail[STRING_LENGTH], buffer[STRING_LENGTH];
 
@@ -477,7 +562,7 @@ void preop(int nodeid){
     strcat(preop, node);
     strcat(preop, dataTail);
     //printf("\nNode %d is now in preop state\n",nodeid);
-    canFeast(preop,junk);
+    return canFeast(preop,junk);
 }
 
 //start motor and set to position mode.
@@ -510,17 +595,19 @@ void initMotorPos(int nodeid){
 
 //Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true.
 int checkPos(long hipTarget, long kneeTarget){
-
-    //The positions could be polled and stored earlier for more readable code. But getpos uses canfeast which has overhead.
-    //Since C support short circuit evaluation, using getPos in if statement is more efficient.
-    char junk[STRING_LENGTH];
-    if(getPos(LHIP, junk) > (hipTarget-POSCLEARANCE) && getPos(LHIP, junk) < (hipTarget+POSCLEARANCE) &&
-       getPos(RHIP, junk) > (hipTarget-POSCLEARANCE) && getPos(RHIP, junk) < (hipTarget+POSCLEARANCE)){
-        if(getPos(LKNEE, junk) > (kneeTarget-POSCLEARANCE) && getPos(LKNEE, junk) < (kneeTarget+POSCLEARANCE) &&
-           getPos(RKNEE, junk) > (kneeTarget-POSCLEARANCE) && getPos(RKNEE, junk) < (kneeTarget+POSCLEARANCE)) {
-            return 1;
-        }
-        return 0;
+    long lhip, lknee, rhip, rknee;
+    int err;
+
+    //Each position is read once. A failed read is returned, it is never compared as a position.
+    if((err=getPos(LHIP, &lhip))!=CANFEAST_OK || (err=getPos(RHIP, &rhip))!=CANFEAST_OK ||
+       (err=getPos(LKNEE, &lknee))!=CANFEAST_OK || (err=getPos(RKNEE, &rknee))!=CANFEAST_OK)
+        return err;
+
+    if(lhip > (hipTarget-POSCLEARANCE) && lhip < (hipTarget+POSCLEARANCE) &&
+       rhip > (hipTarget-POSCLEARANCE) && rhip < (hipTarget+POSCLEARANCE) &&
+       lknee > (kneeTarget-POSCLEARANCE) && lknee < (kneeTarget+POSCLEARANCE) &&
+       rknee > (kneeTarget-POSCLEARANCE) && rknee < (kneeTarget+POSCLEARANCE)){
+        return 1;
     }
     return 0;
 }
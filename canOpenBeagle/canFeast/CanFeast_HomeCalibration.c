@@ -0,0 +1,418 @@
+/*
+ * ALEX Exoskeleton.
+ * Home calibration of the Fourier X2 exoskeleton. Replaces homeCalibration_wPDO.sh.
+ *
+ * Power on with knee and hip fully bent back, let go, then run this program.
+ * All four joints are moved to home, homed and their PDOs set up concurrently.
+ * SDOs go through the parallel command interface of canopend (canopend ... -C ""),
+ * motion is finished when the statusword says so instead of after fixed sleeps.
+ *
+ * Compile: gcc CanFeast_HomeCalibration.c -o homeCalibration
+ * Usage:   ./homeCalibration [-y] [-p <PDOremap program>]
+ *          -y  don't ask for confirmation
+ *          -p  PDO setup program run at the end ("./PDOremap" is default, "" skips it)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <string.h>
+
+//Buffer for socket
+#ifndef BUF_SIZE
+#define BUF_SIZE 1000
+#endif
+//String Length for defining fixed sized char array
+#define STRING_LENGTH 50
+//Node ID for the 4 joints
+#define LHIP 1
+#define LKNEE 2
+#define RHIP 3
+#define RKNEE 4
+#define NUM_JOINTS 4
+//canopend sockets
+#define COMMAND_SOCKET "/tmp/CO_command_socket"
+#define PARALLEL_SOCKET "/tmp/CO_command_socket_parallel"
+//Master node ID, SYNC period set at the end
+#define MASTERNODE 100
+#define SYNC_PERIOD_US 10000
+//Home positions (motor counts) and motion profile used to get there
+#define HOME_HIP 115000
+#define HOME_KNEE -280000
+#define PROFILEVELOCITY 200000
+#define PROFILEACCELERATION 30000
+//Clearance of home position
+#define POSCLEARANCE 10000
+//Statusword (0x6041) bits
+#define SW_FAULT (1 << 3)
+#define SW_TARGET_REACHED (1 << 10)
+#define SW_HOMING_ATTAINED (1 << 12)
+#define SW_HOMING_ERROR (1 << 13)
+//Statusword polling
+#define STATUS_POLL_MS 10
+#define MOVE_TIMEOUT_MS 20000
+#define HOMING_TIMEOUT_MS 5000
+//Maximum number of requests sent in one go
+#define MAX_REQUESTS 32
+
+static const int joints[NUM_JOINTS] = {LHIP, LKNEE, RHIP, RKNEE};
+static const char *jointNames[NUM_JOINTS] = {"left hip", "left knee", "right hip", "right knee"};
+
+//Connects to canopend socket at path. Returns socket or -1.
+int socketUp(const char *path);
+//Sends a single command on the canopend command socket (NMT etc.). Returns 0 on success.
+int canFeastSingle(const char *command);
+//Sends count requests to the parallel socket at once and waits for all responses.
+//values[i] holds the read value. Returns 0 if all requests succeeded.
+int canFeastParallel(int *canSocket, char requests[][STRING_LENGTH], int count, long values[]);
+//Writes the same object with per joint values to all joints.
+int writeAll(int *canSocket, const char *object, const char *type, const long values[]);
+//Reads the same object from all joints.
+int readAll(int *canSocket, const char *object, const char *type, long values[]);
+//Waits until all joints have all bits of mask set in the statusword (and are within
+//POSCLEARANCE of target if given). Returns 0, joint index + 1 of a failed joint, or -1 on timeout.
+int waitStatusAll(int *canSocket, int mask, int errorMask, const long target[], int timeoutMs);
+//Prints actual position of all joints.
+void printPositions(int *canSocket);
+long elapsedMs(struct timeval *start);
+
+static unsigned int sequence = 0;
+
+int main(int argc, char *argv[])
+{
+    char *pdoProgram = "./PDOremap";
+    int confirmed = 0;
+    int opt, socket, failed;
+    long values[NUM_JOINTS];
+    const long home[NUM_JOINTS] = {HOME_HIP, HOME_KNEE, HOME_HIP, HOME_KNEE};
+    struct timeval start;
+    char command[STRING_LENGTH];
+
+    while ((opt = getopt(argc, argv, "yp:")) != -1)
+    {
+        if (opt == 'y')
+            confirmed = 1;
+        else if (opt == 'p')
+            pdoProgram = optarg;
+        else
+        {
+            fprintf(stderr, "Usage: %s [-y] [-p <PDOremap program>]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!confirmed)
+    {
+        char answer[STRING_LENGTH];
+
+        printf("WARNING:\n");
+        printf("Run this program only if you powered on Exo with knee and hip fully bent back.\n");
+        printf("Do you want to proceed(y/n):\n");
+        if (fgets(answer, sizeof(answer), stdin) == NULL || answer[0] != 'y')
+        {
+            printf("Exiting\n");
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    socket = socketUp(PARALLEL_SOCKET);
+    if (socket < 0)
+    {
+        fprintf(stderr, "Start canopend with the parallel command interface (-C \"\")\n");
+        exit(EXIT_FAILURE);
+    }
+    gettimeofday(&start, NULL);
+
+    //Go from preop to start mode
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        snprintf(command, sizeof(command), "[1] %d start", joints[i]);
+        canFeastSingle(command);
+    }
+    printPositions(&socket);
+
+    //MOVING
+    //Position mode, profile and home position, then start motion by toggling new setpoint bit.
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 1;
+    failed = writeAll(&socket, "0x6060 0", "i8", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = PROFILEVELOCITY;
+    failed |= writeAll(&socket, "0x6081 0", "i32", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = PROFILEACCELERATION;
+    failed |= writeAll(&socket, "0x6083 0", "i32", values);
+    failed |= writeAll(&socket, "0x6084 0", "i32", values);
+    failed |= writeAll(&socket, "0x607A 0", "i32", home);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 47;
+    failed |= writeAll(&socket, "0x6040 0", "i16", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 63;
+    failed |= writeAll(&socket, "0x6040 0", "i16", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 47;
+    failed |= writeAll(&socket, "0x6040 0", "i16", values);
+    if (failed)
+    {
+        fprintf(stderr, "Setting up move to home failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Going to home\n");
+    failed = waitStatusAll(&socket, SW_TARGET_REACHED, SW_FAULT, home, MOVE_TIMEOUT_MS);
+    if (failed != 0)
+    {
+        if (failed > 0)
+            fprintf(stderr, "Move to home failed on %s\n", jointNames[failed - 1]);
+        else
+            fprintf(stderr, "Move to home timed out\n");
+        exit(EXIT_FAILURE);
+    }
+    printPositions(&socket);
+    printf("Reached home in %ld ms. Homing now\n", elapsedMs(&start));
+
+    //HOMING
+    //Homing mode (6), home is current position, no offset, then start homing.
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 6;
+    failed = writeAll(&socket, "0x6060 0", "i8", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 0;
+    failed |= writeAll(&socket, "0x6098 0", "i8", values);
+    failed |= writeAll(&socket, "0x607C 0", "i32", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 15;
+    failed |= writeAll(&socket, "0x6040 0", "i16", values);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 31;
+    failed |= writeAll(&socket, "0x6040 0", "i16", values);
+    if (failed)
+    {
+        fprintf(stderr, "Setting up homing failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    failed = waitStatusAll(&socket, SW_HOMING_ATTAINED | SW_TARGET_REACHED, SW_FAULT | SW_HOMING_ERROR, NULL, HOMING_TIMEOUT_MS);
+    for (int i = 0; i < NUM_JOINTS; i++)
+        values[i] = 15;
+    writeAll(&socket, "0x6040 0", "i16", values);
+    if (failed != 0)
+    {
+        if (failed > 0)
+            fprintf(stderr, "Homing failed on %s\n", jointNames[failed - 1]);
+        else
+            fprintf(stderr, "Homing timed out\n");
+        exit(EXIT_FAILURE);
+    }
+    printPositions(&socket);
+    close(socket);
+
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        snprintf(command, sizeof(command), "[1] %d preop", joints[i]);
+        canFeastSingle(command);
+    }
+    printf("Home calibration done in %ld ms.\n", elapsedMs(&start));
+
+    //PDO setup, PDOremap also starts the nodes and clears controlwords.
+    if (strlen(pdoProgram) > 0)
+    {
+        printf("Setting up PDOs\n");
+        if (system(pdoProgram) != 0)
+        {
+            fprintf(stderr, "PDO setup failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //set sync timing to 100hz
+    snprintf(command, sizeof(command), "[1] %d write 0x1006 0 u32 %d", MASTERNODE, SYNC_PERIOD_US);
+    canFeastSingle(command);
+
+    printf("Done in %ld ms.\n", elapsedMs(&start));
+    return 0;
+}
+
+int socketUp(const char *path)
+{
+    struct sockaddr_un addr;
+    int canSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (canSocket == -1)
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(canSocket, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
+    {
+        perror("Socket connection failed");
+        close(canSocket);
+        return -1;
+    }
+    return canSocket;
+}
+
+int canFeastSingle(const char *command)
+{
+    char buf[BUF_SIZE];
+    int canSocket = socketUp(COMMAND_SOCKET);
+    int commandLength = strlen(command);
+    ssize_t n;
+
+    if (canSocket < 0)
+        return -1;
+
+    if (write(canSocket, command, commandLength) != commandLength)
+    {
+        perror("Socket write failed");
+        close(canSocket);
+        return -1;
+    }
+    n = read(canSocket, buf, sizeof(buf) - 1);
+    close(canSocket);
+    if (n <= 0)
+    {
+        perror("Socket read failed");
+        return -1;
+    }
+    buf[n] = 0;
+    if (strstr(buf, "ERROR") != NULL)
+    {
+        fprintf(stderr, "%s: %s", command, buf);
+        return -1;
+    }
+    return 0;
+}
+
+int canFeastParallel(int *canSocket, char requests[][STRING_LENGTH], int count, long values[])
+{
+    char out[MAX_REQUESTS * (STRING_LENGTH + 16)];
+    char in[BUF_SIZE];
+    unsigned int firstSeq = sequence + 1;
+    int pending = count, len = 0, inLen = 0, ret = 0;
+
+    //"[<seq>] <request>\n" for all, responses come back as each transfer is done.
+    for (int i = 0; i < count; i++)
+        len += snprintf(out + len, sizeof(out) - len, "[%u] %s\n", ++sequence, requests[i]);
+
+    if (write(*canSocket, out, len) != len)
+    {
+        perror("Socket write failed");
+        return -1;
+    }
+
+    while (pending > 0)
+    {
+        char *line, *nl;
+        ssize_t n = read(*canSocket, in + inLen, sizeof(in) - 1 - inLen);
+
+        if (n <= 0)
+        {
+            perror("Socket read failed");
+            return -1;
+        }
+        inLen += n;
+        in[inLen] = 0;
+
+        line = in;
+        while ((nl = strchr(line, '\n')) != NULL)
+        {
+            unsigned int seq;
+            int pos = 0;
+
+            *nl = 0;
+            if (sscanf(line, "[%u] %n", &seq, &pos) >= 1 && pos > 0 && seq >= firstSeq && seq < firstSeq + count)
+            {
+                int i = seq - firstSeq;
+
+                if (strncmp(line + pos, "ERROR", 5) == 0)
+                {
+                    fprintf(stderr, "%s: %s\n", requests[i], line + pos);
+                    ret = -1;
+                }
+                else if (values != NULL)
+                    values[i] = strtol(line + pos, NULL, 0);
+                pending--;
+            }
+            line = nl + 1;
+        }
+        inLen -= line - in;
+        memmove(in, line, inLen);
+    }
+    return ret;
+}
+
+int writeAll(int *canSocket, const char *object, const char *type, const long values[])
+{
+    char requests[NUM_JOINTS][STRING_LENGTH];
+
+    for (int i = 0; i < NUM_JOINTS; i++)
+        snprintf(requests[i], STRING_LENGTH, "%d write %s %s %ld", joints[i], object, type, values[i]);
+    return canFeastParallel(canSocket, requests, NUM_JOINTS, NULL);
+}
+
+int readAll(int *canSocket, const char *object, const char *type, long values[])
+{
+    char requests[NUM_JOINTS][STRING_LENGTH];
+
+    for (int i = 0; i < NUM_JOINTS; i++)
+        snprintf(requests[i], STRING_LENGTH, "%d read %s %s", joints[i], object, type);
+    return canFeastParallel(canSocket, requests, NUM_JOINTS, values);
+}
+
+int waitStatusAll(int *canSocket, int mask, int errorMask, const long target[], int timeoutMs)
+{
+    struct timeval start;
+    long status[NUM_JOINTS], position[NUM_JOINTS];
+
+    gettimeofday(&start, NULL);
+    while (elapsedMs(&start) < timeoutMs)
+    {
+        int done = 1;
+
+        if (readAll(canSocket, "0x6041 0", "u16", status) != 0)
+            return -1;
+        if (target != NULL && readAll(canSocket, "0x6064 0", "i32", position) != 0)
+            return -1;
+
+        for (int i = 0; i < NUM_JOINTS; i++)
+        {
+            if (status[i] & errorMask)
+                return i + 1;
+            if ((status[i] & mask) != mask)
+                done = 0;
+            //Target reached may still be set from before the new setpoint.
+            if (target != NULL && labs(position[i] - target[i]) > POSCLEARANCE)
+                done = 0;
+        }
+        if (done)
+            return 0;
+        usleep(STATUS_POLL_MS * 1000);
+    }
+    return -1;
+}
+
+void printPositions(int *canSocket)
+{
+    long position[NUM_JOINTS];
+
+    if (readAll(canSocket, "0x6063 0", "i32", position) != 0)
+        return;
+    for (int i = 0; i < NUM_JOINTS; i++)
+        printf("current %s value: %ld\n", jointNames[i], position[i]);
+}
+
+long elapsedMs(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
@@ -9,6 +9,7 @@
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <errno.h>
 
 //Buffer for socket
 #ifndef BUF_SIZE
@@ -16,7 +17,18 @@
 #endif
 //String Length for defining fixed sized char array
 #define STRING_LENGTH 50
+//Reconnect attempts to canopend before a command fails. Delay is doubled after each attempt, up to max.
 #define MAX_RECONNECTS 10
+#define RECONNECT_DELAY_US 10000
+#define RECONNECT_MAX_DELAY_US 500000
+//Return codes of canFeast functions
+#define CANFEAST_OK 0
+#define CANFEAST_ERR_SOCKET -1  //socket() failed
+#define CANFEAST_ERR_CONNECT -2 //canopend not reachable
+#define CANFEAST_ERR_WRITE -3   //command not sent
+#define CANFEAST_ERR_READ -4    //no response, or canopend closed the connection
+//Return code of the state machine. Negative values are canFeast errors.
+#define EXO_STOP 1              //button 3 pressed
 //Base for int to str conversion
 #define DECIMAL 10
 //Exo skeleton user buttons
@@ -34,6 +46,14 @@
 //Velocity and acceleration for position mode move
 #define PROFILEVELOCITY 200000
 #define PROFILEACCELERATION 40000
+//Node ID of canopend. Profile parameters of all joints are written through its OD entry 0x2110.
+#define MASTERNODE 100
+//0x2110 sub 1..12 hold velocity, acceleration & deceleration of each joint, sub 13 starts the write.
+#define DRIVEPARAM_SUB_CTRL 13
+#define DRIVEPARAM_BUSY 1
+#define DRIVEPARAM_FAILED (-1000) //ERROR reply or timeout, not a node ID
+#define DRIVEPARAM_POLL_US 1000
+#define DRIVEPARAM_TIMEOUT_US 2000000
 //Knee motor reading and corresponding angle. Used for mapping between degree and motor values.
 #define KNEE_MOTOR_POS1 250880
 #define KNEE_MOTOR_DEG1 90
@@ -60,17 +80,26 @@
  Therefore, it can be used by the calling function for error-handling.
  */
 
-//State machine with sit-stand logic
-void sitStand(int state);
-//For sending socket commands
-void canFeastUp(int *canSocket);
-void canFeast(int *canSocket, char *command, char *canReturnMessage);
+/*
+ Socket errors do not end the program. canFeast() reconnects to canopend with bounded retries
+ and returns a CANFEAST_ERR_ code, if all of them fail. The first such error is kept in canFeastError.
+ The state machine checks it in each loop and stops the exo in a controlled way.
+ */
+int canFeastError = CANFEAST_OK;
+
+//State machine with sit-stand logic. Returns EXO_STOP or canFeast error.
+int sitStand(int state);
+//For sending socket commands. Return CANFEAST_OK or CANFEAST_ERR_ code.
+int canFeastUp(int *canSocket);
+int canFeast(int *canSocket, char *command, char *canReturnMessage);
 void canFeastDown(int *canSocket);
-void canFeastErrorHandler(int *canSocket, char *command, char *canReturnMessage);
-//Used to read button status. Returns 1 if button is pressed
+int canFeastReconnect(int *canSocket);
+//Used to read button status. Returns 1 if button is pressed, 0 if not or on canFeast error.
 int getButton(int *canSocket, int button, char *canReturnMessage);
-//Reads position of specified node
-long getPos(int *canSocket, int nodeid, char *canReturnMessage);
+//Reads position of specified node. Returns CANFEAST_OK or canFeast error, position is not set then.
+int getPos(int *canSocket, int nodeid, long *position);
+//Prints position of the 4 joints.
+void printPos(int *canSocket);
 //Sets target position of node and moves it to that position.
 void setAbsPosSmart(int *canSocket, int nodeide, int position, char *canReturnMessage);
 //Converts integer to string
@@ -82,15 +111,18 @@ void stringExtract(char *origStr, char **extractStr, int pos);
 //Converts strings to integer and returns it.
 long strToInt(char str[]);
 //Sets specified node to preop mode
-void preop(int *canSocket, int nodeid);
+int preop(int *canSocket, int nodeid);
 //Sets node to start mode and sets it to position move mode.
 void initMotorPos(int *canSocket, int nodeid);
-//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true.
+//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true,
+//0 if not or canFeast error, if a position can not be read.
 int checkPos(int *canSocket, long hipTarget, long kneeTarget);
 //Sets profile velocity for position mode motion.
 void setProfileVelocity(int *canSocket, int nodeid, long velocity);
 //Sets profile acceleration and deceleration for position mode motion.
 void setProfileAcceleration(int *canSocket, int nodeid, long acceleration);
+//Sets profile velocity, acceleration & deceleration of all joints through canopend.
+void setDriveParams(int *canSocket, long velocity, long acceleration);
 //Used to convert position array from degrees to motors counts as used in CANopen
 void motorPosArrayConverter(const double origArr[], long newArr[], int arrSize, int nodeid);
 //calculate A and B in the formula y=Ax+B. Use by motorPosArrayConverter()
@@ -99,12 +131,11 @@ void calcAB(long y1, long x1, long y2, long x2, double *A, double *B);
 int main()
 {
     printf("Welcome to CANfeast!\n");
-    sitStand(SITTING);
-    return 0;
+    return (sitStand(SITTING) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 //State machine with sit-stand logic
-void sitStand(int state)
+int sitStand(int state)
 {
     //Array of trajectory points from R&D team
     //smallest index is standing
@@ -155,14 +186,15 @@ void sitStand(int state)
 
     // Set up socket to canOpend
     int socket;
-    canFeastUp(&socket);
+    if (canFeastUp(&socket) != CANFEAST_OK)
+        return CANFEAST_ERR_CONNECT;
     //Used to store the canReturnMessage. Not used currently, hence called junk.
     //Should pass this to calling function for possible error handling.
     char junk[STRING_LENGTH];
 
-    while (getButton(&socket, BUTTON_FOUR, junk) == 0)
+    while (getButton(&socket, BUTTON_FOUR, junk) == 0 && canFeastError == CANFEAST_OK)
     {
-        printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", getPos(&socket, LHIP, junk), getPos(&socket, LKNEE, junk), getPos(&socket, RHIP, junk), getPos(&socket, RKNEE, junk));
+        printPos(&socket);
     }
 
     //Initialise 4 joints
@@ -172,14 +204,7 @@ void sitStand(int state)
     initMotorPos(&socket, RKNEE);
 
     //Sets profile velocity, acceleration & deceleration for the joints.
-    setProfileAcceleration(&socket, LHIP, PROFILEACCELERATION);
-    setProfileVelocity(&socket, LHIP, PROFILEVELOCITY);
-    setProfileAcceleration(&socket, LKNEE, PROFILEACCELERATION);
-    setProfileVelocity(&socket, LKNEE, PROFILEVELOCITY);
-    setProfileAcceleration(&socket, RHIP, PROFILEACCELERATION);
-    setProfileVelocity(&socket, RHIP, PROFILEVELOCITY);
-    setProfileAcceleration(&socket, RKNEE, PROFILEACCELERATION);
-    setProfileVelocity(&socket, RKNEE, PROFILEVELOCITY);
+    setDriveParams(&socket, PROFILEVELOCITY, PROFILEACCELERATION);
 
     //Use to maintain states.
     //sitstate goes from 0 to 10, indicating the 11 indices of the sitstandArrays
@@ -191,9 +216,10 @@ void sitStand(int state)
     int button1Status = 0;
     int button2Status = 0;
     int button3Status = 0;
+    int status = EXO_STOP;
 
     //Statemachine loop.
-    //Exits when button 3 is pressed.
+    //Exits when button 3 is pressed or canopend is not reachable.
     //Button 1 sits more, button 2 stands more.
     while (1)
     {
@@ -203,6 +229,14 @@ void sitStand(int state)
         button2Status = getButton(&socket, BUTTON_TWO, junk);
         button3Status = getButton(&socket, BUTTON_THREE, junk);
 
+        //Connection to canopend lost, also after reconnect attempts. Button states are not valid then.
+        if (canFeastError != CANFEAST_OK)
+        {
+            printf("canopend not reachable (sitstand)\n");
+            status = canFeastError;
+            break;
+        }
+
         //Button has to be pressed & Exo not moving & array not at end. If true, execute move.
         if (button1Status == 1 && movestate == STATEIMMOBILE && sitstate < (arrSize - 1))
         {
@@ -217,7 +251,13 @@ void sitStand(int state)
         //If target position is reached, then increment sitstate and set movestate to 0.
         if (sitstate < (arrSize-1) && movestate == STATESITTING)
         {
-            if (checkPos(&socket, sitStandArrayHip[sitstate + 1], sitStandArrayKnee[sitstate + 1]) == 1)
+            int reached = checkPos(&socket, sitStandArrayHip[sitstate + 1], sitStandArrayKnee[sitstate + 1]);
+            if (reached < 0)
+            {
+                status = reached;
+                break;
+            }
+            if (reached == 1)
             {
                 printf("Position reached.\n");
                 sitstate++;
@@ -239,7 +279,13 @@ void sitStand(int state)
         //If target position is reached, then decrease sitstate and set movestate to 0.
         if (sitstate > 0 && movestate == STATESTANDING)
         {
-            if (checkPos(&socket, sitStandArrayHip[sitstate - 1], sitStandArrayKnee[sitstate - 1]) == 1)
+            int reached = checkPos(&socket, sitStandArrayHip[sitstate - 1], sitStandArrayKnee[sitstate - 1]);
+            if (reached < 0)
+            {
+                status = reached;
+                break;
+            }
+            if (reached == 1)
             {
                 printf("Position reached.\n");
                 sitstate--;
@@ -250,21 +296,24 @@ void sitStand(int state)
         //if button 3 pressed, then set to preop and exit.
         if (button3Status == 1)
         {
-            preop(&socket, LHIP);
-            preop(&socket, LKNEE);
-            preop(&socket, RHIP);
-            preop(&socket, RKNEE);
             break;
         }
     }
+
+    //Single stop path: button 3 or lost connection to canopend. Gives up after the first node,
+    //which canopend can not be reached for.
+    if (status < 0)
+        printf("Stopping exo after canFeast error %d\n", status);
+    for (int nodeid = LHIP; nodeid <= RKNEE && preop(&socket, nodeid) == CANFEAST_OK; nodeid++);
     canFeastDown(&socket);
+    return status;
 }
 
 //Used to read button status. Returns 1 if button is pressed
 int getButton(int *canSocket, int button, char *canReturnMessage)
 {
     //char canReturnMessage[STRING_LENGTH];
-    char *buttonMessage;
+    char *buttonMessage = canReturnMessage;
     char *buttonPressed = "0x3F800000";
 
     char buttons[][STRING_LENGTH] =
@@ -274,7 +323,9 @@ int getButton(int *canSocket, int button, char *canReturnMessage)
             "[1] 9 read 0x0103 1 u32", //button 3
             "[1] 9 read 0x0104 1 u32"  //button 4
         };
-    canFeast(canSocket, buttons[button - 1], canReturnMessage);
+    //Not pressed, if canopend is not reachable. Caller checks canFeastError.
+    if (canFeast(canSocket, buttons[button - 1], canReturnMessage) != CANFEAST_OK)
+        return 0;
 
     //printf("CAN return on button press is: %s", canReturnMessage);
     //Button pressed returns "[1] 0x3F800000\n". Extracting 2nd string to compare.
@@ -289,12 +340,12 @@ int getButton(int *canSocket, int button, char *canReturnMessage)
 }
 
 //Reads position of specified node
-long getPos(int *canSocket, int nodeid, char *canReturnMessage)
+int getPos(int *canSocket, int nodeid, long *position)
 {
     char node[STRING_LENGTH], getpos[STRING_LENGTH], dataType[STRING_LENGTH], buffer[STRING_LENGTH];
     char positionMessage[STRING_LENGTH];
-    char *positionStr;
-    long position;
+    char *positionStr = positionMessage;
+    int err;
 
     //Create a message to be sent using canFeast. "[1] <nodeid> read 0x6063 0 i32"
     //Return should be "[1] <position value>\r"
@@ -305,8 +356,9 @@ long getPos(int *canSocket, int nodeid, char *canReturnMessage)
     //concatenate message
     strcat(getpos, node);
     strcat(getpos, dataType);
-    //Send message
-    canFeast(canSocket, getpos, positionMessage);
+    //Send message. Position is not known, if canopend is not reachable.
+    if ((err = canFeast(canSocket, getpos, positionMessage)) != CANFEAST_OK)
+        return err;
 
     //printf("Position Message for node %d: %s",nodeid, positionMessage);
 
@@ -315,10 +367,23 @@ long getPos(int *canSocket, int nodeid, char *canReturnMessage)
     // printf("Extracted Message for node %d: %s\n",nodeid, positionStr);
 
     //Converting string to int
-    position = strToInt(positionStr);
-    // printf("Position of node %d: %ld\n", nodeid, position);
+    *position = strToInt(positionStr);
+    // printf("Position of node %d: %ld\n", nodeid, *position);
 
-    return position;
+    return CANFEAST_OK;
+}
+
+//Prints position of the 4 joints. Nothing is printed, if a position can not be read.
+void printPos(int *canSocket)
+{
+    long position[4];
+
+    for (int nodeid = LHIP; nodeid <= RKNEE; nodeid++)
+    {
+        if (getPos(canSocket, nodeid, &position[nodeid - LHIP]) != CANFEAST_OK)
+            return;
+    }
+    printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", position[0], position[1], position[2], position[3]);
 }
 
 //Sets target position of node and moves it to that position.
@@ -368,7 +433,7 @@ void setAbsPosSmart(int *canSocket, int nodeid, int position, char *canReturnMes
 
 // Creates a socket connection to canopend using a pointer to int socket
 
-void canFeastUp(int *canSocket)
+int canFeastUp(int *canSocket)
 {
     char *socketPath = "/tmp/CO_command_socket"; /* Name of the local domain socket, configurable by arguments. */
     struct sockaddr_un addr;
@@ -377,85 +442,94 @@ void canFeastUp(int *canSocket)
     if (*canSocket == -1)
     {
         perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+        return CANFEAST_ERR_SOCKET;
     }
     memset(&addr, 0, sizeof(struct sockaddr_un));
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
-    // Try to make a connection to the local UNIT AF_UNIX SOCKET, quit if unavailable
+    // Try to make a connection to the local UNIT AF_UNIX SOCKET, caller decides what to do if unavailable
     if (connect(*canSocket, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
     {
         perror("Socket connection failed");
-        exit(EXIT_FAILURE);
+        close(*canSocket);
+        *canSocket = -1;
+        return CANFEAST_ERR_CONNECT;
     }
+    return CANFEAST_OK;
 }
 void canFeastDown(int *canSocket)
 {
     printf("closing socket...\n");
     //close socket
-    close(*canSocket);
+    if (*canSocket != -1)
+        close(*canSocket);
+    *canSocket = -1;
     printf("socket close\n");
 }
-void canFeast(int *canSocket, char *command, char *canReturnMessage)
+// Sends command and copies response (at most STRING_LENGTH - 1 chars) into canReturnMessage.
+// On socket errors reconnects and sends the command again. Commands are absolute (positions,
+// controlwords, NMT), so sending them twice is harmless.
+int canFeast(int *canSocket, char *command, char *canReturnMessage)
 {
     int commandLength = strlen(command);
-    size_t n;
+    ssize_t n;
     char buf[BUF_SIZE];
+    int err = CANFEAST_OK;
 
-    if (write(*canSocket, command, commandLength) != commandLength)
+    canReturnMessage[0] = '\0';
+    //Second attempt only after a successful reconnect, which has its own bounded retries.
+    for (int attempt = 0; attempt < 2; attempt++)
     {
-        perror("Socket write failed");
-        exit(EXIT_FAILURE);
-    }
+        if (attempt > 0 && (err = canFeastReconnect(canSocket)) != CANFEAST_OK)
+            break;
 
-    n = read(*canSocket, buf, sizeof(buf));
-    if (n == -1)
-    {
-        perror("Socket read failed");
-        close(*canSocket);
-        exit(EXIT_FAILURE);
+        //MSG_NOSIGNAL: closed canopend socket must not kill the program with SIGPIPE
+        if (send(*canSocket, command, commandLength, MSG_NOSIGNAL) != commandLength)
+        {
+            perror("Socket write failed");
+            err = CANFEAST_ERR_WRITE;
+            continue;
+        }
+
+        n = read(*canSocket, buf, sizeof(buf) - 1);
+        if (n <= 0)
+        {
+            if (n == 0)
+                errno = ECONNRESET;
+            perror("Socket read failed");
+            err = CANFEAST_ERR_READ;
+            continue;
+        }
+        buf[n] = '\0';
+        //printf("%s", buf);
+        strncpy(canReturnMessage, buf, STRING_LENGTH - 1);
+        canReturnMessage[STRING_LENGTH - 1] = '\0';
+        return CANFEAST_OK;
     }
-    //printf("%s", buf);
-    strcpy(canReturnMessage, buf);
+
+    if (canFeastError == CANFEAST_OK)
+        canFeastError = err;
+    return err;
 }
-// Error handling -> reset socket and try again when sockets fail.
-void canFeastErrorHandler(int *canSocket, char *command, char *canReturnMessage)
+// Replaces the connection to canopend. Retries up to MAX_RECONNECTS times with exponential backoff.
+int canFeastReconnect(int *canSocket)
 {
-    int commandLength = strlen(command);
-    int recconects;
-    size_t n;
-    char buf[BUF_SIZE];
+    useconds_t delay = RECONNECT_DELAY_US;
+    int err = CANFEAST_ERR_CONNECT;
 
-    if (write(*canSocket, command, commandLength) != commandLength)
-    {
-        perror("Socket write failed, attempting again");
-        canFeast(canSocket, command, canReturnMessage);
-    }
-    while ((write(*canSocket, command, commandLength) != commandLength) && recconects != MAX_RECONNECTS)
-    {
-        perror("Socket write failed, attempting again");
-        //shut down socket
-        canFeastDown(canSocket);
-        //recreate socket
-        canFeastUp(canSocket);
-        recconects++;
-        // try to send again
-    }
+    if (*canSocket != -1)
+        close(*canSocket);
+    *canSocket = -1;
 
-    n = read(*canSocket, buf, sizeof(buf));
-    if (n == -1)
+    for (int recconects = 0; recconects < MAX_RECONNECTS; recconects++)
     {
-        perror("Socket read failed, attempting to send command again");
-        //shut down socket
-        canFeastDown(canSocket);
-        //recreate socket
-        canFeastUp(canSocket);
-        // try to send again
-        canFeast(canSocket, command, canReturnMessage);
-        exit(EXIT_FAILURE);
+        usleep(delay);
+        printf("Reconnecting to canopend, attempt %d\n", recconects + 1);
+        if ((err = canFeastUp(canSocket)) == CANFEAST_OK)
+            return CANFEAST_OK;
+        delay = (delay * 2 > RECONNECT_MAX_DELAY_US) ? RECONNECT_MAX_DELAY_US : delay * 2;
     }
-    printf("%s", buf);
-    strcpy(canReturnMessage, buf);
+    return err;
 }
 
 //Definitionof itoa(int to string conversion) and helper Kernighan & Ritchie's Ansi C.
@@ -540,7 +614,7 @@ long strToInt(char str[])
 }
 
 //set node to preop mode
-void preop(int *canSocket, int nodeid)
+int preop(int *canSocket, int nodeid)
 {
     char junk[STRING_LENGTH];
     char node[STRING_LENGTH], preop[STRING_LENGTH], dataTail[STRING_LENGTH], buffer[STRING_LENGTH];
@@ -554,7 +628,7 @@ void preop(int *canSocket, int nodeid)
     strcat(preop, node);
     strcat(preop, dataTail);
     //printf("\nNode %d is now in preop state\n",nodeid);
-    canFeast(canSocket, preop, junk);
+    return canFeast(canSocket, preop, junk);
 }
 
 //start motor and set to position mode.
@@ -589,19 +663,20 @@ void initMotorPos(int *canSocket, int nodeid)
 //Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true.
 int checkPos(int *canSocket, long hipTarget, long kneeTarget)
 {
-
-    //The positions could be polled and stored earlier for more readable code. But getpos uses canfeast which has overhead.
-    //Since C support short circuit evaluation, using getPos in if statement is more efficient.
-    char junk[STRING_LENGTH];
-    if (getPos(canSocket, LHIP, junk) > (hipTarget - POSCLEARANCE) && getPos(canSocket, LHIP, junk) < (hipTarget + POSCLEARANCE) &&
-        getPos(canSocket, RHIP, junk) > (hipTarget - POSCLEARANCE) && getPos(canSocket, RHIP, junk) < (hipTarget + POSCLEARANCE))
+    long lhip, lknee, rhip, rknee;
+    int err;
+
+    //Each position is read once. A failed read is returned, it is never compared as a position.
+    if ((err = getPos(canSocket, LHIP, &lhip)) != CANFEAST_OK || (err = getPos(canSocket, RHIP, &rhip)) != CANFEAST_OK ||
+        (err = getPos(canSocket, LKNEE, &lknee)) != CANFEAST_OK || (err = getPos(canSocket, RKNEE, &rknee)) != CANFEAST_OK)
+        return err;
+
+    if (lhip > (hipTarget - POSCLEARANCE) && lhip < (hipTarget + POSCLEARANCE) &&
+        rhip > (hipTarget - POSCLEARANCE) && rhip < (hipTarget + POSCLEARANCE) &&
+        lknee > (kneeTarget - POSCLEARANCE) && lknee < (kneeTarget + POSCLEARANCE) &&
+        rknee > (kneeTarget - POSCLEARANCE) && rknee < (kneeTarget + POSCLEARANCE))
     {
-        if (getPos(canSocket, LKNEE, junk) > (kneeTarget - POSCLEARANCE) && getPos(canSocket, LKNEE, junk) < (kneeTarget + POSCLEARANCE) &&
-            getPos(canSocket, RKNEE, junk) > (kneeTarget - POSCLEARANCE) && getPos(canSocket, RKNEE, junk) < (kneeTarget + POSCLEARANCE))
-        {
-            return 1;
-        }
-        return 0;
+        return 1;
     }
     return 0;
 }
@@ -661,6 +736,99 @@ void setProfileAcceleration(int *canSocket, int nodeid, long acceleration)
     canFeast(canSocket, commDec, junk);
 }
 
+//Sets profile velocity, acceleration & deceleration of all 4 joints in one go.
+//Values go to 0x2110 of canopend, which then writes all the drives concurrently.
+//Falls back to joint by joint writes if canopend reports a failed drive.
+void setDriveParams(int *canSocket, long velocity, long acceleration)
+{
+    char comm[STRING_LENGTH], buffer[STRING_LENGTH], master[STRING_LENGTH];
+    char canReturnMessage[STRING_LENGTH];
+    char *statusMessage = NULL;
+    long values[3] = {velocity, acceleration, acceleration};
+    long status = 0;
+    int sub = 1;
+
+    itoa(MASTERNODE, master, DECIMAL);
+
+    //"[1] 100 write 0x2110 <sub> i32 <value>", velocity, acceleration & deceleration for each joint.
+    //Any failed write falls back to writing the joints one by one.
+    for (int nodeid = LHIP; nodeid <= RKNEE && status == 0; nodeid++)
+    {
+        for (int i = 0; i < 3 && status == 0; i++, sub++)
+        {
+            strcpy(comm, "[1] ");
+            strcat(comm, master);
+            strcat(comm, " write 0x2110 ");
+            itoa(sub, buffer, DECIMAL);
+            strcat(comm, buffer);
+            strcat(comm, " i32 ");
+            itoa(values[i], buffer, DECIMAL);
+            strcat(comm, buffer);
+            if (canFeast(canSocket, comm, canReturnMessage) != CANFEAST_OK || strstr(canReturnMessage, "ERROR") != NULL)
+                status = DRIVEPARAM_FAILED;
+        }
+    }
+
+    //Start the write: "[1] 100 write 0x2110 13 i32 1"
+    if (status == 0)
+    {
+        strcpy(comm, "[1] ");
+        strcat(comm, master);
+        strcat(comm, " write 0x2110 ");
+        itoa(DRIVEPARAM_SUB_CTRL, buffer, DECIMAL);
+        strcat(comm, buffer);
+        strcat(comm, " i32 1");
+        if (canFeast(canSocket, comm, canReturnMessage) != CANFEAST_OK || strstr(canReturnMessage, "ERROR") != NULL)
+            status = DRIVEPARAM_FAILED;
+    }
+
+    //Poll "[1] 100 read 0x2110 13 i32" until done. Returns 1 while busy, 0 when done or -nodeid on failure.
+    strcpy(comm, "[1] ");
+    strcat(comm, master);
+    strcat(comm, " read 0x2110 ");
+    itoa(DRIVEPARAM_SUB_CTRL, buffer, DECIMAL);
+    strcat(comm, buffer);
+    strcat(comm, " i32");
+    //Reply is "[1] <status>" or "[1] ERROR: <abort code>". Give up after DRIVEPARAM_TIMEOUT_US.
+    for (long waited = 0; status == 0 || status == DRIVEPARAM_BUSY; waited += DRIVEPARAM_POLL_US)
+    {
+        usleep(DRIVEPARAM_POLL_US);
+        if (canFeast(canSocket, comm, canReturnMessage) != CANFEAST_OK || strstr(canReturnMessage, "ERROR") != NULL)
+        {
+            status = DRIVEPARAM_FAILED;
+            break;
+        }
+        statusMessage = NULL;
+        stringExtract(canReturnMessage, &statusMessage, 2);
+        if (statusMessage == NULL)
+        {
+            status = DRIVEPARAM_FAILED;
+            break;
+        }
+        status = strToInt(statusMessage);
+        if (status != DRIVEPARAM_BUSY)
+            break;
+        if (waited >= DRIVEPARAM_TIMEOUT_US)
+        {
+            status = DRIVEPARAM_FAILED;
+            break;
+        }
+    }
+
+    if (status != 0)
+    {
+        if (status == DRIVEPARAM_FAILED)
+            printf("Profile parameters not confirmed by canopend, writing joints one by one\n");
+        else
+            printf("Profile parameters failed on node %ld, writing joints one by one\n", -status);
+        for (int nodeid = LHIP; nodeid <= RKNEE; nodeid++)
+        {
+            setProfileAcceleration(canSocket, nodeid, acceleration);
+            setProfileVelocity(canSocket, nodeid, velocity);
+        }
+    }
+}
+
 //Used to convert position array from degrees to motors counts as used in CANopen
 void motorPosArrayConverter(const double origArr[], long newArr[], int arrSize, int nodeid)
 {
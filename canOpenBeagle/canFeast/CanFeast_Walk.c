@@ -9,6 +9,7 @@
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <errno.h>
 
 //Buffer for socket
 #ifndef BUF_SIZE
@@ -16,7 +17,19 @@
 #endif
 //String Length for defining fixed sized char array
 #define STRING_LENGTH 50
+//Reconnect attempts to canopend before a command fails. Delay is doubled after each attempt, up to max.
 #define MAX_RECONNECTS 10
+#define RECONNECT_DELAY_US 10000
+#define RECONNECT_MAX_DELAY_US 500000
+//Return codes of canFeast functions
+#define CANFEAST_OK 0
+#define CANFEAST_ERR_SOCKET -1  //socket() failed
+#define CANFEAST_ERR_CONNECT -2 //canopend not reachable
+#define CANFEAST_ERR_WRITE -3   //command not sent
+#define CANFEAST_ERR_READ -4    //no response, or canopend closed the connection
+//Return codes of the state machines. Negative values are canFeast errors.
+#define EXO_DONE 0              //left with button 4
+#define EXO_STOP 1              //button 3 pressed
 //Base for int to str conversion
 #define DECIMAL 10
 //Exo skeleton user buttons
@@ -34,6 +47,14 @@
 //Velocity and acceleration for position mode move
 #define PROFILEVELOCITY 200000
 #define PROFILEACCELERATION 40000
+//Node ID of canopend. Profile parameters of all joints are written through its OD entry 0x2110.
+#define MASTERNODE 100
+//0x2110 sub 1..12 hold velocity, acceleration & deceleration of each joint, sub 13 starts the write.
+#define DRIVEPARAM_SUB_CTRL 13
+#define DRIVEPARAM_BUSY 1
+#define DRIVEPARAM_FAILED (-1000) //ERROR reply or timeout, not a node ID
+#define DRIVEPARAM_POLL_US 1000
+#define DRIVEPARAM_TIMEOUT_US 2000000
 //Knee motor reading and corresponding angle. Used for mapping between degree and motor values.
 #define KNEE_MOTOR_POS1 250880
 #define KNEE_MOTOR_DEG1 90
@@ -53,6 +74,14 @@
 #define STATEIMMOBILE 0
 #define WALKINGFORWARD 1
 #define WALKINGBACK 2
+//Continuous gait playback. Cadence is a percentage scaling of PROFILEVELOCITY and PROFILEACCELERATION.
+#define CADENCE_DEFAULT 100
+#define CADENCE_MIN 40
+#define CADENCE_MAX 160
+#define CADENCE_STEP 10
+//Next waypoint is queued to the drives once all joints are within this window of the current waypoint.
+//Must be larger than POSCLEARANCE so the drives never come to rest between waypoints.
+#define LOOKAHEADCLEARANCE 40000
 
 /*
  Most functions defined here use canReturnMessage as a pass-by-reference string.
@@ -62,17 +91,27 @@
  Therefore, it can be used by the calling function for error-handling.
  */
 
-//State machine with sit-stand logic
-void sitStand(int *socket, int initState);
-//For sending socket commands
-void canFeastUp(int *canSocket);
-void canFeast(int *canSocket, char *command, char *canReturnMessage);
+/*
+ Socket errors do not end the program. canFeast() reconnects to canopend with bounded retries
+ and returns a CANFEAST_ERR_ code, if all of them fail. The first such error is kept in canFeastError.
+ State machines check it in each loop and return, so main() can stop the exo in a controlled way.
+ Drives keep their state in canopend, so a reconnect does not need initExo() again.
+ */
+int canFeastError = CANFEAST_OK;
+
+//State machine with sit-stand logic. Returns EXO_DONE, EXO_STOP or canFeast error.
+int sitStand(int *socket, int initState);
+//For sending socket commands. Return CANFEAST_OK or CANFEAST_ERR_ code.
+int canFeastUp(int *canSocket);
+int canFeast(int *canSocket, char *command, char *canReturnMessage);
 void canFeastDown(int *canSocket);
-void canFeastErrorHandler(int *canSocket, char *command, char *canReturnMessage);
-//Used to read button status. Returns 1 if button is pressed
+int canFeastReconnect(int *canSocket);
+//Used to read button status. Returns 1 if button is pressed, 0 if not or on canFeast error.
 int getButton(int *canSocket, int button, char *canReturnMessage);
-//Reads position of specified node
-long getPos(int *canSocket, int nodeid, char *canReturnMessage);
+//Reads position of specified node. Returns CANFEAST_OK or canFeast error, position is not set then.
+int getPos(int *canSocket, int nodeid, long *position);
+//Prints position of the 4 joints.
+void printPos(int *canSocket);
 //Sets target position of node and moves it to that position.
 void setAbsPosSmart(int *canSocket, int nodeide, int position, char *canReturnMessage);
 //Converts integer to string
@@ -84,52 +123,77 @@ void stringExtract(char *origStr, char **extractStr, int pos);
 //Converts strings to integer and returns it.
 long strToInt(char str[]);
 //Sets specified node to preop mode
-void preop(int *canSocket, int nodeid);
+int preop(int *canSocket, int nodeid);
 //Sets node to start mode and sets it to position move mode.
 void initMotorPos(int *canSocket, int nodeid);
-//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true.
+//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true,
+//0 if not or canFeast error, if a position can not be read.
 int checkPos(int *canSocket, long lhipTarget, long lkneeTarget, long rhipTarget, long rkneeTarget);
+//Checks for 4 joints are within +-clearance of the target values. Returns 1 if true, 0 if not or canFeast error.
+int checkPosWindow(int *canSocket, long lhipTarget, long lkneeTarget, long rhipTarget, long rkneeTarget, long clearance);
 //Sets profile velocity for position mode motion.
 void setProfileVelocity(int *canSocket, int nodeid, long velocity);
 //Sets profile acceleration and deceleration for position mode motion.
 void setProfileAcceleration(int *canSocket, int nodeid, long acceleration);
+//Sets profile velocity, acceleration & deceleration of all joints through canopend.
+void setDriveParams(int *canSocket, long velocity, long acceleration);
 //Used to convert position array from degrees to motors counts as used in CANopen
 void motorPosArrayConverter(const double origArr[], long newArr[], int arrSize, int nodeid);
 //calculate A and B in the formula y=Ax+B. Use by motorPosArrayConverter()
 void calcAB(long y1, long x1, long y2, long x2, double *A, double *B);
 //Function to set motors to start mode and set accelerations/velocities.
 void initExo(int *socket);
-//Function to walk
-void walkMode(int *socket);
+//Function to walk. Returns EXO_DONE, EXO_STOP or canFeast error.
+int walkMode(int *socket);
+//Function to walk continuously through the gait table at a button controlled cadence. Returns as walkMode().
+int walkModeContinuous(int *socket);
+//Scales profile velocity, acceleration & deceleration of all joints by cadence (percent).
+void setCadence(int *socket, int cadence);
 //Function to put motors to preop.
-void stopExo(int *socket);
+int stopExo(int *socket);
 
-int main()
+int main(int argc, char *argv[])
 {
     printf("Welcome to CANfeast!\n");
     int socket;
     char junk[STRING_LENGTH];
+    int status;
 
-    canFeastUp(&socket);
+    if (canFeastUp(&socket) != CANFEAST_OK)
+        return EXIT_FAILURE;
 
-    while (getButton(&socket, BUTTON_FOUR, junk) == 0)
+    while (getButton(&socket, BUTTON_FOUR, junk) == 0 && canFeastError == CANFEAST_OK)
     {
-        printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", getPos(&socket, LHIP, junk), getPos(&socket, LKNEE, junk), getPos(&socket, RHIP, junk), getPos(&socket, RKNEE, junk));
+        printPos(&socket);
     }
 
-    initExo(&socket);
-    sitStand(&socket, SITTING);
-    walkMode(&socket);
-    sitStand(&socket, STANDING);
+    status = canFeastError;
+    if (status == EXO_DONE)
+    {
+        initExo(&socket);
+        status = canFeastError;
+    }
+    if (status == EXO_DONE)
+        status = sitStand(&socket, SITTING);
+    //"continuous" plays the gait back at a set cadence instead of one waypoint per button press.
+    if (status == EXO_DONE && argc > 1 && strcmp(argv[1], "continuous") == 0)
+        status = walkModeContinuous(&socket);
+    else if (status == EXO_DONE)
+        status = walkMode(&socket);
+    if (status == EXO_DONE)
+        status = sitStand(&socket, STANDING);
+
+    //Single stop path: end of program, button 3 or lost connection to canopend.
+    if (status < 0)
+        printf("Stopping exo after canFeast error %d\n", status);
     stopExo(&socket);
-
     canFeastDown(&socket);
 
-    return 0;
+    return (status < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 //State machine with sit-stand logic
-void sitStand(int *socket, int initState)
+int sitStand(int *socket, int initState)
 {
     printf("Sit Stand Mode\n");
     //Used to store the canReturnMessage. Not used currently, hence called junk.
@@ -208,6 +272,13 @@ void sitStand(int *socket, int initState)
         button3Status = getButton(socket, BUTTON_THREE, junk);
         button4Status = getButton(socket, BUTTON_FOUR, junk);
 
+        //Connection to canopend lost, also after reconnect attempts. Button states are not valid then.
+        if (canFeastError != CANFEAST_OK)
+        {
+            printf("canopend not reachable (sitstand)\n");
+            return canFeastError;
+        }
+
         //Button has to be pressed & Exo not moving & array not at end. If true, execute move.
         if (button1Status == 1 && movestate == STATEIMMOBILE && sitstate < (arrSize - 1))
         {
@@ -222,7 +293,10 @@ void sitStand(int *socket, int initState)
         //If target position is reached, then increment sitstate and set movestate to 0.
         if (sitstate < (arrSize-1) && movestate == STATESITTING)
         {
-            if (checkPos(socket, sitStandArrayHip[sitstate + 1], sitStandArrayKnee[sitstate + 1], sitStandArrayHip[sitstate + 1], sitStandArrayKnee[sitstate + 1]) == 1)
+            int reached = checkPos(socket, sitStandArrayHip[sitstate + 1], sitStandArrayKnee[sitstate + 1], sitStandArrayHip[sitstate + 1], sitStandArrayKnee[sitstate + 1]);
+            if (reached < 0)
+                return reached;
+            if (reached == 1)
             {
                 printf("Position reached.\n");
                 sitstate++;
@@ -246,7 +320,10 @@ void sitStand(int *socket, int initState)
         //If target position is reached, then decrease sitstate and set movestate to 0.
         if (sitstate > 0 && movestate == STATESTANDING)
         {
-            if (checkPos(socket, sitStandArrayHip[sitstate - 1], sitStandArrayKnee[sitstate - 1], sitStandArrayHip[sitstate - 1], sitStandArrayKnee[sitstate - 1]) == 1)
+            int reached = checkPos(socket, sitStandArrayHip[sitstate - 1], sitStandArrayKnee[sitstate - 1], sitStandArrayHip[sitstate - 1], sitStandArrayKnee[sitstate - 1]);
+            if (reached < 0)
+                return reached;
+            if (reached == 1)
             {
                 printf("Position reached.\n");
                 sitstate--;
@@ -256,167 +333,166 @@ void sitStand(int *socket, int initState)
             }
         }
 
-        //if button 3 pressed, then set to preop and exit.
+        //if button 3 pressed, then return, main() sets to preop and exits.
         if (button3Status == 1)
         {
             printf("Terminating Program (sitstand)\n");
-            stopExo(socket);
-            canFeastDown(socket);
-            exit(EXIT_SUCCESS);
+            return EXO_STOP;
         }
 
         //Exit statemachine only if button 4 pressed and gone from sitting to standing or vice versa.
         if (button4Status == 1 && ((sitstate==arrSize-1 && initState==STANDING)||(sitstate==0 && initState==SITTING)))
         {
-            break;
+            return EXO_DONE;
         }
     }
 }
 
 
+//Walking trajectory points from R&D team. Shared by walkMode() and walkModeContinuous().
+//First and last points are the same standing pose, so the table can be looped.
+static const double walkArrLHip_degrees[] = {
+        171.59,
+        170.89,
+        167.41,
+        161.52,
+        155.55,
+        152.03,
+        152.17,
+        155.05,
+        158.61,
+        160.91,
+        161.39,
+        161.61,
+        162.80,
+        165.12,
+        168.21,
+        171.59,
+        174.97,
+        178.07,
+        180.39,
+        181.58,
+        181.80,
+        180.68,
+        175.16,
+        165.94,
+        156.83,
+        152.03,
+        153.46,
+        159.47,
+        166.36,
+        170.70,
+        171.59
+};
+static const double walkArrLKnee_degrees[] = {
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19
+};
+
+static const double walkArrRHip_degrees[] = {
+        171.59,
+        171.50,
+        171.07,
+        170.56,
+        170.55,
+        171.59,
+        173.93,
+        177.04,
+        179.87,
+        181.48,
+        181.80,
+        180.78,
+        175.68,
+        166.97,
+        157.88,
+        152.03,
+        151.12,
+        154.02,
+        158.09,
+        160.81,
+        161.39,
+        161.70,
+        163.32,
+        166.15,
+        169.26,
+        171.59,
+        172.64,
+        172.62,
+        172.12,
+        171.69,
+        171.59
+};
+static const double walkArrRKnee_degrees[] = {
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19
+};
+
 //Walking state machine
-void walkMode(int *socket){
+int walkMode(int *socket){
 
     printf("Walk Mode\n");
 
     //Used to store the canReturnMessage. Not used currently, hence called junk.
     char junk[STRING_LENGTH];
 
-    //Array of trajectory points from R&D team
-    double walkArrLHip_degrees[] = {
-            171.59,
-            170.89,
-            167.41,
-            161.52,
-            155.55,
-            152.03,
-            152.17,
-            155.05,
-            158.61,
-            160.91,
-            161.39,
-            161.61,
-            162.80,
-            165.12,
-            168.21,
-            171.59,
-            174.97,
-            178.07,
-            180.39,
-            181.58,
-            181.80,
-            180.68,
-            175.16,
-            165.94,
-            156.83,
-            152.03,
-            153.46,
-            159.47,
-            166.36,
-            170.70,
-            171.59
-    };
-    double walkArrLKnee_degrees[] = {
-            18.19,
-            19.94,
-            28.49,
-            42.47,
-            55.59,
-            60.99,
-            55.59,
-            42.47,
-            28.49,
-            19.94,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            19.94,
-            28.49,
-            42.47,
-            55.59,
-            60.99,
-            55.59,
-            42.47,
-            28.49,
-            19.94,
-            18.19
-    };
-
-    double walkArrRHip_degrees[] = {
-            171.59,
-            171.50,
-            171.07,
-            170.56,
-            170.55,
-            171.59,
-            173.93,
-            177.04,
-            179.87,
-            181.48,
-            181.80,
-            180.78,
-            175.68,
-            166.97,
-            157.88,
-            152.03,
-            151.12,
-            154.02,
-            158.09,
-            160.81,
-            161.39,
-            161.70,
-            163.32,
-            166.15,
-            169.26,
-            171.59,
-            172.64,
-            172.62,
-            172.12,
-            171.69,
-            171.59
-    };
-    double walkArrRKnee_degrees[] = {
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            19.94,
-            28.49,
-            42.47,
-            55.59,
-            60.99,
-            55.59,
-            42.47,
-            28.49,
-            19.94,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19,
-            18.19
-    };
-
     int arrSize = sizeof(walkArrLHip_degrees) / sizeof(walkArrLHip_degrees[0]);
     //These arrays store the converted values of joint. These can be sent to the motor.
     long walkArrLHip[arrSize];
@@ -458,6 +534,13 @@ void walkMode(int *socket){
         button3Status = getButton(socket, BUTTON_THREE, junk);
         button4Status = getButton(socket, BUTTON_FOUR, junk);
 
+        //Connection to canopend lost, also after reconnect attempts. Button states are not valid then.
+        if (canFeastError != CANFEAST_OK)
+        {
+            printf("canopend not reachable (walk mode)\n");
+            return canFeastError;
+        }
+
         //Button has to be pressed & Exo not moving & array not at end. If true, execute move.
         if (button1Status == 1 && movestate == STATEIMMOBILE && walkstate < (arrSize - 1))
         {
@@ -472,7 +555,10 @@ void walkMode(int *socket){
         //If target position is reached, then increment walkstate and set movestate to 0.
         if (walkstate < (arrSize-1) && movestate == WALKINGFORWARD)
         {
-            if (checkPos(socket, walkArrLHip[walkstate + 1], walkArrLKnee[walkstate + 1], walkArrRHip[walkstate + 1], walkArrRKnee[walkstate + 1]) == 1)
+            int reached = checkPos(socket, walkArrLHip[walkstate + 1], walkArrLKnee[walkstate + 1], walkArrRHip[walkstate + 1], walkArrRKnee[walkstate + 1]);
+            if (reached < 0)
+                return reached;
+            if (reached == 1)
             {
                 printf("Position reached.\n");
                 walkstate++;
@@ -496,7 +582,10 @@ void walkMode(int *socket){
         //If target position is reached, then decrease walkstate and set movestate to 0.
         if (walkstate > 0 && movestate == WALKINGBACK)
         {
-            if (checkPos(socket, walkArrLHip[walkstate - 1], walkArrLKnee[walkstate - 1], walkArrRHip[walkstate - 1], walkArrRKnee[walkstate - 1]) == 1)
+            int reached = checkPos(socket, walkArrLHip[walkstate - 1], walkArrLKnee[walkstate - 1], walkArrRHip[walkstate - 1], walkArrRKnee[walkstate - 1]);
+            if (reached < 0)
+                return reached;
+            if (reached == 1)
             {
                 printf("Position reached.\n");
                 walkstate--;
@@ -506,27 +595,165 @@ void walkMode(int *socket){
             }
         }
 
-        //if button 3 pressed, then set to preop and exit program.
+        //if button 3 pressed, then return, main() sets to preop and exits program.
         if (button3Status == 1)
         {
             printf("Terminating Program (walk mode)\n");
-            stopExo(socket);
-            canFeastDown(socket);
-            exit(EXIT_SUCCESS);
+            return EXO_STOP;
         }
 
         //Only exit state machine if button 4 pressed and at end of walking array. 
         if(button4Status==1 && walkstate==(arrSize-1)){
-            break;
+            return EXO_DONE;
         }
     }
 }
 
+//Continuous walking state machine.
+//Loops through the walk table at a cadence set with the buttons. The next waypoint is sent to the drives
+//as soon as all joints enter the LOOKAHEADCLEARANCE window of the current one, so there is always a
+//setpoint queued and the joints do not stop between waypoints.
+//Button 1 increases cadence, button 2 decreases it, button 4 requests a stop at the next waypoint with
+//the feet together (first or last of the table) and button 3 kills the motors and ends the program.
+int walkModeContinuous(int *socket){
+
+    printf("Walk Mode (continuous)\n");
+
+    //Used to store the canReturnMessage. Not used currently, hence called junk.
+    char junk[STRING_LENGTH];
+
+    int arrSize = sizeof(walkArrLHip_degrees) / sizeof(walkArrLHip_degrees[0]);
+    //These arrays store the converted values of joint. These can be sent to the motor.
+    long walkArrLHip[arrSize];
+    long walkArrLKnee[arrSize];
+    long walkArrRHip[arrSize];
+    long walkArrRKnee[arrSize];
+
+    //Converting from degrees to motor drive compatible values.
+    motorPosArrayConverter(walkArrLHip_degrees, walkArrLHip, arrSize, LHIP);
+    motorPosArrayConverter(walkArrLKnee_degrees, walkArrLKnee, arrSize, LKNEE);
+    motorPosArrayConverter(walkArrRHip_degrees, walkArrRHip, arrSize, RHIP);
+    motorPosArrayConverter(walkArrRKnee_degrees, walkArrRKnee, arrSize, RKNEE);
+
+    //Last point repeats the first one, so the loop restarts at index 1 to avoid a zero length move.
+    int loopStart = 0;
+    if (walkArrLHip[0] == walkArrLHip[arrSize - 1] && walkArrLKnee[0] == walkArrLKnee[arrSize - 1] &&
+        walkArrRHip[0] == walkArrRHip[arrSize - 1] && walkArrRKnee[0] == walkArrRKnee[arrSize - 1])
+        loopStart = 1;
+
+    //Exo is standing at waypoint 0 when entering walk mode. target is the waypoint currently sent to the drives.
+    int target = 1;
+    int cadence = CADENCE_DEFAULT;
+    int cadenceChanged = 0;
+    int stopRequested = 0;
+
+    //Button states of previous loop. Actions happen on press, not while held. Started from the current
+    //state, so a button still held from entering walk mode is not taken as a new press.
+    int button1Prev = getButton(socket, BUTTON_ONE, junk);
+    int button2Prev = getButton(socket, BUTTON_TWO, junk);
+    int button4Prev = getButton(socket, BUTTON_FOUR, junk);
+    int button1Status = 0;
+    int button2Status = 0;
+    int button3Status = 0;
+    int button4Status = 0;
+
+    setCadence(socket, cadence);
+    setAbsPosSmart(socket, LHIP, walkArrLHip[target], junk);
+    setAbsPosSmart(socket, LKNEE, walkArrLKnee[target], junk);
+    setAbsPosSmart(socket, RHIP, walkArrRHip[target], junk);
+    setAbsPosSmart(socket, RKNEE, walkArrRKnee[target], junk);
+
+    while (1)
+    {
+        //read button state
+        button1Status = getButton(socket, BUTTON_ONE, junk);
+        button2Status = getButton(socket, BUTTON_TWO, junk);
+        button3Status = getButton(socket, BUTTON_THREE, junk);
+        button4Status = getButton(socket, BUTTON_FOUR, junk);
+
+        //Connection to canopend lost, also after reconnect attempts. Button states are not valid then.
+        if (canFeastError != CANFEAST_OK)
+        {
+            printf("canopend not reachable (walk mode)\n");
+            return canFeastError;
+        }
+
+        //Cadence changes are applied when the next waypoint is sent.
+        if (button1Status == 1 && button1Prev == 0 && cadence < CADENCE_MAX)
+        {
+            cadence += CADENCE_STEP;
+            cadenceChanged = 1;
+            printf("Cadence %d%%\n", cadence);
+        }
+        if (button2Status == 1 && button2Prev == 0 && cadence > CADENCE_MIN)
+        {
+            cadence -= CADENCE_STEP;
+            cadenceChanged = 1;
+            printf("Cadence %d%%\n", cadence);
+        }
+        if (button4Status == 1 && button4Prev == 0 && !stopRequested)
+        {
+            stopRequested = 1;
+            printf("Stopping with feet together\n");
+        }
+        button1Prev = button1Status;
+        button2Prev = button2Status;
+        button4Prev = button4Status;
+
+        //if button 3 pressed, then return, main() sets to preop and exits program.
+        if (button3Status == 1)
+        {
+            printf("Terminating Program (walk mode)\n");
+            return EXO_STOP;
+        }
+
+        //Stopping: only the first and last waypoints have the feet together, which sitStand(STANDING)
+        //expects. Let the joints settle there instead of queuing the next one.
+        if (stopRequested && (target == 0 || target == arrSize - 1))
+        {
+            int reached = checkPos(socket, walkArrLHip[target], walkArrLKnee[target], walkArrRHip[target], walkArrRKnee[target]);
+            if (reached < 0)
+                return reached;
+            if (reached == 1)
+            {
+                printf("Stopped with feet together (waypoint %d)\n", target);
+                break;
+            }
+            continue;
+        }
+
+        //Queue the next waypoint once the current one is nearly reached.
+        int reached = checkPosWindow(socket, walkArrLHip[target], walkArrLKnee[target], walkArrRHip[target], walkArrRKnee[target], LOOKAHEADCLEARANCE);
+        if (reached < 0)
+            return reached;
+        if (reached == 1)
+        {
+            target++;
+            if (target >= arrSize)
+                target = loopStart;
+
+            if (cadenceChanged)
+            {
+                setCadence(socket, cadence);
+                cadenceChanged = 0;
+            }
+            setAbsPosSmart(socket, LHIP, walkArrLHip[target], junk);
+            setAbsPosSmart(socket, LKNEE, walkArrLKnee[target], junk);
+            setAbsPosSmart(socket, RHIP, walkArrRHip[target], junk);
+            setAbsPosSmart(socket, RKNEE, walkArrRKnee[target], junk);
+        }
+    }
+
+    //Restore profile used by sit stand mode.
+    setCadence(socket, CADENCE_DEFAULT);
+    return (canFeastError == CANFEAST_OK) ? EXO_DONE : canFeastError;
+}
+
 //Used to read button status. Returns 1 if button is pressed
 int getButton(int *canSocket, int button, char *canReturnMessage)
 {
     //char canReturnMessage[STRING_LENGTH];
-    char *buttonMessage;
+    char *buttonMessage = canReturnMessage;
     char *buttonPressed = "0x3F800000";
 
     char buttons[][STRING_LENGTH] =
@@ -536,7 +763,9 @@ int getButton(int *canSocket, int button, char *canReturnMessage)
                     "[1] 9 read 0x0103 1 u32", //button 3
                     "[1] 9 read 0x0104 1 u32"  //button 4
             };
-    canFeast(canSocket, buttons[button - 1], canReturnMessage);
+    //Not pressed, if canopend is not reachable. Caller checks canFeastError.
+    if (canFeast(canSocket, buttons[button - 1], canReturnMessage) != CANFEAST_OK)
+        return 0;
 
     //printf("CAN return on button press is: %s", canReturnMessage);
     //Button pressed returns "[1] 0x3F800000\n". Extracting 2nd string to compare.
@@ -551,12 +780,12 @@ int getButton(int *canSocket, int button, char *canReturnMessage)
 }
 
 //Reads position of specified node
-long getPos(int *canSocket, int nodeid, char *canReturnMessage)
+int getPos(int *canSocket, int nodeid, long *position)
 {
     char node[STRING_LENGTH], getpos[STRING_LENGTH], dataType[STRING_LENGTH], buffer[STRING_LENGTH];
     char positionMessage[STRING_LENGTH];
-    char *positionStr;
-    long position;
+    char *positionStr = positionMessage;
+    int err;
 
     //Create a message to be sent using canFeast. "[1] <nodeid> read 0x6063 0 i32"
     //Return should be "[1] <position value>\r"
@@ -567,8 +796,9 @@ long getPos(int *canSocket, int nodeid, char *canReturnMessage)
     //concatenate message
     strcat(getpos, node);
     strcat(getpos, dataType);
-    //Send message
-    canFeast(canSocket, getpos, positionMessage);
+    //Send message. Position is not known, if canopend is not reachable.
+    if ((err = canFeast(canSocket, getpos, positionMessage)) != CANFEAST_OK)
+        return err;
 
     //printf("Position Message for node %d: %s",nodeid, positionMessage);
 
@@ -577,10 +807,23 @@ long getPos(int *canSocket, int nodeid, char *canReturnMessage)
     // printf("Extracted Message for node %d: %s\n",nodeid, positionStr);
 
     //Converting string to int
-    position = strToInt(positionStr);
-    // printf("Position of node %d: %ld\n", nodeid, position);
+    *position = strToInt(positionStr);
+    // printf("Position of node %d: %ld\n", nodeid, *position);
+
+    return CANFEAST_OK;
+}
+
+//Prints position of the 4 joints. Nothing is printed, if a position can not be read.
+void printPos(int *canSocket)
+{
+    long position[4];
 
-    return position;
+    for (int nodeid = LHIP; nodeid <= RKNEE; nodeid++)
+    {
+        if (getPos(canSocket, nodeid, &position[nodeid - LHIP]) != CANFEAST_OK)
+            return;
+    }
+    printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", position[0], position[1], position[2], position[3]);
 }
 
 //Sets target position of node and moves it to that position.
@@ -630,7 +873,7 @@ void setAbsPosSmart(int *canSocket, int nodeid, int position, char *canReturnMes
 
 // Creates a socket connection to canopend using a pointer to int socket
 
-void canFeastUp(int *canSocket)
+int canFeastUp(int *canSocket)
 {
     char *socketPath = "/tmp/CO_command_socket"; /* Name of the local domain socket, configurable by arguments. */
     struct sockaddr_un addr;
@@ -641,85 +884,94 @@ void canFeastUp(int *canSocket)
     if (*canSocket == -1)
     {
         perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+        return CANFEAST_ERR_SOCKET;
     }
     memset(&addr, 0, sizeof(struct sockaddr_un));
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
-    // Try to make a connection to the local UNIT AF_UNIX SOCKET, quit if unavailable
+    // Try to make a connection to the local UNIT AF_UNIX SOCKET, caller decides what to do if unavailable
     if (connect(*canSocket, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
     {
         perror("Socket connection failed");
-        exit(EXIT_FAILURE);
+        close(*canSocket);
+        *canSocket = -1;
+        return CANFEAST_ERR_CONNECT;
     }
+    return CANFEAST_OK;
 }
 void canFeastDown(int *canSocket)
 {
     printf("closing socket...\n");
     //close socket
-    close(*canSocket);
+    if (*canSocket != -1)
+        close(*canSocket);
+    *canSocket = -1;
     printf("socket close\n");
 }
-void canFeast(int *canSocket, char *command, char *canReturnMessage)
+// Sends command and copies response (at most STRING_LENGTH - 1 chars) into canReturnMessage.
+// On socket errors reconnects and sends the command again. Commands are absolute (positions,
+// controlwords, NMT), so sending them twice is harmless.
+int canFeast(int *canSocket, char *command, char *canReturnMessage)
 {
     int commandLength = strlen(command);
-    size_t n;
+    ssize_t n;
     char buf[BUF_SIZE];
+    int err = CANFEAST_OK;
 
-    if (write(*canSocket, command, commandLength) != commandLength)
+    canReturnMessage[0] = '\0';
+    //Second attempt only after a successful reconnect, which has its own bounded retries.
+    for (int attempt = 0; attempt < 2; attempt++)
     {
-        perror("Socket write failed");
-        exit(EXIT_FAILURE);
-    }
+        if (attempt > 0 && (err = canFeastReconnect(canSocket)) != CANFEAST_OK)
+            break;
 
-    n = read(*canSocket, buf, sizeof(buf));
-    if (n == -1)
-    {
-        perror("Socket read failed");
-        close(*canSocket);
-        exit(EXIT_FAILURE);
+        //MSG_NOSIGNAL: closed canopend socket must not kill the program with SIGPIPE
+        if (send(*canSocket, command, commandLength, MSG_NOSIGNAL) != commandLength)
+        {
+            perror("Socket write failed");
+            err = CANFEAST_ERR_WRITE;
+            continue;
+        }
+
+        n = read(*canSocket, buf, sizeof(buf) - 1);
+        if (n <= 0)
+        {
+            if (n == 0)
+                errno = ECONNRESET;
+            perror("Socket read failed");
+            err = CANFEAST_ERR_READ;
+            continue;
+        }
+        buf[n] = '\0';
+        //printf("%s", buf);
+        strncpy(canReturnMessage, buf, STRING_LENGTH - 1);
+        canReturnMessage[STRING_LENGTH - 1] = '\0';
+        return CANFEAST_OK;
     }
-    //printf("%s", buf);
-    strcpy(canReturnMessage, buf);
+
+    if (canFeastError == CANFEAST_OK)
+        canFeastError = err;
+    return err;
 }
-// Error handling -> reset socket and try again when sockets fail.
-void canFeastErrorHandler(int *canSocket, char *command, char *canReturnMessage)
+// Replaces the connection to canopend. Retries up to MAX_RECONNECTS times with exponential backoff.
+int canFeastReconnect(int *canSocket)
 {
-    int commandLength = strlen(command);
-    int recconects;
-    size_t n;
-    char buf[BUF_SIZE];
+    useconds_t delay = RECONNECT_DELAY_US;
+    int err = CANFEAST_ERR_CONNECT;
 
-    if (write(*canSocket, command, commandLength) != commandLength)
-    {
-        perror("Socket write failed, attempting again");
-        canFeast(canSocket, command, canReturnMessage);
-    }
-    while ((write(*canSocket, command, commandLength) != commandLength) && recconects != MAX_RECONNECTS)
-    {
-        perror("Socket write failed, attempting again");
-        //shut down socket
-        canFeastDown(canSocket);
-        //recreate socket
-        canFeastUp(canSocket);
-        recconects++;
-        // try to send again
-    }
+    if (*canSocket != -1)
+        close(*canSocket);
+    *canSocket = -1;
 
-    n = read(*canSocket, buf, sizeof(buf));
-    if (n == -1)
+    for (int recconects = 0; recconects < MAX_RECONNECTS; recconects++)
     {
-        perror("Socket read failed, attempting to send command again");
-        //shut down socket
-        canFeastDown(canSocket);
-        //recreate socket
-        canFeastUp(canSocket);
-        // try to send again
-        canFeast(canSocket, command, canReturnMessage);
-        exit(EXIT_FAILURE);
+        usleep(delay);
+        printf("Reconnecting to canopend, attempt %d\n", recconects + 1);
+        if ((err = canFeastUp(canSocket)) == CANFEAST_OK)
+            return CANFEAST_OK;
+        delay = (delay * 2 > RECONNECT_MAX_DELAY_US) ? RECONNECT_MAX_DELAY_US : delay * 2;
     }
-    printf("%s", buf);
-    strcpy(canReturnMessage, buf);
+    return err;
 }
 
 //Definitionof itoa(int to string conversion) and helper Kernighan & Ritchie's Ansi C.
@@ -804,7 +1056,7 @@ long strToInt(char str[])
 }
 
 //set node to preop mode
-void preop(int *canSocket, int nodeid)
+int preop(int *canSocket, int nodeid)
 {
     char junk[STRING_LENGTH];
     char node[STRING_LENGTH], preop[STRING_LENGTH], dataTail[STRING_LENGTH], buffer[STRING_LENGTH];
@@ -818,7 +1070,7 @@ void preop(int *canSocket, int nodeid)
     strcat(preop, node);
     strcat(preop, dataTail);
     //printf("\nNode %d is now in preop state\n",nodeid);
-    canFeast(canSocket, preop, junk);
+    return canFeast(canSocket, preop, junk);
 }
 
 //start motor and set to position mode.
@@ -850,22 +1102,30 @@ void initMotorPos(int *canSocket, int nodeid)
     canFeast(canSocket, comm, canMessage);
 }
 
-//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true.
+//Checks for 4 joints are within +-POSCLEARANCE of the hipTarget and kneeTarget values. Returns 1 if true,
+//0 if not or canFeast error, if a position can not be read.
 int checkPos(int *canSocket, long lhipTarget, long lkneeTarget, long rhipTarget, long rkneeTarget)
 {
+    return checkPosWindow(canSocket, lhipTarget, lkneeTarget, rhipTarget, rkneeTarget, POSCLEARANCE);
+}
 
-    //The positions could be polled and stored earlier for more readable code. But getpos uses canfeast which has overhead.
-    //Since C support short circuit evaluation, using getPos in if statement is more efficient.
-    char junk[STRING_LENGTH];
-    if (getPos(canSocket, LHIP, junk) > (lhipTarget - POSCLEARANCE) && getPos(canSocket, LHIP, junk) < (lhipTarget + POSCLEARANCE) &&
-        getPos(canSocket, RHIP, junk) > (rhipTarget - POSCLEARANCE) && getPos(canSocket, RHIP, junk) < (rhipTarget + POSCLEARANCE))
+//Checks for 4 joints are within +-clearance of the target values. Returns 1 if true, 0 if not or canFeast error.
+int checkPosWindow(int *canSocket, long lhipTarget, long lkneeTarget, long rhipTarget, long rkneeTarget, long clearance)
+{
+    long lhip, lknee, rhip, rknee;
+    int err;
+
+    //Each position is read once. A failed read is returned, it is never compared as a position.
+    if ((err = getPos(canSocket, LHIP, &lhip)) != CANFEAST_OK || (err = getPos(canSocket, RHIP, &rhip)) != CANFEAST_OK ||
+        (err = getPos(canSocket, LKNEE, &lknee)) != CANFEAST_OK || (err = getPos(canSocket, RKNEE, &rknee)) != CANFEAST_OK)
+        return err;
+
+    if (lhip > (lhipTarget - clearance) && lhip < (lhipTarget + clearance) &&
+        rhip > (rhipTarget - clearance) && rhip < (rhipTarget + clearance) &&
+        lknee > (lkneeTarget - clearance) && lknee < (lkneeTarget + clearance) &&
+        rknee > (rkneeTarget - clearance) && rknee < (rkneeTarget + clearance))
     {
-        if (getPos(canSocket, LKNEE, junk) > (lkneeTarget - POSCLEARANCE) && getPos(canSocket, LKNEE, junk) < (lkneeTarget + POSCLEARANCE) &&
-            getPos(canSocket, RKNEE, junk) > (rkneeTarget - POSCLEARANCE) && getPos(canSocket, RKNEE, junk) < (rkneeTarget + POSCLEARANCE))
-        {
-            return 1;
-        }
-        return 0;
+        return 1;
     }
     return 0;
 }
@@ -925,6 +1185,99 @@ void setProfileAcceleration(int *canSocket, int nodeid, long acceleration)
     canFeast(canSocket, commDec, junk);
 }
 
+//Sets profile velocity, acceleration & deceleration of all 4 joints in one go.
+//Values go to 0x2110 of canopend, which then writes all the drives concurrently.
+//Falls back to joint by joint writes if canopend reports a failed drive.
+void setDriveParams(int *canSocket, long velocity, long acceleration)
+{
+    char comm[STRING_LENGTH], buffer[STRING_LENGTH], master[STRING_LENGTH];
+    char canReturnMessage[STRING_LENGTH];
+    char *statusMessage = NULL;
+    long values[3] = {velocity, acceleration, acceleration};
+    long status = 0;
+    int sub = 1;
+
+    itoa(MASTERNODE, master, DECIMAL);
+
+    //"[1] 100 write 0x2110 <sub> i32 <value>", velocity, acceleration & deceleration for each joint.
+    //Any failed write falls back to writing the joints one by one.
+    for (int nodeid = LHIP; nodeid <= RKNEE && status == 0; nodeid++)
+    {
+        for (int i = 0; i < 3 && status == 0; i++, sub++)
+        {
+            strcpy(comm, "[1] ");
+            strcat(comm, master);
+            strcat(comm, " write 0x2110 ");
+            itoa(sub, buffer, DECIMAL);
+            strcat(comm, buffer);
+            strcat(comm, " i32 ");
+            itoa(values[i], buffer, DECIMAL);
+            strcat(comm, buffer);
+            if (canFeast(canSocket, comm, canReturnMessage) != CANFEAST_OK || strstr(canReturnMessage, "ERROR") != NULL)
+                status = DRIVEPARAM_FAILED;
+        }
+    }
+
+    //Start the write: "[1] 100 write 0x2110 13 i32 1"
+    if (status == 0)
+    {
+        strcpy(comm, "[1] ");
+        strcat(comm, master);
+        strcat(comm, " write 0x2110 ");
+        itoa(DRIVEPARAM_SUB_CTRL, buffer, DECIMAL);
+        strcat(comm, buffer);
+        strcat(comm, " i32 1");
+        if (canFeast(canSocket, comm, canReturnMessage) != CANFEAST_OK || strstr(canReturnMessage, "ERROR") != NULL)
+            status = DRIVEPARAM_FAILED;
+    }
+
+    //Poll "[1] 100 read 0x2110 13 i32" until done. Returns 1 while busy, 0 when done or -nodeid on failure.
+    strcpy(comm, "[1] ");
+    strcat(comm, master);
+    strcat(comm, " read 0x2110 ");
+    itoa(DRIVEPARAM_SUB_CTRL, buffer, DECIMAL);
+    strcat(comm, buffer);
+    strcat(comm, " i32");
+    //Reply is "[1] <status>" or "[1] ERROR: <abort code>". Give up after DRIVEPARAM_TIMEOUT_US.
+    for (long waited = 0; status == 0 || status == DRIVEPARAM_BUSY; waited += DRIVEPARAM_POLL_US)
+    {
+        usleep(DRIVEPARAM_POLL_US);
+        if (canFeast(canSocket, comm, canReturnMessage) != CANFEAST_OK || strstr(canReturnMessage, "ERROR") != NULL)
+        {
+            status = DRIVEPARAM_FAILED;
+            break;
+        }
+        statusMessage = NULL;
+        stringExtract(canReturnMessage, &statusMessage, 2);
+        if (statusMessage == NULL)
+        {
+            status = DRIVEPARAM_FAILED;
+            break;
+        }
+        status = strToInt(statusMessage);
+        if (status != DRIVEPARAM_BUSY)
+            break;
+        if (waited >= DRIVEPARAM_TIMEOUT_US)
+        {
+            status = DRIVEPARAM_FAILED;
+            break;
+        }
+    }
+
+    if (status != 0)
+    {
+        if (status == DRIVEPARAM_FAILED)
+            printf("Profile parameters not confirmed by canopend, writing joints one by one\n");
+        else
+            printf("Profile parameters failed on node %ld, writing joints one by one\n", -status);
+        for (int nodeid = LHIP; nodeid <= RKNEE; nodeid++)
+        {
+            setProfileAcceleration(canSocket, nodeid, acceleration);
+            setProfileVelocity(canSocket, nodeid, velocity);
+        }
+    }
+}
+
 //Used to convert position array from degrees to motors counts as used in CANopen
 void motorPosArrayConverter(const double origArr[], long newArr[], int arrSize, int nodeid)
 {
@@ -961,20 +1314,23 @@ void initExo(int *socket){
     initMotorPos(socket, RKNEE);
 
     //Sets profile velocity, acceleration & deceleration for the joints.
-    setProfileAcceleration(socket, LHIP, PROFILEACCELERATION);
-    setProfileVelocity(socket, LHIP, PROFILEVELOCITY);
-    setProfileAcceleration(socket, LKNEE, PROFILEACCELERATION);
-    setProfileVelocity(socket, LKNEE, PROFILEVELOCITY);
-    setProfileAcceleration(socket, RHIP, PROFILEACCELERATION);
-    setProfileVelocity(socket, RHIP, PROFILEVELOCITY);
-    setProfileAcceleration(socket, RKNEE, PROFILEACCELERATION);
-    setProfileVelocity(socket, RKNEE, PROFILEVELOCITY);
+    setDriveParams(socket, PROFILEVELOCITY, PROFILEACCELERATION);
 }
 
-//Function to put motors to preop.
-void stopExo(int *socket){
-    preop(socket, LHIP);
-    preop(socket, LKNEE);
-    preop(socket, RHIP);
-    preop(socket, RKNEE);
-}
\ No newline at end of file
+//Function to put motors to preop. Gives up after the first node, which canopend can not be reached for.
+int stopExo(int *socket){
+    int nodes[] = {LHIP, LKNEE, RHIP, RKNEE};
+    int err = CANFEAST_OK;
+
+    for (int i = 0; i < 4 && err == CANFEAST_OK; i++)
+        err = preop(socket, nodes[i]);
+    return err;
+}
+
+//Scales profile velocity, acceleration & deceleration of all joints by cadence (percent).
+void setCadence(int *socket, int cadence){
+    long velocity = (long)PROFILEVELOCITY * cadence / 100;
+    long acceleration = (long)PROFILEACCELERATION * cadence / 100;
+
+    setDriveParams(socket, velocity, acceleration);
+}
@@ -0,0 +1,552 @@
+/*
+ * ALEX Exoskeleton.
+ * Walk mode of the Fourier X2 exoskeleton, written with coroutines on one event loop.
+ *
+ * Same buttons as walkMode() in CanFeast_Walk.c: button 1 steps forward through the gait table,
+ * button 2 steps back, button 4 at the end of the table finishes and button 3 stops the motors.
+ * Instead of one loop which polls each button and position in turn, the program is three tasks:
+ * the walk state machine, an emergency stop waiting for button 3 and a telemetry printout. They
+ * wait on the same event loop (CO_ODclientAsync.hpp) with no busy loops and no threads, so
+ * button 3 is seen while the joints move and the telemetry does not slow down the motion.
+ *
+ * Needs canopend with the parallel command interface and the button node in the SDO pool:
+ *   canopend can1 -i 100 -c "" -n 1-4,9 -C ""
+ *
+ * Compile: g++ -std=c++20 -Wall -I../../CANopenSocket_Extended CanFeast_WalkAsync.cpp -o walkAsync
+ *          (gcc 10 needs -fcoroutines in addition)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <string.h>
+#include "CO_ODclientAsync.hpp"
+
+#ifndef CO_ODCLIENT_COROUTINES
+#error "Compile with -std=c++20"
+#endif
+
+//Buffer for socket
+#ifndef BUF_SIZE
+#define BUF_SIZE 1000
+#endif
+//String Length for defining fixed sized char array
+#define STRING_LENGTH 50
+//Exo skeleton user buttons. Button n is object 0x0100+n sub 1 of BUTTON_NODE, 1.0f if pressed.
+#define BUTTON_ONE 1
+#define BUTTON_TWO 2
+#define BUTTON_THREE 3
+#define BUTTON_FOUR 4
+#define BUTTON_NODE 9
+#define BUTTON_PRESSED 0x3F800000
+//Node ID for the 4 joints
+#define LHIP 1
+#define LKNEE 2
+#define RHIP 3
+#define RKNEE 4
+#define NUM_JOINTS 4
+//canopend sockets
+#define COMMAND_SOCKET "/tmp/CO_command_socket"
+#define PARALLEL_SOCKET "/tmp/CO_command_socket_parallel"
+//Clearance used when doing point to point motion
+#define POSCLEARANCE 10000
+//Velocity and acceleration for position mode move
+#define PROFILEVELOCITY 200000
+#define PROFILEACCELERATION 40000
+//Controlword values, which start a position mode move (new setpoint bit low, then high)
+#define CW_SETPOINT_LOW 47
+#define CW_SETPOINT_HIGH 63
+//Polling period of buttons and positions, printout period of telemetry
+#define POLL_MS 10
+#define TELEMETRY_MS 500
+//Knee motor reading and corresponding angle. Used for mapping between degree and motor values.
+#define KNEE_MOTOR_POS1 250880
+#define KNEE_MOTOR_DEG1 90
+#define KNEE_MOTOR_POS2 0
+#define KNEE_MOTOR_DEG2 0
+//Hip motor reading and corresponding angle. Used for mapping between degree and motor values.
+#define HIP_MOTOR_POS1 250880
+#define HIP_MOTOR_DEG1 90
+#define HIP_MOTOR_POS2 0
+#define HIP_MOTOR_DEG2 180
+
+static const int joints[NUM_JOINTS] = {LHIP, LKNEE, RHIP, RKNEE};
+
+//Walking trajectory points from R&D team, same as in CanFeast_Walk.c.
+static const double walkArrLHip_degrees[] = {
+        171.59,
+        170.89,
+        167.41,
+        161.52,
+        155.55,
+        152.03,
+        152.17,
+        155.05,
+        158.61,
+        160.91,
+        161.39,
+        161.61,
+        162.80,
+        165.12,
+        168.21,
+        171.59,
+        174.97,
+        178.07,
+        180.39,
+        181.58,
+        181.80,
+        180.68,
+        175.16,
+        165.94,
+        156.83,
+        152.03,
+        153.46,
+        159.47,
+        166.36,
+        170.70,
+        171.59
+};
+static const double walkArrLKnee_degrees[] = {
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19
+};
+
+static const double walkArrRHip_degrees[] = {
+        171.59,
+        171.50,
+        171.07,
+        170.56,
+        170.55,
+        171.59,
+        173.93,
+        177.04,
+        179.87,
+        181.48,
+        181.80,
+        180.78,
+        175.68,
+        166.97,
+        157.88,
+        152.03,
+        151.12,
+        154.02,
+        158.09,
+        160.81,
+        161.39,
+        161.70,
+        163.32,
+        166.15,
+        169.26,
+        171.59,
+        172.64,
+        172.62,
+        172.12,
+        171.69,
+        171.59
+};
+static const double walkArrRKnee_degrees[] = {
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        19.94,
+        28.49,
+        42.47,
+        55.59,
+        60.99,
+        55.59,
+        42.47,
+        28.49,
+        19.94,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19,
+        18.19
+};
+
+//Event loop and its two connections to canopend. Motion requests go with high priority, so the
+//telemetry can't delay them on the drives.
+static CO::EventLoop loop;
+static CO::AsyncODclient od(loop);
+static CO::AsyncODclient telemetryOd(loop);
+
+//Sends a single command on the canopend command socket (NMT). Blocks, used before and after the loop.
+int canFeastSingle(const char *command);
+//Converts joint angle in degrees to motor counts.
+long degreesToMotor(double degrees, int nodeid);
+//Position mode and motion profile on all joints.
+CO::Task<uint32_t> initExo();
+//Moves joints to targets and returns when all are within POSCLEARANCE. Returns 0 or SDO error.
+CO::Task<uint32_t> moveTo(const int nodes[], const long targets[], int count);
+//Returns true if button is pressed.
+CO::Task<bool> isPressed(int button);
+//Returns when button is pressed.
+CO::Task<> buttonPressed(int button);
+//Returns the first of buttons 1, 2 and 4, which is pressed.
+CO::Task<int> nextButton();
+//Walk state machine, returns at the end of the gait table.
+CO::Task<> walkMode();
+//Stops the motors and the program on button 3.
+CO::Task<> emergencyStop();
+//Prints joint positions every TELEMETRY_MS.
+CO::Task<> telemetry();
+//Initialisation, walk, stop.
+CO::Task<> walkProgram();
+//Puts all joints to preop.
+void stopExo();
+
+int main()
+{
+    printf("Welcome to CANfeast!\n");
+
+    if (od.open(PARALLEL_SOCKET) != 0 || telemetryOd.open(PARALLEL_SOCKET) != 0)
+    {
+        perror("Socket connection failed");
+        fprintf(stderr, "Start canopend with the parallel command interface (-C \"\")\n");
+        exit(EXIT_FAILURE);
+    }
+
+    CO::spawn(walkProgram());
+    loop.run();
+
+    od.close();
+    telemetryOd.close();
+    return 0;
+}
+
+CO::Task<> walkProgram()
+{
+    uint32_t err;
+
+    //Go from preop to start mode
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        char command[STRING_LENGTH];
+        snprintf(command, sizeof(command), "[1] %d start", joints[i]);
+        canFeastSingle(command);
+    }
+
+    od.setPriority(CO::ODclient::PRIO_HIGH);
+    telemetryOd.setPriority(CO::ODclient::PRIO_LOW);
+    err = co_await initExo();
+    if (err != 0)
+    {
+        fprintf(stderr, "Initialisation failed: 0x%08X\n", err);
+        stopExo();
+        loop.stop();
+        co_return;
+    }
+
+    CO::spawn(emergencyStop());
+    CO::spawn(telemetry());
+    co_await walkMode();
+
+    printf("Walk finished\n");
+    stopExo();
+    loop.stop();
+}
+
+CO::Task<uint32_t> initExo()
+{
+    std::vector<CO::Request<uint32_t> > profile;
+    std::vector<CO::Request<int8_t> > mode;
+    uint32_t err = 0;
+
+    //All requests go out together, drives are written concurrently
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        mode.push_back(od.write<CO::drive::modesOfOperation>(joints[i], 1));
+        profile.push_back(od.write<CO::drive::profileVelocity>(joints[i], PROFILEVELOCITY));
+        profile.push_back(od.write<CO::drive::profileAcceleration>(joints[i], PROFILEACCELERATION));
+        profile.push_back(od.write<CO::drive::profileDeceleration>(joints[i], PROFILEACCELERATION));
+    }
+    for (auto &r : mode)
+    {
+        CO::Reply<int8_t> reply = co_await r;
+        if (err == 0)
+            err = reply.result;
+    }
+    for (auto &r : profile)
+    {
+        CO::Reply<uint32_t> reply = co_await r;
+        if (err == 0)
+            err = reply.result;
+    }
+    co_return err;
+}
+
+CO::Task<uint32_t> moveTo(const int nodes[], const long targets[], int count)
+{
+    std::vector<CO::Request<int32_t> > target;
+    std::vector<CO::Request<uint16_t> > control;
+
+    //Requests to the same drive are done in order: target, then new setpoint bit low and high.
+    for (int i = 0; i < count; i++)
+    {
+        target.push_back(od.write<CO::drive::targetPosition>(nodes[i], targets[i]));
+        control.push_back(od.write<CO::drive::controlword>(nodes[i], CW_SETPOINT_LOW));
+        control.push_back(od.write<CO::drive::controlword>(nodes[i], CW_SETPOINT_HIGH));
+    }
+    for (auto &r : target)
+    {
+        CO::Reply<int32_t> reply = co_await r;
+        if (!reply)
+            co_return reply.result;
+    }
+    for (auto &r : control)
+    {
+        CO::Reply<uint16_t> reply = co_await r;
+        if (!reply)
+            co_return reply.result;
+    }
+
+    for (;;)
+    {
+        std::vector<CO::Request<int32_t> > pos;
+        bool reached = true;
+
+        for (int i = 0; i < count; i++)
+            pos.push_back(od.read<CO::drive::positionActualInternal>(nodes[i]));
+        for (int i = 0; i < count; i++)
+        {
+            CO::Reply<int32_t> reply = co_await pos[i];
+            if (!reply)
+                co_return reply.result;
+            if (reply.value <= targets[i] - POSCLEARANCE || reply.value >= targets[i] + POSCLEARANCE)
+                reached = false;
+        }
+        if (reached)
+            co_return 0;
+        co_await loop.sleep(POLL_MS);
+    }
+}
+
+CO::Task<bool> isPressed(int button)
+{
+    CO::Reply<uint32_t> reply = co_await od.readAt<uint32_t>(BUTTON_NODE, 0x0100 + button, 1);
+    co_return reply && reply.value == BUTTON_PRESSED;
+}
+
+CO::Task<> buttonPressed(int button)
+{
+    for (;;)
+    {
+        //Keep co_await out of loop conditions, gcc 12 miscompiles it
+        bool pressed = co_await isPressed(button);
+        if (pressed)
+            co_return;
+        co_await loop.sleep(POLL_MS);
+    }
+}
+
+CO::Task<int> nextButton()
+{
+    static const int buttons[] = {BUTTON_ONE, BUTTON_TWO, BUTTON_FOUR};
+
+    for (;;)
+    {
+        std::vector<CO::Request<uint32_t> > state;
+
+        for (int b : buttons)
+            state.push_back(od.readAt<uint32_t>(BUTTON_NODE, 0x0100 + b, 1));
+        for (size_t i = 0; i < state.size(); i++)
+        {
+            CO::Reply<uint32_t> reply = co_await state[i];
+            if (reply && reply.value == BUTTON_PRESSED)
+                co_return buttons[i];
+        }
+        co_await loop.sleep(POLL_MS);
+    }
+}
+
+CO::Task<> walkMode()
+{
+    printf("Walk Mode\n");
+
+    const int arrSize = sizeof(walkArrLHip_degrees) / sizeof(walkArrLHip_degrees[0]);
+    //The walkstate value should be 1 position outside array index (ie -1 for the first move).
+    int walkstate = -1;
+
+    for (;;)
+    {
+        int button = co_await nextButton();
+        int next;
+
+        if (button == BUTTON_ONE && walkstate < arrSize - 1)
+        {
+            printf("Walking forward\n");
+            next = walkstate + 1;
+        }
+        else if (button == BUTTON_TWO && walkstate > 0)
+        {
+            printf("Walking backward\n");
+            next = walkstate - 1;
+        }
+        else if (button == BUTTON_FOUR && walkstate == arrSize - 1)
+        {
+            co_return;
+        }
+        else
+        {
+            co_await loop.sleep(POLL_MS);
+            continue;
+        }
+
+        const long targets[NUM_JOINTS] = {
+            degreesToMotor(walkArrLHip_degrees[next], LHIP),
+            degreesToMotor(walkArrLKnee_degrees[next], LKNEE),
+            degreesToMotor(walkArrRHip_degrees[next], RHIP),
+            degreesToMotor(walkArrRKnee_degrees[next], RKNEE)};
+        uint32_t err = co_await moveTo(joints, targets, NUM_JOINTS);
+        if (err != 0)
+        {
+            fprintf(stderr, "Move failed: 0x%08X\n", err);
+            stopExo();
+            loop.stop();
+            co_return;
+        }
+        printf("Position reached.\n");
+        if (next > walkstate && next == arrSize - 1)
+            printf("final array position\n");
+        if (next < walkstate && next == 0)
+            printf("first array position\n");
+        walkstate = next;
+    }
+}
+
+CO::Task<> emergencyStop()
+{
+    co_await buttonPressed(BUTTON_THREE);
+    printf("Terminating Program (walk mode)\n");
+    stopExo();
+    loop.stop();
+}
+
+CO::Task<> telemetry()
+{
+    for (;;)
+    {
+        std::vector<CO::Request<int32_t> > pos;
+        long values[NUM_JOINTS];
+
+        for (int i = 0; i < NUM_JOINTS; i++)
+            pos.push_back(telemetryOd.read<CO::drive::positionActualInternal>(joints[i]));
+        for (int i = 0; i < NUM_JOINTS; i++)
+        {
+            CO::Reply<int32_t> reply = co_await pos[i];
+            values[i] = reply ? reply.value : 0;
+        }
+        printf("LHIP: %ld, LKNEE: %ld, RHIP: %ld, RKNEE: %ld\n", values[0], values[1], values[2], values[3]);
+        co_await loop.sleep(TELEMETRY_MS);
+    }
+}
+
+void stopExo()
+{
+    for (int i = 0; i < NUM_JOINTS; i++)
+    {
+        char command[STRING_LENGTH];
+        snprintf(command, sizeof(command), "[1] %d preop", joints[i]);
+        canFeastSingle(command);
+    }
+}
+
+long degreesToMotor(double degrees, int nodeid)
+{
+    double y1, x1, y2, x2;
+
+    if (nodeid == LHIP || nodeid == RHIP)
+    {
+        y1 = HIP_MOTOR_POS1; x1 = HIP_MOTOR_DEG1; y2 = HIP_MOTOR_POS2; x2 = HIP_MOTOR_DEG2;
+    }
+    else
+    {
+        y1 = KNEE_MOTOR_POS1; x1 = KNEE_MOTOR_DEG1; y2 = KNEE_MOTOR_POS2; x2 = KNEE_MOTOR_DEG2;
+    }
+    //y=Ax+B through both calibration points
+    return (long)((y2 - y1) / (x2 - x1) * degrees + (y1 * x2 - y2 * x1) / (x2 - x1));
+}
+
+int canFeastSingle(const char *command)
+{
+    struct sockaddr_un addr;
+    char buf[BUF_SIZE];
+    int commandLength = strlen(command);
+    int canSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    ssize_t n;
+
+    if (canSocket == -1)
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, COMMAND_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(canSocket, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1
+        || write(canSocket, command, commandLength) != commandLength)
+    {
+        perror("Socket connection failed");
+        close(canSocket);
+        return -1;
+    }
+    n = read(canSocket, buf, sizeof(buf) - 1);
+    close(canSocket);
+    if (n <= 0)
+    {
+        perror("Socket read failed");
+        return -1;
+    }
+    buf[n] = 0;
+    if (strstr(buf, "ERROR") != NULL)
+    {
+        fprintf(stderr, "%s: %s", command, buf);
+        return -1;
+    }
+    return 0;
+}
@@ -5,6 +5,7 @@
 //              canFeast acts as regular but now takes the int socket as an additional argument -> is now canSend
 //              canFeast Down closes the socket.
 //              Socket error handling is passed up from these functions to the main program for catching.
+//              canFeast reconnects with bounded retries and returns a CANFEAST_ERR_ code, if they all fail.
 //
 
 #include <stdio.h>
@@ -13,6 +14,7 @@
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <errno.h>
 
 //Buffer for socket
 #ifndef BUF_SIZE
@@ -21,13 +23,26 @@
 
 #define STRING_LENGTH 50
 #define MAX_STRINGS 40
+//Reconnect attempts to canopend before a command fails. Delay is doubled after each attempt, up to max.
 #define MAX_RECONNECTS 10
-
-
-void canFeastUp(int *canSocket);
-void canFeast(int *canSocket, char *command, char *canReturnMessage);
+#define RECONNECT_DELAY_US 10000
+#define RECONNECT_MAX_DELAY_US 500000
+//Return codes of canFeast functions
+#define CANFEAST_OK 0
+#define CANFEAST_ERR_SOCKET -1  //socket() failed
+#define CANFEAST_ERR_CONNECT -2 //canopend not reachable
+#define CANFEAST_ERR_WRITE -3   //command not sent
+#define CANFEAST_ERR_READ -4    //no response, or canopend closed the connection
+
+
+//First error of canFeast(), which was not recovered by reconnecting.
+int canFeastError = CANFEAST_OK;
+
+//Return CANFEAST_OK or CANFEAST_ERR_ code.
+int canFeastUp(int *canSocket);
+int canFeast(int *canSocket, char *command, char *canReturnMessage);
 void canFeastDown(int *canSocket);
-void canFeastErrorHandler(int *canSocket, char *command, char *canReturnMessage);
+int canFeastReconnect(int *canSocket);
 
 // Test code
 int main (/*int argc, char *argv[]*/){
@@ -37,7 +52,8 @@ int main (/*int argc, char *argv[]*/){
     printf("Welcome to canFeastOpen test!\n");
     int socket;
     //set up canFeasts socket
-    canFeastUp(&socket);
+    if (canFeastUp(&socket) != CANFEAST_OK)
+        return EXIT_FAILURE;
     char commList[][MAX_STRINGS]=
             {
                     "[1] 4 start", //go to start mode
@@ -48,90 +64,109 @@ int main (/*int argc, char *argv[]*/){
 
     int Num_of_Strings = sizeof(commList)/MAX_STRINGS;
 
-    for(int i=0; i<Num_of_Strings; ++i) {
-        canFeast(&socket, commList[i], junk);
+    for(int i=0; i<Num_of_Strings && canFeastError == CANFEAST_OK; ++i) {
+        if (canFeast(&socket, commList[i], junk) == CANFEAST_OK)
+            printf("%s", junk);
     }
     canFeastDown(&socket);
-    return 1;
+    return (canFeastError == CANFEAST_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 
 }
-void canFeastUp(int *canSocket) {
-    char *socketPath = "/tmp/CO_command_socket";  /* Name of the local domain socket, configurable by arguments. */
+int canFeastUp(int *canSocket)
+{
+    char *socketPath = "/tmp/CO_command_socket"; /* Name of the local domain socket, configurable by arguments. */
     struct sockaddr_un addr;
 
     *canSocket = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (*canSocket == -1) {
+    if (*canSocket == -1)
+    {
         perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+        return CANFEAST_ERR_SOCKET;
     }
     memset(&addr, 0, sizeof(struct sockaddr_un));
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socketPath, sizeof(addr.sun_path) - 1);
-// Try to make a connection to the local UNIT AF_UNIX SOCKET, quit if unavailable
-    if (connect(*canSocket, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) == -1) {
+    // Try to make a connection to the local UNIT AF_UNIX SOCKET, caller decides what to do if unavailable
+    if (connect(*canSocket, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == -1)
+    {
         perror("Socket connection failed");
-        exit(EXIT_FAILURE);
+        close(*canSocket);
+        *canSocket = -1;
+        return CANFEAST_ERR_CONNECT;
     }
+    return CANFEAST_OK;
 }
-void canFeast(int *canSocket, char *command, char *canReturnMessage) {
-    int commandLength = strlen(command);
-    size_t n;
-    char buf[BUF_SIZE];
-
-    if (write(*canSocket, command, commandLength) != commandLength){
-        perror("Socket write failed");
-        exit(EXIT_FAILURE);
-    }
-
-    n = read(*canSocket, buf, sizeof(buf));
-    if (n == -1){
-        perror("Socket read failed");
+void canFeastDown(int *canSocket)
+{
+    printf("closing socket...\n");
+    //close socket
+    if (*canSocket != -1)
         close(*canSocket);
-        exit(EXIT_FAILURE);
-    }
-    printf("%s", buf);
-    strcpy(canReturnMessage,buf);
-
+    *canSocket = -1;
+    printf("socket close\n");
 }
-// Error handling -> reset socket and try again when sockets fail.
-void canFeastErrorHandler(int *canSocket, char *command, char *canReturnMessage) {
+// Sends command and copies response (at most STRING_LENGTH - 1 chars) into canReturnMessage.
+// On socket errors reconnects and sends the command again. Commands are absolute (positions,
+// controlwords, NMT), so sending them twice is harmless.
+int canFeast(int *canSocket, char *command, char *canReturnMessage)
+{
     int commandLength = strlen(command);
-    int recconects;
-    size_t n;
+    ssize_t n;
     char buf[BUF_SIZE];
-
-    if (write(*canSocket, command, commandLength) != commandLength){
-        perror("Socket write failed, attempting again");
-        canFeast( canSocket, command, canReturnMessage);
-    }
-    while((write(*canSocket, command, commandLength) != commandLength) && recconects!= MAX_RECONNECTS){
-        perror("Socket write failed, attempting again");
-        //shut down socket
-        canFeastDown(canSocket);
-        //recreate socket
-        canFeastUp(canSocket);
-        recconects ++;
-        // try to send again
+    int err = CANFEAST_OK;
+
+    canReturnMessage[0] = '\0';
+    //Second attempt only after a successful reconnect, which has its own bounded retries.
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (attempt > 0 && (err = canFeastReconnect(canSocket)) != CANFEAST_OK)
+            break;
+
+        //MSG_NOSIGNAL: closed canopend socket must not kill the program with SIGPIPE
+        if (send(*canSocket, command, commandLength, MSG_NOSIGNAL) != commandLength)
+        {
+            perror("Socket write failed");
+            err = CANFEAST_ERR_WRITE;
+            continue;
+        }
+
+        n = read(*canSocket, buf, sizeof(buf) - 1);
+        if (n <= 0)
+        {
+            if (n == 0)
+                errno = ECONNRESET;
+            perror("Socket read failed");
+            err = CANFEAST_ERR_READ;
+            continue;
+        }
+        buf[n] = '\0';
+        //printf("%s", buf);
+        strncpy(canReturnMessage, buf, STRING_LENGTH - 1);
+        canReturnMessage[STRING_LENGTH - 1] = '\0';
+        return CANFEAST_OK;
     }
 
+    if (canFeastError == CANFEAST_OK)
+        canFeastError = err;
+    return err;
+}
+// Replaces the connection to canopend. Retries up to MAX_RECONNECTS times with exponential backoff.
+int canFeastReconnect(int *canSocket)
+{
+    useconds_t delay = RECONNECT_DELAY_US;
+    int err = CANFEAST_ERR_CONNECT;
 
-    n = read(*canSocket, buf, sizeof(buf));
-    if (n == -1){
-        perror("Socket read failed, attempting to send command again");
-        //shut down socket
-        canFeastDown(canSocket);
-        //recreate socket
-        canFeastUp(canSocket);
-        // try to send again
-        canFeastErrorHandler( canSocket, command, canReturnMessage);
+    if (*canSocket != -1)
+        close(*canSocket);
+    *canSocket = -1;
+
+    for (int recconects = 0; recconects < MAX_RECONNECTS; recconects++)
+    {
+        usleep(delay);
+        printf("Reconnecting to canopend, attempt %d\n", recconects + 1);
+        if ((err = canFeastUp(canSocket)) == CANFEAST_OK)
+            return CANFEAST_OK;
+        delay = (delay * 2 > RECONNECT_MAX_DELAY_US) ? RECONNECT_MAX_DELAY_US : delay * 2;
     }
-    printf("%s", buf);
-    strcpy(canReturnMessage,buf);
+    return err;
 }
-
-void canFeastDown(int *canSocket) {
-    printf("closing socket...\n");
-    //close socket
-    close(*canSocket);
-    printf("socket close\n");
-}
\ No newline at end of file